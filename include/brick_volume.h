@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "npz_to_glb.h"
+
+namespace npz_to_glb {
+
+// 下采样后的体按该边长分块，块内体素全为背景时不输出
+static constexpr size_t kVolumeBrickSize = 32;
+
+struct BrickVolumeFormat {
+    size_t max_dim = 256;   // 下采样后各轴的最大体素数
+    bool wide = false;      // true 时强度为 uint16，否则为 uint8
+};
+
+struct BrickVolumeInfo {
+    size_t dims[3] = {0, 0, 0};   // 下采样后的 (x, y, z)
+    size_t brick_count = 0;
+    size_t stored_bricks = 0;
+    size_t data_bytes = 0;
+};
+
+// 按各轴整数倍下采样：强度取块内均值并按整卷最小/最大值线性映射到 [0, max_code]；
+// 类别取块内出现最多的非背景类别，细小结构不会被周围背景淹没
+static inline void downsample_brick_source(const RawVolume &raw,
+                                           const std::vector<uint8_t> &classes,
+                                           const size_t factor[3],
+                                           const size_t dims[3],
+                                           uint16_t max_code,
+                                           std::vector<uint16_t> &intensity,
+                                           std::vector<uint8_t> &down_classes,
+                                           float &vmin,
+                                           float &vmax) {
+    const size_t width = raw.width;
+    const size_t height = raw.height;
+    const size_t z_count = raw.z_count;
+    const size_t slice_size = height * width;
+    const size_t out_slice = dims[0] * dims[1];
+    intensity.assign(out_slice * dims[2], 0);
+    down_classes.assign(out_slice * dims[2], 0);
+
+    visit_npy_data(raw.dtype, raw.buffer.data(), [&](const auto *data) {
+        std::vector<float> slice_min(z_count);
+        std::vector<float> slice_max(z_count);
+        parallel_for_each_index(z_count, [&](size_t z) {
+            const auto *slice = data + z * slice_size;
+            float lo = static_cast<float>(slice[0]);
+            float hi = lo;
+            for (size_t i = 1; i < slice_size; ++i) {
+                lo = std::min(lo, static_cast<float>(slice[i]));
+                hi = std::max(hi, static_cast<float>(slice[i]));
+            }
+            slice_min[z] = lo;
+            slice_max[z] = hi;
+        });
+        vmin = *std::min_element(slice_min.begin(), slice_min.end());
+        vmax = *std::max_element(slice_max.begin(), slice_max.end());
+        const double scale = vmax > vmin ? max_code / (static_cast<double>(vmax) - vmin) : 0.0;
+
+        parallel_for_each_index(dims[2], [&](size_t oz) {
+            const size_t z0 = oz * factor[2];
+            const size_t z1 = std::min(z_count, z0 + factor[2]);
+            uint32_t counts[256] = {0};
+            std::vector<uint8_t> touched;
+            for (size_t oy = 0; oy < dims[1]; ++oy) {
+                const size_t y0 = oy * factor[1];
+                const size_t y1 = std::min(height, y0 + factor[1]);
+                for (size_t ox = 0; ox < dims[0]; ++ox) {
+                    const size_t x0 = ox * factor[0];
+                    const size_t x1 = std::min(width, x0 + factor[0]);
+                    double sum = 0.0;
+                    touched.clear();
+                    for (size_t z = z0; z < z1; ++z) {
+                        for (size_t y = y0; y < y1; ++y) {
+                            const size_t row = z * slice_size + y * width;
+                            for (size_t x = x0; x < x1; ++x) {
+                                sum += static_cast<double>(data[row + x]);
+                                const uint8_t c = classes[row + x];
+                                if (c != 0 && counts[c]++ == 0) {
+                                    touched.push_back(c);
+                                }
+                            }
+                        }
+                    }
+                    const size_t count = (z1 - z0) * (y1 - y0) * (x1 - x0);
+                    const double t = (sum / count - vmin) * scale;
+                    const size_t out = oz * out_slice + oy * dims[0] + ox;
+                    intensity[out] = static_cast<uint16_t>(std::min<double>(max_code, std::max(0.0, std::round(t))));
+                    uint8_t best = 0;
+                    for (uint8_t c : touched) {
+                        if (best == 0 || counts[c] > counts[best] || (counts[c] == counts[best] && c < best)) {
+                            best = c;
+                        }
+                    }
+                    for (uint8_t c : touched) {
+                        counts[c] = 0;
+                    }
+                    down_classes[out] = best;
+                }
+            }
+        });
+    });
+}
+
+// 读取目录中的切片并导出稀疏体素块，供网页端直接光线步进，不再提取三角网格。
+// bin_path 为各非空块依次拼接的 zlib 数据：每块先是 32³ 个强度值（x 最快，其次 y、z，uint16 为小端，越界部分补 0），
+// 有标注时再跟 32³ 个 uint8 类别序号（0 为背景，k 对应索引 labels 中的第 k 项）；json_path 为索引，记录尺寸、下采样倍数、
+// 强度范围、类别表以及各块的 [bx, by, bz, 偏移, 长度]。无标注时按原图阈值（同 build_raw_threshold_labels）判定空块，
+// 阈值以强度范围的比例写入索引
+static inline BrickVolumeInfo write_brick_volume(const fs::path &input_dir,
+                                                 const Options &opts,
+                                                 const BrickVolumeFormat &format,
+                                                 const fs::path &json_path,
+                                                 const fs::path &bin_path) {
+    Options load_opts = opts;
+    load_opts.keep_raw = true;
+    RawVolume raw_volume;
+    std::vector<uint8_t> label_volume;
+    size_t z_count = 0;
+    size_t height = 0;
+    size_t width = 0;
+    bool has_ann = false;
+    load_slices(input_dir, load_opts, raw_volume, label_volume, z_count, height, width, has_ann);
+    if (!has_ann) {
+        if (!opts.use_raw_threshold) {
+            throw std::runtime_error("No annotation found. Enable raw threshold to build volume.");
+        }
+        label_volume = build_raw_threshold_labels(raw_volume);
+    }
+
+    BrickVolumeInfo info;
+    const size_t source[3] = {width, height, z_count};
+    const size_t max_dim = std::max<size_t>(1, format.max_dim);
+    size_t factor[3];
+    for (int a = 0; a < 3; ++a) {
+        factor[a] = (source[a] + max_dim - 1) / max_dim;
+        info.dims[a] = (source[a] + factor[a] - 1) / factor[a];
+    }
+    const uint16_t max_code = format.wide ? 65535 : 255;
+    std::vector<uint16_t> intensity;
+    std::vector<uint8_t> classes;
+    float vmin = 0.0f;
+    float vmax = 0.0f;
+    downsample_brick_source(raw_volume, label_volume, factor, info.dims, max_code, intensity, classes, vmin, vmax);
+    raw_volume.buffer.release();
+    std::vector<uint8_t>().swap(label_volume);
+
+    constexpr size_t B = kVolumeBrickSize;
+    size_t grid[3];
+    for (int a = 0; a < 3; ++a) {
+        grid[a] = (info.dims[a] + B - 1) / B;
+    }
+    info.brick_count = grid[0] * grid[1] * grid[2];
+    const size_t word = format.wide ? 2 : 1;
+    const size_t out_slice = info.dims[0] * info.dims[1];
+
+    // 各块独立压缩，客户端可按索引中的偏移只取需要的块
+    std::vector<std::vector<unsigned char>> bricks(info.brick_count);
+    parallel_for_each_index(info.brick_count, [&](size_t b) {
+        const size_t bx = b % grid[0];
+        const size_t by = (b / grid[0]) % grid[1];
+        const size_t bz = b / (grid[0] * grid[1]);
+        const size_t x0 = bx * B;
+        const size_t y0 = by * B;
+        const size_t z0 = bz * B;
+        const size_t x1 = std::min(info.dims[0], x0 + B);
+        const size_t y1 = std::min(info.dims[1], y0 + B);
+        const size_t z1 = std::min(info.dims[2], z0 + B);
+
+        bool occupied = false;
+        for (size_t z = z0; z < z1 && !occupied; ++z) {
+            for (size_t y = y0; y < y1 && !occupied; ++y) {
+                const uint8_t *row = classes.data() + z * out_slice + y * info.dims[0];
+                occupied = std::any_of(row + x0, row + x1, [](uint8_t c) { return c != 0; });
+            }
+        }
+        if (!occupied) {
+            return;
+        }
+
+        const size_t voxels = B * B * B;
+        std::vector<unsigned char> payload(voxels * word + (has_ann ? voxels : 0), 0);
+        for (size_t z = z0; z < z1; ++z) {
+            for (size_t y = y0; y < y1; ++y) {
+                for (size_t x = x0; x < x1; ++x) {
+                    const size_t src = z * out_slice + y * info.dims[0] + x;
+                    const size_t dst = ((z - z0) * B + (y - y0)) * B + (x - x0);
+                    if (format.wide) {
+                        payload[dst * 2] = static_cast<unsigned char>(intensity[src] & 0xFF);
+                        payload[dst * 2 + 1] = static_cast<unsigned char>(intensity[src] >> 8);
+                    } else {
+                        payload[dst] = static_cast<unsigned char>(intensity[src]);
+                    }
+                    if (has_ann) {
+                        payload[voxels * word + dst] = classes[src];
+                    }
+                }
+            }
+        }
+        uLongf size = compressBound(static_cast<uLong>(payload.size()));
+        std::vector<unsigned char> &out = bricks[b];
+        out.resize(size);
+        if (compress2(out.data(), &size, payload.data(), static_cast<uLong>(payload.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+            throw std::runtime_error("Failed to compress volume brick.");
+        }
+        out.resize(size);
+    });
+
+    std::ofstream bin(bin_path, std::ios::binary | std::ios::trunc);
+    if (!bin) {
+        throw std::runtime_error("Failed to open output: " + bin_path.string());
+    }
+    std::ostringstream entries;
+    for (size_t b = 0; b < bricks.size(); ++b) {
+        if (bricks[b].empty()) {
+            continue;
+        }
+        if (info.stored_bricks++ > 0) {
+            entries << ",";
+        }
+        entries << "[" << b % grid[0] << "," << (b / grid[0]) % grid[1] << "," << b / (grid[0] * grid[1]) << ","
+                << info.data_bytes << "," << bricks[b].size() << "]";
+        bin.write(reinterpret_cast<const char *>(bricks[b].data()), static_cast<std::streamsize>(bricks[b].size()));
+        info.data_bytes += bricks[b].size();
+    }
+    if (!bin) {
+        throw std::runtime_error("Failed to write output: " + bin_path.string());
+    }
+
+    std::ostringstream json;
+    json << "{\"version\":1,\"source_dims\":[" << width << "," << height << "," << z_count << "]"
+         << ",\"dims\":[" << info.dims[0] << "," << info.dims[1] << "," << info.dims[2] << "]"
+         << ",\"downsample\":[" << factor[0] << "," << factor[1] << "," << factor[2] << "]"
+         << ",\"brick_size\":" << B << ",\"brick_grid\":[" << grid[0] << "," << grid[1] << "," << grid[2] << "]"
+         << ",\"compression\":\"zlib\""
+         << ",\"intensity\":{\"type\":\"" << (format.wide ? "uint16" : "uint8") << "\",\"min\":" << vmin
+         << ",\"max\":" << vmax << "}";
+    if (has_ann) {
+        json << ",\"labels\":[";
+        for (size_t k = 0; k < opts.label_classes.size(); ++k) {
+            const LabelClass &cls = opts.label_classes[k];
+            json << (k ? "," : "") << "{\"index\":" << k + 1 << ",\"value\":" << cls.value
+                 << ",\"name\":\"" << escape_json_string(cls.name) << "\",\"color\":[" << cls.color[0] << ","
+                 << cls.color[1] << "," << cls.color[2] << "," << cls.color[3] << "]}";
+        }
+        json << "]";
+    } else {
+        json << ",\"threshold\":0.5";
+    }
+    json << ",\"bricks\":[" << entries.str() << "]}";
+
+    std::ofstream index(json_path, std::ios::binary | std::ios::trunc);
+    if (!index) {
+        throw std::runtime_error("Failed to open output: " + json_path.string());
+    }
+    const std::string text = json.str();
+    index.write(text.data(), static_cast<std::streamsize>(text.size()));
+    return info;
+}
+
+} // namespace npz_to_glb
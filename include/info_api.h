@@ -18,12 +18,20 @@
 #include <cstring>
 #include <random>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
 #include <unordered_map>
 #include <unordered_set>
+#include <list>
+#include <memory>
 #include <regex>
 #include <cstdio>
 #include <cstdlib>
 #include <optional>
+#include <tuple>
+#include <limits>
+#include <type_traits>
 #ifndef _WIN32
 #include <sys/wait.h>
 #else
@@ -33,11 +41,17 @@
 #include <windows.h>
 #endif
 #include <onnxruntime/onnxruntime_cxx_api.h>
+#include <zlib.h>
 #include "cnpy.h"
+#include "brick_volume.h"
 #include "info_store.h"
+#include "mesh_decimate.h"
 #include "npz_enhance_utils.h"
 #include "npz_to_glb.h"
+#include "parallel_utils.h"
 #include "runtime_logger.h"
+#include "slice_render.h"
+#include "zip_stream_writer.h"
 
 #ifdef _WIN32
 #ifdef DELETE
@@ -305,7 +319,6 @@ static inline fs::path require_temp_project_dir(const InfoStore &store, const st
     return dir;
 }
 
-
 static inline const cnpy::NpyArray *find_npz_array(const cnpy::npz_t &npz,
                                                    const std::vector<std::string> &keys);
 static inline void all2npz(const fs::path &src, const fs::path &dst);
@@ -316,6 +329,22 @@ static inline void convert_npz_to_pngs(const fs::path &npz_path,
                                        bool marked,
                                        bool write_raw_png = true,
                                        const std::string &marked_suffix = "_marked");
+static inline void convert_npz_files_to_pngs(const std::vector<fs::path> &npz_files,
+                                             const fs::path &png_dir,
+                                             const fs::path &marked_dir,
+                                             bool marked,
+                                             bool write_raw_png = true,
+                                             const std::string &marked_suffix = "_marked");
+static inline void prepare_slice_pngs(const fs::path &npz_dir,
+                                      const std::vector<fs::path> &npz_files,
+                                      const fs::path &png_dir,
+                                      const fs::path &marked_dir,
+                                      bool marked,
+                                      bool write_raw_png = true,
+                                      const std::string &marked_suffix = "_marked");
+static inline void materialize_lazy_png_dir(const fs::path &png_dir);
+static inline void invalidate_zip_archive_cache(const fs::path &root);
+static inline std::string json_escape(const std::string &s);
 static inline bool is_valid_crop(int xL, int xR, int yL, int yR, int width, int height);
 static inline std::vector<int64_t> run_onnx_inference_mask(const fs::path &onnx_path,
                                                            const std::vector<fs::path> &source_npz_files,
@@ -393,6 +422,7 @@ static inline crow::response inited_project_dir_response(const crow::request &re
     fs::path png_dir = project_dir / "png";
     fs::path marked_dir = project_dir / "markedpng";
     fs::create_directories(temp_dir);
+    invalidate_zip_archive_cache(project_dir);
 
     auto temp_files = list_files(temp_dir);
     if (temp_files.empty()) throw std::runtime_error("temp 为空");
@@ -408,17 +438,19 @@ static inline crow::response inited_project_dir_response(const crow::request &re
 
     if (raw != "png") {
         if (raw == "npz") {
-            for (const auto &src : temp_files) {
-                convert_npz_to_pngs(src, png_dir, marked_dir, false);
-            }
+            prepare_slice_pngs(npz_dir, temp_files, png_dir, marked_dir, false);
         } else if (raw == "markednpz") {
-            for (const auto &src : temp_files) {
-                convert_npz_to_pngs(src, png_dir, marked_dir, true, true, "_marked");
-            }
+            prepare_slice_pngs(npz_dir, temp_files, png_dir, marked_dir, true, true, "_marked");
         } else if (raw == "dcm" || raw == "nii") {
-            for (const auto &src : temp_files) {
-                fs::path dst = png_dir / (src.stem().string() + ".png");
-                all2png(src, dst);
+            if (slice_render::png_options().lazy) {
+                // dcm/nii 已先转换为 npz，按需渲染直接以 npz 目录为源
+                prepare_slice_pngs(npz_dir, {}, png_dir, marked_dir, false);
+            } else {
+                parallel_for_each_index(temp_files.size(), [&](size_t i) {
+                    const fs::path &src = temp_files[i];
+                    fs::path dst = png_dir / (src.stem().string() + ".png");
+                    all2png(src, dst);
+                });
             }
         }
     }
@@ -486,14 +518,18 @@ static inline crow::response start_analysis_project_dir_response(const crow::req
     fs::path processed_npz_dir = processed_dir / "npzs";
     fs::path processed_png_dir = processed_dir / "pngs";
     std::error_code ec;
+    invalidate_zip_archive_cache(processed_dir);
     fs::remove_all(processed_dir, ec);
     fs::remove_all(project_dir / "3d", ec);
     fs::remove_all(project_dir / "OG3d", ec);
+    fs::remove_all(project_dir / "3d_volume", ec);
+    fs::remove_all(project_dir / "OG3d_volume", ec);
     fs::create_directories(processed_npz_dir);
     fs::create_directories(processed_png_dir);
 
     const int out_size = 512;
     const int img_size = 224;
+    std::vector<fs::path> processed_npz_files;
     for (size_t file_index = 0; file_index < npz_files.size(); ++file_index) {
         const auto &src = npz_files[file_index];
         RuntimeLogger::info("[推理流程] 处理文件: " + src.filename().string() + ", id=" + project_label);
@@ -528,9 +564,10 @@ static inline crow::response start_analysis_project_dir_response(const crow::req
 
         fs::path out_npz = processed_npz_dir / (src.stem().string() + "-PD.npz");
         save_npz_with_same_keys(src.string(), out_npz.string(), pred, out_size, out_size, "label", crop_xL, crop_xR, crop_yL, crop_yR);
-        convert_npz_to_pngs(out_npz, processed_png_dir, processed_png_dir, true, false, "");
+        processed_npz_files.push_back(out_npz);
         RuntimeLogger::info("[推理流程] 文件完成: " + src.filename().string() + ", id=" + project_label);
     }
+    prepare_slice_pngs(processed_npz_dir, processed_npz_files, processed_png_dir, processed_png_dir, true, false, "");
 
     update_project_json_fields(project_json, {
         {"processed", "\"" + mode_val + "\""},
@@ -829,21 +866,6 @@ static inline std::vector<uint8_t> read_tag_value_explicit_vr(const std::vector<
     return {};
 }
 
-static inline std::vector<size_t> require_shape_2d(const cnpy::NpyArray &arr)
-{
-    if (arr.shape.size() != 2) {
-        throw std::runtime_error("仅支持二维数组，当前维度=" + std::to_string(arr.shape.size()));
-    }
-    return arr.shape;
-}
-
-static inline std::vector<double> npy_to_double_2d_strict(const cnpy::NpyArray &arr)
-{
-    int h = 0;
-    int w = 0;
-    return npy_to_double_2d(arr, h, w);
-}
-
 static inline std::vector<uint16_t> to_uint16_clipped(const std::vector<double> &input)
 {
     std::vector<uint16_t> out(input.size(), 0);
@@ -884,26 +906,9 @@ static inline std::vector<double> image_from_gray_u8(const cv::Mat &gray)
     return out;
 }
 
-static inline void save_onnx_compatible_npz(const fs::path &out_path,
-                                            const std::vector<size_t> &image_shape,
-                                            const std::vector<double> &image_data)
-{
-    if (image_shape.size() != 2) {
-        throw std::runtime_error("save_onnx_compatible_npz 仅支持 2D image");
-    }
-    const size_t n = image_shape[0] * image_shape[1];
-    if (image_data.size() != n) {
-        throw std::runtime_error("image 数据长度与 shape 不匹配");
-    }
-
-    std::vector<uint8_t> label(n, 0);
-    cnpy::npz_save(out_path.string(), "image", image_data.data(), image_shape, "w");
-    cnpy::npz_save(out_path.string(), "label", label.data(), image_shape, "a");
-}
-
 static inline std::string uid_like()
 {
-    static std::mt19937_64 rng{std::random_device{}()};
+    thread_local std::mt19937_64 rng{std::random_device{}()};
     std::uniform_int_distribution<uint64_t> dist(1000000ULL, 999999999ULL);
     return "2.25." + std::to_string(dist(rng));
 }
@@ -1014,19 +1019,158 @@ struct Nifti1Header {
 
 static_assert(sizeof(Nifti1Header) == 348, "Nifti1Header 大小必须为 348 字节");
 
-static inline void dcm_to_npz(const fs::path &input_path, const fs::path &out_path)
+// 格式转换的内存中间表示：dcm/nii/png/npz 先解码为 ImageSlice/ImageVolume，再由目标格式编码，全程不落临时文件
+struct ImageSlice {
+    size_t height = 0;
+    size_t width = 0;
+    std::vector<double> image;
+    std::string image_descr = "<f8";
+    std::vector<double> spacing;  // 行间距、列间距[、层厚]，单位 mm；为空表示未知
+    std::vector<uint8_t> npz_bytes;
+};
+
+// dim1 为列方向(x)、dim2 为行方向(y)，与 NIfTI 的 x 最快变化存储顺序一致
+struct ImageVolume {
+    size_t dim1 = 0;
+    size_t dim2 = 0;
+    size_t dim3 = 1;
+    std::vector<float> voxels;
+    std::array<float, 3> spacing{{1.0F, 1.0F, 1.0F}};
+    std::vector<uint8_t> npz_bytes;
+};
+
+static inline const npzproc::ZipEntry *find_npz_entry(const std::vector<npzproc::ZipEntry> &entries,
+                                                      const std::vector<std::string> &keys)
 {
-    RuntimeLogger::info("[dcm转npz] 开始: " + input_path.string() + " -> " + out_path.string());
-    const std::vector<uint8_t> dcm_bytes = [&] {
-        std::string raw = read_text_file(input_path);
-        return std::vector<uint8_t>(raw.begin(), raw.end());
-    }();
+    for (const auto &k : keys) {
+        for (const auto &e : entries) {
+            if (e.name == k + ".npy" || e.name == k) return &e;
+        }
+    }
+    return nullptr;
+}
+
+static inline std::vector<double> read_npz_spacing(const std::vector<npzproc::ZipEntry> &entries)
+{
+    const npzproc::ZipEntry *entry = find_npz_entry(entries, {"spacing"});
+    if (entry == nullptr) return {};
+    const auto meta = npzproc::parse_npy_meta(entry->data);
+    auto values = npzproc::decode_numeric_data(entry->data, meta);
+    if (values.size() != 2 && values.size() != 3) return {};
+    for (double v : values) {
+        if (!std::isfinite(v) || v <= 0.0) return {};
+    }
+    return values;
+}
+
+static inline std::array<float, 3> spacing_to_xyz(const std::vector<double> &spacing)
+{
+    std::array<float, 3> xyz{{1.0F, 1.0F, 1.0F}};
+    if (spacing.size() >= 2) {
+        xyz[0] = static_cast<float>(spacing[1]);
+        xyz[1] = static_cast<float>(spacing[0]);
+    }
+    if (spacing.size() >= 3) {
+        xyz[2] = static_cast<float>(spacing[2]);
+    }
+    return xyz;
+}
+
+static inline ImageSlice decode_npz_bytes_to_slice(std::vector<uint8_t> npz_bytes,
+                                                   const std::vector<std::string> &keys)
+{
+    const auto entries = npzproc::load_npz_entries_from_bytes(npz_bytes);
+    const npzproc::ZipEntry *entry = find_npz_entry(entries, keys);
+    if (entry == nullptr) {
+        throw std::runtime_error("npz 中找不到键: " + (keys.empty() ? std::string() : keys.front()));
+    }
+    const auto meta = npzproc::parse_npy_meta(entry->data);
+    if (meta.shape.size() != 2) {
+        throw std::runtime_error("仅支持二维数组，当前维度=" + std::to_string(meta.shape.size()));
+    }
+    ImageSlice slice;
+    slice.height = meta.shape[0];
+    slice.width = meta.shape[1];
+    slice.image = npzproc::decode_numeric_data(entry->data, meta);
+    slice.image_descr = meta.descr;
+    slice.spacing = read_npz_spacing(entries);
+    slice.npz_bytes = std::move(npz_bytes);
+    return slice;
+}
+
+static inline ImageVolume decode_npz_bytes_to_volume(std::vector<uint8_t> npz_bytes, const std::string &key)
+{
+    const auto entries = npzproc::load_npz_entries_from_bytes(npz_bytes);
+    const npzproc::ZipEntry *entry = find_npz_entry(entries, {key});
+    if (entry == nullptr) {
+        throw std::runtime_error("npz 中找不到键: " + key);
+    }
+    const auto meta = npzproc::parse_npy_meta(entry->data);
+    if (meta.shape.size() != 2 && meta.shape.size() != 3) {
+        throw std::runtime_error("仅支持 2D/3D 写入 NIfTI");
+    }
+    // npz 为 C 顺序，最后一维变化最快，对应 NIfTI 的 x
+    ImageVolume volume;
+    volume.dim1 = meta.shape.back();
+    volume.dim2 = meta.shape[meta.shape.size() - 2];
+    volume.dim3 = meta.shape.size() == 3 ? meta.shape[0] : 1;
+    volume.voxels = to_float32(npzproc::decode_numeric_data(entry->data, meta));
+    volume.spacing = spacing_to_xyz(read_npz_spacing(entries));
+    volume.npz_bytes = std::move(npz_bytes);
+    return volume;
+}
+
+// 嵌入的往返载荷可能来自任意 npz，按常见原图键名回退；载荷是 3D 数组或缺少原图键时返回 false，
+// 调用方改为解码文件本身的像素，载荷仍随切片保留
+static inline bool try_decode_embedded_npz_to_slice(const std::vector<uint8_t> &npz_bytes, ImageSlice &slice)
+{
+    static const std::vector<std::string> kRawKeys = {
+        "image", "img", "raw", "ct", "data", "slice", "input"
+    };
+    try {
+        slice = decode_npz_bytes_to_slice(npz_bytes, kRawKeys);
+        return true;
+    } catch (const std::exception &e) {
+        RuntimeLogger::debug(std::string("[嵌入NPZ] 无法解码为切片，改用文件像素: ") + e.what());
+        return false;
+    }
+}
+
+// 默认只接受正值（间距、层厚）；Rescale Intercept 等可为负的字段传 positive_only=false
+static inline std::vector<double> parse_ds_values(const std::vector<uint8_t> &value, bool positive_only = true)
+{
+    std::vector<double> out;
+    std::string text(value.begin(), value.end());
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, '\\')) {
+        try {
+            const double v = std::stod(item);
+            if (!std::isfinite(v) || (positive_only && v <= 0.0)) return {};
+            out.push_back(v);
+        } catch (...) {
+            return {};
+        }
+    }
+    return out;
+}
+
+static inline std::string format_ds_value(double v)
+{
+    std::ostringstream oss;
+    oss << std::setprecision(8) << v;
+    return oss.str();
+}
+
+static inline ImageSlice decode_dcm_to_slice(const fs::path &input_path)
+{
+    const std::vector<uint8_t> dcm_bytes = npzproc::read_file_bytes(input_path);
 
     std::vector<uint8_t> embedded_npz;
     if (try_extract_embedded_npz_from_bytes(dcm_bytes, &embedded_npz)) {
-        write_text_file(out_path, std::string(embedded_npz.begin(), embedded_npz.end()));
-        RuntimeLogger::info("[dcm转npz] 完成(命中嵌入NPZ): " + out_path.string());
-        return;
+        RuntimeLogger::debug("[dcm解码] 命中嵌入NPZ: " + input_path.string());
+        ImageSlice embedded;
+        if (try_decode_embedded_npz_to_slice(embedded_npz, embedded)) return embedded;
     }
 
     bool ok_rows = false;
@@ -1047,33 +1191,229 @@ static inline void dcm_to_npz(const fs::path &input_path, const fs::path &out_pa
         throw std::runtime_error("DICOM PixelData 长度不足");
     }
 
-    std::vector<uint16_t> image(n, 0);
-    std::memcpy(image.data(), pixel_buf.data(), n * sizeof(uint16_t));
-    std::vector<uint8_t> label(n, 0);
-    const std::vector<size_t> shape{rows, cols};
-    cnpy::npz_save(out_path.string(), "image", image.data(), shape, "w");
-    cnpy::npz_save(out_path.string(), "label", label.data(), shape, "a");
-    RuntimeLogger::info("[dcm转npz] 完成: " + out_path.string() + ", rows=" + std::to_string(rows) + ", cols=" + std::to_string(cols));
+    ImageSlice slice;
+    slice.height = rows;
+    slice.width = cols;
+    bool ok_spacing = false;
+    bool ok_thickness = false;
+    const auto spacing = parse_ds_values(read_tag_value_explicit_vr(dcm_bytes, 0x0028, 0x0030, &ok_spacing));
+    const auto thickness = parse_ds_values(read_tag_value_explicit_vr(dcm_bytes, 0x0018, 0x0050, &ok_thickness));
+    if (ok_spacing && spacing.size() == 2) {
+        slice.spacing = spacing;
+        if (ok_thickness && thickness.size() == 1) slice.spacing.push_back(thickness[0]);
+    }
+    // PixelRepresentation=1 为有符号像素；Rescale Slope/Intercept 换算为 HU 等物理值，窗宽窗位预设按此取值
+    bool ok_sign = false;
+    bool ok_slope = false;
+    bool ok_intercept = false;
+    const auto sign_buf = read_tag_value_explicit_vr(dcm_bytes, 0x0028, 0x0103, &ok_sign);
+    const auto slope_vals = parse_ds_values(read_tag_value_explicit_vr(dcm_bytes, 0x0028, 0x1053, &ok_slope), false);
+    const auto intercept_vals = parse_ds_values(read_tag_value_explicit_vr(dcm_bytes, 0x0028, 0x1052, &ok_intercept), false);
+    const bool is_signed = ok_sign && sign_buf.size() >= 2 && read_u16_le(sign_buf, 0) == 1;
+    const double slope = ok_slope && slope_vals.size() == 1 && slope_vals[0] != 0.0 ? slope_vals[0] : 1.0;
+    const double intercept = ok_intercept && intercept_vals.size() == 1 ? intercept_vals[0] : 0.0;
+
+    slice.image.resize(n, 0.0);
+    double lo = 0.0;
+    double hi = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        const uint16_t raw = read_u16_le(pixel_buf, i * sizeof(uint16_t));
+        const double stored = is_signed ? static_cast<double>(static_cast<int16_t>(raw)) : static_cast<double>(raw);
+        const double v = stored * slope + intercept;
+        slice.image[i] = v;
+        lo = i == 0 ? v : std::min(lo, v);
+        hi = i == 0 ? v : std::max(hi, v);
+    }
+    const bool integral = slope == std::floor(slope) && intercept == std::floor(intercept);
+    if (!integral) {
+        slice.image_descr = "<f4";
+    } else if (lo >= 0.0 && hi <= 65535.0) {
+        slice.image_descr = "<u2";
+    } else if (lo >= -32768.0 && hi <= 32767.0) {
+        slice.image_descr = "<i2";
+    } else {
+        slice.image_descr = "<i4";
+    }
+    slice.npz_bytes = std::move(embedded_npz);
+    return slice;
 }
 
-static inline void npz_to_dcm(const fs::path &input_path, const fs::path &out_path, const std::string &key)
+static inline bool is_gzip_bytes(const std::vector<uint8_t> &bytes)
 {
-    RuntimeLogger::info("[npz转dcm] 开始: " + input_path.string() + " -> " + out_path.string() + ", key=" + key);
-    const auto npz_map = cnpy::npz_load(input_path.string());
-    auto it = npz_map.find(key);
-    if (it == npz_map.end()) {
-        throw std::runtime_error("npz 中找不到键: " + key);
+    return bytes.size() >= 2 && bytes[0] == 0x1F && bytes[1] == 0x8B;
+}
+
+static inline std::vector<uint8_t> gunzip_bytes(const std::vector<uint8_t> &bytes)
+{
+    z_stream stream{};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("inflateInit2 失败");
+    }
+    std::vector<uint8_t> out(std::max<size_t>(bytes.size() * 4, 1 << 16));
+    stream.next_in = const_cast<Bytef *>(reinterpret_cast<const Bytef *>(bytes.data()));
+    stream.avail_in = static_cast<uInt>(bytes.size());
+    int rc = Z_OK;
+    while (rc != Z_STREAM_END) {
+        if (stream.total_out == out.size()) out.resize(out.size() * 2);
+        stream.next_out = reinterpret_cast<Bytef *>(out.data() + stream.total_out);
+        stream.avail_out = static_cast<uInt>(out.size() - stream.total_out);
+        rc = inflate(&stream, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END) {
+            inflateEnd(&stream);
+            throw std::runtime_error("gzip 解压失败");
+        }
+    }
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    return out;
+}
+
+static inline ImageSlice decode_nii_to_slice(const fs::path &input_path, int slice_index = -1)
+{
+    std::vector<uint8_t> all = npzproc::read_file_bytes(input_path);
+    if (is_gzip_bytes(all)) {
+        all = gunzip_bytes(all);
+    }
+    if (all.size() < 352) {
+        throw std::runtime_error("NIfTI 文件过小");
+    }
+
+    std::vector<uint8_t> embedded_npz;
+    if (try_extract_embedded_npz_from_bytes(all, &embedded_npz)) {
+        RuntimeLogger::debug("[nii解码] 命中嵌入NPZ: " + input_path.string());
+        ImageSlice embedded;
+        if (try_decode_embedded_npz_to_slice(embedded_npz, embedded)) return embedded;
+    }
+
+    Nifti1Header hdr{};
+    std::memcpy(&hdr, all.data(), 348);
+    if (hdr.sizeof_hdr != 348) {
+        throw std::runtime_error("不支持的 NIfTI 头部");
+    }
+
+    const int ndim = hdr.dim[0];
+    const int d1 = std::max<int>(1, hdr.dim[1]);
+    const int d2 = std::max<int>(1, hdr.dim[2]);
+    const int d3 = std::max<int>(1, hdr.dim[3]);
+
+    if (ndim < 2) {
+        throw std::runtime_error("NIfTI 维度不足");
+    }
+
+    const size_t vox_offset = static_cast<size_t>(hdr.vox_offset);
+    if (vox_offset >= all.size()) {
+        throw std::runtime_error("NIfTI vox_offset 越界");
+    }
+
+    const int use_slice = (d3 == 1) ? 0 : (slice_index >= 0 ? slice_index : (d3 / 2));
+    if (use_slice < 0 || use_slice >= d3) {
+        throw std::runtime_error("slice_index 越界");
+    }
+
+    // 只解码目标切片，不展开整个体数据
+    const size_t n = static_cast<size_t>(d1) * static_cast<size_t>(d2) * static_cast<size_t>(d3);
+    const size_t hw = static_cast<size_t>(d1) * static_cast<size_t>(d2);
+    const size_t z_off = static_cast<size_t>(use_slice) * hw;
+    ImageSlice slice;
+    slice.height = static_cast<size_t>(d2);
+    slice.width = static_cast<size_t>(d1);
+    slice.image.resize(hw, 0.0);
+    if (hdr.pixdim[1] > 0.0F && hdr.pixdim[2] > 0.0F) {
+        slice.spacing = {hdr.pixdim[2], hdr.pixdim[1]};
+        if (hdr.pixdim[3] > 0.0F) slice.spacing.push_back(hdr.pixdim[3]);
+    }
+
+    auto copy_slice = [&](auto tag) {
+        using T = decltype(tag);
+        if (vox_offset + n * sizeof(T) > all.size()) throw std::runtime_error("NIfTI 数据长度不足");
+        const auto *p = reinterpret_cast<const T *>(all.data() + static_cast<long>(vox_offset)) + z_off;
+        for (size_t i = 0; i < hw; ++i) slice.image[i] = static_cast<double>(p[i]);
+    };
+
+    if (hdr.datatype == 16 && hdr.bitpix == 32) {
+        copy_slice(float{});
+    } else if (hdr.datatype == 64 && hdr.bitpix == 64) {
+        copy_slice(double{});
+    } else if (hdr.datatype == 512 && hdr.bitpix == 16) {
+        copy_slice(uint16_t{});
+    } else if (hdr.datatype == 4 && hdr.bitpix == 16) {
+        copy_slice(int16_t{});
+    } else if (hdr.datatype == 2 && hdr.bitpix == 8) {
+        copy_slice(uint8_t{});
+    } else {
+        throw std::runtime_error("当前仅支持读取 float32/float64/uint16/int16/uint8 的 NIfTI");
+    }
+    RuntimeLogger::debug("[nii解码] " + input_path.string() + ", 使用切片=" + std::to_string(use_slice));
+    slice.npz_bytes = std::move(embedded_npz);
+    return slice;
+}
+
+static inline ImageSlice decode_png_to_slice(const fs::path &input_path)
+{
+    const cv::Mat gray = cv::imread(input_path.string(), cv::IMREAD_GRAYSCALE);
+    if (gray.empty()) {
+        throw std::runtime_error("读取 png 失败: " + input_path.string());
+    }
+    ImageSlice slice;
+    slice.height = static_cast<size_t>(gray.rows);
+    slice.width = static_cast<size_t>(gray.cols);
+    slice.image = image_from_gray_u8(gray);
+    return slice;
+}
+
+static inline std::vector<uint8_t> encode_slice_to_npz_bytes(const ImageSlice &slice)
+{
+    if (!slice.npz_bytes.empty()) {
+        return slice.npz_bytes;
+    }
+    const size_t n = slice.height * slice.width;
+    if (slice.image.size() != n) {
+        throw std::runtime_error("image 数据长度与 shape 不匹配");
+    }
+    npzproc::NpyMeta image_meta;
+    image_meta.descr = slice.image_descr;
+    image_meta.shape = {slice.height, slice.width};
+    npzproc::NpyMeta label_meta;
+    label_meta.descr = "|u1";
+    label_meta.shape = image_meta.shape;
+
+    std::vector<npzproc::ZipEntry> entries;
+    entries.push_back({"image.npy",
+                       npzproc::make_npy_bytes(image_meta, npzproc::encode_numeric_data(slice.image, image_meta))});
+    entries.push_back({"label.npy", npzproc::make_npy_bytes(label_meta, std::vector<uint8_t>(n, 0))});
+    if (!slice.spacing.empty()) {
+        npzproc::NpyMeta spacing_meta;
+        spacing_meta.descr = "<f8";
+        spacing_meta.shape = {slice.spacing.size()};
+        entries.push_back({"spacing.npy",
+                           npzproc::make_npy_bytes(spacing_meta, npzproc::encode_numeric_data(slice.spacing, spacing_meta))});
+    }
+    return npzproc::save_npz_entries(entries);
+}
+
+static inline void encode_slice_to_npz(const ImageSlice &slice, const fs::path &out_path)
+{
+    if (!slice.npz_bytes.empty()) {
+        npzproc::write_file_bytes(out_path, slice.npz_bytes);
+        return;
     }
-    const auto shape = require_shape_2d(it->second);
-    const auto image_f64 = npy_to_double_2d_strict(it->second);
-    const auto image_u16 = to_uint16_clipped(image_f64);
+    npzproc::write_file_bytes(out_path, encode_slice_to_npz_bytes(slice));
+}
 
-    const uint16_t rows = static_cast<uint16_t>(shape[0]);
-    const uint16_t cols = static_cast<uint16_t>(shape[1]);
+static inline void encode_slice_to_png(const ImageSlice &slice, const fs::path &out_path)
+{
+    cv::Mat image = normalize_to_u8(slice.image, static_cast<int>(slice.height), static_cast<int>(slice.width));
+    if (!cv::imwrite(out_path.string(), image, slice_render::png_write_params())) {
+        throw std::runtime_error("写入 png 失败: " + out_path.string());
+    }
+}
 
-    const std::string npz_raw = read_text_file(input_path);
-    const std::vector<uint8_t> npz_bytes(npz_raw.begin(), npz_raw.end());
-    const auto packed_npz = pack_embedded_npz(npz_bytes);
+static inline void encode_slice_to_dcm(const ImageSlice &slice, const fs::path &out_path)
+{
+    const auto image_u16 = to_uint16_clipped(slice.image);
+    const uint16_t rows = static_cast<uint16_t>(slice.height);
+    const uint16_t cols = static_cast<uint16_t>(slice.width);
+    const auto packed_npz = pack_embedded_npz(encode_slice_to_npz_bytes(slice));
 
     std::vector<uint8_t> out(128, 0);
     out.push_back('D');
@@ -1108,10 +1448,17 @@ static inline void npz_to_dcm(const fs::path &input_path, const fs::path &out_pa
     append_tag(out, 0x0008, 0x0060, "CS", str_bytes("OT"));
     append_tag(out, 0x0010, 0x0010, "PN", str_bytes("Converted^FromNPZ"));
     append_tag(out, 0x0010, 0x0020, "LO", str_bytes("NPZ0001"));
+    if (slice.spacing.size() >= 3) {
+        append_tag(out, 0x0018, 0x0050, "DS", str_bytes(format_ds_value(slice.spacing[2])));
+    }
     append_tag(out, 0x0028, 0x0010, "US", u16_bytes(rows));
     append_tag(out, 0x0028, 0x0011, "US", u16_bytes(cols));
     append_tag(out, 0x0028, 0x0002, "US", u16_bytes(1));
     append_tag(out, 0x0028, 0x0004, "CS", str_bytes("MONOCHROME2"));
+    if (slice.spacing.size() >= 2) {
+        append_tag(out, 0x0028, 0x0030, "DS",
+                   str_bytes(format_ds_value(slice.spacing[0]) + "\\" + format_ds_value(slice.spacing[1])));
+    }
     append_tag(out, 0x0028, 0x0100, "US", u16_bytes(16));
     append_tag(out, 0x0028, 0x0101, "US", u16_bytes(16));
     append_tag(out, 0x0028, 0x0102, "US", u16_bytes(15));
@@ -1123,264 +1470,299 @@ static inline void npz_to_dcm(const fs::path &input_path, const fs::path &out_pa
     std::memcpy(pixel_bytes.data(), image_u16.data(), pixel_bytes.size());
     append_tag(out, 0x7FE0, 0x0010, "OW", pixel_bytes);
 
-    write_text_file(out_path, std::string(out.begin(), out.end()));
-    RuntimeLogger::info("[npz转dcm] 完成: " + out_path.string() + ", rows=" + std::to_string(rows) + ", cols=" + std::to_string(cols));
+    npzproc::write_file_bytes(out_path, out);
 }
 
-static inline void npz_to_nii(const fs::path &input_path, const fs::path &out_path, const std::string &key)
+static inline Nifti1Header make_nifti_header(size_t dim1,
+                                             size_t dim2,
+                                             size_t dim3,
+                                             int16_t datatype,
+                                             int16_t bitpix,
+                                             const std::array<float, 3> &spacing,
+                                             int32_t ext_size)
 {
-    RuntimeLogger::info("[npz转nii] 开始: " + input_path.string() + " -> " + out_path.string() + ", key=" + key);
-    const auto npz_map = cnpy::npz_load(input_path.string());
-    auto it = npz_map.find(key);
-    if (it == npz_map.end()) {
-        throw std::runtime_error("npz 中找不到键: " + key);
-    }
-
-    std::vector<size_t> shape = it->second.shape;
-    std::vector<float> image_f32;
-    if (shape.size() == 2) {
-        const auto image_f64 = npy_to_double_2d_strict(it->second);
-        image_f32 = to_float32(image_f64);
-        shape = {shape[0], shape[1], 1};
-    } else if (shape.size() == 3) {
-        const size_t n = shape[0] * shape[1] * shape[2];
-        image_f32.resize(n, 0.0F);
-        if (it->second.word_size == sizeof(float)) {
-            const auto *p = it->second.data<float>();
-            std::copy(p, p + n, image_f32.begin());
-        } else if (it->second.word_size == sizeof(double)) {
-            const auto *p = it->second.data<double>();
-            for (size_t i = 0; i < n; ++i) image_f32[i] = static_cast<float>(p[i]);
-        } else {
-            throw std::runtime_error("3D NIfTI 仅支持 float32/float64 输入");
-        }
-    } else {
-        throw std::runtime_error("仅支持 2D/3D 写入 NIfTI");
+    if (dim1 > 32767 || dim2 > 32767 || dim3 > 32767) {
+        throw std::runtime_error("NIfTI-1 单维尺寸不能超过 32767");
     }
-
-    const std::string npz_raw = read_text_file(input_path);
-    const std::vector<uint8_t> npz_bytes(npz_raw.begin(), npz_raw.end());
-    const auto packed_npz = pack_embedded_npz(npz_bytes);
-
     Nifti1Header hdr{};
     hdr.sizeof_hdr = 348;
     hdr.dim[0] = 3;
-    hdr.dim[1] = static_cast<int16_t>(shape[0]);
-    hdr.dim[2] = static_cast<int16_t>(shape[1]);
-    hdr.dim[3] = static_cast<int16_t>(shape[2]);
-    hdr.datatype = 16;
-    hdr.bitpix = 32;
-    hdr.pixdim[1] = 1.0F;
-    hdr.pixdim[2] = 1.0F;
-    hdr.pixdim[3] = 1.0F;
-
-    int32_t ext_size = static_cast<int32_t>(8 + packed_npz.size());
-    const int32_t rem = ext_size % 16;
-    if (rem != 0) ext_size += (16 - rem);
+    hdr.dim[1] = static_cast<int16_t>(dim1);
+    hdr.dim[2] = static_cast<int16_t>(dim2);
+    hdr.dim[3] = static_cast<int16_t>(dim3);
+    hdr.dim[4] = 1;
+    hdr.dim[5] = 1;
+    hdr.dim[6] = 1;
+    hdr.dim[7] = 1;
+    hdr.datatype = datatype;
+    hdr.bitpix = bitpix;
+    hdr.pixdim[0] = 1.0F;
+    hdr.pixdim[1] = spacing[0];
+    hdr.pixdim[2] = spacing[1];
+    hdr.pixdim[3] = spacing[2];
     hdr.vox_offset = static_cast<float>(352 + ext_size);
+    hdr.scl_slope = 1.0F;
+    hdr.xyzt_units = 2;
     std::strncpy(hdr.descrip, "ConvertedFromNPZ", sizeof(hdr.descrip) - 1);
+    hdr.qform_code = 1;
     hdr.sform_code = 1;
-    hdr.srow_x[0] = 1.0F;
-    hdr.srow_y[1] = 1.0F;
-    hdr.srow_z[2] = 1.0F;
+    hdr.srow_x[0] = spacing[0];
+    hdr.srow_y[1] = spacing[1];
+    hdr.srow_z[2] = spacing[2];
     hdr.magic[0] = 'n';
     hdr.magic[1] = '+';
     hdr.magic[2] = '1';
     hdr.magic[3] = '\0';
+    return hdr;
+}
 
-    std::vector<uint8_t> out;
-    out.resize(348);
-    std::memcpy(out.data(), &hdr, 348);
-
-    out.push_back(1);
-    out.push_back(0);
-    out.push_back(0);
-    out.push_back(0);
-
-    append_u32_le(out, static_cast<uint32_t>(ext_size));
-    append_u32_le(out, 40);
-    out.insert(out.end(), packed_npz.begin(), packed_npz.end());
-    while ((out.size() - 352) % 16 != 0) {
-        out.push_back(0);
-    }
+static inline std::string random_hex_id(std::size_t length);
 
-    const auto data_offset = static_cast<size_t>(hdr.vox_offset);
-    if (out.size() < data_offset) {
-        out.resize(data_offset, 0);
+// 顺序写出文件，按需 gzip；先写临时文件，close 时再替换目标，避免中途失败留下半个文件。
+// 临时文件名带随机后缀，并发写同一目标时互不覆盖
+struct BinaryFileSink {
+    fs::path path;
+    fs::path tmp_path;
+    bool gzip = false;
+    std::ofstream plain;
+    gzFile gz = nullptr;
+
+    BinaryFileSink(const fs::path &out_path, bool use_gzip, int level = 6)
+        : path(out_path), tmp_path(out_path.string() + ".part" + random_hex_id(8)), gzip(use_gzip)
+    {
+        if (!path.parent_path().empty()) fs::create_directories(path.parent_path());
+        if (gzip) {
+            const std::string mode = "wb" + std::to_string(std::clamp(level, 1, 9));
+#ifdef _WIN32
+            gz = gzopen_w(tmp_path.wstring().c_str(), mode.c_str());
+#else
+            gz = gzopen(tmp_path.string().c_str(), mode.c_str());
+#endif
+            if (gz == nullptr) throw std::runtime_error("无法写入文件: " + path.string());
+            gzbuffer(gz, 1 << 17);
+        } else {
+            plain.open(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!plain) throw std::runtime_error("无法写入文件: " + path.string());
+        }
     }
-    const size_t data_bytes = image_f32.size() * sizeof(float);
-    const size_t base = out.size();
-    out.resize(base + data_bytes);
-    std::memcpy(out.data() + static_cast<long>(base), image_f32.data(), data_bytes);
 
-    write_text_file(out_path, std::string(out.begin(), out.end()));
-    RuntimeLogger::info("[npz转nii] 完成: " + out_path.string());
-}
-
-static inline void nii_to_npz(const fs::path &input_path, const fs::path &out_path, int slice_index = -1)
-{
-    RuntimeLogger::info("[nii转npz] 开始: " + input_path.string() + " -> " + out_path.string());
-    const std::string raw = read_text_file(input_path);
-    const std::vector<uint8_t> all(raw.begin(), raw.end());
-    if (all.size() < 352) {
-        throw std::runtime_error("NIfTI 文件过小");
-    }
+    BinaryFileSink(const BinaryFileSink &) = delete;
+    BinaryFileSink &operator=(const BinaryFileSink &) = delete;
 
-    std::vector<uint8_t> embedded_npz;
-    if (try_extract_embedded_npz_from_bytes(all, &embedded_npz)) {
-        write_text_file(out_path, std::string(embedded_npz.begin(), embedded_npz.end()));
-        RuntimeLogger::info("[nii转npz] 完成(命中嵌入NPZ): " + out_path.string());
-        return;
+    ~BinaryFileSink()
+    {
+        if (gz != nullptr) gzclose(gz);
+        if (plain.is_open()) plain.close();
+        std::error_code ec;
+        if (fs::exists(tmp_path, ec)) fs::remove(tmp_path, ec);
+    }
+
+    void write(const void *data, size_t size)
+    {
+        if (size == 0) return;
+        if (gzip) {
+            const auto *p = static_cast<const char *>(data);
+            while (size > 0) {
+                const unsigned chunk = static_cast<unsigned>(std::min<size_t>(size, 1U << 30));
+                if (gzwrite(gz, p, chunk) != static_cast<int>(chunk)) {
+                    throw std::runtime_error("gzip 写入失败: " + path.string());
+                }
+                p += chunk;
+                size -= chunk;
+            }
+        } else {
+            plain.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+            if (!plain) throw std::runtime_error("写入失败: " + path.string());
+        }
     }
 
-    Nifti1Header hdr{};
-    std::memcpy(&hdr, all.data(), 348);
-    if (hdr.sizeof_hdr != 348) {
-        throw std::runtime_error("不支持的 NIfTI 头部");
+    void close()
+    {
+        if (gzip) {
+            const int rc = gzclose(gz);
+            gz = nullptr;
+            if (rc != Z_OK) throw std::runtime_error("gzip 写入失败: " + path.string());
+        } else {
+            plain.close();
+            if (!plain) throw std::runtime_error("写入失败: " + path.string());
+        }
+        std::error_code ec;
+        fs::rename(tmp_path, path, ec);
+        if (ec) {
+            fs::remove(path, ec);
+            fs::rename(tmp_path, path, ec);
+            if (ec) throw std::runtime_error("重命名输出文件失败: " + ec.message());
+        }
     }
+};
 
-    const int ndim = hdr.dim[0];
-    const int d1 = std::max<int>(1, hdr.dim[1]);
-    const int d2 = std::max<int>(1, hdr.dim[2]);
-    const int d3 = std::max<int>(1, hdr.dim[3]);
+static inline bool is_gzip_path(const fs::path &path)
+{
+    return to_lower_copy(path.extension().string()) == ".gz";
+}
 
-    if (ndim < 2) {
-        throw std::runtime_error("NIfTI 维度不足");
-    }
+static inline void encode_volume_to_nii(const ImageVolume &volume, const fs::path &out_path)
+{
+    const bool has_payload = !volume.npz_bytes.empty();
+    const std::vector<uint8_t> packed_npz = has_payload ? pack_embedded_npz(volume.npz_bytes)
+                                                        : std::vector<uint8_t>{};
 
-    const size_t vox_offset = static_cast<size_t>(hdr.vox_offset);
-    if (vox_offset >= all.size()) {
-        throw std::runtime_error("NIfTI vox_offset 越界");
+    int32_t ext_size = 0;
+    if (has_payload) {
+        ext_size = static_cast<int32_t>(8 + packed_npz.size());
+        const int32_t rem = ext_size % 16;
+        if (rem != 0) ext_size += (16 - rem);
     }
+    const Nifti1Header hdr = make_nifti_header(volume.dim1, volume.dim2, volume.dim3, 16, 32, volume.spacing, ext_size);
 
-    const size_t n = static_cast<size_t>(d1) * static_cast<size_t>(d2) * static_cast<size_t>(d3);
-    std::vector<double> volume(n, 0.0);
-
-    if (hdr.datatype == 16 && hdr.bitpix == 32) {
-        const size_t need = n * sizeof(float);
-        if (vox_offset + need > all.size()) throw std::runtime_error("NIfTI 数据长度不足");
-        const auto *p = reinterpret_cast<const float *>(all.data() + static_cast<long>(vox_offset));
-        for (size_t i = 0; i < n; ++i) volume[i] = static_cast<double>(p[i]);
-    } else if (hdr.datatype == 64 && hdr.bitpix == 64) {
-        const size_t need = n * sizeof(double);
-        if (vox_offset + need > all.size()) throw std::runtime_error("NIfTI 数据长度不足");
-        const auto *p = reinterpret_cast<const double *>(all.data() + static_cast<long>(vox_offset));
-        std::copy(p, p + n, volume.begin());
-    } else if (hdr.datatype == 512 && hdr.bitpix == 16) {
-        const size_t need = n * sizeof(uint16_t);
-        if (vox_offset + need > all.size()) throw std::runtime_error("NIfTI 数据长度不足");
-        const auto *p = reinterpret_cast<const uint16_t *>(all.data() + static_cast<long>(vox_offset));
-        for (size_t i = 0; i < n; ++i) volume[i] = static_cast<double>(p[i]);
-    } else {
-        throw std::runtime_error("当前仅支持读取 float32/float64/uint16 的 NIfTI");
+    std::vector<uint8_t> head(352, 0);
+    std::memcpy(head.data(), &hdr, 348);
+    if (has_payload) {
+        head[348] = 1;
+        append_u32_le(head, static_cast<uint32_t>(ext_size));
+        append_u32_le(head, 40);
+        head.insert(head.end(), packed_npz.begin(), packed_npz.end());
+        head.resize(352 + static_cast<size_t>(ext_size), 0);
     }
 
-    const int use_slice = (d3 == 1) ? 0 : (slice_index >= 0 ? slice_index : (d3 / 2));
-    if (use_slice < 0 || use_slice >= d3) {
-        throw std::runtime_error("slice_index 越界");
-    }
+    BinaryFileSink sink(out_path, is_gzip_path(out_path));
+    sink.write(head.data(), head.size());
+    sink.write(volume.voxels.data(), volume.voxels.size() * sizeof(float));
+    sink.close();
+}
 
-    const size_t hw = static_cast<size_t>(d1) * static_cast<size_t>(d2);
-    std::vector<double> image(hw, 0.0);
-    const size_t z_off = static_cast<size_t>(use_slice) * hw;
-    std::copy(volume.begin() + static_cast<long>(z_off),
-              volume.begin() + static_cast<long>(z_off + hw),
-              image.begin());
+static inline void encode_slice_to_nii(const ImageSlice &slice, const fs::path &out_path)
+{
+    ImageVolume volume;
+    volume.dim1 = slice.width;
+    volume.dim2 = slice.height;
+    volume.dim3 = 1;
+    volume.voxels = to_float32(slice.image);
+    volume.spacing = spacing_to_xyz(slice.spacing);
+    volume.npz_bytes = encode_slice_to_npz_bytes(slice);
+    encode_volume_to_nii(volume, out_path);
+}
 
-    save_onnx_compatible_npz(out_path, {static_cast<size_t>(d1), static_cast<size_t>(d2)}, image);
-    RuntimeLogger::info("[nii转npz] 完成: " + out_path.string() + ", 使用切片=" + std::to_string(use_slice));
+static inline bool is_nii_path(const fs::path &path)
+{
+    const std::string ext = to_lower_copy(path.extension().string());
+    return ext == ".nii" || ext == ".gz";
 }
 
-static inline void png_to_npz(const fs::path &input_path, const fs::path &out_path)
+// 转换图入口：源格式解码一次，目标格式编码一次
+static inline ImageSlice decode_image_slice(const fs::path &src, const std::string &npz_key = "image")
 {
-    RuntimeLogger::info("[png转npz] 开始: " + input_path.string() + " -> " + out_path.string());
-    const cv::Mat gray = cv::imread(input_path.string(), cv::IMREAD_GRAYSCALE);
-    if (gray.empty()) {
-        throw std::runtime_error("读取 png 失败: " + input_path.string());
-    }
-    const auto image = image_from_gray_u8(gray);
-    save_onnx_compatible_npz(out_path,
-                             {static_cast<size_t>(gray.rows), static_cast<size_t>(gray.cols)},
-                             image);
-    RuntimeLogger::info("[png转npz] 完成: " + out_path.string() + ", rows=" + std::to_string(gray.rows) + ", cols=" + std::to_string(gray.cols));
+    const std::string ext = to_lower_copy(src.extension().string());
+    if (ext == ".npz") return decode_npz_bytes_to_slice(npzproc::read_file_bytes(src), {npz_key});
+    if (ext == ".dcm") return decode_dcm_to_slice(src);
+    if (is_nii_path(src)) return decode_nii_to_slice(src, -1);
+    if (ext == ".png") return decode_png_to_slice(src);
+    throw std::runtime_error("不支持解码的文件类型: " + src.extension().string());
 }
 
-static inline void npz_to_png(const fs::path &input_path, const fs::path &out_path, const std::string &key = "image")
+static inline void encode_image_slice(const ImageSlice &slice, const fs::path &dst)
 {
-    RuntimeLogger::info("[npz转png] 开始: " + input_path.string() + " -> " + out_path.string() + ", key=" + key);
-    const auto npz_map = cnpy::npz_load(input_path.string());
-    auto it = npz_map.find(key);
-    if (it == npz_map.end()) {
-        throw std::runtime_error("npz 中找不到键: " + key);
-    }
-    int h = 0;
-    int w = 0;
-    std::vector<double> image_data = npy_to_double_2d(it->second, h, w);
-    cv::Mat image = normalize_to_u8(image_data, h, w);
-    if (!cv::imwrite(out_path.string(), image)) {
-        throw std::runtime_error("写入 png 失败: " + out_path.string());
-    }
-    RuntimeLogger::info("[npz转png] 完成: " + out_path.string() + ", rows=" + std::to_string(h) + ", cols=" + std::to_string(w));
+    const std::string ext = to_lower_copy(dst.extension().string());
+    if (ext == ".npz") return encode_slice_to_npz(slice, dst);
+    if (ext == ".png") return encode_slice_to_png(slice, dst);
+    if (ext == ".dcm") return encode_slice_to_dcm(slice, dst);
+    if (is_nii_path(dst)) return encode_slice_to_nii(slice, dst);
+    throw std::runtime_error("不支持编码的文件类型: " + dst.extension().string());
 }
 
-static inline void all2npz(const fs::path &src, const fs::path &dst)
+static inline void convert_image_file(const fs::path &src, const fs::path &dst, const std::string &npz_key = "image")
 {
-    RuntimeLogger::info("[任意转npz] 开始: " + src.string() + " -> " + dst.string());
+    const std::string src_ext = to_lower_copy(src.extension().string());
+    const std::string dst_ext = to_lower_copy(dst.extension().string());
+    RuntimeLogger::info("[格式转换] 开始: " + src.string() + " -> " + dst.string() + ", key=" + npz_key);
     std::error_code ec;
     fs::create_directories(dst.parent_path(), ec);
-    const std::string ext = to_lower_copy(src.extension().string());
-    if (ext == ".npz") {
+    if (src_ext == dst_ext && (src_ext == ".npz" || src_ext == ".png")) {
         fs::copy_file(src, dst, fs::copy_options::overwrite_existing, ec);
-        if (ec) throw std::runtime_error("npz 复制失败: " + ec.message());
-        RuntimeLogger::info("[任意转npz] 完成(npz复制): " + dst.string());
-        return;
-    }
-    if (ext == ".dcm") {
-        dcm_to_npz(src, dst);
-        RuntimeLogger::info("文件转换完成 dcm->npz: " + dst.string());
+        if (ec) throw std::runtime_error(src_ext.substr(1) + " 复制失败: " + ec.message());
+        RuntimeLogger::info("[格式转换] 完成(复制): " + dst.string());
         return;
     }
-    if (ext == ".nii" || ext == ".gz" || ext == ".nii.gz") {
-        nii_to_npz(src, dst, -1);
-        RuntimeLogger::info("文件转换完成 nii->npz: " + dst.string());
-        return;
+    if (dst_ext == ".npz" && (src_ext == ".dcm" || is_nii_path(src))) {
+        // 带往返载荷的 dcm/nii 原样写出嵌入的 npz，不经过解码
+        std::vector<uint8_t> bytes = npzproc::read_file_bytes(src);
+        if (is_gzip_bytes(bytes)) bytes = gunzip_bytes(bytes);
+        std::vector<uint8_t> embedded_npz;
+        if (try_extract_embedded_npz_from_bytes(bytes, &embedded_npz)) {
+            npzproc::write_file_bytes(dst, embedded_npz);
+            RuntimeLogger::info("[格式转换] 完成(嵌入载荷): " + dst.string());
+            return;
+        }
     }
-    if (ext == ".png") {
-        png_to_npz(src, dst);
-        RuntimeLogger::info("文件转换完成 png->npz: " + dst.string());
-        return;
+    if (src_ext == ".npz" && is_nii_path(dst)) {
+        // npz 可能直接存放 3D 数组，按体数据写出
+        encode_volume_to_nii(decode_npz_bytes_to_volume(npzproc::read_file_bytes(src), npz_key), dst);
+    } else {
+        encode_image_slice(decode_image_slice(src, npz_key), dst);
     }
-    throw std::runtime_error("不支持转换为npz的文件类型: " + src.extension().string());
+    RuntimeLogger::info("[格式转换] 完成: " + dst.string());
 }
 
-static inline void all2png(const fs::path &src, const fs::path &dst)
+static inline void npz_to_dcm(const fs::path &input_path, const fs::path &out_path, const std::string &key)
 {
-    RuntimeLogger::info("[任意转png] 开始: " + src.string() + " -> " + dst.string());
-    std::error_code ec;
-    fs::create_directories(dst.parent_path(), ec);
-    const std::string ext = to_lower_copy(src.extension().string());
-    if (ext == ".png") {
-        fs::copy_file(src, dst, fs::copy_options::overwrite_existing, ec);
-        if (ec) throw std::runtime_error("png 复制失败: " + ec.message());
-        RuntimeLogger::info("[任意转png] 完成(png复制): " + dst.string());
-        return;
+    convert_image_file(input_path, out_path, key);
+}
+
+static inline void npz_to_nii(const fs::path &input_path, const fs::path &out_path, const std::string &key)
+{
+    convert_image_file(input_path, out_path, key);
+}
+
+static inline void all2npz(const fs::path &src, const fs::path &dst)
+{
+    convert_image_file(src, dst, "image");
+}
+
+static inline void all2png(const fs::path &src, const fs::path &dst)
+{
+    convert_image_file(src, dst, "image");
+}
+
+// 按约定键名查找原图与标注条目；缺少标注键时退而取第一个非原图、非间距的条目
+static inline void find_npz_render_entries(const std::vector<npzproc::ZipEntry> &entries,
+                                           const npzproc::ZipEntry *&raw_entry,
+                                           const npzproc::ZipEntry *&ann_entry)
+{
+    static const std::vector<std::string> kRawKeys = {
+        "image", "img", "raw", "ct", "data", "slice", "input"
+    };
+    static const std::vector<std::string> kAnnKeys = {
+        "label", "mask", "seg", "annotation", "gt"
+    };
+    if (entries.empty()) throw std::runtime_error("npz为空");
+
+    raw_entry = find_npz_entry(entries, kRawKeys);
+    ann_entry = find_npz_entry(entries, kAnnKeys);
+    if (!raw_entry) {
+        raw_entry = &entries.front();
     }
-    if (ext == ".npz") {
-        npz_to_png(src, dst, "image");
-        RuntimeLogger::info("文件转换完成 npz->png: " + dst.string());
-        return;
+    if (!ann_entry) {
+        for (const auto &e : entries) {
+            if (&e != raw_entry && e.name != "spacing.npy") {
+                ann_entry = &e;
+                break;
+            }
+        }
     }
-    if (ext == ".dcm" || ext == ".nii" || ext == ".gz" || ext == ".nii.gz") {
-        fs::path tmp_npz = dst.parent_path() / (src.stem().string() + ".__tmp_convert__.npz");
-        RuntimeLogger::debug("创建临时转换文件: " + tmp_npz.string());
-        all2npz(src, tmp_npz);
-        npz_to_png(tmp_npz, dst, "image");
-        fs::remove(tmp_npz, ec);
-        RuntimeLogger::debug("清理临时转换文件: " + tmp_npz.string());
-        RuntimeLogger::info("[任意转png] 完成(复合流程): " + dst.string());
-        return;
+}
+
+static inline cv::Mat render_npz_label_overlay(const npzproc::ZipEntry *ann_entry, int h, int w)
+{
+    cv::Mat classes;
+    if (ann_entry) {
+        classes = slice_render::label_mat_to_classes(slice_render::npy_entry_to_mat(*ann_entry));
+    } else {
+        classes = cv::Mat(h, w, CV_8U, cv::Scalar(0));
+    }
+    if (classes.rows != h || classes.cols != w) {
+        throw std::runtime_error("标注尺寸与原图不一致");
     }
-    throw std::runtime_error("不支持转换为png的文件类型: " + src.extension().string());
+    return slice_render::render_label_overlay(classes);
 }
 
 static inline void convert_npz_to_pngs(const fs::path &npz_path,
@@ -1394,78 +1776,43 @@ static inline void convert_npz_to_pngs(const fs::path &npz_path,
                         ", png_dir=" + png_dir.string() +
                         ", marked_dir=" + marked_dir.string() +
                         ", marked=" + (marked ? std::string("true") : std::string("false")));
-    static const std::vector<std::string> kRawKeys = {
-        "image", "img", "raw", "ct", "data", "slice", "input"
-    };
-    static const std::vector<std::string> kAnnKeys = {
-        "label", "mask", "seg", "annotation", "gt"
-    };
-
-    cnpy::npz_t npz = cnpy::npz_load(npz_path.string());
-    if (npz.empty()) throw std::runtime_error("npz为空");
-
-    const cnpy::NpyArray *raw_arr = find_npz_array(npz, kRawKeys);
-    const cnpy::NpyArray *ann_arr = find_npz_array(npz, kAnnKeys);
-    if (!raw_arr) {
-        raw_arr = &npz.begin()->second;
-    }
-    if (!ann_arr) {
-        for (const auto &kv : npz) {
-            if (&kv.second != raw_arr) {
-                ann_arr = &kv.second;
-                break;
-            }
-        }
-    }
+    std::vector<npzproc::ZipEntry> entries = npzproc::load_npz_entries(npz_path);
+    const npzproc::ZipEntry *raw_entry = nullptr;
+    const npzproc::ZipEntry *ann_entry = nullptr;
+    find_npz_render_entries(entries, raw_entry, ann_entry);
 
-    int h = 0;
-    int w = 0;
-    std::vector<double> raw_data = npy_to_double_2d(*raw_arr, h, w);
-    cv::Mat raw_u8 = normalize_to_u8(raw_data, h, w);
+    cv::Mat raw_mat = slice_render::npy_entry_to_mat(*raw_entry);
 
     if (write_raw_png) {
         fs::create_directories(png_dir);
         fs::path out_png = png_dir / (npz_path.stem().string() + ".png");
-        if (!cv::imwrite(out_png.string(), raw_u8)) throw std::runtime_error("写入png失败");
+        slice_render::write_png(out_png, slice_render::normalize_mat_to_u8(raw_mat));
         RuntimeLogger::info("[npz转png] 输出原始PNG: " + out_png.string());
     }
 
     if (marked) {
         fs::create_directories(marked_dir);
-        std::vector<double> ann_data;
-        int ann_h = 0;
-        int ann_w = 0;
-        if (ann_arr) {
-            ann_data = npy_to_double_2d(*ann_arr, ann_h, ann_w);
-        } else {
-            ann_h = h;
-            ann_w = w;
-            ann_data.assign(static_cast<size_t>(h) * w, 0.0);
-        }
-        if (ann_h != h || ann_w != w) {
-            throw std::runtime_error("标注尺寸与原图不一致");
-        }
-
-        const uchar alpha = 160;
-        cv::Mat rgba(h, w, CV_8UC4, cv::Scalar(0, 0, 0, 0));
-        for (int r = 0; r < h; ++r) {
-            for (int c = 0; c < w; ++c) {
-                double v = ann_data[static_cast<size_t>(r) * w + c];
-                if (v > 1.0) {
-                    rgba.at<cv::Vec4b>(r, c) = cv::Vec4b(0, 212, 255, alpha);
-                } else if (v > 0.0) {
-                    rgba.at<cv::Vec4b>(r, c) = cv::Vec4b(59, 59, 255, alpha);
-                }
-            }
-        }
         fs::path out_marked = marked_dir / (npz_path.stem().string() + marked_suffix + ".png");
-        if (!cv::imwrite(out_marked.string(), rgba)) throw std::runtime_error("写入markedpng失败");
+        slice_render::write_png(out_marked, render_npz_label_overlay(ann_entry, raw_mat.rows, raw_mat.cols));
         RuntimeLogger::info("[npz转png] 输出标注PNG: " + out_marked.string());
     }
 
     RuntimeLogger::info("[npz转png] 流程完成: " + npz_path.string());
 }
 
+// 多个 npz 之间互不依赖，按硬件线程数并行渲染
+static inline void convert_npz_files_to_pngs(const std::vector<fs::path> &npz_files,
+                                             const fs::path &png_dir,
+                                             const fs::path &marked_dir,
+                                             bool marked,
+                                             bool write_raw_png,
+                                             const std::string &marked_suffix)
+{
+    parallel_for_each_index(npz_files.size(), [&](size_t i) {
+        convert_npz_to_pngs(npz_files[i], png_dir, marked_dir, marked, write_raw_png, marked_suffix);
+    });
+}
+
 static inline bool is_valid_crop(int xL, int xR, int yL, int yR, int width, int height)
 {
     return xL >= 0 && yL >= 0 && xR > xL && yR > yL && xR <= width && yR <= height;
@@ -2255,7 +2602,6 @@ static inline std::string powershell_single_quote_escape(const std::string &s)
 }
 
 static inline bool command_exists(const std::string &cmd);
-static inline std::string random_hex_id(std::size_t length);
 
 static inline std::optional<std::string> get_env_copy(const char *name)
 {
@@ -2387,61 +2733,47 @@ static inline fs::path require_command_path(const std::string &cmd, const std::s
     throw std::runtime_error(error_message);
 }
 
+// 打包临时目录：每次请求使用独立文件名，超过 1 小时的残留归档在下次打包时清理
+static inline fs::path zip_temp_dir()
+{
+    fs::path dir = fs::temp_directory_path() / "medimg_zip";
+    fs::create_directories(dir);
+    return dir;
+}
+
+static inline void prune_stale_zip_temp_files(const fs::path &dir)
+{
+    std::error_code ec;
+    const auto now = fs::file_time_type::clock::now();
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file(ec)) continue;
+        auto mtime = entry.last_write_time(ec);
+        if (ec || now - mtime < std::chrono::hours(1)) continue;
+        fs::remove(entry.path(), ec);
+    }
+}
+
 static inline fs::path create_zip_store(const fs::path &dir, const std::string &zip_name)
 {
     if (!fs::exists(dir)) throw std::runtime_error("目录不存在");
-    fs::path tmp = fs::temp_directory_path() / zip_name;
-    if (fs::exists(tmp)) fs::remove(tmp);
+    const fs::path tmp_dir = zip_temp_dir();
+    prune_stale_zip_temp_files(tmp_dir);
+    const fs::path stem = fs::path(zip_name).stem();
+    fs::path tmp = tmp_dir / (stem.string() + "_" + random_hex_id(8) + ".zip");
     RuntimeLogger::info("[目录转zip] 开始: " + dir.string() + " -> " + tmp.string());
 
-    int rc = 0;
-    bool used_multicore = false;
-#ifdef _WIN32
-    if (command_exists("7z")) {
-        fs::path seven_zip = require_command_path("7z", "缺少 7z，且 PowerShell 压缩不可用");
-        std::string dst_zip = powershell_single_quote_escape(tmp.string());
-        std::string cmd =
-            "powershell -NoProfile -NonInteractive -Command \""
-            "$ErrorActionPreference='Stop'; "
-            "$d='" + powershell_single_quote_escape(dir.string()) + "'; "
-            "$z='" + dst_zip + "'; "
-            "Set-Location -LiteralPath $d; "
-            "& '" + powershell_single_quote_escape(seven_zip.string()) + "' a -tzip -mx=5 -mmt=on -y $z * | Out-Null\"";
-        rc = std::system(cmd.c_str());
-        used_multicore = true;
-    } else {
-        std::string src_glob = powershell_single_quote_escape((dir / "*").string());
-        std::string dst_zip = powershell_single_quote_escape(tmp.string());
-        std::string cmd =
-            "powershell -NoProfile -NonInteractive -Command \"Compress-Archive -Path '" +
-            src_glob +
-            "' -DestinationPath '" +
-            dst_zip +
-            "' -CompressionLevel Optimal -Force\"";
-        rc = std::system(cmd.c_str());
-    }
-#else
-    auto cwd = fs::current_path();
-    fs::current_path(dir);
     try {
-        std::string cmd;
-        if (command_exists("7z")) {
-            cmd = "7z a -tzip -mx=5 -mmt=on -y " + shell_escape(tmp.string()) + " . >/dev/null";
-            used_multicore = true;
-        } else {
-            cmd = "zip -5 -r " + shell_escape(tmp.string()) + " . >/dev/null";
-        }
-        rc = std::system(cmd.c_str());
-        fs::current_path(cwd);
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        if (!ofs) throw std::runtime_error("无法创建 zip 文件: " + tmp.string());
+        zipstream::write_dir_zip(dir, ofs, 5);
     } catch (...) {
-        fs::current_path(cwd);
+        std::error_code ec;
+        fs::remove(tmp, ec);
         throw;
     }
-#endif
 
-    if (rc != 0 || !fs::exists(tmp)) throw std::runtime_error("zip 失败");
-    RuntimeLogger::info(std::string("[目录转zip] 压缩参数: level=5, multicore=") + (used_multicore ? "on" : "off"));
-    RuntimeLogger::info("[目录转zip] 完成: " + tmp.string());
+    RuntimeLogger::info("[目录转zip] 压缩参数: level=5, png/npz 直接存储, 其余并行 deflate");
+    RuntimeLogger::info("[目录转zip] 完成: " + tmp.string() + ", bytes=" + std::to_string(fs::file_size(tmp)));
     return tmp;
 }
 
@@ -2465,238 +2797,2079 @@ static inline std::string derive_base_png_stem(std::string stem)
     return stem;
 }
 
-static inline cv::Mat ensure_bgr_image(const cv::Mat &image)
+static inline std::vector<fs::path> list_npz_files_natural(const fs::path &dir)
 {
-    if (image.empty()) return {};
-    if (image.channels() == 3) return image.clone();
+    std::vector<fs::path> out;
+    for (const auto &p : list_files(dir)) {
+        if (to_lower_copy(p.extension().string()) == ".npz") out.push_back(p);
+    }
+    std::sort(out.begin(), out.end(), npz_to_glb::natural_less);
+    return out;
+}
 
-    cv::Mat converted;
-    if (image.channels() == 1) {
-        cv::cvtColor(image, converted, cv::COLOR_GRAY2BGR);
-        return converted;
+// 体数据导出：按切片顺序逐个解码 npz 并直接写入同一个 3D NIfTI，内存中只保留当前切片
+static inline void export_npz_dir_to_nii_volume(const fs::path &npz_dir,
+                                                const fs::path &out_path,
+                                                const std::string &npz_key)
+{
+    const auto npz_files = list_npz_files_natural(npz_dir);
+    if (npz_files.empty()) {
+        throw std::runtime_error("源npz目录为空，无法转换");
     }
-    if (image.channels() == 4) {
-        cv::cvtColor(image, converted, cv::COLOR_BGRA2BGR);
-        return converted;
+    RuntimeLogger::info("[npz转nii体数据] 开始: src_dir=" + npz_dir.string() + ", out=" + out_path.string() +
+                        ", slices=" + std::to_string(npz_files.size()) + ", key=" + npz_key);
+
+    std::unique_ptr<BinaryFileSink> sink;
+    size_t height = 0;
+    size_t width = 0;
+    int16_t datatype = 16;
+    std::vector<uint8_t> buffer;
+    for (size_t z = 0; z < npz_files.size(); ++z) {
+        const auto entries = npzproc::load_npz_entries(npz_files[z]);
+        const npzproc::ZipEntry *entry = find_npz_entry(entries, {npz_key});
+        if (entry == nullptr) {
+            throw std::runtime_error("npz 中找不到键: " + npz_key + ", file=" + npz_files[z].filename().string());
+        }
+        const auto meta = npzproc::parse_npy_meta(entry->data);
+        if (meta.shape.size() != 2) {
+            throw std::runtime_error("体数据导出仅支持二维切片: " + npz_files[z].filename().string());
+        }
+        const auto values = npzproc::decode_numeric_data(entry->data, meta);
+
+        if (z == 0) {
+            height = meta.shape[0];
+            width = meta.shape[1];
+            const auto dtype = npzproc::parse_dtype(meta.descr);
+            int16_t bitpix = 32;
+            if (dtype.kind == 'b' || (dtype.kind == 'u' && dtype.item_size == 1)) {
+                datatype = 2;
+                bitpix = 8;
+            } else if (dtype.kind == 'u' && dtype.item_size == 2) {
+                datatype = 512;
+                bitpix = 16;
+            } else if (dtype.kind == 'i' && dtype.item_size <= 2) {
+                datatype = 4;
+                bitpix = 16;
+            }
+            const Nifti1Header hdr = make_nifti_header(width, height, npz_files.size(), datatype, bitpix,
+                                                       spacing_to_xyz(read_npz_spacing(entries)), 0);
+            std::vector<uint8_t> head(352, 0);
+            std::memcpy(head.data(), &hdr, 348);
+            sink = std::make_unique<BinaryFileSink>(out_path, is_gzip_path(out_path));
+            sink->write(head.data(), head.size());
+        } else if (meta.shape[0] != height || meta.shape[1] != width) {
+            throw std::runtime_error("切片尺寸不一致，无法合成体数据: " + npz_files[z].filename().string());
+        }
+
+        auto store_as = [&](auto tag, double lo, double hi) {
+            using T = decltype(tag);
+            buffer.resize(values.size() * sizeof(T));
+            T *dst = reinterpret_cast<T *>(buffer.data());
+            for (size_t i = 0; i < values.size(); ++i) {
+                double v = std::isfinite(values[i]) ? values[i] : 0.0;
+                dst[i] = static_cast<T>(std::clamp(v, lo, hi));
+            }
+        };
+        if (datatype == 2) {
+            store_as(uint8_t{}, 0.0, 255.0);
+        } else if (datatype == 512) {
+            store_as(uint16_t{}, 0.0, 65535.0);
+        } else if (datatype == 4) {
+            store_as(int16_t{}, -32768.0, 32767.0);
+        } else {
+            store_as(float{}, -static_cast<double>(std::numeric_limits<float>::max()),
+                     static_cast<double>(std::numeric_limits<float>::max()));
+        }
+        sink->write(buffer.data(), buffer.size());
     }
-    throw std::runtime_error("不支持的基础PNG通道数");
+    sink->close();
+    RuntimeLogger::info("[npz转nii体数据] 完成: " + out_path.string() + ", dims=" + std::to_string(width) + "x" +
+                        std::to_string(height) + "x" + std::to_string(npz_files.size()));
 }
 
-static inline cv::Mat ensure_bgra_image(const cv::Mat &image)
+// 往返载荷 sidecar：源 npz 原样打包一次，不再逐切片嵌入到 NIfTI 扩展中
+static inline void export_npz_dir_roundtrip_sidecar(const fs::path &npz_dir, const fs::path &out_path)
 {
-    if (image.empty()) return {};
-    if (image.channels() == 4) return image.clone();
-
-    cv::Mat converted;
-    if (image.channels() == 3) {
-        cv::cvtColor(image, converted, cv::COLOR_BGR2BGRA);
-        return converted;
+    const auto npz_files = list_npz_files_natural(npz_dir);
+    if (npz_files.empty()) {
+        throw std::runtime_error("源npz目录为空，无法转换");
     }
-    if (image.channels() == 1) {
-        cv::cvtColor(image, converted, cv::COLOR_GRAY2BGRA);
-        return converted;
+    std::vector<npzproc::ZipEntry> entries;
+    entries.reserve(npz_files.size());
+    for (const auto &src : npz_files) {
+        entries.push_back({src.filename().string(), npzproc::read_file_bytes(src)});
     }
-    throw std::runtime_error("不支持的标注PNG通道数");
+    BinaryFileSink sink(out_path, false);
+    const auto zip_bytes = npzproc::save_npz_entries(entries);
+    sink.write(zip_bytes.data(), zip_bytes.size());
+    sink.close();
+    RuntimeLogger::info("[npz转nii体数据] 输出往返载荷: " + out_path.string() + ", files=" + std::to_string(npz_files.size()));
 }
 
-static inline void blend_png_with_markedpng(const fs::path &base_png,
-                                            const fs::path &marked_png,
-                                            const fs::path &out_png)
+struct ContentCrcEntry {
+    uintmax_t size = 0;
+    int64_t mtime = 0;
+    uint32_t crc = 0;
+};
+
+// 文件内容 CRC，按 (路径, 大小, 修改时间) 记忆，重复下载时无需重新读盘
+static inline uint32_t file_content_crc32(const fs::path &path)
 {
-    RuntimeLogger::info("[PNG融合] 开始: base=" + base_png.string() +
-                        ", overlay=" + marked_png.string() +
-                        " -> " + out_png.string());
-    cv::Mat base = cv::imread(base_png.string(), cv::IMREAD_UNCHANGED);
-    cv::Mat overlay = cv::imread(marked_png.string(), cv::IMREAD_UNCHANGED);
-    if (base.empty()) throw std::runtime_error("读取基础PNG失败: " + base_png.string());
-    if (overlay.empty()) throw std::runtime_error("读取标注PNG失败: " + marked_png.string());
+    static std::mutex mtx;
+    static std::unordered_map<std::string, ContentCrcEntry> memo;
 
-    cv::Mat base_bgr = ensure_bgr_image(base);
-    cv::Mat overlay_bgra = ensure_bgra_image(overlay);
-    if (overlay_bgra.size() != base_bgr.size()) {
-        cv::resize(overlay_bgra, overlay_bgra, base_bgr.size(), 0, 0, cv::INTER_NEAREST);
+    const uintmax_t size = fs::file_size(path);
+    const int64_t mtime = static_cast<int64_t>(fs::last_write_time(path).time_since_epoch().count());
+    const std::string key = path.string();
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = memo.find(key);
+        if (it != memo.end() && it->second.size == size && it->second.mtime == mtime) {
+            return it->second.crc;
+        }
     }
 
-    cv::Mat blended = base_bgr.clone();
-    for (int r = 0; r < blended.rows; ++r) {
-        for (int c = 0; c < blended.cols; ++c) {
-            const cv::Vec4b over_px = overlay_bgra.at<cv::Vec4b>(r, c);
-            const double alpha = static_cast<double>(over_px[3]) / 255.0;
-            if (alpha <= 0.0) continue;
-            cv::Vec3b &base_px = blended.at<cv::Vec3b>(r, c);
-            for (int ch = 0; ch < 3; ++ch) {
-                const double mixed = base_px[ch] * (1.0 - alpha) + over_px[ch] * alpha;
-                base_px[ch] = static_cast<uchar>(std::clamp(mixed, 0.0, 255.0));
-            }
-        }
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) throw std::runtime_error("无法打开文件: " + path.string());
+    std::vector<char> buf(1 << 20);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (ifs) {
+        ifs.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        const std::streamsize got = ifs.gcount();
+        if (got <= 0) break;
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(buf.data()), static_cast<uInt>(got));
     }
 
-    fs::create_directories(out_png.parent_path());
-    if (!cv::imwrite(out_png.string(), blended)) {
-        throw std::runtime_error("写入融合PNG失败: " + out_png.string());
+    std::lock_guard<std::mutex> lk(mtx);
+    memo[key] = ContentCrcEntry{size, mtime, static_cast<uint32_t>(crc)};
+    return static_cast<uint32_t>(crc);
+}
+
+static inline void fnv1a_update(uint64_t &h, const void *data, size_t size)
+{
+    const auto *p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
     }
-    RuntimeLogger::info("[PNG融合] 完成: " + out_png.string());
 }
 
-static inline fs::path build_fused_png_temp_dir(const fs::path &base_dir,
-                                                const fs::path &overlay_dir,
-                                                const std::string &tag)
+// 源 npz 集合的内容指纹：文件名、大小、内容 CRC 与导出参数共同决定
+static inline std::string fingerprint_npz_dir(const fs::path &npz_dir, const std::string &salt)
 {
-    if (!fs::exists(base_dir)) throw std::runtime_error("基础PNG目录不存在");
-    if (!fs::exists(overlay_dir)) throw std::runtime_error("标注PNG目录不存在");
+    uint64_t h = 1469598103934665603ULL;
+    fnv1a_update(h, salt.data(), salt.size());
+    for (const auto &p : list_npz_files_natural(npz_dir)) {
+        const std::string name = p.filename().string();
+        const uint64_t size = static_cast<uint64_t>(fs::file_size(p));
+        const uint32_t crc = file_content_crc32(p);
+        fnv1a_update(h, name.data(), name.size() + 1);
+        fnv1a_update(h, &size, sizeof(size));
+        fnv1a_update(h, &crc, sizeof(crc));
+    }
+    std::ostringstream oss;
+    oss << std::hex << std::setw(16) << std::setfill('0') << h;
+    return oss.str();
+}
 
-    fs::path out_dir = fs::temp_directory_path() / (tag + "_" + random_hex_id(8));
-    fs::create_directories(out_dir);
+// 目录清单指纹：按相对路径、大小与修改时间累积，不读取文件内容
+static inline void fingerprint_dir_listing(uint64_t &h, const fs::path &dir)
+{
+    if (!fs::exists(dir)) throw std::runtime_error("目录不存在");
+    const std::string root = dir.lexically_normal().generic_string();
+    fnv1a_update(h, root.data(), root.size() + 1);
+    std::vector<std::tuple<std::string, uint64_t, int64_t>> listing;
+    for (const auto &it : fs::recursive_directory_iterator(dir)) {
+        if (!it.is_regular_file()) continue;
+        listing.emplace_back(it.path().lexically_relative(dir).generic_string(),
+                             static_cast<uint64_t>(it.file_size()),
+                             static_cast<int64_t>(it.last_write_time().time_since_epoch().count()));
+    }
+    std::sort(listing.begin(), listing.end());
+    for (const auto &[name, size, mtime] : listing) {
+        fnv1a_update(h, name.data(), name.size() + 1);
+        fnv1a_update(h, &size, sizeof(size));
+        fnv1a_update(h, &mtime, sizeof(mtime));
+    }
+}
 
-    auto overlays = list_files(overlay_dir);
-    int fused_count = 0;
-    for (const auto &overlay : overlays) {
-        if (to_lower_copy(overlay.extension().string()) != ".png") continue;
-        const std::string overlay_stem = overlay.stem().string();
-        const std::string base_stem = derive_base_png_stem(overlay_stem);
-        fs::path base_png = base_dir / (base_stem + ".png");
-        if (!fs::exists(base_png)) {
-            RuntimeLogger::warn("[PNG融合] 未找到基础图，跳过: overlay=" + overlay.filename().string() +
-                                ", expected_base=" + base_png.filename().string());
-            continue;
-        }
+static inline fs::path export_fingerprint_path(const fs::path &target)
+{
+    return target.parent_path() / ("." + target.filename().string() + ".fingerprint");
+}
 
-        fs::path out_png = out_dir / (overlay_stem + "_fused.png");
-        blend_png_with_markedpng(base_png, overlay, out_png);
-        ++fused_count;
-    }
+static inline std::string read_export_fingerprint(const fs::path &target)
+{
+    const fs::path path = export_fingerprint_path(target);
+    if (!fs::exists(path)) return {};
+    std::string text = read_text_file(path);
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back())) != 0) text.pop_back();
+    return text;
+}
 
-    if (fused_count == 0) {
-        std::error_code ec;
-        fs::remove_all(out_dir, ec);
-        throw std::runtime_error("未生成任何融合PNG");
-    }
-    return out_dir;
+static inline void write_export_fingerprint(const fs::path &target, const std::string &fingerprint)
+{
+    write_text_file(export_fingerprint_path(target), fingerprint);
+}
+
+// 按导出目标路径分配的互斥锁：同一目标的指纹检查与重建串行执行，不同目标互不阻塞
+static inline std::mutex &export_path_mutex(const fs::path &target)
+{
+    static std::mutex map_mtx;
+    static std::unordered_map<std::string, std::unique_ptr<std::mutex>> mutexes;
+    std::lock_guard<std::mutex> lk(map_mtx);
+    auto &slot = mutexes[target.lexically_normal().string()];
+    if (!slot) slot = std::make_unique<std::mutex>();
+    return *slot;
+}
+
+// 项目顶层与 npz/ 同级的 dcm/、nii/ 可能存放用户上传的原始文件；其余导出目录都只由 npz 生成
+static inline bool is_uploaded_source_dir(const fs::path &npz_dir, const fs::path &out_dir)
+{
+    return npz_dir.filename() == "npz" && out_dir.parent_path() == npz_dir.parent_path();
 }
 
-static inline void ensure_converted_from_npz_dir(const fs::path &npz_dir,
+// 逐切片导出 dcm/nii。输出目录附带源 npz 指纹：指纹一致直接复用，不一致则在暂存目录中并行重建后整体替换。
+// 上传原始数据的目录非空但没有指纹文件时保持不动，其余目录缺指纹即视为过期。同一输出目录的检查与重建串行执行。
+// 返回值表示本次是否实际执行了转换。
+static inline bool ensure_converted_from_npz_dir(const fs::path &npz_dir,
                                                  const fs::path &out_dir,
                                                  const std::string &target,
                                                  const std::string &npz_key)
 {
-    auto existing = list_files(out_dir);
-    if (!existing.empty()) {
-        RuntimeLogger::info("[npz转" + target + "] 跳过: 目标目录已有文件, dir=" + out_dir.string());
-        return;
+    if (target != "dcm" && target != "nii") {
+        throw std::runtime_error("未知转换目标: " + target);
+    }
+    std::lock_guard<std::mutex> lk(export_path_mutex(out_dir));
+    const bool has_existing = !list_files(out_dir).empty();
+    const std::string stored = read_export_fingerprint(out_dir);
+    if (has_existing && stored.empty() && is_uploaded_source_dir(npz_dir, out_dir)) {
+        RuntimeLogger::info("[npz转" + target + "] 跳过: 目标目录已有原始文件, dir=" + out_dir.string());
+        return false;
     }
 
     if (!fs::exists(npz_dir)) {
         throw std::runtime_error("源npz目录不存在，无法转换");
     }
+    const std::string fingerprint = fingerprint_npz_dir(npz_dir, target + "|" + npz_key);
+    if (has_existing && stored == fingerprint) {
+        RuntimeLogger::info("[npz转" + target + "] 跳过: 源npz未变化, dir=" + out_dir.string());
+        return false;
+    }
+
+    const auto npz_files = list_npz_files_natural(npz_dir);
+    if (npz_files.empty()) {
+        throw std::runtime_error("源npz目录为空，无法转换");
+    }
+    RuntimeLogger::info("[npz转" + target + "] 开始批量转换: src_dir=" + npz_dir.string() + ", out_dir=" + out_dir.string() +
+                        ", count=" + std::to_string(npz_files.size()) + (has_existing ? ", 原因=源npz已变化" : ""));
+
+    std::error_code ec;
+    const fs::path staging_dir = out_dir.parent_path() / (out_dir.filename().string() + ".staging" + random_hex_id(8));
+    fs::remove_all(staging_dir, ec);
+    fs::create_directories(staging_dir);
+    try {
+        parallel_for_each_index(npz_files.size(), [&](size_t i) {
+            const fs::path &src = npz_files[i];
+            if (target == "dcm") {
+                npz_to_dcm(src, staging_dir / (src.stem().string() + ".dcm"), npz_key);
+            } else {
+                npz_to_nii(src, staging_dir / (src.stem().string() + ".nii"), npz_key);
+            }
+        });
+    } catch (...) {
+        fs::remove_all(staging_dir, ec);
+        throw;
+    }
 
-    RuntimeLogger::info("[npz转" + target + "] 开始批量转换: src_dir=" + npz_dir.string() + ", out_dir=" + out_dir.string());
+    fs::remove_all(out_dir, ec);
+    fs::rename(staging_dir, out_dir, ec);
+    if (ec) {
+        fs::remove_all(staging_dir, ec);
+        throw std::runtime_error("替换导出目录失败: " + out_dir.string());
+    }
+    write_export_fingerprint(out_dir, fingerprint);
+    RuntimeLogger::info("[npz转" + target + "] 完成批量转换: count=" + std::to_string(npz_files.size()));
+    return true;
+}
 
-    fs::create_directories(out_dir);
-    auto npz_files = list_files(npz_dir);
-    size_t converted = 0;
-    for (const auto &src : npz_files) {
-        if (to_lower_copy(src.extension().string()) != ".npz") continue;
-        if (target == "dcm") {
-            fs::path dst = out_dir / (src.stem().string() + ".dcm");
-            npz_to_dcm(src, dst, npz_key);
-            ++converted;
-        } else if (target == "nii") {
-            fs::path dst = out_dir / (src.stem().string() + ".nii");
-            npz_to_nii(src, dst, npz_key);
-            ++converted;
-        } else {
-            throw std::runtime_error("未知转换目标: " + target);
+// 单张融合图：原图取自基础 npz，标注取自标注 npz（可为同一文件），尺寸不一致时标注按最近邻缩放
+static inline void render_fused_png_from_npz(const fs::path &base_npz, const fs::path &label_npz, const fs::path &out_png)
+{
+    std::vector<npzproc::ZipEntry> base_entries = npzproc::load_npz_entries(base_npz);
+    const npzproc::ZipEntry *raw_entry = nullptr;
+    const npzproc::ZipEntry *ann_entry = nullptr;
+    find_npz_render_entries(base_entries, raw_entry, ann_entry);
+    cv::Mat gray = slice_render::normalize_mat_to_u8(slice_render::npy_entry_to_mat(*raw_entry));
+
+    std::vector<npzproc::ZipEntry> label_entries;
+    if (label_npz != base_npz) {
+        label_entries = npzproc::load_npz_entries(label_npz);
+        const npzproc::ZipEntry *label_raw = nullptr;
+        find_npz_render_entries(label_entries, label_raw, ann_entry);
+    }
+    cv::Mat classes = ann_entry ? slice_render::label_mat_to_classes(slice_render::npy_entry_to_mat(*ann_entry))
+                                : cv::Mat(gray.rows, gray.cols, CV_8U, cv::Scalar(0));
+    if (classes.size() != gray.size()) {
+        cv::resize(classes, classes, gray.size(), 0, 0, cv::INTER_NEAREST);
+    }
+    slice_render::write_png(out_png, slice_render::render_fused_slice(gray, classes));
+}
+
+// 融合图目录：按标注 npz 逐张并行渲染并持久化到 out_dir；源 npz 与 PNG 参数未变化时直接复用
+static inline void ensure_fused_pngs_from_npz(const fs::path &base_npz_dir,
+                                              const fs::path &label_npz_dir,
+                                              const fs::path &out_dir,
+                                              const std::string &marked_suffix)
+{
+    if (!fs::exists(base_npz_dir)) throw std::runtime_error("基础npz目录不存在");
+    if (!fs::exists(label_npz_dir)) throw std::runtime_error("标注npz目录不存在");
+
+    // 同一输出目录的检查与重建串行执行，不同项目互不阻塞
+    std::lock_guard<std::mutex> lk(export_path_mutex(out_dir));
+
+    const auto &png = slice_render::png_options();
+    uint64_t h = 1469598103934665603ULL;
+    const std::string salt = "fused|" + marked_suffix + "|png=" + std::to_string(png.compression) + "," + std::to_string(png.strategy);
+    fnv1a_update(h, salt.data(), salt.size() + 1);
+    fingerprint_dir_listing(h, label_npz_dir);
+    if (label_npz_dir != base_npz_dir) fingerprint_dir_listing(h, base_npz_dir);
+    std::ostringstream fp;
+    fp << std::hex << std::setw(16) << std::setfill('0') << h;
+    const std::string fingerprint = fp.str();
+    if (!list_files(out_dir).empty() && read_export_fingerprint(out_dir) == fingerprint) {
+        RuntimeLogger::info("[PNG融合] 跳过: 源npz未变化, dir=" + out_dir.string());
+        return;
+    }
+
+    std::vector<std::pair<fs::path, fs::path>> jobs;
+    for (const auto &label_npz : list_npz_files_natural(label_npz_dir)) {
+        const std::string base_stem = derive_base_png_stem(label_npz.stem().string());
+        fs::path base_npz = base_npz_dir / (base_stem + ".npz");
+        if (!fs::exists(base_npz)) {
+            RuntimeLogger::warn("[PNG融合] 未找到基础npz，跳过: label=" + label_npz.filename().string() +
+                                ", expected_base=" + base_npz.filename().string());
+            continue;
         }
+        jobs.emplace_back(std::move(base_npz), label_npz);
     }
+    if (jobs.empty()) throw std::runtime_error("未生成任何融合PNG");
+    RuntimeLogger::info("[PNG融合] 开始批量渲染: out_dir=" + out_dir.string() + ", count=" + std::to_string(jobs.size()));
 
-    if (converted == 0) {
-        throw std::runtime_error("源npz目录为空，无法转换");
+    std::error_code ec;
+    const fs::path staging_dir = out_dir.parent_path() / (out_dir.filename().string() + ".staging" + random_hex_id(8));
+    fs::remove_all(staging_dir, ec);
+    fs::create_directories(staging_dir);
+    try {
+        parallel_for_each_index(jobs.size(), [&](size_t i) {
+            const auto &[base_npz, label_npz] = jobs[i];
+            render_fused_png_from_npz(base_npz, label_npz,
+                                      staging_dir / (label_npz.stem().string() + marked_suffix + "_fused.png"));
+        });
+    } catch (...) {
+        fs::remove_all(staging_dir, ec);
+        throw;
+    }
+
+    fs::remove_all(out_dir, ec);
+    fs::rename(staging_dir, out_dir, ec);
+    if (ec) {
+        fs::remove_all(staging_dir, ec);
+        throw std::runtime_error("替换融合图目录失败: " + out_dir.string());
     }
-    RuntimeLogger::info("[npz转" + target + "] 完成批量转换: count=" + std::to_string(converted));
+    write_export_fingerprint(out_dir, fingerprint);
+    RuntimeLogger::info("[PNG融合] 完成批量渲染: count=" + std::to_string(jobs.size()));
 }
 
-static inline crow::response make_file_list_response(const fs::path &dir)
+static inline fs::path nii_volume_file_path(const fs::path &volume_dir, bool gzip)
 {
-    return make_json_ok_response(json_filename_array(list_files(dir)));
+    return volume_dir / (gzip ? "volume.nii.gz" : "volume.nii");
 }
 
-static inline crow::response make_binary_file_response(const fs::path &path,
-                                                       const std::string &content_type)
+static inline fs::path nii_volume_sidecar_path(const fs::path &volume_dir)
 {
-    if (!fs::exists(path)) throw std::runtime_error("file not found");
-    crow::response r{read_text_file(path)};
-    r.set_header("Content-Type", content_type);
-    r.set_header("Access-Control-Allow-Origin", "*");
-    r.code = 200;
-    return r;
+    return volume_dir / "volume.roundtrip.zip";
 }
 
-static inline crow::response make_zip_response(const fs::path &dir,
-                                               const std::string &zip_name,
-                                               const std::string &download_name)
+// rebuilt 非空时写入本次是否重新生成
+static inline fs::path ensure_nii_volume_from_npz_dir(const fs::path &npz_dir,
+                                                      const fs::path &volume_dir,
+                                                      const std::string &npz_key,
+                                                      bool gzip,
+                                                      bool *rebuilt = nullptr)
 {
-    auto zip_path = create_zip_store(dir, zip_name);
-    crow::response r{read_text_file(zip_path)};
-    r.set_header("Content-Type", "application/zip");
-    r.set_header("Content-Disposition", "attachment; filename=\"" + download_name + "\"");
-    return r;
+    if (rebuilt != nullptr) *rebuilt = false;
+    if (!fs::exists(npz_dir)) {
+        throw std::runtime_error("源npz目录不存在，无法转换");
+    }
+    const fs::path out_path = nii_volume_file_path(volume_dir, gzip);
+    std::lock_guard<std::mutex> lk(export_path_mutex(out_path));
+    const std::string fingerprint = fingerprint_npz_dir(npz_dir, "nii-volume|" + npz_key);
+    if (fs::exists(out_path) && read_export_fingerprint(out_path) == fingerprint) {
+        RuntimeLogger::info("[npz转nii体数据] 跳过: 源npz未变化, file=" + out_path.string());
+        return out_path;
+    }
+    export_npz_dir_to_nii_volume(npz_dir, out_path, npz_key);
+    write_export_fingerprint(out_path, fingerprint);
+    if (rebuilt != nullptr) *rebuilt = true;
+    return out_path;
 }
 
-static inline crow::response build_3d_model_project_dir_response(const fs::path &project_dir,
-                                                                 const std::string &project_label,
-                                                                 bool allow_raw_only_when_unprocessed = false)
+static inline fs::path ensure_nii_volume_sidecar(const fs::path &npz_dir,
+                                                 const fs::path &volume_dir,
+                                                 bool *rebuilt = nullptr)
 {
-    RuntimeLogger::info("[npz转glb] 开始3D模型转换: id=" + project_label);
-    fs::path project_json = project_dir / "project.json";
-    std::string json = read_text_file(project_json);
+    if (rebuilt != nullptr) *rebuilt = false;
+    if (!fs::exists(npz_dir)) {
+        throw std::runtime_error("源npz目录不存在，无法转换");
+    }
+    const fs::path out_path = nii_volume_sidecar_path(volume_dir);
+    std::lock_guard<std::mutex> lk(export_path_mutex(out_path));
+    const std::string fingerprint = fingerprint_npz_dir(npz_dir, "roundtrip");
+    if (fs::exists(out_path) && read_export_fingerprint(out_path) == fingerprint) return out_path;
+    export_npz_dir_roundtrip_sidecar(npz_dir, out_path);
+    write_export_fingerprint(out_path, fingerprint);
+    if (rebuilt != nullptr) *rebuilt = true;
+    return out_path;
+}
 
-    fs::path processed_npz_dir = project_dir / "processed" / "npzs";
-    const bool has_processed_npz = !list_files(processed_npz_dir).empty();
-    auto raw_val = extract_string_field(json, "raw");
-    const bool raw_markednpz = raw_val && to_lower_copy(*raw_val) == "markednpz";
+// 缓存中的一段文件内容及其强 ETag(内容一致则 ETag 一致)
+struct CachedBlob {
+    std::string data;
+    std::string etag;
+};
 
-    if (!has_processed_npz && !(allow_raw_only_when_unprocessed && raw_markednpz)) {
-        throw std::runtime_error("processed npz 为空");
+// 线程安全的字节 LRU 缓存，按值的总字节数限额
+class LruBytesCache {
+public:
+    using Value = std::shared_ptr<const CachedBlob>;
+
+    explicit LruBytesCache(size_t capacity_bytes) : capacity_(capacity_bytes) {}
+
+    Value get(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        order_.splice(order_.begin(), order_, it->second);
+        return it->second->second;
+    }
+
+    void put(const std::string &key, Value value)
+    {
+        if (!value || value->data.size() > capacity_) return;
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            used_ -= it->second->second->data.size();
+            order_.erase(it->second);
+            index_.erase(it);
+        }
+        order_.emplace_front(key, std::move(value));
+        index_[key] = order_.begin();
+        used_ += order_.front().second->data.size();
+        while (used_ > capacity_ && !order_.empty()) {
+            const size_t bytes = order_.back().second->data.size();
+            used_ -= bytes;
+            evicted_bytes_ += bytes;
+            index_.erase(order_.back().first);
+            order_.pop_back();
+        }
     }
 
-    std::error_code ec;
-    npz_to_glb::Options opts;
-    opts.use_raw_threshold = true;
+    uint64_t hits() const { return hits_.load(); }
+    uint64_t misses() const { return misses_.load(); }
+    uint64_t evicted_bytes() const { return evicted_bytes_.load(); }
+    size_t used_bytes()
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        return used_;
+    }
+    size_t capacity_bytes() const { return capacity_; }
 
-    if (has_processed_npz) {
-        fs::path out_dir = project_dir / "3d";
-        fs::remove_all(out_dir, ec);
-        fs::create_directories(out_dir);
-        fs::path out_glb = out_dir / "model.glb";
-        npz_to_glb::convert_directory_to_glb(processed_npz_dir, out_glb, opts);
-        RuntimeLogger::info("[npz转glb] 生成processed模型: " + out_glb.string() + ", id=" + project_label);
-    } else {
-        fs::remove_all(project_dir / "3d", ec);
-        RuntimeLogger::info("[npz转glb] 跳过processed模型生成，仅输出人工标注模型: id=" + project_label);
+private:
+    using Entry = std::pair<std::string, Value>;
+    std::mutex mtx_;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+    std::list<Entry> order_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evicted_bytes_{0};
+};
+
+// 分片 LRU：按键哈希落到互不干扰的分片，并发读取不同文件时不争同一把锁。
+// 分片数按容量收缩，保证单个分片至少能放下一个 max_entry_bytes 大小的值
+class ShardedLruBytesCache {
+public:
+    static constexpr size_t kMaxShards = 16;
+
+    ShardedLruBytesCache(size_t capacity_bytes, size_t max_entry_bytes)
+    {
+        const size_t count = std::clamp<size_t>(capacity_bytes / std::max<size_t>(max_entry_bytes, 1), 1, kMaxShards);
+        for (size_t i = 0; i < count; ++i) {
+            shards_.push_back(std::make_unique<LruBytesCache>(capacity_bytes / count));
+        }
     }
 
-    if (raw_markednpz) {
-        fs::path og_dir = project_dir / "OG3d";
-        fs::remove_all(og_dir, ec);
-        fs::create_directories(og_dir);
-        fs::path og_glb = og_dir / "model.glb";
-        fs::path raw_npz_dir = project_dir / "npz";
-        npz_to_glb::convert_directory_to_glb(raw_npz_dir, og_glb, opts);
-        RuntimeLogger::info("[npz转glb] 生成原始模型: " + og_glb.string() + ", id=" + project_label);
+    LruBytesCache::Value get(const std::string &key) { return shard(key).get(key); }
+    void put(const std::string &key, LruBytesCache::Value value) { shard(key).put(key, std::move(value)); }
+
+    uint64_t hits() const { return sum([](const LruBytesCache &c) { return c.hits(); }); }
+    uint64_t misses() const { return sum([](const LruBytesCache &c) { return c.misses(); }); }
+    uint64_t evicted_bytes() const { return sum([](const LruBytesCache &c) { return c.evicted_bytes(); }); }
+    size_t used_bytes()
+    {
+        size_t total = 0;
+        for (auto &s : shards_) total += s->used_bytes();
+        return total;
     }
+    size_t capacity_bytes() const { return sum([](const LruBytesCache &c) { return c.capacity_bytes(); }); }
 
-    update_project_json_fields(project_json, {{"PD-3d", has_processed_npz ? "true" : "false"}});
-    RuntimeLogger::info("[npz转glb] 完成3D模型转换: id=" + project_label);
-    return make_json_ok_response("{\"status\":\"ok\"}");
+private:
+    LruBytesCache &shard(const std::string &key) { return *shards_[std::hash<std::string>{}(key) % shards_.size()]; }
+
+    template <typename Fn>
+    uint64_t sum(Fn &&fn) const
+    {
+        uint64_t total = 0;
+        for (const auto &s : shards_) total += fn(*s);
+        return total;
+    }
+
+    std::vector<std::unique_ptr<LruBytesCache>> shards_;
+};
+
+// 按需渲染: PNG 目录旁的 .{目录名}.lazy 记录源 npz 目录与渲染方式，目录中缺失的 PNG 在首次请求时从 npz 渲染
+struct LazyPngSource {
+    fs::path npz_dir;
+    bool marked = false;
+    std::string suffix;
+};
+
+inline constexpr size_t kLazyPngMemoryCacheBytes = 64ull << 20;
+inline constexpr uintmax_t kLazyPngDiskCacheBytes = 256ull << 20;
+// 磁盘缓存累计新写入达到任一阈值后才扫描清理一次
+inline constexpr uintmax_t kLazyPngPruneIntervalBytes = 16ull << 20;
+inline constexpr size_t kLazyPngPruneIntervalFiles = 256;
+
+static inline fs::path lazy_png_marker_path(const fs::path &png_dir)
+{
+    return png_dir.parent_path() / ("." + png_dir.filename().string() + ".lazy");
 }
 
-static inline crow::response make_glb_download_response(const fs::path &glb_path)
+static inline fs::path lazy_png_cache_dir(const fs::path &png_dir)
 {
-    if (!fs::exists(glb_path)) throw std::runtime_error("3d model not found");
-    crow::response r{read_text_file(glb_path)};
-    r.set_header("Content-Type", "model/gltf-binary");
-    r.set_header("Content-Disposition", "attachment; filename=\"model.glb\"");
-    return r;
+    return png_dir.parent_path() / ("." + png_dir.filename().string() + ".render_cache");
+}
+
+static inline LruBytesCache &lazy_png_memory_cache()
+{
+    static LruBytesCache cache(kLazyPngMemoryCacheBytes);
+    return cache;
+}
+
+static inline std::optional<LazyPngSource> read_lazy_png_source(const fs::path &png_dir)
+{
+    const fs::path marker = lazy_png_marker_path(png_dir);
+    if (!fs::exists(marker)) return std::nullopt;
+    std::ifstream ifs(marker, std::ios::binary);
+    LazyPngSource src;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        const auto eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        const std::string key = line.substr(0, eq);
+        const std::string value = line.substr(eq + 1);
+        if (key == "npz_dir") src.npz_dir = (png_dir / value).lexically_normal();
+        else if (key == "marked") src.marked = value == "1";
+        else if (key == "suffix") src.suffix = value;
+    }
+    if (src.npz_dir.empty()) return std::nullopt;
+    return src;
+}
+
+static inline void clear_lazy_png_dir(const fs::path &png_dir)
+{
+    std::error_code ec;
+    fs::remove(lazy_png_marker_path(png_dir), ec);
+    fs::remove_all(lazy_png_cache_dir(png_dir), ec);
+}
+
+// 以空目录加标记替代逐张写 PNG；旧的 PNG 与渲染缓存一并清除，避免与新 npz 不一致
+static inline void register_lazy_png_dir(const fs::path &npz_dir,
+                                         const fs::path &png_dir,
+                                         bool marked,
+                                         const std::string &suffix)
+{
+    std::error_code ec;
+    fs::remove_all(png_dir, ec);
+    clear_lazy_png_dir(png_dir);
+    fs::create_directories(png_dir);
+    std::ofstream ofs(lazy_png_marker_path(png_dir), std::ios::binary | std::ios::trunc);
+    ofs << "npz_dir=" << npz_dir.lexically_relative(png_dir).generic_string() << "\n"
+        << "marked=" << (marked ? "1" : "0") << "\n"
+        << "suffix=" << suffix << "\n";
+    if (!ofs) throw std::runtime_error("写入按需渲染标记失败: " + png_dir.string());
+    RuntimeLogger::info("[按需渲染] 已登记: png_dir=" + png_dir.string() + ", npz_dir=" + npz_dir.string() +
+                        ", marked=" + (marked ? std::string("true") : std::string("false")));
+}
+
+static inline std::vector<std::string> lazy_png_names(const LazyPngSource &src)
+{
+    std::vector<std::string> names;
+    for (const auto &p : list_files(src.npz_dir)) {
+        if (to_lower_copy(p.extension().string()) != ".npz") continue;
+        names.push_back(p.stem().string() + src.suffix + ".png");
+    }
+    return names;
+}
+
+static inline fs::path lazy_png_source_npz(const LazyPngSource &src, const std::string &filename)
+{
+    fs::path name(filename);
+    if (to_lower_copy(name.extension().string()) != ".png") throw std::runtime_error("file not found");
+    std::string stem = name.stem().string();
+    if (!src.suffix.empty()) {
+        if (stem.size() <= src.suffix.size() ||
+            stem.compare(stem.size() - src.suffix.size(), src.suffix.size(), src.suffix) != 0) {
+            throw std::runtime_error("file not found");
+        }
+        stem.resize(stem.size() - src.suffix.size());
+    }
+    fs::path npz_path = src.npz_dir / (stem + ".npz");
+    if (!fs::exists(npz_path)) throw std::runtime_error("file not found");
+    return npz_path;
+}
+
+// 记录一次磁盘缓存写入；距上次清理累计的字节数或文件数超过阈值时返回 true，由本次调用负责清理
+static inline bool lazy_png_disk_prune_due(const fs::path &cache_dir, uintmax_t written)
+{
+    struct Pending {
+        uintmax_t bytes = 0;
+        size_t files = 0;
+    };
+    static std::mutex mtx;
+    static std::unordered_map<std::string, Pending> pending;
+    std::lock_guard<std::mutex> lk(mtx);
+    Pending &p = pending[cache_dir.string()];
+    p.bytes += written;
+    ++p.files;
+    if (p.bytes < kLazyPngPruneIntervalBytes && p.files < kLazyPngPruneIntervalFiles) return false;
+    p = Pending{};
+    return true;
+}
+
+static inline void prune_lazy_png_disk_cache(const fs::path &cache_dir)
+{
+    std::vector<std::pair<fs::file_time_type, fs::path>> files;
+    uintmax_t total = 0;
+    std::error_code ec;
+    for (fs::directory_iterator it(cache_dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entry_ec;
+        if (!it->is_regular_file(entry_ec) || it->path().extension() != ".png") continue;
+        const uintmax_t size = it->file_size(entry_ec);
+        if (entry_ec) continue;
+        const auto mtime = it->last_write_time(entry_ec);
+        if (entry_ec) continue;
+        total += size;
+        files.emplace_back(mtime, it->path());
+    }
+    if (total <= kLazyPngDiskCacheBytes) return;
+    std::sort(files.begin(), files.end());
+    for (const auto &f : files) {
+        if (total <= kLazyPngDiskCacheBytes) break;
+        const uintmax_t size = fs::file_size(f.second, ec);
+        if (!ec && fs::remove(f.second, ec)) total -= size;
+    }
+}
+
+// 渲染结果按 (npz 内容 CRC, 大小, 渲染方式, PNG 编码参数) 缓存：先查内存 LRU，再查磁盘缓存，最后才解码 npz
+static inline LruBytesCache::Value render_lazy_png(const fs::path &png_dir,
+                                                   const LazyPngSource &src,
+                                                   const std::string &filename)
+{
+    const fs::path npz_path = lazy_png_source_npz(src, filename);
+    const auto &options = slice_render::png_options();
+    std::ostringstream key;
+    key << std::hex << std::setw(8) << std::setfill('0') << file_content_crc32(npz_path) << std::dec
+        << "-" << fs::file_size(npz_path) << "-" << (src.marked ? "m" : "r")
+        << "-l" << options.compression << "s" << options.strategy;
+    const std::string cache_key = key.str();
+
+    auto &memory = lazy_png_memory_cache();
+    if (auto hit = memory.get(cache_key)) return hit;
+
+    const fs::path cache_dir = lazy_png_cache_dir(png_dir);
+    const fs::path cache_path = cache_dir / (cache_key + ".png");
+    if (fs::exists(cache_path)) {
+        auto bytes = std::make_shared<const CachedBlob>(CachedBlob{read_text_file(cache_path), "\"" + cache_key + "\""});
+        std::error_code ec;
+        fs::last_write_time(cache_path, fs::file_time_type::clock::now(), ec);
+        memory.put(cache_key, bytes);
+        return bytes;
+    }
+
+    std::vector<npzproc::ZipEntry> entries = npzproc::load_npz_entries(npz_path);
+    const npzproc::ZipEntry *raw_entry = nullptr;
+    const npzproc::ZipEntry *ann_entry = nullptr;
+    find_npz_render_entries(entries, raw_entry, ann_entry);
+    cv::Mat image;
+    if (src.marked) {
+        const npzproc::NpyMeta meta = npzproc::parse_npy_meta(raw_entry->data);
+        if (meta.shape.size() != 2) throw std::runtime_error("仅支持2D数组: " + raw_entry->name);
+        image = render_npz_label_overlay(ann_entry, static_cast<int>(meta.shape[0]), static_cast<int>(meta.shape[1]));
+    } else {
+        image = slice_render::normalize_mat_to_u8(slice_render::npy_entry_to_mat(*raw_entry));
+    }
+    std::vector<uchar> encoded;
+    if (!cv::imencode(".png", image, encoded, slice_render::png_write_params())) {
+        throw std::runtime_error("PNG编码失败: " + filename);
+    }
+    auto bytes = std::make_shared<const CachedBlob>(
+        CachedBlob{std::string(encoded.begin(), encoded.end()), "\"" + cache_key + "\""});
+
+    std::error_code ec;
+    fs::create_directories(cache_dir, ec);
+    const fs::path tmp_path = cache_path.string() + ".part" + random_hex_id(4);
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+        ofs.write(bytes->data.data(), static_cast<std::streamsize>(bytes->data.size()));
+    }
+    fs::rename(tmp_path, cache_path, ec);
+    if (ec) fs::remove(tmp_path, ec);
+    if (lazy_png_disk_prune_due(cache_dir, bytes->data.size())) prune_lazy_png_disk_cache(cache_dir);
+
+    memory.put(cache_key, bytes);
+    RuntimeLogger::debug("[按需渲染] 渲染完成: " + (png_dir / filename).string());
+    return bytes;
+}
+
+// 打包下载等需要完整目录的场景：把尚未落盘的 PNG 并行渲染到目录中
+static inline void materialize_lazy_png_dir(const fs::path &png_dir)
+{
+    const auto src = read_lazy_png_source(png_dir);
+    if (!src) return;
+    std::vector<std::string> missing;
+    for (const auto &name : lazy_png_names(*src)) {
+        if (!fs::exists(png_dir / name)) missing.push_back(name);
+    }
+    if (missing.empty()) return;
+    RuntimeLogger::info("[按需渲染] 补全目录: " + png_dir.string() + ", count=" + std::to_string(missing.size()));
+    fs::create_directories(png_dir);
+    parallel_for_each_index(missing.size(), [&](size_t i) {
+        auto bytes = render_lazy_png(png_dir, *src, missing[i]);
+        const fs::path out_path = png_dir / missing[i];
+        const fs::path tmp_path = out_path.string() + ".part" + random_hex_id(4);
+        std::error_code ec;
+        {
+            std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+            ofs.write(bytes->data.data(), static_cast<std::streamsize>(bytes->data.size()));
+            if (!ofs) {
+                ofs.close();
+                fs::remove(tmp_path, ec);
+                throw std::runtime_error("写入PNG失败: " + out_path.string());
+            }
+        }
+        fs::rename(tmp_path, out_path, ec);
+        if (ec) {
+            fs::remove(tmp_path, ec);
+            throw std::runtime_error("写入PNG失败: " + out_path.string());
+        }
+    });
+}
+
+// 初始化/推理/增强后的 PNG 生成入口：按需渲染模式下只登记标记，否则立即并行渲染
+static inline void prepare_slice_pngs(const fs::path &npz_dir,
+                                      const std::vector<fs::path> &npz_files,
+                                      const fs::path &png_dir,
+                                      const fs::path &marked_dir,
+                                      bool marked,
+                                      bool write_raw_png,
+                                      const std::string &marked_suffix)
+{
+    if (slice_render::png_options().lazy) {
+        if (write_raw_png) register_lazy_png_dir(npz_dir, png_dir, false, "");
+        if (marked) register_lazy_png_dir(npz_dir, marked_dir, true, marked_suffix);
+        return;
+    }
+    if (write_raw_png) clear_lazy_png_dir(png_dir);
+    if (marked) clear_lazy_png_dir(marked_dir);
+    convert_npz_files_to_pngs(npz_files, png_dir, marked_dir, marked, write_raw_png, marked_suffix);
+}
+
+// 目录中的切片文件，按需渲染目录额外包含尚未生成的文件名；顺序与列表接口一致
+static inline std::vector<fs::path> list_slice_files(const fs::path &dir)
+{
+    auto files = list_files(dir);
+    if (const auto src = read_lazy_png_source(dir)) {
+        for (const auto &name : lazy_png_names(*src)) {
+            if (!fs::exists(dir / name)) files.push_back(dir / name);
+        }
+        std::sort(files.begin(), files.end());
+    }
+    return files;
+}
+
+static inline crow::response make_file_list_response(const fs::path &dir)
+{
+    return make_json_ok_response(json_filename_array(list_slice_files(dir)));
+}
+
+struct ByteRange {
+    uintmax_t first = 0;
+    uintmax_t last = 0;
+    bool to_end = false;   // a- 或 -n 形式，请求一直读到文件末尾
+};
+
+// 显式闭区间 a-b 单次最多返回的字节数；读到末尾的区间不截断
+inline constexpr uintmax_t kMaxRangeResponseBytes = 16ull << 20;
+
+// 解析单段 Range(bytes=a-b / a- / -n)；多段或无法识别时返回空并按完整响应处理，越界时置 unsatisfiable
+static inline std::optional<ByteRange> parse_byte_range(const std::string &header, uintmax_t size, bool &unsatisfiable)
+{
+    unsatisfiable = false;
+    const std::string prefix = "bytes=";
+    if (header.compare(0, prefix.size(), prefix) != 0) return std::nullopt;
+    const std::string spec = header.substr(prefix.size());
+    if (spec.find(',') != std::string::npos) return std::nullopt;
+    const auto dash = spec.find('-');
+    if (dash == std::string::npos) return std::nullopt;
+    const std::string a = spec.substr(0, dash);
+    const std::string b = spec.substr(dash + 1);
+    auto all_digits = [](const std::string &t) {
+        return !t.empty() && std::all_of(t.begin(), t.end(), [](unsigned char c) { return std::isdigit(c) != 0; });
+    };
+    if ((!a.empty() && !all_digits(a)) || (!b.empty() && !all_digits(b)) || (a.empty() && b.empty())) {
+        return std::nullopt;
+    }
+
+    ByteRange range;
+    try {
+        if (a.empty()) {
+            const uintmax_t suffix = std::stoull(b);
+            if (suffix == 0 || size == 0) {
+                unsatisfiable = true;
+                return std::nullopt;
+            }
+            range.first = suffix >= size ? 0 : size - suffix;
+            range.last = size - 1;
+            range.to_end = true;
+        } else {
+            range.first = std::stoull(a);
+            if (!b.empty() && std::stoull(b) < range.first) return std::nullopt;
+            if (range.first >= size) {
+                unsatisfiable = true;
+                return std::nullopt;
+            }
+            range.last = b.empty() ? size - 1 : std::min<uintmax_t>(std::stoull(b), size - 1);
+            range.to_end = b.empty();
+        }
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+    return range;
+}
+
+// 以 (修改时间, 大小) 作为下载文件的校验值，供 If-Range 判断续传是否仍指向同一份文件
+static inline std::string file_validator_etag(const fs::path &path)
+{
+    std::ostringstream oss;
+    oss << "\"" << std::hex << static_cast<uint64_t>(fs::last_write_time(path).time_since_epoch().count())
+        << "-" << fs::file_size(path) << "\"";
+    return oss.str();
+}
+
+// 文件下载：完整请求由 Crow 直接从磁盘分块发送；Range 请求只读取所需区间(单次最多 16MB，客户端按 Content-Range 续取)；
+// HEAD 只返回头部。单个下载占用的内存与文件大小无关
+static inline crow::response make_streamed_file_response(const crow::request &req,
+                                                         const fs::path &path,
+                                                         const std::string &content_type,
+                                                         const std::string &download_name)
+{
+    if (!fs::exists(path)) throw std::runtime_error("file not found");
+    const uintmax_t size = fs::file_size(path);
+    const std::string etag = file_validator_etag(path);
+
+    crow::response r;
+    r.set_header("Content-Type", content_type);
+    if (!download_name.empty()) {
+        r.set_header("Content-Disposition", "attachment; filename=\"" + download_name + "\"");
+    }
+    r.set_header("Accept-Ranges", "bytes");
+    r.set_header("ETag", etag);
+    r.set_header("Access-Control-Allow-Origin", "*");
+    r.set_header("Access-Control-Expose-Headers", "ETag, Content-Range, Content-Disposition");
+
+    const std::string range_header = req.get_header_value("Range");
+    const std::string if_range = req.get_header_value("If-Range");
+    if (!range_header.empty() && (if_range.empty() || if_range == etag)) {
+        bool unsatisfiable = false;
+        const auto range = parse_byte_range(range_header, size, unsatisfiable);
+        if (unsatisfiable) {
+            r.code = 416;
+            r.set_header("Content-Range", "bytes */" + std::to_string(size));
+            return r;
+        }
+        // 读到末尾的区间（续传）若超过单次上限，截断会让客户端误以为下载完成：改为 200 从磁盘发送完整文件
+        if (range && !(range->to_end && range->last - range->first + 1 > kMaxRangeResponseBytes)) {
+            const uintmax_t last = std::min(range->last, range->first + kMaxRangeResponseBytes - 1);
+            const uintmax_t length = last - range->first + 1;
+            r.code = 206;
+            r.set_header("Content-Range", "bytes " + std::to_string(range->first) + "-" + std::to_string(last) +
+                                              "/" + std::to_string(size));
+            if (req.method == crow::HTTPMethod::HEAD) {
+                r.set_header("Content-Length", std::to_string(length));
+                return r;
+            }
+            std::ifstream ifs(path, std::ios::binary);
+            if (!ifs) throw std::runtime_error("无法读取文件");
+            ifs.seekg(static_cast<std::streamoff>(range->first));
+            r.body.resize(static_cast<size_t>(length));
+            ifs.read(&r.body[0], static_cast<std::streamsize>(length));
+            r.body.resize(static_cast<size_t>(ifs.gcount()));
+            return r;
+        }
+    }
+
+    r.code = 200;
+    if (req.method == crow::HTTPMethod::HEAD) {
+        r.set_header("Content-Length", std::to_string(size));
+        return r;
+    }
+    // set_static_file_info_unsafe 会按扩展名追加一个 Content-Type，之后再覆盖为调用方指定的类型，避免出现两个
+    r.set_static_file_info_unsafe(path.string());
+    r.set_header("Content-Type", content_type);
+    return r;
+}
+
+inline constexpr uintmax_t kHotFileMaxEntryBytes = 8ull << 20;
+
+// 热点文件缓存总容量，由 main 按 --file-cache-mb 在注册路由前设置
+static inline size_t &hot_file_cache_capacity_bytes()
+{
+    static size_t capacity = 256ull << 20;
+    return capacity;
+}
+
+static inline ShardedLruBytesCache &hot_file_cache()
+{
+    static ShardedLruBytesCache cache(hot_file_cache_capacity_bytes(), kHotFileMaxEntryBytes);
+    return cache;
+}
+
+static inline std::string make_strong_etag(const std::string &data)
+{
+    const uLong crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(data.data()), static_cast<uInt>(data.size()));
+    std::ostringstream oss;
+    oss << "\"" << std::hex << std::setw(8) << std::setfill('0') << crc << "-" << data.size() << "\"";
+    return oss.str();
+}
+
+// 文件内容按 (路径, 修改时间, 大小) 缓存；文件被覆盖后键随之变化，旧条目自然被 LRU 淘汰
+static inline LruBytesCache::Value load_file_cached(const fs::path &path)
+{
+    const uintmax_t size = fs::file_size(path);
+    const int64_t mtime = static_cast<int64_t>(fs::last_write_time(path).time_since_epoch().count());
+    const std::string key = path.string() + "|" + std::to_string(mtime) + "|" + std::to_string(size);
+    auto &cache = hot_file_cache();
+    if (size <= kHotFileMaxEntryBytes) {
+        if (auto hit = cache.get(key)) return hit;
+    }
+    CachedBlob blob;
+    blob.data = read_text_file(path);
+    blob.etag = make_strong_etag(blob.data);
+    auto value = std::make_shared<const CachedBlob>(std::move(blob));
+    if (size <= kHotFileMaxEntryBytes) cache.put(key, value);
+    return value;
+}
+
+// If-None-Match 采用弱比较：忽略 W/ 前缀，支持逗号分隔的多个值与 *
+static inline bool if_none_match_hit(const std::string &header, const std::string &etag)
+{
+    if (header.empty() || etag.empty()) return false;
+    std::stringstream ss(header);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        const auto first = item.find_first_not_of(" \t");
+        if (first == std::string::npos) continue;
+        item = item.substr(first, item.find_last_not_of(" \t") - first + 1);
+        if (item.rfind("W/", 0) == 0) item = item.substr(2);
+        if (item == "*" || item == etag) return true;
+    }
+    return false;
+}
+
+static inline crow::response make_cached_blob_response(const crow::request &req,
+                                                       const LruBytesCache::Value &blob,
+                                                       const std::string &content_type)
+{
+    crow::response r;
+    r.set_header("ETag", blob->etag);
+    r.set_header("Cache-Control", "no-cache");
+    r.set_header("Access-Control-Allow-Origin", "*");
+    r.set_header("Access-Control-Expose-Headers", "ETag");
+    if (if_none_match_hit(req.get_header_value("If-None-Match"), blob->etag)) {
+        r.code = 304;
+        return r;
+    }
+    r.body = blob->data;
+    r.set_header("Content-Type", content_type);
+    r.code = 200;
+    return r;
+}
+
+// 单张切片内容：已落盘的走热点缓存，按需渲染目录中尚未生成的走渲染缓存
+static inline LruBytesCache::Value load_slice_blob(const fs::path &path)
+{
+    if (fs::exists(path)) return load_file_cached(path);
+    const auto src = read_lazy_png_source(path.parent_path());
+    if (!src) throw std::runtime_error("file not found");
+    return render_lazy_png(path.parent_path(), *src, path.filename().string());
+}
+
+static inline crow::response make_binary_file_response(const crow::request &req,
+                                                       const fs::path &path,
+                                                       const std::string &content_type)
+{
+    if (fs::exists(path) &&
+        (!req.get_header_value("Range").empty() || fs::file_size(path) > kHotFileMaxEntryBytes)) {
+        return make_streamed_file_response(req, path, content_type, "");
+    }
+    return make_cached_blob_response(req, load_slice_blob(path), content_type);
+}
+
+// 窗宽窗位参数：wc/ww 或 preset 指定窗，colormap 与 invert 可单独使用；均未出现时返回空
+static inline std::optional<slice_render::WindowParams> parse_window_params(const crow::request &req)
+{
+    const char *wc = req.url_params.get("wc");
+    const char *ww = req.url_params.get("ww");
+    const char *preset = req.url_params.get("preset");
+    const char *colormap = req.url_params.get("colormap");
+    const char *invert = req.url_params.get("invert");
+    if (!wc && !ww && !preset && !colormap && !invert) return std::nullopt;
+
+    slice_render::WindowParams params;
+    if (preset) {
+        if (!slice_render::window_preset(preset, params.center, params.width)) {
+            throw std::runtime_error(std::string("invalid preset: ") + preset);
+        }
+        params.has_window = true;
+    }
+    if (wc || ww) {
+        if (!wc || !ww) throw std::runtime_error("wc and ww must be given together");
+        try {
+            params.center = std::stod(wc);
+            params.width = std::stod(ww);
+        } catch (const std::exception &) {
+            throw std::runtime_error("invalid wc/ww");
+        }
+        if (!std::isfinite(params.center) || !std::isfinite(params.width) || params.width < 1.0) {
+            throw std::runtime_error("invalid wc/ww");
+        }
+        params.has_window = true;
+    }
+    if (colormap) params.colormap = colormap;
+    int colormap_id = 0;
+    if (!slice_render::colormap_id(params.colormap, colormap_id)) {
+        throw std::runtime_error("invalid colormap: " + params.colormap);
+    }
+    params.invert = invert && std::string(invert) == "1";
+    return params;
+}
+
+// 按窗参数从源 npz 渲染单张 PNG；结果以 (npz, 修改时间, 大小, 参数, PNG 编码参数) 为键放入渲染缓存
+static inline crow::response make_windowed_png_response(const crow::request &req,
+                                                        const fs::path &npz_path,
+                                                        const slice_render::WindowParams &params)
+{
+    if (!fs::exists(npz_path)) throw std::runtime_error("file not found");
+    const auto &png = slice_render::png_options();
+    const std::string key = "win|" + npz_path.string() + "|" +
+                            std::to_string(fs::last_write_time(npz_path).time_since_epoch().count()) + "|" +
+                            std::to_string(fs::file_size(npz_path)) + "|" + params.key() + "|l" +
+                            std::to_string(png.compression) + "s" + std::to_string(png.strategy);
+    auto &cache = lazy_png_memory_cache();
+    LruBytesCache::Value blob = cache.get(key);
+    if (!blob) {
+        const auto entries = npzproc::load_npz_entries(npz_path);
+        const npzproc::ZipEntry *raw_entry = nullptr;
+        const npzproc::ZipEntry *ann_entry = nullptr;
+        find_npz_render_entries(entries, raw_entry, ann_entry);
+        const cv::Mat image = slice_render::render_windowed(slice_render::npy_entry_to_mat(*raw_entry), params);
+        std::vector<uchar> encoded;
+        if (!cv::imencode(".png", image, encoded, slice_render::png_write_params())) {
+            throw std::runtime_error("PNG编码失败: " + npz_path.string());
+        }
+        CachedBlob rendered;
+        rendered.data.assign(encoded.begin(), encoded.end());
+        rendered.etag = make_strong_etag(rendered.data);
+        blob = std::make_shared<const CachedBlob>(std::move(rendered));
+        cache.put(key, blob);
+    }
+    return make_cached_blob_response(req, blob, "image/png");
+}
+
+// png 目录中的文件对应 npz 目录中的同名 npz
+static inline crow::response make_slice_png_response(const crow::request &req,
+                                                     const fs::path &png_dir,
+                                                     const fs::path &npz_dir,
+                                                     const std::string &filename)
+{
+    if (const auto params = parse_window_params(req)) {
+        return make_windowed_png_response(req, npz_dir / (fs::path(filename).stem().string() + ".npz"), *params);
+    }
+    return make_binary_file_response(req, png_dir / filename, "image/png");
+}
+
+inline constexpr size_t kSliceBatchMaxEntries = 1024;
+
+// 批量切片图层名到目录的映射，与单张接口的路径一致
+static inline fs::path slice_layer_dir(const fs::path &project_dir, const std::string &layer)
+{
+    if (layer == "png") return project_dir / "png";
+    if (layer == "markedpng") return project_dir / "markedpng";
+    if (layer == "processed") return project_dir / "processed" / "pngs";
+    if (layer == "enhdb_png") return project_dir / "enhDBprocessed" / "pngs";
+    if (layer == "enhdb_markedpng") return project_dir / "enhDBprocessed" / "markedpngs";
+    throw std::runtime_error("invalid layer: " + layer);
+}
+
+static inline std::vector<std::string> split_csv_param(const char *value)
+{
+    std::vector<std::string> out;
+    if (value == nullptr) return out;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+static inline size_t parse_slice_index(const std::string &text)
+{
+    if (text.empty() || !std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c) != 0; })) {
+        throw std::runtime_error("invalid slice index: " + text);
+    }
+    return static_cast<size_t>(std::stoull(text));
+}
+
+// 批量切片：一次返回多个图层、多张切片，省去逐张请求的往返
+// 查询参数 layers=png,markedpng,...（默认 png）；indices=0,3,5 或 from=0&to=63（闭区间），下标对应各图层列表接口的顺序
+// 响应体: [u32 LE 索引长度][索引 JSON][各切片 PNG 依次拼接]，索引中的 offset 相对于数据区起点
+static inline crow::response make_slice_batch_response(const crow::request &req, const fs::path &project_dir)
+{
+    std::vector<std::string> layers = split_csv_param(req.url_params.get("layers"));
+    if (layers.empty()) layers.push_back("png");
+
+    std::vector<size_t> indices;
+    if (const char *list = req.url_params.get("indices")) {
+        for (const auto &item : split_csv_param(list)) indices.push_back(parse_slice_index(item));
+    } else {
+        const char *from = req.url_params.get("from");
+        const char *to = req.url_params.get("to");
+        const size_t first = from ? parse_slice_index(from) : 0;
+        const size_t last = to ? parse_slice_index(to) : first + 63;
+        if (last < first) throw std::runtime_error("invalid slice range");
+        for (size_t i = first; i <= last && i - first < kSliceBatchMaxEntries; ++i) indices.push_back(i);
+    }
+    if (indices.empty()) throw std::runtime_error("missing slice indices");
+
+    struct BatchItem {
+        std::string layer;
+        size_t index = 0;
+        fs::path path;
+        LruBytesCache::Value blob;
+    };
+    std::vector<BatchItem> items;
+    std::vector<std::pair<std::string, size_t>> missing;
+    for (const auto &layer : layers) {
+        const auto files = list_slice_files(slice_layer_dir(project_dir, layer));
+        for (size_t index : indices) {
+            if (index >= files.size()) {
+                missing.emplace_back(layer, index);
+                continue;
+            }
+            items.push_back(BatchItem{layer, index, files[index], nullptr});
+        }
+    }
+    if (items.size() > kSliceBatchMaxEntries) {
+        throw std::runtime_error("too many slices in one batch, max " + std::to_string(kSliceBatchMaxEntries));
+    }
+
+    // 热缓存命中时几乎无开销，未命中的读盘或渲染并行完成
+    parallel_for_each_index(items.size(), [&](size_t i) {
+        items[i].blob = load_slice_blob(items[i].path);
+    });
+
+    uint64_t h = 1469598103934665603ULL;
+    std::ostringstream index_json;
+    index_json << "{\"count\":" << items.size() << ",\"entries\":[";
+    size_t offset = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const auto &item = items[i];
+        const std::string name = item.path.filename().string();
+        if (i) index_json << ",";
+        index_json << "{\"layer\":\"" << json_escape(item.layer) << "\",\"index\":" << item.index
+                   << ",\"name\":\"" << json_escape(name) << "\",\"offset\":" << offset
+                   << ",\"length\":" << item.blob->data.size() << ",\"etag\":\"" << json_escape(item.blob->etag) << "\"}";
+        offset += item.blob->data.size();
+        fnv1a_update(h, item.layer.data(), item.layer.size() + 1);
+        fnv1a_update(h, name.data(), name.size() + 1);
+        fnv1a_update(h, item.blob->etag.data(), item.blob->etag.size());
+    }
+    index_json << "],\"missing\":[";
+    for (size_t i = 0; i < missing.size(); ++i) {
+        if (i) index_json << ",";
+        index_json << "{\"layer\":\"" << json_escape(missing[i].first) << "\",\"index\":" << missing[i].second << "}";
+    }
+    index_json << "]}";
+
+    std::ostringstream etag;
+    etag << "\"batch-" << std::hex << std::setw(16) << std::setfill('0') << h << "\"";
+
+    crow::response r;
+    r.set_header("ETag", etag.str());
+    r.set_header("Cache-Control", "no-cache");
+    r.set_header("Access-Control-Allow-Origin", "*");
+    r.set_header("Access-Control-Expose-Headers", "ETag");
+    if (if_none_match_hit(req.get_header_value("If-None-Match"), etag.str())) {
+        r.code = 304;
+        return r;
+    }
+
+    const std::string header = index_json.str();
+    std::string body;
+    body.reserve(4 + header.size() + offset);
+    const uint32_t header_len = static_cast<uint32_t>(header.size());
+    for (int i = 0; i < 4; ++i) body.push_back(static_cast<char>((header_len >> (8 * i)) & 0xFF));
+    body += header;
+    for (const auto &item : items) body += item.blob->data;
+
+    r.body = std::move(body);
+    r.set_header("Content-Type", "application/octet-stream");
+    r.code = 200;
+    return r;
+}
+
+inline constexpr size_t kRawVolumeMaxBytes = 1024ull << 20;
+
+static inline fs::path raw_volume_source_dir(const fs::path &project_dir, const std::string &source)
+{
+    if (source == "npz") return project_dir / "npz";
+    if (source == "processed") return project_dir / "processed" / "npzs";
+    if (source == "enhdb") return project_dir / "enhDBprocessed" / "npzs";
+    throw std::runtime_error("invalid source: " + source);
+}
+
+// 原始数组输出类型：auto 时与源 dtype 一致（不在支持列表内的退化为 float32）
+static inline std::string resolve_raw_dtype(const std::string &requested, const npzproc::DTypeInfo &src)
+{
+    if (requested == "uint8" || requested == "uint16" || requested == "int16" || requested == "float32") return requested;
+    if (requested != "auto") throw std::runtime_error("invalid dtype: " + requested);
+    if (src.kind == 'u' && src.item_size == 1) return "uint8";
+    if (src.kind == 'u' && src.item_size == 2) return "uint16";
+    if (src.kind == 'i' && src.item_size == 2) return "int16";
+    return "float32";
+}
+
+static inline size_t raw_dtype_size(const std::string &dtype)
+{
+    if (dtype == "uint8") return 1;
+    if (dtype == "float32") return 4;
+    return 2;
+}
+
+static inline bool raw_dtype_matches(const std::string &dtype, const npzproc::DTypeInfo &src)
+{
+    if (!src.little_endian) return false;
+    if (dtype == "uint8") return src.kind == 'u' && src.item_size == 1;
+    if (dtype == "uint16") return src.kind == 'u' && src.item_size == 2;
+    if (dtype == "int16") return src.kind == 'i' && src.item_size == 2;
+    return src.kind == 'f' && src.item_size == 4;
+}
+
+template <typename T>
+static inline void store_raw_values(const std::vector<double> &values, char *out)
+{
+    for (size_t i = 0; i < values.size(); ++i) {
+        T v;
+        if constexpr (std::is_floating_point_v<T>) {
+            v = static_cast<T>(values[i]);
+        } else {
+            const double clamped = std::clamp(std::round(values[i]),
+                                              static_cast<double>(std::numeric_limits<T>::min()),
+                                              static_cast<double>(std::numeric_limits<T>::max()));
+            v = static_cast<T>(clamped);
+        }
+        std::memcpy(out + i * sizeof(T), &v, sizeof(T));
+    }
+}
+
+// 单张切片写入输出缓冲：dtype 一致且为 C 顺序时直接复制 npy 数据区，否则解码后按目标类型饱和转换
+static inline void copy_npy_slice_as(const npzproc::ZipEntry &entry,
+                                     const std::string &dtype,
+                                     size_t h,
+                                     size_t w,
+                                     char *out)
+{
+    const auto meta = npzproc::parse_npy_meta(entry.data);
+    if (meta.shape.size() != 2 || meta.shape[0] != h || meta.shape[1] != w) {
+        throw std::runtime_error("切片尺寸不一致: " + entry.name);
+    }
+    const auto src = npzproc::parse_dtype(meta.descr);
+    const size_t bytes = h * w * raw_dtype_size(dtype);
+    if (!meta.fortran_order && raw_dtype_matches(dtype, src)) {
+        if (meta.data_offset + bytes > entry.data.size()) throw std::runtime_error("NPY 数据区长度不足: " + entry.name);
+        std::memcpy(out, entry.data.data() + meta.data_offset, bytes);
+        return;
+    }
+    const std::vector<double> values = npzproc::decode_numeric_data(entry.data, meta);
+    if (dtype == "uint8") store_raw_values<uint8_t>(values, out);
+    else if (dtype == "uint16") store_raw_values<uint16_t>(values, out);
+    else if (dtype == "int16") store_raw_values<int16_t>(values, out);
+    else store_raw_values<float>(values, out);
+}
+
+static inline const npzproc::ZipEntry *find_raw_volume_entry(const std::vector<npzproc::ZipEntry> &entries,
+                                                             const std::string &key)
+{
+    const npzproc::ZipEntry *raw_entry = nullptr;
+    const npzproc::ZipEntry *ann_entry = nullptr;
+    find_npz_render_entries(entries, raw_entry, ann_entry);
+    const npzproc::ZipEntry *entry = key == "label" ? ann_entry : raw_entry;
+    if (entry == nullptr) throw std::runtime_error("npz 中找不到" + std::string(key == "label" ? "标注" : "原图") + "数组");
+    return entry;
+}
+
+// 原始体数据：按切片顺序拼接为 C 顺序 [切片, 行, 列] 的小端数组，供前端在 GPU 上自行窗宽窗位
+// 查询参数 source=npz|processed|enhdb，key=image|label，slice=N 或 from/to（闭区间，缺省为整卷），
+// dtype=auto|uint8|uint16|int16|float32，deflate=1 时以 Content-Encoding: deflate 压缩，describe=1 只返回 JSON 描述
+static inline crow::response make_raw_volume_response(const crow::request &req, const fs::path &project_dir)
+{
+    auto param = [&](const char *name, const std::string &fallback) {
+        const char *v = req.url_params.get(name);
+        return v ? std::string(v) : fallback;
+    };
+    const std::string source = param("source", "npz");
+    const std::string key = param("key", "image");
+    if (key != "image" && key != "label") throw std::runtime_error("invalid key: " + key);
+    const auto npz_files = list_npz_files_natural(raw_volume_source_dir(project_dir, source));
+    if (npz_files.empty()) throw std::runtime_error("npz为空");
+
+    size_t first = 0;
+    size_t last = npz_files.size() - 1;
+    if (const char *slice = req.url_params.get("slice")) {
+        first = last = parse_slice_index(slice);
+    } else {
+        if (const char *from = req.url_params.get("from")) first = parse_slice_index(from);
+        if (const char *to = req.url_params.get("to")) last = parse_slice_index(to);
+    }
+    if (first > last || last >= npz_files.size()) throw std::runtime_error("invalid slice range");
+    const size_t depth = last - first + 1;
+    const bool deflate = param("deflate", "0") == "1";
+
+    const auto head_entries = npzproc::load_npz_entries(npz_files[first]);
+    const auto head_meta = npzproc::parse_npy_meta(find_raw_volume_entry(head_entries, key)->data);
+    if (head_meta.shape.size() != 2) throw std::runtime_error("仅支持2D切片");
+    const size_t h = head_meta.shape[0];
+    const size_t w = head_meta.shape[1];
+    const std::string dtype = resolve_raw_dtype(param("dtype", "auto"), npzproc::parse_dtype(head_meta.descr));
+    const std::vector<double> spacing = read_npz_spacing(head_entries);
+
+    std::ostringstream spacing_csv;
+    for (size_t i = 0; i < spacing.size(); ++i) spacing_csv << (i ? "," : "") << spacing[i];
+    std::ostringstream desc;
+    desc << "{\"shape\":[" << depth << "," << h << "," << w << "],\"dtype\":\"" << dtype
+         << "\",\"byte_order\":\"little\",\"spacing\":[" << spacing_csv.str() << "],\"first\":" << first
+         << ",\"last\":" << last << ",\"source\":\"" << source << "\",\"key\":\"" << key << "\"}";
+
+    // ETag 只取源文件名、大小与修改时间，未变化时无需解码即可返回 304；describe 的 JSON 与二进制体是不同表示，各自计入
+    const bool describe = param("describe", "0") == "1";
+    uint64_t hsh = 1469598103934665603ULL;
+    const std::string desc_str = desc.str() + (describe ? "|describe" : "") + (deflate ? "|deflate" : "");
+    fnv1a_update(hsh, desc_str.data(), desc_str.size());
+    for (size_t i = first; i <= last; ++i) {
+        const std::string name = npz_files[i].filename().string();
+        const uint64_t size = static_cast<uint64_t>(fs::file_size(npz_files[i]));
+        const int64_t mtime = static_cast<int64_t>(fs::last_write_time(npz_files[i]).time_since_epoch().count());
+        fnv1a_update(hsh, name.data(), name.size() + 1);
+        fnv1a_update(hsh, &size, sizeof(size));
+        fnv1a_update(hsh, &mtime, sizeof(mtime));
+    }
+    std::ostringstream etag;
+    etag << "\"raw-" << std::hex << std::setw(16) << std::setfill('0') << hsh << "\"";
+
+    crow::response r;
+    r.set_header("ETag", etag.str());
+    r.set_header("Cache-Control", "no-cache");
+    r.set_header("Access-Control-Allow-Origin", "*");
+    r.set_header("Access-Control-Expose-Headers", "ETag, X-Volume-Shape, X-Volume-Dtype, X-Volume-Spacing");
+    r.set_header("X-Volume-Shape", std::to_string(depth) + "," + std::to_string(h) + "," + std::to_string(w));
+    r.set_header("X-Volume-Dtype", dtype);
+    r.set_header("X-Volume-Spacing", spacing_csv.str());
+    if (describe) {
+        r.body = desc.str();
+        r.code = 200;
+        set_json_headers(r);
+        return r;
+    }
+    if (if_none_match_hit(req.get_header_value("If-None-Match"), etag.str())) {
+        r.code = 304;
+        return r;
+    }
+
+    const size_t slice_bytes = h * w * raw_dtype_size(dtype);
+    if (slice_bytes * depth > kRawVolumeMaxBytes) {
+        throw std::runtime_error("请求的数据量过大，请缩小切片范围");
+    }
+    std::string body(slice_bytes * depth, '\0');
+    parallel_for_each_index(depth, [&](size_t i) {
+        std::vector<npzproc::ZipEntry> loaded;
+        if (i > 0) loaded = npzproc::load_npz_entries(npz_files[first + i]);
+        copy_npy_slice_as(*find_raw_volume_entry(i > 0 ? loaded : head_entries, key), dtype, h, w, &body[i * slice_bytes]);
+    });
+
+    if (deflate) {
+        uLongf packed_size = compressBound(static_cast<uLong>(body.size()));
+        std::string packed(packed_size, '\0');
+        if (compress2(reinterpret_cast<Bytef *>(&packed[0]), &packed_size,
+                      reinterpret_cast<const Bytef *>(body.data()), static_cast<uLong>(body.size()), 1) != Z_OK) {
+            throw std::runtime_error("deflate 压缩失败");
+        }
+        packed.resize(packed_size);
+        body.swap(packed);
+        r.set_header("Content-Encoding", "deflate");
+    }
+    r.body = std::move(body);
+    r.set_header("Content-Type", "application/octet-stream");
+    r.code = 200;
+    return r;
+}
+
+// 打包结果缓存：键由源目录清单（相对路径、大小、修改时间）与打包参数共同决定，内容不变时重复下载直接复用。
+// Crow 在处理函数返回后才按路径打开文件，因此 get/put 交给调用方的是打包临时目录中的硬链接：
+// 之后缓存条目被淘汰或失效时直接删除缓存文件，已发出的链接仍指向完整内容，1 小时后随临时文件一起清理
+class ZipArchiveCache {
+public:
+    // dir 只属于当前进程（目录名带随机后缀），启动时创建、退出时删除，不影响共用临时目录的其他实例
+    ZipArchiveCache(fs::path dir, size_t capacity_bytes) : dir_(std::move(dir)), capacity_(capacity_bytes)
+    {
+        fs::create_directories(dir_);
+    }
+
+    ~ZipArchiveCache()
+    {
+        std::error_code ec;
+        fs::remove_all(dir_, ec);
+    }
+
+    ZipArchiveCache(const ZipArchiveCache &) = delete;
+    ZipArchiveCache &operator=(const ZipArchiveCache &) = delete;
+
+    std::optional<fs::path> get(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto it = index_.find(key);
+        if (it == index_.end() || !fs::exists(it->second.path)) {
+            ++misses_;
+            return std::nullopt;
+        }
+        order_.splice(order_.begin(), order_, it->second.order_it);
+        ++hits_;
+        return lease_locked(it->second.path);
+    }
+
+    // 将新建的归档移入缓存目录；超过容量的单个归档不缓存，直接返回原路径
+    fs::path put(const std::string &key, const fs::path &built_zip, std::vector<fs::path> sources)
+    {
+        const uint64_t size = static_cast<uint64_t>(fs::file_size(built_zip));
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (size > capacity_) return built_zip;
+        auto existing = index_.find(key);
+        if (existing != index_.end()) retire_locked(existing);
+
+        fs::path cached = dir_ / (key + ".zip");
+        fs::rename(built_zip, cached);
+        order_.push_front(key);
+        Entry entry;
+        entry.path = cached;
+        entry.size = size;
+        entry.sources = std::move(sources);
+        entry.order_it = order_.begin();
+        index_.emplace(key, std::move(entry));
+        used_ += size;
+        while (used_ > capacity_ && order_.size() > 1) {
+            auto victim = index_.find(order_.back());
+            evicted_ += victim->second.size;
+            retire_locked(victim);
+        }
+        return lease_locked(cached);
+    }
+
+    // 源目录位于 root 之下的归档全部失效
+    void invalidate(const fs::path &root)
+    {
+        const std::string prefix = fs::path(root).lexically_normal().generic_string();
+        std::lock_guard<std::mutex> lk(mtx_);
+        for (auto it = index_.begin(); it != index_.end();) {
+            const bool stale = std::any_of(it->second.sources.begin(), it->second.sources.end(), [&](const fs::path &src) {
+                const std::string s = src.lexically_normal().generic_string();
+                return s.compare(0, prefix.size(), prefix) == 0 &&
+                       (s.size() == prefix.size() || s[prefix.size()] == '/' || prefix.back() == '/');
+            });
+            auto next = std::next(it);
+            if (stale) retire_locked(it);
+            it = next;
+        }
+    }
+
+    uint64_t hits() const { std::lock_guard<std::mutex> lk(mtx_); return hits_; }
+    uint64_t misses() const { std::lock_guard<std::mutex> lk(mtx_); return misses_; }
+    uint64_t evicted_bytes() const { std::lock_guard<std::mutex> lk(mtx_); return evicted_; }
+    uint64_t used_bytes() const { std::lock_guard<std::mutex> lk(mtx_); return used_; }
+    uint64_t capacity_bytes() const { return capacity_; }
+
+private:
+    struct Entry {
+        fs::path path;
+        uint64_t size = 0;
+        std::vector<fs::path> sources;
+        std::list<std::string>::iterator order_it;
+    };
+
+    // 为一次响应创建指向缓存文件的硬链接并刷新修改时间（同一 inode 的所有链接共用），
+    // 保证链接在临时目录按 1 小时清理前可用；不支持硬链接时退回缓存文件本身
+    fs::path lease_locked(const fs::path &cached)
+    {
+        std::error_code ec;
+        const fs::path lease = zip_temp_dir() / ("lease_" + random_hex_id(8) + ".zip");
+        fs::create_hard_link(cached, lease, ec);
+        if (ec) return cached;
+        fs::last_write_time(lease, fs::file_time_type::clock::now(), ec);
+        return lease;
+    }
+
+    void retire_locked(std::unordered_map<std::string, Entry>::iterator it)
+    {
+        std::error_code ec;
+        fs::remove(it->second.path, ec);
+        used_ -= it->second.size;
+        order_.erase(it->second.order_it);
+        index_.erase(it);
+    }
+
+    fs::path dir_;
+    uint64_t capacity_ = 0;
+    mutable std::mutex mtx_;
+    std::list<std::string> order_;
+    std::unordered_map<std::string, Entry> index_;
+    uint64_t used_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t evicted_ = 0;
+};
+
+// 打包缓存总容量，由 main 按 --zip-cache-mb 在注册路由前设置，0 表示关闭
+static inline size_t &zip_archive_cache_capacity_bytes()
+{
+    static size_t capacity = 1024ull << 20;
+    return capacity;
+}
+
+static inline ZipArchiveCache &zip_archive_cache()
+{
+    static ZipArchiveCache cache(fs::temp_directory_path() / ("medimg_zip_cache_" + random_hex_id(8)),
+                                 zip_archive_cache_capacity_bytes());
+    return cache;
+}
+
+static inline void invalidate_zip_archive_cache(const fs::path &root)
+{
+    if (zip_archive_cache_capacity_bytes() == 0) return;
+    zip_archive_cache().invalidate(root);
+}
+
+inline constexpr int kAtlasScales[] = {2, 4, 8};
+
+static inline fs::path slice_atlas_dir(const fs::path &project_dir)
+{
+    return project_dir / "thumbnails";
+}
+
+static inline fs::path slice_atlas_path(const fs::path &project_dir, const std::string &layer, int scale)
+{
+    return slice_atlas_dir(project_dir) / (layer + "_" + std::to_string(scale) + ".png");
+}
+
+static inline fs::path slice_atlas_index_path(const fs::path &project_dir, const std::string &layer)
+{
+    return slice_atlas_dir(project_dir) / (layer + "_atlas.json");
+}
+
+static inline cv::Mat convert_tile_channels(const cv::Mat &tile, int channels)
+{
+    if (tile.channels() == channels) return tile;
+    static const int codes[5][5] = {
+        {-1, -1, -1, -1, -1},
+        {-1, -1, -1, cv::COLOR_GRAY2BGR, cv::COLOR_GRAY2BGRA},
+        {-1, -1, -1, -1, -1},
+        {-1, cv::COLOR_BGR2GRAY, -1, -1, cv::COLOR_BGR2BGRA},
+        {-1, cv::COLOR_BGRA2GRAY, -1, cv::COLOR_BGRA2BGR, -1},
+    };
+    const int code = codes[tile.channels()][channels];
+    if (code < 0) throw std::runtime_error("不支持的切片通道数");
+    cv::Mat out;
+    cv::cvtColor(tile, out, code);
+    return out;
+}
+
+// 先写同目录临时文件再重命名替换，读取方不会看到写了一半的文件
+static inline void replace_file_contents(const fs::path &path, const std::string &data)
+{
+    const fs::path tmp_path = path.string() + ".part" + random_hex_id(4);
+    std::error_code ec;
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+        ofs.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!ofs) {
+            ofs.close();
+            fs::remove(tmp_path, ec);
+            throw std::runtime_error("写入文件失败: " + path.string());
+        }
+    }
+    fs::rename(tmp_path, path, ec);
+    if (ec) {
+        fs::remove(tmp_path, ec);
+        throw std::runtime_error("重命名输出文件失败: " + path.string());
+    }
+}
+
+// 缩略图图集：图层中每张切片依次缩小到 1/2、1/4、1/8（每级由上一级 INTER_AREA 缩小），按行优先排入网格，
+// 每个缩放级别一张 PNG，另有 JSON 索引记录网格与文件名顺序；图层目录清单未变化时直接复用。
+// 同一项目的缩略图目录加锁重建，图集 PNG 先于索引替换，各文件均经临时文件重命名写出
+static inline void ensure_slice_atlas(const fs::path &project_dir, const std::string &layer)
+{
+    const fs::path layer_dir = slice_layer_dir(project_dir, layer);
+    if (!fs::exists(layer_dir)) throw std::runtime_error("图层目录不存在: " + layer);
+    materialize_lazy_png_dir(layer_dir);
+
+    std::lock_guard<std::mutex> lk(export_path_mutex(slice_atlas_dir(project_dir)));
+
+    const auto &png = slice_render::png_options();
+    uint64_t h = 1469598103934665603ULL;
+    const std::string salt = "atlas|" + std::to_string(png.compression) + "," + std::to_string(png.strategy);
+    fnv1a_update(h, salt.data(), salt.size() + 1);
+    fingerprint_dir_listing(h, layer_dir);
+    std::ostringstream fp;
+    fp << std::hex << std::setw(16) << std::setfill('0') << h;
+    const fs::path index_path = slice_atlas_index_path(project_dir, layer);
+    if (fs::exists(index_path) && read_export_fingerprint(index_path) == fp.str()) return;
+
+    std::vector<fs::path> files;
+    for (const auto &p : list_slice_files(layer_dir)) {
+        if (to_lower_copy(p.extension().string()) == ".png") files.push_back(p);
+    }
+    if (files.empty()) throw std::runtime_error("图层中没有切片: " + layer);
+    RuntimeLogger::info("[缩略图集] 开始生成: layer=" + layer + ", count=" + std::to_string(files.size()));
+
+    const size_t levels = std::size(kAtlasScales);
+    std::vector<std::vector<cv::Mat>> tiles(files.size(), std::vector<cv::Mat>(levels));
+    parallel_for_each_index(files.size(), [&](size_t i) {
+        cv::Mat src = cv::imread(files[i].string(), cv::IMREAD_UNCHANGED);
+        if (src.empty()) throw std::runtime_error("读取PNG失败: " + files[i].string());
+        for (size_t l = 0; l < levels; ++l) {
+            cv::resize(src, src, cv::Size(std::max(1, src.cols / 2), std::max(1, src.rows / 2)), 0, 0, cv::INTER_AREA);
+            tiles[i][l] = src.clone();
+        }
+    });
+
+    int channels = 1;
+    for (const auto &t : tiles) channels = std::max(channels, t[0].channels());
+    const int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(files.size()))));
+    const int rows = static_cast<int>((files.size() + columns - 1) / columns);
+
+    fs::create_directories(slice_atlas_dir(project_dir));
+    std::ostringstream index;
+    index << "{\"layer\":\"" << layer << "\",\"count\":" << files.size() << ",\"columns\":" << columns
+          << ",\"rows\":" << rows << ",\"levels\":[";
+    for (size_t l = 0; l < levels; ++l) {
+        int tile_w = 1;
+        int tile_h = 1;
+        for (const auto &t : tiles) {
+            tile_w = std::max(tile_w, t[l].cols);
+            tile_h = std::max(tile_h, t[l].rows);
+        }
+        cv::Mat atlas(rows * tile_h, columns * tile_w, CV_MAKETYPE(CV_8U, channels), cv::Scalar(0, 0, 0, 0));
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            const cv::Mat tile = convert_tile_channels(tiles[i][l], channels);
+            const int x = static_cast<int>(i % columns) * tile_w;
+            const int y = static_cast<int>(i / columns) * tile_h;
+            cv::Mat roi = atlas(cv::Rect(x, y, tile.cols, tile.rows));
+            tile.copyTo(roi);
+        }
+        const fs::path atlas_path = slice_atlas_path(project_dir, layer, kAtlasScales[l]);
+        std::vector<uchar> encoded;
+        if (!cv::imencode(".png", atlas, encoded, slice_render::png_write_params())) {
+            throw std::runtime_error("PNG编码失败: " + atlas_path.string());
+        }
+        replace_file_contents(atlas_path, std::string(encoded.begin(), encoded.end()));
+        if (l) index << ",";
+        index << "{\"scale\":" << kAtlasScales[l] << ",\"tile_width\":" << tile_w << ",\"tile_height\":" << tile_h
+              << ",\"file\":\"" << atlas_path.filename().string() << "\"}";
+    }
+    index << "],\"names\":" << json_filename_array(files) << "}";
+    replace_file_contents(index_path, index.str());
+    write_export_fingerprint(index_path, fp.str());
+    RuntimeLogger::info("[缩略图集] 生成完成: layer=" + layer + ", columns=" + std::to_string(columns) +
+                        ", rows=" + std::to_string(rows));
+}
+
+// 缩略图集接口：layer 同批量切片接口（默认 png），scale=2|4|8（默认 8），describe=1 返回索引 JSON
+static inline crow::response make_slice_atlas_response(const crow::request &req, const fs::path &project_dir)
+{
+    const char *layer_param = req.url_params.get("layer");
+    const std::string layer = layer_param ? layer_param : "png";
+    const char *scale_param = req.url_params.get("scale");
+    const std::string scale_text = scale_param ? scale_param : "8";
+    int scale = 0;
+    for (int s : kAtlasScales) {
+        if (scale_text == std::to_string(s)) scale = s;
+    }
+    if (scale == 0) throw std::runtime_error("invalid scale: " + scale_text);
+
+    ensure_slice_atlas(project_dir, layer);
+    const char *describe = req.url_params.get("describe");
+    if (describe && std::string(describe) == "1") {
+        return make_binary_file_response(req, slice_atlas_index_path(project_dir, layer), "application/json");
+    }
+    return make_binary_file_response(req, slice_atlas_path(project_dir, layer, scale), "image/png");
+}
+
+// 命中缓存直接返回缓存中的归档，否则调用 build 生成并放入缓存
+template <typename Build>
+static inline fs::path cached_zip_archive(const std::vector<fs::path> &source_dirs,
+                                          const std::string &options,
+                                          Build &&build)
+{
+    if (zip_archive_cache_capacity_bytes() == 0) return build();
+    uint64_t h = 1469598103934665603ULL;
+    fnv1a_update(h, options.data(), options.size() + 1);
+    for (const auto &dir : source_dirs) fingerprint_dir_listing(h, dir);
+    std::ostringstream oss;
+    oss << std::hex << std::setw(16) << std::setfill('0') << h;
+    const std::string key = oss.str();
+
+    auto &cache = zip_archive_cache();
+    if (auto hit = cache.get(key)) {
+        RuntimeLogger::info("[目录转zip] 命中缓存: " + hit->string());
+        return *hit;
+    }
+    return cache.put(key, build(), source_dirs);
+}
+
+static inline crow::response make_zip_response(const crow::request &req,
+                                               const fs::path &dir,
+                                               const std::string &zip_name,
+                                               const std::string &download_name)
+{
+    // 与导出目录的重建共用一把锁，补全与打包期间目录不会被整体替换，也不会打进补全中的临时文件
+    std::lock_guard<std::mutex> lk(export_path_mutex(dir));
+    materialize_lazy_png_dir(dir);
+    auto zip_path = cached_zip_archive({dir}, "zip|level=5", [&] { return create_zip_store(dir, zip_name); });
+    return make_streamed_file_response(req, zip_path, "application/zip", download_name);
+}
+
+// 融合图打包：融合图持久化在 fused_dir 中，打包再经过归档缓存，重复下载不再重新融合
+static inline crow::response make_fused_zip_response(const crow::request &req,
+                                                     const fs::path &base_npz_dir,
+                                                     const fs::path &label_npz_dir,
+                                                     const fs::path &fused_dir,
+                                                     const std::string &marked_suffix,
+                                                     const std::string &zip_name,
+                                                     const std::string &download_name)
+{
+    ensure_fused_pngs_from_npz(base_npz_dir, label_npz_dir, fused_dir, marked_suffix);
+    return make_zip_response(req, fused_dir, zip_name, download_name);
+}
+
+// nii 下载：默认导出单个 3D 体数据文件；layout=slices 保持旧的逐切片 zip，sidecar=1 返回往返载荷
+static inline crow::response make_nii_download_response(const crow::request &req,
+                                                        const fs::path &npz_dir,
+                                                        const fs::path &slice_dir,
+                                                        const std::string &npz_key,
+                                                        const std::string &zip_name,
+                                                        const std::string &download_stem,
+                                                        bool *converted = nullptr)
+{
+    const char *layout = req.url_params.get("layout");
+    if (layout != nullptr && std::string(layout) == "slices") {
+        const bool rebuilt = ensure_converted_from_npz_dir(npz_dir, slice_dir, "nii", npz_key);
+        if (converted != nullptr) *converted = rebuilt;
+        return make_zip_response(req, slice_dir, zip_name, download_stem + ".zip");
+    }
+
+    const fs::path volume_dir = slice_dir.parent_path() / (slice_dir.filename().string() + "_volume");
+    const char *sidecar = req.url_params.get("sidecar");
+    if (sidecar != nullptr && std::string(sidecar) == "1") {
+        const fs::path path = ensure_nii_volume_sidecar(npz_dir, volume_dir, converted);
+        return make_streamed_file_response(req, path, "application/zip", download_stem + ".roundtrip.zip");
+    }
+
+    const char *gzip_param = req.url_params.get("gzip");
+    const bool gzip = gzip_param == nullptr || std::string(gzip_param) != "0";
+    const fs::path path = ensure_nii_volume_from_npz_dir(npz_dir, volume_dir, npz_key, gzip, converted);
+    return make_streamed_file_response(req,
+                                       path,
+                                       gzip ? "application/gzip" : "application/octet-stream",
+                                       download_stem + (gzip ? ".nii.gz" : ".nii"));
+}
+
+// 3D 模型各级 LOD 的整体三角形预算（从大到小），为空时只输出完整模型
+static inline std::vector<size_t> &glb_lod_triangle_budgets()
+{
+    static std::vector<size_t> budgets{200000, 50000};
+    return budgets;
+}
+
+// GLB 默认启用量化与顶点缓存优化；以 --glb-float 启动时输出 float32 顶点属性，兼容不支持 KHR_mesh_quantization 的查看器
+static inline npz_to_glb::GlbEncoding &glb_encoding()
+{
+    static npz_to_glb::GlbEncoding encoding{true, true};
+    return encoding;
+}
+
+// 3D 模型的标注颜色表，每个类别输出一个 primitive；可由 --glb-labels 覆盖
+static inline std::vector<npz_to_glb::LabelClass> &glb_label_classes()
+{
+    static std::vector<npz_to_glb::LabelClass> classes = npz_to_glb::default_label_classes();
+    return classes;
+}
+
+// 3D 模型的等值面提取方式，默认 Marching Cubes；可由 --glb-mesher surface-nets 切换
+static inline npz_to_glb::MeshMode &glb_mesh_mode()
+{
+    static npz_to_glb::MeshMode mode = npz_to_glb::MeshMode::MarchingCubes;
+    return mode;
+}
+
+// 3D 模型的 slab 网格片段缓存目录，与输出目录同级且不随输出目录删除：重新分析只改动少数切片时只需重新提取对应 slab
+static inline fs::path glb_fragment_cache_dir(const fs::path &out_glb)
+{
+    const fs::path out_dir = out_glb.parent_path();
+    return out_dir.parent_path() / ("." + out_dir.filename().string() + ".mesh_cache");
+}
+
+// 由 npz 目录生成 model.glb 及 model_lod<k>.glb；源目录清单与参数未变化时直接复用已有模型，
+// 否则借助片段缓存只重新提取内容有变化的 slab。返回是否实际重建
+static inline bool ensure_glb_model(const fs::path &npz_dir, const fs::path &out_glb, const npz_to_glb::Options &opts)
+{
+    uint64_t h = 1469598103934665603ULL;
+    std::string salt = "glb|ann=" + std::to_string(opts.ann_threshold) + "|raw=" + (opts.use_raw_threshold ? "1" : "0") + "|lod";
+    for (size_t budget : glb_lod_triangle_budgets()) salt += "," + std::to_string(budget);
+    salt += std::string("|q=") + (glb_encoding().quantize ? "1" : "0") + (glb_encoding().optimize ? "1" : "0");
+    salt += std::string("|mesher=") + (opts.mesh_mode == npz_to_glb::MeshMode::SurfaceNets ? "nets" : "mc");
+    salt += "|labels";
+    for (const auto &cls : opts.label_classes) {
+        salt += "," + std::to_string(cls.value) + ":" + cls.name;
+        for (float c : cls.color) salt += ":" + std::to_string(c);
+    }
+    fnv1a_update(h, salt.data(), salt.size() + 1);
+    fingerprint_dir_listing(h, npz_dir);
+    std::ostringstream fp;
+    fp << std::hex << std::setw(16) << std::setfill('0') << h;
+    const fs::path out_dir = out_glb.parent_path();
+    std::lock_guard<std::mutex> lk(export_path_mutex(out_dir));
+    if (fs::exists(out_glb) && read_export_fingerprint(out_glb) == fp.str()) return false;
+
+    // 在暂存目录中生成各级模型与指纹后整体替换，下载方不会看到新旧 LOD 混合的目录
+    std::error_code ec;
+    const fs::path staging_dir = out_dir.parent_path() / (out_dir.filename().string() + ".staging" + random_hex_id(8));
+    const fs::path staging_glb = staging_dir / out_glb.filename();
+    fs::create_directories(staging_dir);
+    try {
+        npz_to_glb::SlabFragmentCache fragments(glb_fragment_cache_dir(out_glb));
+        npz_to_glb::Options build_opts = opts;
+        build_opts.fragment_cache = &fragments;
+        std::vector<npz_to_glb::PrimitiveData> primitives;
+        std::vector<unsigned char> png;
+        npz_to_glb::load_primitives(npz_dir, build_opts, primitives, png);
+        fragments.prune();
+        RuntimeLogger::info("[npz转glb] 网格片段: 复用 " + std::to_string(fragments.reused()) + " 个, 重新提取 " +
+                            std::to_string(fragments.rebuilt()) + " 个");
+        const auto lods = npz_to_glb::write_glb_lods(staging_glb, primitives, png, glb_lod_triangle_budgets(), glb_encoding());
+        for (const auto &lod : lods) {
+            RuntimeLogger::info("[npz转glb] LOD" + std::to_string(lod.level) + ": " + lod.path.filename().string() +
+                                ", triangles=" + std::to_string(lod.triangles));
+        }
+        write_export_fingerprint(staging_glb, fp.str());
+    } catch (...) {
+        fs::remove_all(staging_dir, ec);
+        throw;
+    }
+    fs::remove_all(out_dir, ec);
+    fs::rename(staging_dir, out_dir, ec);
+    if (ec) {
+        fs::remove_all(staging_dir, ec);
+        throw std::runtime_error("替换3D模型目录失败: " + out_dir.string());
+    }
+    return true;
+}
+
+static inline crow::response build_3d_model_project_dir_response(const fs::path &project_dir,
+                                                                 const std::string &project_label,
+                                                                 bool allow_raw_only_when_unprocessed = false)
+{
+    RuntimeLogger::info("[npz转glb] 开始3D模型转换: id=" + project_label);
+    fs::path project_json = project_dir / "project.json";
+    std::string json = read_text_file(project_json);
+
+    fs::path processed_npz_dir = project_dir / "processed" / "npzs";
+    const bool has_processed_npz = !list_files(processed_npz_dir).empty();
+    auto raw_val = extract_string_field(json, "raw");
+    const bool raw_markednpz = raw_val && to_lower_copy(*raw_val) == "markednpz";
+
+    if (!has_processed_npz && !(allow_raw_only_when_unprocessed && raw_markednpz)) {
+        throw std::runtime_error("processed npz 为空");
+    }
+
+    std::error_code ec;
+    npz_to_glb::Options opts;
+    opts.use_raw_threshold = true;
+    opts.label_classes = glb_label_classes();
+    opts.mesh_mode = glb_mesh_mode();
+    opts.mmap_min_bytes = static_cast<size_t>(256) << 20;  // 大体数据的原图放在匿名映射中，不常驻进程堆
+
+    if (has_processed_npz) {
+        fs::path out_glb = project_dir / "3d" / "model.glb";
+        if (ensure_glb_model(processed_npz_dir, out_glb, opts)) {
+            RuntimeLogger::info("[npz转glb] 生成processed模型: " + out_glb.string() + ", id=" + project_label);
+        } else {
+            RuntimeLogger::info("[npz转glb] processed模型未变化，复用: " + out_glb.string() + ", id=" + project_label);
+        }
+    } else {
+        std::lock_guard<std::mutex> lk(export_path_mutex(project_dir / "3d"));
+        fs::remove_all(project_dir / "3d", ec);
+        fs::remove_all(glb_fragment_cache_dir(project_dir / "3d" / "model.glb"), ec);
+        RuntimeLogger::info("[npz转glb] 跳过processed模型生成，仅输出人工标注模型: id=" + project_label);
+    }
+
+    if (raw_markednpz) {
+        fs::path og_glb = project_dir / "OG3d" / "model.glb";
+        fs::path raw_npz_dir = project_dir / "npz";
+        if (ensure_glb_model(raw_npz_dir, og_glb, opts)) {
+            RuntimeLogger::info("[npz转glb] 生成原始模型: " + og_glb.string() + ", id=" + project_label);
+        } else {
+            RuntimeLogger::info("[npz转glb] 原始模型未变化，复用: " + og_glb.string() + ", id=" + project_label);
+        }
+    }
+
+    update_project_json_fields(project_json, {{"PD-3d", has_processed_npz ? "true" : "false"}});
+    RuntimeLogger::info("[npz转glb] 完成3D模型转换: id=" + project_label);
+    return make_json_ok_response("{\"status\":\"ok\"}");
+}
+
+// 稀疏体素块导出：源 npz 目录与参数未变化时直接复用已有的 volume.json / volume.bin
+static inline void ensure_brick_volume(const fs::path &npz_dir,
+                                       const fs::path &out_dir,
+                                       const npz_to_glb::Options &opts,
+                                       const npz_to_glb::BrickVolumeFormat &format)
+{
+    uint64_t h = 1469598103934665603ULL;
+    std::string salt = "bricks|max=" + std::to_string(format.max_dim) + "|wide=" + (format.wide ? "1" : "0") +
+                       "|ann=" + std::to_string(opts.ann_threshold) + "|labels";
+    for (const auto &cls : opts.label_classes) {
+        salt += "," + std::to_string(cls.value) + ":" + cls.name;
+        for (float c : cls.color) salt += ":" + std::to_string(c);
+    }
+    fnv1a_update(h, salt.data(), salt.size() + 1);
+    fingerprint_dir_listing(h, npz_dir);
+    std::ostringstream fp;
+    fp << std::hex << std::setw(16) << std::setfill('0') << h;
+    const fs::path index_path = out_dir / "volume.json";
+    std::lock_guard<std::mutex> lk(export_path_mutex(out_dir));
+    if (fs::exists(index_path) && read_export_fingerprint(index_path) == fp.str()) return;
+
+    // 在暂存目录中生成索引、块数据与指纹后整体替换，读取方不会看到新旧混合的文件
+    std::error_code ec;
+    const fs::path staging_dir = out_dir.parent_path() / (out_dir.filename().string() + ".staging" + random_hex_id(8));
+    fs::create_directories(staging_dir);
+    npz_to_glb::BrickVolumeInfo info;
+    try {
+        info = npz_to_glb::write_brick_volume(npz_dir, opts, format, staging_dir / "volume.json", staging_dir / "volume.bin");
+        write_export_fingerprint(staging_dir / "volume.json", fp.str());
+    } catch (...) {
+        fs::remove_all(staging_dir, ec);
+        throw;
+    }
+    fs::remove_all(out_dir, ec);
+    fs::rename(staging_dir, out_dir, ec);
+    if (ec) {
+        fs::remove_all(staging_dir, ec);
+        throw std::runtime_error("替换体素块目录失败: " + out_dir.string());
+    }
+    RuntimeLogger::info("[体素块] 生成完成: " + out_dir.string() + ", dims=" + std::to_string(info.dims[0]) + "x" +
+                        std::to_string(info.dims[1]) + "x" + std::to_string(info.dims[2]) + ", bricks=" +
+                        std::to_string(info.stored_bricks) + "/" + std::to_string(info.brick_count) +
+                        ", bytes=" + std::to_string(info.data_bytes));
+}
+
+// 体素块接口：source=raw 取项目原始 npz（默认 processed/npzs），bits=8|16（默认 8）；
+// part=index 返回索引 JSON，否则返回块数据，支持 Range，客户端可按索引中的偏移逐块请求
+static inline crow::response make_brick_volume_response(const crow::request &req, const fs::path &project_dir)
+{
+    const char *source = req.url_params.get("source");
+    const bool raw_source = source != nullptr && std::string(source) == "raw";
+    if (source != nullptr && !raw_source && std::string(source) != "processed") throw std::runtime_error("invalid source");
+    const char *bits = req.url_params.get("bits");
+    if (bits != nullptr && std::string(bits) != "8" && std::string(bits) != "16") throw std::runtime_error("invalid bits");
+
+    const fs::path npz_dir = raw_source ? project_dir / "npz" : project_dir / "processed" / "npzs";
+    if (list_files(npz_dir).empty()) throw std::runtime_error(raw_source ? "npz 为空" : "processed npz 为空");
+
+    npz_to_glb::Options opts;
+    opts.use_raw_threshold = true;
+    opts.label_classes = glb_label_classes();
+    opts.mmap_min_bytes = static_cast<size_t>(256) << 20;
+    npz_to_glb::BrickVolumeFormat format;
+    format.wide = bits != nullptr && std::string(bits) == "16";
+    const fs::path out_dir = project_dir / (raw_source ? "OG3d_volume" : "3d_volume") / (format.wide ? "u16" : "u8");
+    ensure_brick_volume(npz_dir, out_dir, opts, format);
+
+    const char *part = req.url_params.get("part");
+    if (part != nullptr && std::string(part) == "index") {
+        return make_binary_file_response(req, out_dir / "volume.json", "application/json");
+    }
+    return make_streamed_file_response(req, out_dir / "volume.bin", "application/octet-stream", "volume.bin");
+}
+
+// lod=k 返回第 k 级简化模型；请求的级别不存在时退回到现有的最粗一级，客户端可先取粗模型再逐级细化
+static inline crow::response make_glb_download_response(const crow::request &req, const fs::path &glb_path)
+{
+    if (!fs::exists(glb_path)) throw std::runtime_error("3d model not found");
+    const char *lod_param = req.url_params.get("lod");
+    int lod = 0;
+    if (lod_param) {
+        try {
+            lod = std::stoi(lod_param);
+        } catch (const std::exception &) {
+            throw std::runtime_error("invalid lod");
+        }
+        if (lod < 0) throw std::runtime_error("invalid lod");
+    }
+    for (; lod > 0; --lod) {
+        const std::string name = glb_path.stem().string() + "_lod" + std::to_string(lod) + glb_path.extension().string();
+        const fs::path lod_path = glb_path.parent_path() / name;
+        if (fs::exists(lod_path)) return make_streamed_file_response(req, lod_path, "model/gltf-binary", name);
+    }
+    return make_streamed_file_response(req, glb_path, "model/gltf-binary", "model.glb");
 }
 
 struct LlmSettings {
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "npz_to_glb.h"
+
+namespace npz_to_glb {
+
+// 平面方程 ax+by+cz+d=0 的误差二次型（对称 4x4 矩阵的上三角 10 个元素）
+struct QemQuadric {
+    double m[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+    QemQuadric() = default;
+    QemQuadric(double a, double b, double c, double d)
+        : m{a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d} {}
+
+    QemQuadric &operator+=(const QemQuadric &o) {
+        for (int i = 0; i < 10; ++i) {
+            m[i] += o.m[i];
+        }
+        return *this;
+    }
+
+    double error(const double p[3]) const {
+        const double x = p[0];
+        const double y = p[1];
+        const double z = p[2];
+        return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+             + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+             + m[7] * z * z + 2 * m[8] * z + m[9];
+    }
+};
+
+static inline double det3(const double a[3][3]) {
+    return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+         - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+         + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+}
+
+// 二次误差度量（QEM）边折叠简化：每轮以逐渐放宽的误差阈值折叠边，误差相同时优先处理先遇到的三角形，
+// 结果只取决于输入网格；开放边界（含体数据边缘与非流形边）上的顶点保持不动，避免模型出现缺口
+class QemDecimator {
+public:
+    explicit QemDecimator(const MeshData &mesh) {
+        const size_t vertex_count = mesh.positions.size() / 3;
+        verts_.resize(vertex_count);
+        const bool has_uv = mesh.uvs.size() == vertex_count * 2;
+        for (size_t i = 0; i < vertex_count; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                verts_[i].p[k] = mesh.positions[i * 3 + k];
+            }
+            if (has_uv) {
+                verts_[i].uv[0] = mesh.uvs[i * 2];
+                verts_[i].uv[1] = mesh.uvs[i * 2 + 1];
+            }
+        }
+        tris_.resize(mesh.indices.size() / 3);
+        for (size_t t = 0; t < tris_.size(); ++t) {
+            for (int k = 0; k < 3; ++k) {
+                tris_[t].v[k] = mesh.indices[t * 3 + k];
+            }
+        }
+    }
+
+    // 折叠到不超过 target_triangles 个三角形（误差阈值放宽到上限后仍达不到时尽量接近）
+    MeshData simplify(size_t target_triangles) {
+        size_t deleted_triangles = 0;
+        const size_t triangle_count = tris_.size();
+        std::vector<uint8_t> deleted0;
+        std::vector<uint8_t> deleted1;
+
+        for (int iteration = 0; iteration < 100; ++iteration) {
+            if (triangle_count - deleted_triangles <= target_triangles) {
+                break;
+            }
+            if (iteration % 5 == 0) {
+                update_mesh(iteration);
+            }
+            for (auto &t : tris_) {
+                t.dirty = false;
+            }
+
+            const double threshold = 1e-9 * std::pow(static_cast<double>(iteration + 3), 7.0);
+            for (size_t i = 0; i < tris_.size(); ++i) {
+                Tri &t = tris_[i];
+                if (t.err[3] > threshold || t.deleted || t.dirty) {
+                    continue;
+                }
+                for (int j = 0; j < 3; ++j) {
+                    if (t.err[j] >= threshold) {
+                        continue;
+                    }
+                    const uint32_t i0 = t.v[j];
+                    const uint32_t i1 = t.v[(j + 1) % 3];
+                    Vert &v0 = verts_[i0];
+                    Vert &v1 = verts_[i1];
+                    if (v0.border || v1.border) {
+                        continue;
+                    }
+
+                    double p[3];
+                    collapse_error(i0, i1, p);
+                    deleted0.assign(v0.tcount, 0);
+                    deleted1.assign(v1.tcount, 0);
+                    if (flipped(p, i1, v0, deleted0) || flipped(p, i0, v1, deleted1)) {
+                        continue;
+                    }
+
+                    std::copy(p, p + 3, v0.p);
+                    v0.q += v1.q;
+                    const size_t tstart = refs_.size();
+                    update_triangles(i0, v0, deleted0, deleted_triangles);
+                    update_triangles(i0, v1, deleted1, deleted_triangles);
+                    const size_t tcount = refs_.size() - tstart;
+                    if (tcount <= v0.tcount) {
+                        if (tcount) {
+                            std::copy(refs_.begin() + tstart, refs_.end(), refs_.begin() + v0.tstart);
+                        }
+                    } else {
+                        v0.tstart = static_cast<uint32_t>(tstart);
+                    }
+                    v0.tcount = static_cast<uint32_t>(tcount);
+                    break;
+                }
+                if (triangle_count - deleted_triangles <= target_triangles) {
+                    break;
+                }
+            }
+        }
+        return compact();
+    }
+
+private:
+    struct Tri {
+        uint32_t v[3] = {0, 0, 0};
+        double err[4] = {0, 0, 0, 0};
+        double n[3] = {0, 0, 0};
+        bool deleted = false;
+        bool dirty = false;
+    };
+    struct Vert {
+        double p[3] = {0, 0, 0};
+        float uv[2] = {0.0f, 0.0f};
+        QemQuadric q;
+        uint32_t tstart = 0;
+        uint32_t tcount = 0;
+        bool border = false;
+    };
+    struct Ref {
+        uint32_t tid;
+        uint32_t tvertex;
+    };
+
+    std::vector<Vert> verts_;
+    std::vector<Tri> tris_;
+    std::vector<Ref> refs_;
+
+    static void sub(const double a[3], const double b[3], double out[3]) {
+        out[0] = a[0] - b[0];
+        out[1] = a[1] - b[1];
+        out[2] = a[2] - b[2];
+    }
+    static void cross(const double a[3], const double b[3], double out[3]) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+    static double dot(const double a[3], const double b[3]) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+    static void normalize(double v[3]) {
+        const double len = std::sqrt(dot(v, v));
+        if (len > 1e-12) {
+            v[0] /= len;
+            v[1] /= len;
+            v[2] /= len;
+        }
+    }
+
+    // 折叠边 (a, b) 的误差与最优位置；矩阵奇异（平坦区域）或两端都在边界时在端点与中点中取误差最小者
+    double collapse_error(uint32_t a, uint32_t b, double out[3]) const {
+        QemQuadric q = verts_[a].q;
+        q += verts_[b].q;
+        const double A[3][3] = {{q.m[0], q.m[1], q.m[2]}, {q.m[1], q.m[4], q.m[5]}, {q.m[2], q.m[5], q.m[7]}};
+        const double rhs[3] = {-q.m[3], -q.m[6], -q.m[8]};
+        const double det = det3(A);
+        if (std::fabs(det) > 1e-10 && !(verts_[a].border && verts_[b].border)) {
+            for (int c = 0; c < 3; ++c) {
+                double Ac[3][3];
+                for (int r = 0; r < 3; ++r) {
+                    for (int k = 0; k < 3; ++k) {
+                        Ac[r][k] = (k == c) ? rhs[r] : A[r][k];
+                    }
+                }
+                out[c] = det3(Ac) / det;
+            }
+            return q.error(out);
+        }
+        const double *pa = verts_[a].p;
+        const double *pb = verts_[b].p;
+        const double mid[3] = {(pa[0] + pb[0]) * 0.5, (pa[1] + pb[1]) * 0.5, (pa[2] + pb[2]) * 0.5};
+        const double ea = q.error(pa);
+        const double eb = q.error(pb);
+        const double em = q.error(mid);
+        const double best = std::min(ea, std::min(eb, em));
+        const double *pick = (best == ea) ? pa : (best == eb) ? pb : mid;
+        std::copy(pick, pick + 3, out);
+        return best;
+    }
+
+    // 把 v 移到 p 后，v 周围（不含将被删除的）三角形是否翻转或退化
+    bool flipped(const double p[3], uint32_t other, const Vert &v, std::vector<uint8_t> &deleted) const {
+        for (uint32_t k = 0; k < v.tcount; ++k) {
+            const Ref &r = refs_[v.tstart + k];
+            const Tri &t = tris_[r.tid];
+            if (t.deleted) {
+                continue;
+            }
+            const uint32_t id1 = t.v[(r.tvertex + 1) % 3];
+            const uint32_t id2 = t.v[(r.tvertex + 2) % 3];
+            if (id1 == other || id2 == other) {
+                deleted[k] = 1;
+                continue;
+            }
+            double d1[3];
+            double d2[3];
+            sub(verts_[id1].p, p, d1);
+            sub(verts_[id2].p, p, d2);
+            normalize(d1);
+            normalize(d2);
+            if (std::fabs(dot(d1, d2)) > 0.999) {
+                return true;
+            }
+            double n[3];
+            cross(d1, d2, n);
+            normalize(n);
+            if (dot(n, t.n) < 0.2) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void update_tri_errors(Tri &t) const {
+        double p[3];
+        t.err[0] = collapse_error(t.v[0], t.v[1], p);
+        t.err[1] = collapse_error(t.v[1], t.v[2], p);
+        t.err[2] = collapse_error(t.v[2], t.v[0], p);
+        t.err[3] = std::min(t.err[0], std::min(t.err[1], t.err[2]));
+    }
+
+    void update_triangles(uint32_t i0, const Vert &v, const std::vector<uint8_t> &deleted, size_t &deleted_triangles) {
+        for (uint32_t k = 0; k < v.tcount; ++k) {
+            const Ref r = refs_[v.tstart + k];
+            Tri &t = tris_[r.tid];
+            if (t.deleted) {
+                continue;
+            }
+            if (deleted[k]) {
+                t.deleted = true;
+                ++deleted_triangles;
+                continue;
+            }
+            t.v[r.tvertex] = i0;
+            t.dirty = true;
+            update_tri_errors(t);
+            refs_.push_back(r);
+        }
+    }
+
+    // 压缩三角形列表并重建顶点 -> 三角形引用；首轮同时识别边界顶点并初始化二次型与折叠误差
+    void update_mesh(int iteration) {
+        if (iteration > 0) {
+            size_t dst = 0;
+            for (size_t i = 0; i < tris_.size(); ++i) {
+                if (!tris_[i].deleted) {
+                    tris_[dst++] = tris_[i];
+                }
+            }
+            tris_.resize(dst);
+        }
+
+        for (auto &v : verts_) {
+            v.tstart = 0;
+            v.tcount = 0;
+        }
+        for (const auto &t : tris_) {
+            for (int k = 0; k < 3; ++k) {
+                verts_[t.v[k]].tcount++;
+            }
+        }
+        uint32_t tstart = 0;
+        for (auto &v : verts_) {
+            v.tstart = tstart;
+            tstart += v.tcount;
+            v.tcount = 0;
+        }
+        refs_.resize(tris_.size() * 3);
+        for (size_t i = 0; i < tris_.size(); ++i) {
+            for (int k = 0; k < 3; ++k) {
+                Vert &v = verts_[tris_[i].v[k]];
+                refs_[v.tstart + v.tcount] = {static_cast<uint32_t>(i), static_cast<uint32_t>(k)};
+                v.tcount++;
+            }
+        }
+
+        if (iteration != 0) {
+            return;
+        }
+
+        // 只被一个三角形使用的边为边界边，其两端顶点标记为边界
+        std::vector<uint32_t> neighbor_ids;
+        std::vector<uint32_t> neighbor_counts;
+        for (size_t i = 0; i < verts_.size(); ++i) {
+            Vert &v = verts_[i];
+            neighbor_ids.clear();
+            neighbor_counts.clear();
+            for (uint32_t k = 0; k < v.tcount; ++k) {
+                const Tri &t = tris_[refs_[v.tstart + k].tid];
+                for (int j = 0; j < 3; ++j) {
+                    const uint32_t id = t.v[j];
+                    if (id == i) {
+                        continue;
+                    }
+                    size_t ofs = 0;
+                    while (ofs < neighbor_ids.size() && neighbor_ids[ofs] != id) {
+                        ++ofs;
+                    }
+                    if (ofs == neighbor_ids.size()) {
+                        neighbor_ids.push_back(id);
+                        neighbor_counts.push_back(1);
+                    } else {
+                        neighbor_counts[ofs]++;
+                    }
+                }
+            }
+            for (size_t j = 0; j < neighbor_ids.size(); ++j) {
+                if (neighbor_counts[j] != 2) {
+                    v.border = true;
+                    verts_[neighbor_ids[j]].border = true;
+                }
+            }
+        }
+
+        for (auto &t : tris_) {
+            double e1[3];
+            double e2[3];
+            sub(verts_[t.v[1]].p, verts_[t.v[0]].p, e1);
+            sub(verts_[t.v[2]].p, verts_[t.v[0]].p, e2);
+            cross(e1, e2, t.n);
+            normalize(t.n);
+            const QemQuadric q(t.n[0], t.n[1], t.n[2], -dot(t.n, verts_[t.v[0]].p));
+            for (int k = 0; k < 3; ++k) {
+                verts_[t.v[k]].q += q;
+            }
+        }
+        for (auto &t : tris_) {
+            update_tri_errors(t);
+        }
+    }
+
+    // 输出未删除的三角形与被引用的顶点，法线按面积加权重新计算
+    MeshData compact() const {
+        MeshData out;
+        std::vector<uint32_t> remap(verts_.size(), UINT32_MAX);
+        for (const auto &t : tris_) {
+            if (t.deleted) {
+                continue;
+            }
+            uint32_t ids[3];
+            for (int k = 0; k < 3; ++k) {
+                uint32_t &slot = remap[t.v[k]];
+                if (slot == UINT32_MAX) {
+                    const Vert &v = verts_[t.v[k]];
+                    slot = static_cast<uint32_t>(out.positions.size() / 3);
+                    const float x = static_cast<float>(v.p[0]);
+                    const float y = static_cast<float>(v.p[1]);
+                    const float z = static_cast<float>(v.p[2]);
+                    out.positions.insert(out.positions.end(), {x, y, z});
+                    out.normals.insert(out.normals.end(), {0.0f, 0.0f, 0.0f});
+                    out.uvs.insert(out.uvs.end(), {v.uv[0], v.uv[1]});
+                    update_minmax(out, x, y, z, slot == 0);
+                }
+                ids[k] = slot;
+            }
+            out.indices.insert(out.indices.end(), {ids[0], ids[1], ids[2]});
+            accumulate_face_normal(out, ids[0], ids[1], ids[2]);
+        }
+        finalize_normals(out);
+        return out;
+    }
+};
+
+static inline MeshData decimate_mesh(const MeshData &mesh, size_t target_triangles) {
+    if (mesh.indices.size() / 3 <= target_triangles) {
+        return mesh;
+    }
+    QemDecimator decimator(mesh);
+    return decimator.simplify(target_triangles);
+}
+
+struct GlbLod {
+    int level = 0;
+    fs::path path;
+    size_t triangles = 0;
+};
+
+static inline size_t count_triangles(const std::vector<PrimitiveData> &primitives) {
+    size_t total = 0;
+    for (const auto &prim : primitives) {
+        total += prim.mesh.indices.size() / 3;
+    }
+    return total;
+}
+
+// 写出完整模型 output_path（LOD0），再按 budgets（整体三角形预算，从大到小）逐级简化写出 <stem>_lod<k>.glb。
+// 每一级由上一级继续简化，各 primitive 按三角形数占比分配预算并行简化；预算不小于上一级时跳过该级
+static inline std::vector<GlbLod> write_glb_lods(const fs::path &output_path,
+                                                 const std::vector<PrimitiveData> &primitives,
+                                                 const std::vector<unsigned char> &png,
+                                                 const std::vector<size_t> &budgets,
+                                                 const GlbEncoding &encoding = GlbEncoding()) {
+    std::vector<GlbLod> lods;
+    write_glb(output_path, primitives, png, encoding);
+    lods.push_back({0, output_path, count_triangles(primitives)});
+
+    const std::vector<PrimitiveData> *prev = &primitives;
+    std::vector<PrimitiveData> current;
+    for (size_t budget : budgets) {
+        const size_t prev_total = lods.back().triangles;
+        if (budget == 0 || budget >= prev_total) {
+            continue;
+        }
+        std::vector<PrimitiveData> next(prev->size());
+        parallel_for_each_index(prev->size(), [&](size_t i) {
+            const PrimitiveData &src = (*prev)[i];
+            PrimitiveData &dst = next[i];
+            dst.use_texture = src.use_texture;
+            std::copy(src.base_color, src.base_color + 4, dst.base_color);
+            dst.label = src.label;
+            dst.bounds = src.bounds;
+            const size_t tris = src.mesh.indices.size() / 3;
+            const size_t target = std::max<size_t>(4, static_cast<size_t>(static_cast<double>(tris) * budget / prev_total));
+            dst.mesh = decimate_mesh(src.mesh, target);
+            if (dst.mesh.indices.empty()) {
+                dst.mesh = src.mesh;
+            }
+        });
+        const int level = static_cast<int>(lods.size());
+        const fs::path path = output_path.parent_path() /
+                              (output_path.stem().string() + "_lod" + std::to_string(level) + output_path.extension().string());
+        write_glb(path, next, png, encoding);
+        lods.push_back({level, path, count_triangles(next)});
+        current = std::move(next);
+        prev = &current;
+    }
+    return lods;
+}
+
+} // namespace npz_to_glb
@@ -56,6 +56,15 @@ struct ZipEntry {
     std::vector<uint8_t> data;
 };
 
+// 本地文件头中的一个条目：只记录位置与长度，数据按需解压
+struct ZipMemberInfo {
+    std::string name;
+    uint16_t method = 0;  // 0 = 存储，8 = deflate
+    size_t data_offset = 0;
+    size_t compressed_size = 0;
+    size_t uncompressed_size = 0;
+};
+
 struct DTypeInfo {
     char kind = '?';
     size_t item_size = 0;
@@ -75,6 +84,10 @@ inline uint32_t read_u32_le(const uint8_t* ptr) {
            (static_cast<uint32_t>(ptr[2]) << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
 }
 
+inline uint64_t read_u64_le(const uint8_t* ptr) {
+    return static_cast<uint64_t>(read_u32_le(ptr)) | (static_cast<uint64_t>(read_u32_le(ptr + 4)) << 32);
+}
+
 inline void append_u16_le(std::vector<uint8_t>& out, uint16_t value) {
     out.push_back(static_cast<uint8_t>(value & 0xFF));
     out.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
@@ -135,61 +148,147 @@ inline std::vector<uint8_t> inflate_raw_deflate(const uint8_t* data, size_t comp
     return out;
 }
 
-inline std::vector<ZipEntry> load_npz_entries(const fs::path& path) {
-    const auto bytes = read_file_bytes(path);
-    std::vector<ZipEntry> entries;
+// 只解析本地文件头，不解压任何数据；条目长度为 0xFFFFFFFF 时从 zip64 扩展字段读取
+inline std::vector<ZipMemberInfo> list_npz_members(const uint8_t* bytes, size_t size) {
+    std::vector<ZipMemberInfo> members;
     size_t offset = 0;
 
-    while (offset + 4 <= bytes.size()) {
-        const uint32_t sig = read_u32_le(bytes.data() + offset);
+    while (offset + 4 <= size) {
+        const uint32_t sig = read_u32_le(bytes + offset);
         if (sig == 0x02014B50 || sig == 0x06054B50) {
             break;
         }
         if (sig != 0x04034B50) {
             throw std::runtime_error("无效的 NPZ/ZIP 本地文件头");
         }
-        if (offset + 30 > bytes.size()) {
+        if (offset + 30 > size) {
             throw std::runtime_error("NPZ 本地文件头不完整");
         }
 
-        const uint16_t flags = read_u16_le(bytes.data() + offset + 6);
-        const uint16_t method = read_u16_le(bytes.data() + offset + 8);
-        const uint32_t compressed_size = read_u32_le(bytes.data() + offset + 18);
-        const uint32_t uncompressed_size = read_u32_le(bytes.data() + offset + 22);
-        const uint16_t name_len = read_u16_le(bytes.data() + offset + 26);
-        const uint16_t extra_len = read_u16_le(bytes.data() + offset + 28);
-
+        const uint8_t* header = bytes + offset;
+        const uint16_t flags = read_u16_le(header + 6);
+        const uint16_t name_len = read_u16_le(header + 26);
+        const uint16_t extra_len = read_u16_le(header + 28);
         if ((flags & 0x08U) != 0U) {
             throw std::runtime_error("暂不支持带数据描述符的 NPZ 条目");
         }
-
         const size_t header_size = 30 + static_cast<size_t>(name_len) + static_cast<size_t>(extra_len);
-        if (offset + header_size + compressed_size > bytes.size()) {
-            throw std::runtime_error("NPZ 条目长度越界");
+        if (offset + header_size > size) {
+            throw std::runtime_error("NPZ 本地文件头不完整");
         }
 
-        const std::string name(reinterpret_cast<const char*>(bytes.data() + offset + 30), name_len);
-        const uint8_t* payload = bytes.data() + offset + header_size;
-
-        std::vector<uint8_t> data;
-        if (method == 0) {
-            data.assign(payload, payload + compressed_size);
-        } else if (method == 8) {
-            data = inflate_raw_deflate(payload, compressed_size, uncompressed_size);
-        } else {
+        ZipMemberInfo member;
+        member.name.assign(reinterpret_cast<const char*>(header + 30), name_len);
+        member.method = read_u16_le(header + 8);
+        member.compressed_size = read_u32_le(header + 18);
+        member.uncompressed_size = read_u32_le(header + 22);
+        if (member.method != 0 && member.method != 8) {
             throw std::runtime_error("不支持的 NPZ 压缩方式");
         }
+        const uint8_t* extra = header + 30 + name_len;
+        for (size_t e = 0; e + 4 <= extra_len;) {
+            const uint16_t id = read_u16_le(extra + e);
+            const uint16_t field_size = read_u16_le(extra + e + 2);
+            if (id == 0x0001) {
+                // zip64 字段依次为未压缩、压缩长度，只包含 32 位字段溢出的那几项
+                size_t field = e + 4;
+                const size_t field_end = std::min<size_t>(e + 4 + field_size, extra_len);
+                if (member.uncompressed_size == 0xFFFFFFFFu && field + 8 <= field_end) {
+                    member.uncompressed_size = static_cast<size_t>(read_u64_le(extra + field));
+                    field += 8;
+                }
+                if (member.compressed_size == 0xFFFFFFFFu && field + 8 <= field_end) {
+                    member.compressed_size = static_cast<size_t>(read_u64_le(extra + field));
+                }
+            }
+            e += 4 + field_size;
+        }
 
-        entries.push_back(ZipEntry{name, std::move(data)});
-        offset += header_size + compressed_size;
+        member.data_offset = offset + header_size;
+        if (member.compressed_size > size - member.data_offset ||
+            (member.method == 0 && member.compressed_size != member.uncompressed_size)) {
+            throw std::runtime_error("NPZ 条目长度越界");
+        }
+        offset = member.data_offset + member.compressed_size;
+        members.push_back(std::move(member));
     }
 
-    if (entries.empty()) {
+    if (members.empty()) {
         throw std::runtime_error("未在 NPZ 中解析到任何条目");
     }
+    return members;
+}
+
+// 解压条目数据，跳过前 skip 个字节后写出 count 个字节到 dst；写满即停止，不解压其余部分
+inline void inflate_npz_member(const uint8_t* bytes, const ZipMemberInfo& member, size_t skip, uint8_t* dst, size_t count) {
+    if (skip > member.uncompressed_size || count > member.uncompressed_size - skip) {
+        throw std::runtime_error("NPZ 条目 " + member.name + " 长度不足");
+    }
+    const uint8_t* payload = bytes + member.data_offset;
+    if (member.method == 0) {
+        if (count > 0) {
+            std::memcpy(dst, payload + skip, count);
+        }
+        return;
+    }
+    z_stream stream{};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("inflateInit2 失败");
+    }
+    size_t consumed = 0;
+    const auto feed = [&] {
+        // avail_in / avail_out 均为 uInt，超大条目分块送入与写出
+        if (stream.avail_in == 0 && consumed < member.compressed_size) {
+            const size_t n = std::min<size_t>(member.compressed_size - consumed, 1u << 30);
+            stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(payload + consumed));
+            stream.avail_in = static_cast<uInt>(n);
+            consumed += n;
+        }
+    };
+    uint8_t discard[4096];
+    int rc = Z_OK;
+    while (skip > 0 && rc == Z_OK) {
+        feed();
+        const size_t n = std::min(skip, sizeof(discard));
+        stream.next_out = discard;
+        stream.avail_out = static_cast<uInt>(n);
+        rc = inflate(&stream, Z_NO_FLUSH);
+        skip -= n - stream.avail_out;
+    }
+    size_t written = 0;
+    while (written < count && rc == Z_OK) {
+        feed();
+        const size_t n = std::min<size_t>(count - written, 1u << 30);
+        stream.next_out = dst + written;
+        stream.avail_out = static_cast<uInt>(n);
+        rc = inflate(&stream, Z_NO_FLUSH);
+        written += n - stream.avail_out;
+    }
+    inflateEnd(&stream);
+    if (skip > 0 || written < count) {
+        throw std::runtime_error("解压 NPZ 条目失败: " + member.name);
+    }
+}
+
+inline std::vector<ZipEntry> load_npz_entries_from_bytes(const std::vector<uint8_t>& bytes) {
+    std::vector<ZipEntry> entries;
+    for (const auto& member : list_npz_members(bytes.data(), bytes.size())) {
+        const uint8_t* payload = bytes.data() + member.data_offset;
+        std::vector<uint8_t> data;
+        if (member.method == 0) {
+            data.assign(payload, payload + member.compressed_size);
+        } else {
+            data = inflate_raw_deflate(payload, member.compressed_size, member.uncompressed_size);
+        }
+        entries.push_back(ZipEntry{member.name, std::move(data)});
+    }
     return entries;
 }
 
+inline std::vector<ZipEntry> load_npz_entries(const fs::path& path) {
+    return load_npz_entries_from_bytes(read_file_bytes(path));
+}
+
 inline std::vector<uint8_t> save_npz_entries(const std::vector<ZipEntry>& entries) {
     std::vector<uint8_t> out;
     std::vector<uint8_t> central_directory;
@@ -339,6 +438,24 @@ inline NpyMeta parse_npy_meta(const std::vector<uint8_t>& bytes) {
     return meta;
 }
 
+// 只解压条目开头的 npy 头并解析，数据区保持压缩状态
+inline NpyMeta read_npz_member_meta(const uint8_t* bytes, const ZipMemberInfo& member) {
+    std::vector<uint8_t> head(std::min<size_t>(12, member.uncompressed_size));
+    inflate_npz_member(bytes, member, 0, head.data(), head.size());
+    if (head.size() < 10) {
+        throw std::runtime_error("NPY 数据过短");
+    }
+    const size_t prefix = head[6] == 1 ? 10 : 12;
+    const size_t header_len = head[6] == 1 ? read_u16_le(head.data() + 8) : read_u32_le(head.data() + 8);
+    const size_t data_offset = prefix + header_len;
+    if (head.size() < prefix || data_offset > member.uncompressed_size) {
+        throw std::runtime_error("NPY 头部长度越界");
+    }
+    head.resize(data_offset);
+    inflate_npz_member(bytes, member, 0, head.data(), head.size());
+    return parse_npy_meta(head);
+}
+
 inline std::vector<uint8_t> make_npy_bytes(const NpyMeta& meta, const std::vector<uint8_t>& raw_data) {
     std::ostringstream shape_stream;
     shape_stream << '(';
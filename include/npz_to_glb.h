@@ -1,21 +1,27 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include <zlib.h>
 
-#include "cnpy.h"
+#include "npz_volume.h"
+#include "parallel_utils.h"
 
 namespace npz_to_glb {
 namespace fs = std::filesystem;
@@ -29,10 +35,211 @@ struct MeshData {
     float max_pos[3] = {0.0f, 0.0f, 0.0f};
 };
 
+// 体素包围盒，下标顺序为 (x, y, z)，闭区间
+struct VoxelBounds {
+    bool empty = true;
+    size_t min[3] = {0, 0, 0};
+    size_t max[3] = {0, 0, 0};
+
+    void merge(size_t x0, size_t x1, size_t y, size_t z) {
+        if (empty) {
+            min[0] = x0; max[0] = x1;
+            min[1] = max[1] = y;
+            min[2] = max[2] = z;
+            empty = false;
+            return;
+        }
+        min[0] = std::min(min[0], x0);
+        max[0] = std::max(max[0], x1);
+        min[1] = std::min(min[1], y);
+        max[1] = std::max(max[1], y);
+        min[2] = std::min(min[2], z);
+        max[2] = std::max(max[2], z);
+    }
+
+    void merge(const VoxelBounds &other) {
+        if (other.empty) {
+            return;
+        }
+        merge(other.min[0], other.max[0], other.min[1], other.min[2]);
+        merge(other.min[0], other.max[0], other.max[1], other.max[2]);
+    }
+};
+
 struct PrimitiveData {
     MeshData mesh;
     bool use_texture = false;
     float base_color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    std::string label;       // 写入 primitive extras，便于前端区分各部分
+    VoxelBounds bounds;      // 生成该 primitive 的体素包围盒
+};
+
+// 颜色表中的一类标注：标注值为 value 的体素提取为一个 primitive，颜色为 RGBA（0-1）
+struct LabelClass {
+    int value = 1;           // 1-255
+    std::string name;        // 写入 primitive extras 的 label
+    float color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+};
+
+// 默认颜色表：标注值 2 为黄色、1 为红色；primitive 按颜色表顺序输出
+static inline std::vector<LabelClass> default_label_classes() {
+    return {
+        {2, "yellow", {1.0f, 0.831f, 0.0f, 1.0f}},
+        {1, "red", {1.0f, 0.231f, 0.231f, 1.0f}},
+    };
+}
+
+// slab 网格片段的磁盘缓存：每个 slab 的局部网格以其输入切片内容与网格参数的哈希为键存为一个文件，
+// 重建时键未变化的 slab 直接读回，只有内容变化的切片所在的 slab 重新提取。片段只是加速手段，读写失败时按未命中处理
+class SlabFragmentCache {
+public:
+    explicit SlabFragmentCache(fs::path dir) : dir_(std::move(dir)) {}
+
+    size_t reused() const { return reused_; }
+    size_t rebuilt() const { return rebuilt_; }
+
+    // 读取键对应片段的负载部分；文件缺失、截断或头部不符时返回 false
+    bool load(uint64_t key, std::string &payload) {
+        const fs::path path = path_for(key);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            used_.push_back(path.filename().string());
+        }
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        const std::streamoff size = in ? static_cast<std::streamoff>(in.tellg()) : -1;
+        uint32_t header[2] = {0, 0};
+        uint64_t stored_key = 0;
+        bool ok = size >= static_cast<std::streamoff>(sizeof(header) + sizeof(stored_key));
+        if (ok) {
+            in.seekg(0);
+            payload.resize(static_cast<size_t>(size) - sizeof(header) - sizeof(stored_key));
+            ok = in.read(reinterpret_cast<char *>(header), sizeof(header)) &&
+                 in.read(reinterpret_cast<char *>(&stored_key), sizeof(stored_key)) &&
+                 in.read(&payload[0], static_cast<std::streamsize>(payload.size())) &&
+                 header[0] == kMagic && header[1] == kVersion && stored_key == key;
+        }
+        if (!ok) {
+            payload.clear();
+        }
+        return ok;
+    }
+
+    // 统计片段是否被复用（负载解析失败也按重新提取计）
+    void record(bool reused) {
+        ++(reused ? reused_ : rebuilt_);
+    }
+
+    // 先写临时文件再改名，并发读取不会看到半写的片段
+    void store(uint64_t key, const std::string &payload) {
+        std::error_code ec;
+        fs::create_directories(dir_, ec);
+        const fs::path path = path_for(key);
+        const fs::path tmp = path.string() + ".part" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            const uint32_t header[2] = {kMagic, kVersion};
+            out.write(reinterpret_cast<const char *>(header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(&key), sizeof(key));
+            out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+            if (!out) {
+                out.close();
+                fs::remove(tmp, ec);
+                return;
+            }
+        }
+        fs::rename(tmp, path, ec);
+        if (ec) {
+            fs::remove(tmp, ec);
+        }
+    }
+
+    // 删除本次构建没有用到的片段（旧内容或旧参数留下的），缓存大小始终与当前模型相当
+    void prune() {
+        std::error_code ec;
+        if (!fs::is_directory(dir_, ec)) {
+            return;
+        }
+        std::vector<std::string> used;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            used = used_;
+        }
+        std::sort(used.begin(), used.end());
+        std::vector<fs::path> stale;
+        for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+            if (!std::binary_search(used.begin(), used.end(), it->path().filename().string())) {
+                stale.push_back(it->path());
+            }
+        }
+        for (const auto &path : stale) {
+            fs::remove(path, ec);
+        }
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x47524653;  // "SFRG"
+    static constexpr uint32_t kVersion = 1;
+
+    fs::path path_for(uint64_t key) const {
+        char name[24];
+        std::snprintf(name, sizeof(name), "%016llx.frag", static_cast<unsigned long long>(key));
+        return dir_ / name;
+    }
+
+    fs::path dir_;
+    std::mutex mutex_;
+    std::vector<std::string> used_;
+    std::atomic<size_t> reused_{0};
+    std::atomic<size_t> rebuilt_{0};
+};
+
+// 片段负载的顺序读写：标量按原始字节，数组为 (元素数, 原始字节)。片段只在本机复用，不考虑字节序
+struct FragmentWriter {
+    std::string bytes;
+
+    template <typename T>
+    void put(const T &value) {
+        bytes.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void put_vector(const std::vector<T> &values) {
+        put<uint64_t>(values.size());
+        bytes.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+};
+
+struct FragmentReader {
+    const std::string &bytes;
+    size_t pos = 0;
+
+    template <typename T>
+    bool get(T &value) {
+        if (bytes.size() - pos < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, bytes.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool get_vector(std::vector<T> &values) {
+        uint64_t count = 0;
+        if (!get(count) || count > (bytes.size() - pos) / sizeof(T)) {
+            return false;
+        }
+        values.resize(static_cast<size_t>(count));
+        std::memcpy(values.data(), bytes.data() + pos, values.size() * sizeof(T));
+        pos += values.size() * sizeof(T);
+        return true;
+    }
+};
+
+// 等值面提取方式：Marching Cubes 保留体素级细节；Surface Nets 每个立方体至多一个顶点且经过约束松弛，三角形更少、表面更平滑
+enum class MeshMode {
+    MarchingCubes,
+    SurfaceNets,
 };
 
 struct Options {
@@ -40,6 +247,11 @@ struct Options {
     std::string ann_key;
     float ann_threshold = 0.5f;
     bool use_raw_threshold = false;
+    std::vector<LabelClass> label_classes = default_label_classes();
+    size_t mmap_min_bytes = 0;     // 原图体数据不小于该字节数时存放在匿名映射中，0 表示始终使用堆内存
+    bool keep_raw = false;         // 有标注时同样解码并保留原图（体素块导出需要强度通道）
+    MeshMode mesh_mode = MeshMode::MarchingCubes;
+    SlabFragmentCache *fragment_cache = nullptr;  // 非空时按 slab 复用/保存网格片段
 };
 
 static inline bool is_digit(char c) {
@@ -81,138 +293,85 @@ static inline bool natural_less(const fs::path &a, const fs::path &b) {
     return sa.size() < sb.size();
 }
 
-static inline size_t compute_index(const std::vector<size_t> &idx,
-                                   const std::vector<size_t> &shape,
-                                   bool fortran_order) {
-    size_t n = shape.size();
-    size_t index = 0;
-    if (fortran_order) {
-        size_t stride = 1;
-        for (size_t k = 0; k < n; ++k) {
-            index += idx[k] * stride;
-            stride *= shape[k];
-        }
-    } else {
-        size_t stride = 1;
-        for (size_t k = n; k-- > 0;) {
-            index += idx[k] * stride;
-            stride *= shape[k];
+// 按 key 精确查找 npz 成员，未指定或未找到时依次尝试常见名称；原图仍找不到时取名称排序最前的成员
+static inline void find_slice_members(const NpzFile &file,
+                                      const Options &opts,
+                                      const NpzMember *&raw,
+                                      const NpzMember *&ann) {
+    static const std::vector<std::string> kRawKeys = {
+        "image", "img", "raw", "ct", "data", "slice", "input"
+    };
+    static const std::vector<std::string> kAnnKeys = {
+        "label", "mask", "seg", "annotation", "gt"
+    };
+    auto find_by_keys = [&](const std::vector<std::string> &keys) -> const NpzMember * {
+        for (const auto &k : keys) {
+            if (const NpzMember *m = file.find(k)) {
+                return m;
+            }
         }
-    }
-    return index;
-}
+        return nullptr;
+    };
 
-static inline float read_value_as_float(const cnpy::NpyArray &arr, size_t idx) {
-    const unsigned char *data = reinterpret_cast<const unsigned char *>(arr.data_holder->data());
-    switch (arr.word_size) {
-        case 1:
-            return static_cast<float>(data[idx]);
-        case 2: {
-            uint16_t v;
-            std::memcpy(&v, data + idx * 2, sizeof(uint16_t));
-            return static_cast<float>(v);
-        }
-        case 4: {
-            float v;
-            std::memcpy(&v, data + idx * 4, sizeof(float));
-            return v;
-        }
-        case 8: {
-            double v;
-            std::memcpy(&v, data + idx * 8, sizeof(double));
-            return static_cast<float>(v);
-        }
-        default:
-            return 0.0f;
+    raw = opts.raw_key.empty() ? nullptr : file.find(opts.raw_key);
+    ann = opts.ann_key.empty() ? nullptr : file.find(opts.ann_key);
+    if (!raw) {
+        raw = find_by_keys(kRawKeys);
     }
-}
-
-static inline const cnpy::NpyArray *find_array_by_key(const cnpy::npz_t &npz,
-                                                      const std::string &key) {
-    auto it = npz.find(key);
-    if (it == npz.end()) {
-        return nullptr;
+    if (!ann) {
+        ann = find_by_keys(kAnnKeys);
     }
-    return &it->second;
-}
-
-static inline const cnpy::NpyArray *find_array_by_keys(const cnpy::npz_t &npz,
-                                                       const std::vector<std::string> &keys) {
-    for (const auto &k : keys) {
-        auto it = npz.find(k);
-        if (it != npz.end()) {
-            return &it->second;
+    if (!raw) {
+        for (const auto &m : file.members()) {
+            if (!raw || m.name < raw->name) {
+                raw = &m;
+            }
         }
     }
-    return nullptr;
-}
-
-static inline void squeeze_shape(std::vector<size_t> &shape) {
-    std::vector<size_t> out;
-    for (size_t v : shape) {
-        if (v != 1) {
-            out.push_back(v);
-        }
+    if (!raw) {
+        throw std::runtime_error("No raw array found in " + file.path().string());
     }
-    shape.swap(out);
 }
 
-static inline bool extract_2d(const cnpy::NpyArray &arr,
-                              std::vector<float> &out,
-                              size_t &height,
-                              size_t &width) {
-    std::vector<size_t> shape = arr.shape;
-    squeeze_shape(shape);
-
-    if (shape.size() == 2) {
-        height = shape[0];
-        width = shape[1];
-        out.resize(height * width);
-        for (size_t y = 0; y < height; ++y) {
-            for (size_t x = 0; x < width; ++x) {
-                size_t idx = compute_index({y, x}, shape, arr.fortran_order);
-                out[y * width + x] = read_value_as_float(arr, idx);
-            }
-        }
-        return true;
+// 颜色表转为 标注值 -> 类别序号（从 1 开始，0 为背景）的查找表；大于颜色表最大值的标注值归入该最大值所在类别
+static inline std::vector<uint8_t> build_label_lookup(const std::vector<LabelClass> &classes) {
+    if (classes.empty() || classes.size() > 255) {
+        throw std::runtime_error("Label class table must have 1-255 entries.");
     }
-
-    if (shape.size() == 3) {
-        size_t c0 = shape[0];
-        size_t c2 = shape[2];
-        if (c0 <= 4) {
-            height = shape[1];
-            width = shape[2];
-            out.resize(height * width);
-            for (size_t y = 0; y < height; ++y) {
-                for (size_t x = 0; x < width; ++x) {
-                    size_t idx = compute_index({0, y, x}, shape, arr.fortran_order);
-                    out[y * width + x] = read_value_as_float(arr, idx);
-                }
-            }
-            return true;
+    std::vector<uint8_t> lut(256, 0);
+    int max_value = 0;
+    for (size_t k = 0; k < classes.size(); ++k) {
+        const int value = classes[k].value;
+        if (value < 1 || value > 255) {
+            throw std::runtime_error("Label value out of range: " + std::to_string(value));
         }
-        if (c2 <= 4) {
-            height = shape[0];
-            width = shape[1];
-            out.resize(height * width);
-            for (size_t y = 0; y < height; ++y) {
-                for (size_t x = 0; x < width; ++x) {
-                    size_t idx = compute_index({y, x, 0}, shape, arr.fortran_order);
-                    out[y * width + x] = read_value_as_float(arr, idx);
-                }
-            }
-            return true;
+        if (lut[value] == 0) {
+            lut[value] = static_cast<uint8_t>(k + 1);
         }
+        max_value = std::max(max_value, value);
+    }
+    for (int value = max_value + 1; value < 256; ++value) {
+        lut[value] = lut[max_value];
     }
+    return lut;
+}
 
-    return false;
+// 标注值不超过 threshold 的体素为背景，其余向上取整后查表得到类别序号
+static inline uint8_t classify_label(float v, float threshold, const std::vector<uint8_t> &lut) {
+    if (!(v > threshold)) {
+        return 0;
+    }
+    const float level = std::ceil(std::min(v, 255.0f));
+    return lut[static_cast<size_t>(std::max(level, 1.0f))];
 }
 
+// 先读第一张切片的 npy 头确定尺寸并一次性分配整卷，再按切片并行解码到各自的 z 偏移，不再逐张追加反复扩容。
+// 标注解码后直接转为 uint8 类别序号（见 classify_label）；原图只在设置 keep_raw 或第一张切片没有标注且启用原图阈值时解码，
+// 保持 npy 原始 dtype，不小于 opts.mmap_min_bytes 时存放在匿名映射中。最终存在标注且未设置 keep_raw 时原图随即释放
 static inline bool load_slices(const fs::path &input_dir,
                                const Options &opts,
-                               std::vector<float> &raw_volume,
-                               std::vector<float> &ann_volume,
+                               RawVolume &raw_volume,
+                               std::vector<uint8_t> &label_volume,
                                size_t &z_count,
                                size_t &height,
                                size_t &width,
@@ -237,97 +396,105 @@ static inline bool load_slices(const fs::path &input_dir,
 
     std::sort(files.begin(), files.end(), natural_less);
 
-    std::vector<float> raw_slice;
-    std::vector<float> ann_slice;
-    size_t slice_h = 0;
-    size_t slice_w = 0;
-
-    std::vector<float> raws;
-    std::vector<float> anns;
-    has_ann = false;
-
-    static const std::vector<std::string> kRawKeys = {
-        "image", "img", "raw", "ct", "data", "slice", "input"
-    };
-    static const std::vector<std::string> kAnnKeys = {
-        "label", "mask", "seg", "annotation", "gt"
-    };
+    const std::vector<uint8_t> lut = build_label_lookup(opts.label_classes);
+    NpyDtype raw_dtype;
+    bool decode_raw = false;
+    {
+        NpzFile first(files[0]);
+        const NpzMember *raw = nullptr;
+        const NpzMember *ann = nullptr;
+        find_slice_members(first, opts, raw, ann);
+        const NpyHeader header = first.read_header(*raw);
+        if (!npy_slice_dims(header, height, width)) {
+            throw std::runtime_error("Failed to extract 2D raw from " + files[0].string());
+        }
+        raw_dtype = header.dtype;
+        decode_raw = opts.keep_raw || (!ann && opts.use_raw_threshold);
+    }
 
-    for (const auto &file : files) {
-        cnpy::npz_t npz = cnpy::npz_load(file.string());
-        const cnpy::NpyArray *raw_arr = nullptr;
-        const cnpy::NpyArray *ann_arr = nullptr;
+    z_count = files.size();
+    const size_t slice_size = height * width;
+    std::vector<uint8_t> labels(z_count * slice_size, 0);
+    std::vector<uint8_t> slice_has_ann(z_count, 0);
+
+    raw_volume.buffer.release();
+    raw_volume.dtype = raw_dtype;
+    raw_volume.z_count = z_count;
+    raw_volume.height = height;
+    raw_volume.width = width;
+    const size_t raw_slice_bytes = slice_size * raw_dtype.word_size;
+    if (decode_raw) {
+        require_supported_npy_dtype(raw_dtype);  // 分配整卷缓冲与并行读取前先拒绝无法转换的 dtype
+        const size_t total = raw_slice_bytes * z_count;
+        raw_volume.buffer.allocate(total, opts.mmap_min_bytes > 0 && total >= opts.mmap_min_bytes);
+    }
 
-        if (!opts.raw_key.empty()) {
-            raw_arr = find_array_by_key(npz, opts.raw_key);
-        }
-        if (!opts.ann_key.empty()) {
-            ann_arr = find_array_by_key(npz, opts.ann_key);
+    parallel_for_each_index(z_count, [&](size_t z) {
+        const fs::path &path = files[z];
+        NpzFile file(path);
+        const NpzMember *raw = nullptr;
+        const NpzMember *ann = nullptr;
+        find_slice_members(file, opts, raw, ann);
+
+        const NpyHeader raw_header = file.read_header(*raw);
+        size_t h = 0;
+        size_t w = 0;
+        if (!npy_slice_dims(raw_header, h, w)) {
+            throw std::runtime_error("Failed to extract 2D raw from " + path.string());
         }
-        if (!raw_arr) {
-            raw_arr = find_array_by_keys(npz, kRawKeys);
+        if (h != height || w != width) {
+            throw std::runtime_error("Slice size mismatch in " + path.string());
         }
-        if (!ann_arr) {
-            ann_arr = find_array_by_keys(npz, kAnnKeys);
-        }
-
-        if (!raw_arr && !npz.empty()) {
-            raw_arr = &npz.begin()->second;
+        if (decode_raw) {
+            if (raw_header.dtype != raw_dtype) {
+                throw std::runtime_error("Slice dtype mismatch in " + path.string());
+            }
+            decode_npy_slice(file, *raw, raw_header, height, width, raw_volume.buffer.data() + z * raw_slice_bytes);
         }
 
-        if (!raw_arr) {
-            throw std::runtime_error("No raw array found in " + file.string());
+        if (!ann) {
+            return;
         }
-
-        raw_slice.clear();
-        if (!extract_2d(*raw_arr, raw_slice, slice_h, slice_w)) {
-            throw std::runtime_error("Failed to extract 2D raw from " + file.string());
+        const NpyHeader ann_header = file.read_header(*ann);
+        if (!npy_slice_dims(ann_header, h, w)) {
+            throw std::runtime_error("Failed to extract 2D ann from " + path.string());
         }
-
-        if (raws.empty()) {
-            height = slice_h;
-            width = slice_w;
-        } else if (slice_h != height || slice_w != width) {
-            throw std::runtime_error("Slice size mismatch in " + file.string());
+        if (h != height || w != width) {
+            throw std::runtime_error("Annotation size mismatch in " + path.string());
         }
-
-        if (ann_arr) {
-            ann_slice.clear();
-            size_t ah = 0;
-            size_t aw = 0;
-            if (!extract_2d(*ann_arr, ann_slice, ah, aw)) {
-                throw std::runtime_error("Failed to extract 2D ann from " + file.string());
-            }
-            if (ah != height || aw != width) {
-                throw std::runtime_error("Annotation size mismatch in " + file.string());
+        std::vector<unsigned char> scratch(slice_size * ann_header.dtype.word_size);
+        decode_npy_slice(file, *ann, ann_header, height, width, scratch.data());
+        uint8_t *dst = labels.data() + z * slice_size;
+        visit_npy_data(ann_header.dtype, scratch.data(), [&](const auto *values) {
+            for (size_t i = 0; i < slice_size; ++i) {
+                dst[i] = classify_label(static_cast<float>(values[i]), opts.ann_threshold, lut);
             }
-            has_ann = true;
-        } else {
-            ann_slice.assign(height * width, 0.0f);
-        }
+        });
+        slice_has_ann[z] = 1;
+    });
 
-        raws.insert(raws.end(), raw_slice.begin(), raw_slice.end());
-        anns.insert(anns.end(), ann_slice.begin(), ann_slice.end());
+    has_ann = std::find(slice_has_ann.begin(), slice_has_ann.end(), 1) != slice_has_ann.end();
+    if (has_ann && !opts.keep_raw) {
+        raw_volume.buffer.release();
     }
-
-    z_count = files.size();
-    raw_volume.swap(raws);
-    ann_volume.swap(anns);
+    label_volume.swap(labels);
     return true;
 }
 
-static inline std::vector<unsigned char> build_texture_from_raw(const std::vector<float> &raw_volume,
-                                                                size_t z_count,
-                                                                size_t height,
-                                                                size_t width) {
+static inline std::vector<unsigned char> build_texture_from_raw(const RawVolume &raw_volume) {
+    const size_t z_count = raw_volume.z_count;
+    const size_t height = raw_volume.height;
+    const size_t width = raw_volume.width;
     std::vector<float> acc(height * width, 0.0f);
     const size_t slice_size = height * width;
-    for (size_t z = 0; z < z_count; ++z) {
-        const float *slice = raw_volume.data() + z * slice_size;
-        for (size_t i = 0; i < slice_size; ++i) {
-            acc[i] += slice[i];
+    visit_npy_data(raw_volume.dtype, raw_volume.buffer.data(), [&](const auto *data) {
+        for (size_t z = 0; z < z_count; ++z) {
+            const auto *slice = data + z * slice_size;
+            for (size_t i = 0; i < slice_size; ++i) {
+                acc[i] += static_cast<float>(slice[i]);
+            }
         }
-    }
+    });
     for (float &v : acc) {
         v /= static_cast<float>(z_count);
     }
@@ -432,447 +599,1387 @@ static inline void normalize_vec3(float &x, float &y, float &z) {
     }
 }
 
-static inline MeshData build_mesh_from_scalar(const std::vector<float> &vol,
-                                              size_t z_count,
-                                              size_t height,
-                                              size_t width) {
+// Marching Cubes 查找表：立方体 8 个角点内外状态 -> 被穿过的边 / 三角形的边序列
+static const int kMcEdgeTable[256] = {
+    0x0, 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c,
+    0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
+    0x190, 0x99, 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c,
+    0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
+    0x230, 0x339, 0x33, 0x13a, 0x636, 0x73f, 0x435, 0x53c,
+    0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30,
+    0x3a0, 0x2a9, 0x1a3, 0xaa, 0x7a6, 0x6af, 0x5a5, 0x4ac,
+    0xbac, 0xaa5, 0x9af, 0x8a6, 0xfaa, 0xea3, 0xda9, 0xca0,
+    0x460, 0x569, 0x663, 0x76a, 0x66, 0x16f, 0x265, 0x36c,
+    0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
+    0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0xff, 0x3f5, 0x2fc,
+    0xdfc, 0xcf5, 0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0,
+    0x650, 0x759, 0x453, 0x55a, 0x256, 0x35f, 0x55, 0x15c,
+    0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53, 0x859, 0x950,
+    0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0xcc,
+    0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0,
+    0x8c0, 0x9c9, 0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc,
+    0xcc, 0x1c5, 0x2cf, 0x3c6, 0x4ca, 0x5c3, 0x6c9, 0x7c0,
+    0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f, 0xf55, 0xe5c,
+    0x15c, 0x55, 0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
+    0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc,
+    0x2fc, 0x3f5, 0xff, 0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0,
+    0xb60, 0xa69, 0x963, 0x86a, 0xf66, 0xe6f, 0xd65, 0xc6c,
+    0x36c, 0x265, 0x16f, 0x66, 0x76a, 0x663, 0x569, 0x460,
+    0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac,
+    0x4ac, 0x5a5, 0x6af, 0x7a6, 0xaa, 0x1a3, 0x2a9, 0x3a0,
+    0xd30, 0xc39, 0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c,
+    0x53c, 0x435, 0x73f, 0x636, 0x13a, 0x33, 0x339, 0x230,
+    0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f, 0x895, 0x99c,
+    0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x99, 0x190,
+    0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c,
+    0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0
+};
+
+static const int kMcTriTable[256][16] = {
+    {-1},
+    {0, 8, 3, -1},
+    {0, 1, 9, -1},
+    {1, 8, 3, 9, 8, 1, -1},
+    {1, 2, 10, -1},
+    {0, 8, 3, 1, 2, 10, -1},
+    {9, 2, 10, 0, 2, 9, -1},
+    {2, 8, 3, 2, 10, 8, 10, 9, 8, -1},
+    {3, 11, 2, -1},
+    {0, 11, 2, 8, 11, 0, -1},
+    {1, 9, 0, 2, 3, 11, -1},
+    {1, 11, 2, 1, 9, 11, 9, 8, 11, -1},
+    {3, 10, 1, 11, 10, 3, -1},
+    {0, 10, 1, 0, 8, 10, 8, 11, 10, -1},
+    {3, 9, 0, 3, 11, 9, 11, 10, 9, -1},
+    {9, 8, 10, 10, 8, 11, -1},
+    {4, 7, 8, -1},
+    {4, 3, 0, 7, 3, 4, -1},
+    {0, 1, 9, 8, 4, 7, -1},
+    {4, 1, 9, 4, 7, 1, 7, 3, 1, -1},
+    {1, 2, 10, 8, 4, 7, -1},
+    {3, 4, 7, 3, 0, 4, 1, 2, 10, -1},
+    {9, 2, 10, 9, 0, 2, 8, 4, 7, -1},
+    {2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1},
+    {8, 4, 7, 3, 11, 2, -1},
+    {11, 4, 7, 11, 2, 4, 2, 0, 4, -1},
+    {9, 0, 1, 8, 4, 7, 2, 3, 11, -1},
+    {4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1},
+    {3, 10, 1, 3, 11, 10, 7, 8, 4, -1},
+    {1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1},
+    {4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1},
+    {4, 7, 11, 4, 11, 9, 9, 11, 10, -1},
+    {9, 5, 4, -1},
+    {9, 5, 4, 0, 8, 3, -1},
+    {0, 5, 4, 1, 5, 0, -1},
+    {8, 5, 4, 8, 3, 5, 3, 1, 5, -1},
+    {1, 2, 10, 9, 5, 4, -1},
+    {3, 0, 8, 1, 2, 10, 4, 9, 5, -1},
+    {5, 2, 10, 5, 4, 2, 4, 0, 2, -1},
+    {2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1},
+    {9, 5, 4, 2, 3, 11, -1},
+    {0, 11, 2, 0, 8, 11, 4, 9, 5, -1},
+    {0, 5, 4, 0, 1, 5, 2, 3, 11, -1},
+    {2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1},
+    {10, 3, 11, 10, 1, 3, 9, 5, 4, -1},
+    {4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1},
+    {5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1},
+    {5, 4, 8, 5, 8, 10, 10, 8, 11, -1},
+    {9, 7, 8, 5, 7, 9, -1},
+    {9, 3, 0, 9, 5, 3, 5, 7, 3, -1},
+    {0, 7, 8, 0, 1, 7, 1, 5, 7, -1},
+    {1, 5, 3, 3, 5, 7, -1},
+    {9, 7, 8, 9, 5, 7, 10, 1, 2, -1},
+    {10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1},
+    {8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1},
+    {2, 10, 5, 2, 5, 3, 3, 5, 7, -1},
+    {7, 9, 5, 7, 8, 9, 3, 11, 2, -1},
+    {9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1},
+    {2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1},
+    {11, 2, 1, 11, 1, 7, 7, 1, 5, -1},
+    {9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1},
+    {5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
+    {11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
+    {11, 10, 5, 7, 11, 5, -1},
+    {10, 6, 5, -1},
+    {0, 8, 3, 5, 10, 6, -1},
+    {9, 0, 1, 5, 10, 6, -1},
+    {1, 8, 3, 1, 9, 8, 5, 10, 6, -1},
+    {1, 6, 5, 2, 6, 1, -1},
+    {1, 6, 5, 1, 2, 6, 3, 0, 8, -1},
+    {9, 6, 5, 9, 0, 6, 0, 2, 6, -1},
+    {5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1},
+    {2, 3, 11, 10, 6, 5, -1},
+    {11, 0, 8, 11, 2, 0, 10, 6, 5, -1},
+    {0, 1, 9, 2, 3, 11, 5, 10, 6, -1},
+    {5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1},
+    {6, 3, 11, 6, 5, 3, 5, 1, 3, -1},
+    {0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1},
+    {3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1},
+    {6, 5, 9, 6, 9, 11, 11, 9, 8, -1},
+    {5, 10, 6, 4, 7, 8, -1},
+    {4, 3, 0, 4, 7, 3, 6, 5, 10, -1},
+    {1, 9, 0, 5, 10, 6, 8, 4, 7, -1},
+    {10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1},
+    {6, 1, 2, 6, 5, 1, 4, 7, 8, -1},
+    {1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1},
+    {8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1},
+    {7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
+    {3, 11, 2, 7, 8, 4, 10, 6, 5, -1},
+    {5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1},
+    {0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1},
+    {9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
+    {8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1},
+    {5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
+    {0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
+    {6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1},
+    {10, 4, 9, 6, 4, 10, -1},
+    {4, 10, 6, 4, 9, 10, 0, 8, 3, -1},
+    {10, 0, 1, 10, 6, 0, 6, 4, 0, -1},
+    {8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1},
+    {1, 4, 9, 1, 2, 4, 2, 6, 4, -1},
+    {3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1},
+    {0, 2, 4, 4, 2, 6, -1},
+    {8, 3, 2, 8, 2, 4, 4, 2, 6, -1},
+    {10, 4, 9, 10, 6, 4, 11, 2, 3, -1},
+    {0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1},
+    {3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1},
+    {6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
+    {9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1},
+    {8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
+    {3, 11, 6, 3, 6, 0, 0, 6, 4, -1},
+    {6, 4, 8, 11, 6, 8, -1},
+    {7, 10, 6, 7, 8, 10, 8, 9, 10, -1},
+    {0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1},
+    {10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1},
+    {10, 6, 7, 10, 7, 1, 1, 7, 3, -1},
+    {1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1},
+    {2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
+    {7, 8, 0, 7, 0, 6, 6, 0, 2, -1},
+    {7, 3, 2, 6, 7, 2, -1},
+    {2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1},
+    {2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
+    {1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
+    {11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1},
+    {8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
+    {0, 9, 1, 11, 6, 7, -1},
+    {7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1},
+    {7, 11, 6, -1},
+    {7, 6, 11, -1},
+    {3, 0, 8, 11, 7, 6, -1},
+    {0, 1, 9, 11, 7, 6, -1},
+    {8, 1, 9, 8, 3, 1, 11, 7, 6, -1},
+    {10, 1, 2, 6, 11, 7, -1},
+    {1, 2, 10, 3, 0, 8, 6, 11, 7, -1},
+    {2, 9, 0, 2, 10, 9, 6, 11, 7, -1},
+    {6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1},
+    {7, 2, 3, 6, 2, 7, -1},
+    {7, 0, 8, 7, 6, 0, 6, 2, 0, -1},
+    {2, 7, 6, 2, 3, 7, 0, 1, 9, -1},
+    {1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1},
+    {10, 7, 6, 10, 1, 7, 1, 3, 7, -1},
+    {10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1},
+    {0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1},
+    {7, 6, 10, 7, 10, 8, 8, 10, 9, -1},
+    {6, 8, 4, 11, 8, 6, -1},
+    {3, 6, 11, 3, 0, 6, 0, 4, 6, -1},
+    {8, 6, 11, 8, 4, 6, 9, 0, 1, -1},
+    {9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1},
+    {6, 8, 4, 6, 11, 8, 2, 10, 1, -1},
+    {1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1},
+    {4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1},
+    {10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
+    {8, 2, 3, 8, 4, 2, 4, 6, 2, -1},
+    {0, 4, 2, 4, 6, 2, -1},
+    {1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1},
+    {1, 9, 4, 1, 4, 2, 2, 4, 6, -1},
+    {8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1},
+    {10, 1, 0, 10, 0, 6, 6, 0, 4, -1},
+    {4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
+    {10, 9, 4, 6, 10, 4, -1},
+    {4, 9, 5, 7, 6, 11, -1},
+    {0, 8, 3, 4, 9, 5, 11, 7, 6, -1},
+    {5, 0, 1, 5, 4, 0, 7, 6, 11, -1},
+    {11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1},
+    {9, 5, 4, 10, 1, 2, 7, 6, 11, -1},
+    {6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1},
+    {7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1},
+    {3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
+    {7, 2, 3, 7, 6, 2, 5, 4, 9, -1},
+    {9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1},
+    {3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1},
+    {6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
+    {9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1},
+    {1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
+    {4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
+    {7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1},
+    {6, 9, 5, 6, 11, 9, 11, 8, 9, -1},
+    {3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1},
+    {0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1},
+    {6, 11, 3, 6, 3, 5, 5, 3, 1, -1},
+    {1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1},
+    {0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
+    {11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
+    {6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1},
+    {5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1},
+    {9, 5, 6, 9, 6, 0, 0, 6, 2, -1},
+    {1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
+    {1, 5, 6, 2, 1, 6, -1},
+    {1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
+    {10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1},
+    {0, 3, 8, 5, 6, 10, -1},
+    {10, 5, 6, -1},
+    {11, 5, 10, 7, 5, 11, -1},
+    {11, 5, 10, 11, 7, 5, 8, 3, 0, -1},
+    {5, 11, 7, 5, 10, 11, 1, 9, 0, -1},
+    {10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1},
+    {11, 1, 2, 11, 7, 1, 7, 5, 1, -1},
+    {0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1},
+    {9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1},
+    {7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
+    {2, 5, 10, 2, 3, 5, 3, 7, 5, -1},
+    {8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1},
+    {9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1},
+    {9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
+    {1, 3, 5, 3, 7, 5, -1},
+    {0, 8, 7, 0, 7, 1, 1, 7, 5, -1},
+    {9, 0, 3, 9, 3, 5, 5, 3, 7, -1},
+    {9, 8, 7, 5, 9, 7, -1},
+    {5, 8, 4, 5, 10, 8, 10, 11, 8, -1},
+    {5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1},
+    {0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1},
+    {10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
+    {2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1},
+    {0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
+    {0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
+    {9, 4, 5, 2, 11, 3, -1},
+    {2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1},
+    {5, 10, 2, 5, 2, 4, 4, 2, 0, -1},
+    {3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
+    {5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1},
+    {8, 4, 5, 8, 5, 3, 3, 5, 1, -1},
+    {0, 4, 5, 1, 0, 5, -1},
+    {8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1},
+    {9, 4, 5, -1},
+    {4, 11, 7, 4, 9, 11, 9, 10, 11, -1},
+    {0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1},
+    {1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1},
+    {3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
+    {4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1},
+    {9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
+    {11, 7, 4, 11, 4, 2, 2, 4, 0, -1},
+    {11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1},
+    {2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1},
+    {9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
+    {3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
+    {1, 10, 2, 8, 7, 4, -1},
+    {4, 9, 1, 4, 1, 7, 7, 1, 3, -1},
+    {4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1},
+    {4, 0, 3, 7, 4, 3, -1},
+    {4, 8, 7, -1},
+    {9, 10, 8, 10, 11, 8, -1},
+    {3, 0, 9, 3, 9, 11, 11, 9, 10, -1},
+    {0, 1, 10, 0, 10, 8, 8, 10, 11, -1},
+    {3, 1, 10, 11, 3, 10, -1},
+    {1, 2, 11, 1, 11, 9, 9, 11, 8, -1},
+    {3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1},
+    {0, 2, 11, 8, 0, 11, -1},
+    {3, 2, 11, -1},
+    {2, 3, 8, 2, 8, 10, 10, 8, 9, -1},
+    {9, 10, 2, 0, 9, 2, -1},
+    {2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1},
+    {1, 10, 2, -1},
+    {1, 3, 8, 9, 1, 8, -1},
+    {0, 9, 1, -1},
+    {0, 3, 8, -1},
+    {-1}
+};
+
+// 边 e 连接的两个角点，以及角点相对立方体原点的偏移 (x, y, z)
+static const int kMcEdgeToVertex[12][2] = {
+    {0, 1}, {1, 2}, {2, 3}, {3, 0},
+    {4, 5}, {5, 6}, {6, 7}, {7, 4},
+    {0, 4}, {1, 5}, {2, 6}, {3, 7}
+};
+
+static const int kMcVertexOffset[8][3] = {
+    {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+    {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}
+};
+
+// 累加到顶点上的法线为未归一化的面法线（模长为三角形面积的 2 倍），归一化后即为面积加权平滑法线
+static inline void accumulate_face_normal(MeshData &mesh, uint32_t ia, uint32_t ib, uint32_t ic) {
+    const float *a = &mesh.positions[ia * 3];
+    const float *b = &mesh.positions[ib * 3];
+    const float *c = &mesh.positions[ic * 3];
+    const float ux = b[0] - a[0];
+    const float uy = b[1] - a[1];
+    const float uz = b[2] - a[2];
+    const float vx = c[0] - a[0];
+    const float vy = c[1] - a[1];
+    const float vz = c[2] - a[2];
+    const float nx = uy * vz - uz * vy;
+    const float ny = uz * vx - ux * vz;
+    const float nz = ux * vy - uy * vx;
+    for (uint32_t id : {ia, ib, ic}) {
+        mesh.normals[id * 3] += nx;
+        mesh.normals[id * 3 + 1] += ny;
+        mesh.normals[id * 3 + 2] += nz;
+    }
+}
+
+static inline void finalize_normals(MeshData &mesh) {
+    for (size_t i = 0; i + 2 < mesh.normals.size(); i += 3) {
+        normalize_vec3(mesh.normals[i], mesh.normals[i + 1], mesh.normals[i + 2]);
+    }
+}
+
+// 每个 slab 包含的立方体层数；固定层数（而不是按线程数切分）保证输出与机器核数无关
+static constexpr size_t kMeshSlabDepth = 16;
+
+// 空区域跳过的 brick 边长（立方体个数）
+static constexpr size_t kMeshBrickSize = 8;
+
+// 立方体按 kMeshBrickSize^3 分块的占用情况：brick 覆盖的采样点中同时存在不同类别时才可能产生三角形，
+// 其余 brick 的每个立方体索引必为 0 或 255，提取时整块跳过，结果与逐立方体扫描一致
+struct BrickOccupancy {
+    size_t bricks[3] = {0, 0, 0};        // x, y, z 方向 brick 数
+    std::vector<uint8_t> active;         // [bz][by][bx]
+    std::vector<uint8_t> row_active;     // [bz][by]，该行任一 brick 活跃
+    std::vector<uint8_t> layer_active;   // [bz]
+    size_t active_count = 0;
+
+    bool is_active(size_t bz, size_t by, size_t bx) const {
+        return active[(bz * bricks[1] + by) * bricks[0] + bx] != 0;
+    }
+};
+
+// 单个 z-slab 的局部网格。与上一 slab 共享的底面交点在本 slab 中也会生成一份，
+// 拼接时按边键对齐到上一 slab 顶面的同一交点；边键 = 方向(0=x,1=y) * slice_size + 像素下标
+struct SlabMesh {
+    MeshData mesh;
+    std::vector<std::pair<size_t, uint32_t>> bottom;  // z_begin 层 (边键, 局部顶点 id)，按边键升序
+    std::vector<std::pair<size_t, uint32_t>> top;     // z_end 层
+    std::vector<uint32_t> remap;                      // 局部顶点 id -> 全局顶点 id
+    size_t owned = 0;
+};
+
+// 拼接各 slab 的局部网格：每个 slab 的底面交点映射到上一 slab 顶面的同一顶点，其余顶点按 slab 顺序经前缀和分配全局 id。
+// 顶点与三角形顺序与单线程逐层扫描一致；slab 边界顶点的法线由两侧分别累加后再合并，浮点求和顺序不同，
+// 末位可能与单线程结果有差异。slab 深度固定，输出与核数无关
+static inline MeshData stitch_slab_meshes(std::vector<SlabMesh> &slabs) {
     MeshData mesh;
+    const size_t slab_count = slabs.size();
+    if (slab_count == 0) {
+        return mesh;
+    }
+    if (slab_count == 1) {
+        mesh = std::move(slabs[0].mesh);
+        finalize_normals(mesh);
+        return mesh;
+    }
+
+    for (size_t s = 1; s < slab_count; ++s) {
+        const auto &below = slabs[s - 1].top;
+        const auto &above = slabs[s].bottom;
+        if (below.size() != above.size()) {
+            throw std::runtime_error("Slab boundary mismatch at slab " + std::to_string(s) + ".");
+        }
+        for (size_t i = 0; i < below.size(); ++i) {
+            if (below[i].first != above[i].first) {
+                throw std::runtime_error("Slab boundary mismatch at slab " + std::to_string(s) + ".");
+            }
+        }
+    }
+
+    // 前缀和：每个 slab 自有顶点（去掉借用的底面顶点）与三角形索引在全局数组中的起点
+    std::vector<size_t> vertex_offset(slab_count + 1, 0);
+    std::vector<size_t> index_offset(slab_count + 1, 0);
+    for (size_t s = 0; s < slab_count; ++s) {
+        SlabMesh &slab = slabs[s];
+        slab.owned = slab.mesh.positions.size() / 3 - slab.bottom.size();
+        vertex_offset[s + 1] = vertex_offset[s] + slab.owned;
+        index_offset[s + 1] = index_offset[s] + slab.mesh.indices.size();
+    }
+    if (vertex_offset[slab_count] > UINT32_MAX) {
+        throw std::runtime_error("Mesh has too many vertices for 32-bit indices.");
+    }
+
+    constexpr uint32_t kBorrowed = UINT32_MAX;
+    parallel_for_each_index(slab_count, [&](size_t s) {
+        SlabMesh &slab = slabs[s];
+        const size_t local_count = slab.mesh.positions.size() / 3;
+        slab.remap.assign(local_count, 0);
+        for (const auto &entry : slab.bottom) {
+            slab.remap[entry.second] = kBorrowed;
+        }
+        uint32_t next = static_cast<uint32_t>(vertex_offset[s]);
+        for (size_t v = 0; v < local_count; ++v) {
+            if (slab.remap[v] != kBorrowed) {
+                slab.remap[v] = next++;
+            }
+        }
+    });
+    parallel_for_each_index(slab_count, [&](size_t s) {
+        if (s == 0) {
+            return;
+        }
+        SlabMesh &slab = slabs[s];
+        const SlabMesh &below = slabs[s - 1];
+        for (size_t i = 0; i < slab.bottom.size(); ++i) {
+            slab.remap[slab.bottom[i].second] = below.remap[below.top[i].second];
+        }
+    });
+
+    const size_t vertex_count = vertex_offset[slab_count];
+    mesh.positions.resize(vertex_count * 3);
+    mesh.normals.resize(vertex_count * 3);
+    mesh.uvs.resize(vertex_count * 2);
+    mesh.indices.resize(index_offset[slab_count]);
+    parallel_for_each_index(slab_count, [&](size_t s) {
+        const SlabMesh &slab = slabs[s];
+        const MeshData &local = slab.mesh;
+        for (size_t v = 0; v < slab.remap.size(); ++v) {
+            const size_t g = slab.remap[v];
+            if (g < vertex_offset[s]) {
+                continue;  // 借用的底面顶点由上一 slab 写出
+            }
+            std::copy_n(&local.positions[v * 3], 3, &mesh.positions[g * 3]);
+            std::copy_n(&local.normals[v * 3], 3, &mesh.normals[g * 3]);
+            std::copy_n(&local.uvs[v * 2], 2, &mesh.uvs[g * 2]);
+        }
+        uint32_t *dst = mesh.indices.data() + index_offset[s];
+        for (size_t i = 0; i < local.indices.size(); ++i) {
+            dst[i] = slab.remap[local.indices[i]];
+        }
+    });
+    // 借用顶点在本 slab 中累加的法线并入上一 slab 的同一顶点；每个目标顶点只属于一个边界，可并行
+    parallel_for_each_index(slab_count, [&](size_t s) {
+        const SlabMesh &slab = slabs[s];
+        for (const auto &entry : slab.bottom) {
+            const size_t g = slab.remap[entry.second];
+            for (int k = 0; k < 3; ++k) {
+                mesh.normals[g * 3 + k] += slab.mesh.normals[entry.second * 3 + k];
+            }
+        }
+    });
+    finalize_normals(mesh);
+
+    bool init = true;
+    for (const auto &slab : slabs) {
+        if (slab.mesh.positions.empty()) {
+            continue;
+        }
+        update_minmax(mesh, slab.mesh.min_pos[0], slab.mesh.min_pos[1], slab.mesh.min_pos[2], init);
+        update_minmax(mesh, slab.mesh.max_pos[0], slab.mesh.max_pos[1], slab.mesh.max_pos[2], false);
+        init = false;
+    }
+    return mesh;
+}
+
+// 标签体（0 为背景，1..class_count 为类别序号）的 brick 占用：brick 覆盖的采样全部属于同一类别时任何类别都不会产生三角形，整块跳过。
+// 逐行按 brick 求类别的最小 / 最大值，二者不等即为活跃；各类别体素包围盒在同一遍中顺带得到，class_bounds[k - 1] 对应类别 k
+static inline BrickOccupancy compute_label_occupancy(const std::vector<uint8_t> &labels,
+                                                     size_t z_count,
+                                                     size_t height,
+                                                     size_t width,
+                                                     size_t class_count,
+                                                     std::vector<VoxelBounds> &class_bounds) {
+    BrickOccupancy occ;
+    class_bounds.assign(class_count, VoxelBounds());
+    if (z_count < 2 || height < 2 || width < 2) {
+        return occ;
+    }
     const size_t slice_size = height * width;
+    const size_t bx_count = (width - 1 + kMeshBrickSize - 1) / kMeshBrickSize;
+    const size_t by_count = (height - 1 + kMeshBrickSize - 1) / kMeshBrickSize;
+    const size_t bz_count = (z_count - 1 + kMeshBrickSize - 1) / kMeshBrickSize;
+    occ.bricks[0] = bx_count;
+    occ.bricks[1] = by_count;
+    occ.bricks[2] = bz_count;
+    occ.active.assign(bx_count * by_count * bz_count, 0);
+    occ.row_active.assign(by_count * bz_count, 0);
+    occ.layer_active.assign(bz_count, 0);
+
+    std::vector<std::vector<VoxelBounds>> layer_bounds(bz_count, std::vector<VoxelBounds>(class_count));
+    std::vector<uint8_t> layer_max(bz_count, 0);
+    parallel_for_each_index(bz_count, [&](size_t bz) {
+        std::vector<uint8_t> lo(by_count * bx_count, UINT8_MAX);
+        std::vector<uint8_t> hi(by_count * bx_count, 0);
+        std::vector<size_t> first(256, SIZE_MAX);
+        std::vector<size_t> last(256, 0);
+        std::vector<uint8_t> touched;
+        std::vector<VoxelBounds> &bounds = layer_bounds[bz];
+        const size_t z0 = bz * kMeshBrickSize;
+        const size_t z1 = std::min(z0 + kMeshBrickSize, z_count - 1);
+        for (size_t z = z0; z <= z1; ++z) {
+            for (size_t y = 0; y < height; ++y) {
+                const uint8_t *row = labels.data() + z * slice_size + y * width;
+                size_t by_list[2];
+                size_t by_n = 0;
+                if (y / kMeshBrickSize < by_count) {
+                    by_list[by_n++] = y / kMeshBrickSize;
+                }
+                if (y > 0 && y % kMeshBrickSize == 0) {
+                    by_list[by_n++] = y / kMeshBrickSize - 1;
+                }
+                uint8_t row_max = 0;
+                for (size_t bx = 0; bx < bx_count; ++bx) {
+                    const size_t x0 = bx * kMeshBrickSize;
+                    const size_t x1 = std::min(x0 + kMeshBrickSize, width - 1);
+                    uint8_t bmin = UINT8_MAX;
+                    uint8_t bmax = 0;
+                    for (size_t x = x0; x <= x1; ++x) {
+                        bmin = std::min(bmin, row[x]);
+                        bmax = std::max(bmax, row[x]);
+                    }
+                    row_max = std::max(row_max, bmax);
+                    for (size_t k = 0; k < by_n; ++k) {
+                        const size_t cell = by_list[k] * bx_count + bx;
+                        lo[cell] = std::min(lo[cell], bmin);
+                        hi[cell] = std::max(hi[cell], bmax);
+                    }
+                }
+                if (row_max == 0) {
+                    continue;
+                }
+                layer_max[bz] = std::max(layer_max[bz], row_max);
+                for (size_t x = 0; x < width; ++x) {
+                    const uint8_t c = row[x];
+                    if (c == 0 || c > class_count) {
+                        continue;
+                    }
+                    if (first[c] == SIZE_MAX) {
+                        first[c] = x;
+                        touched.push_back(c);
+                    }
+                    last[c] = x;
+                }
+                for (uint8_t c : touched) {
+                    bounds[c - 1].merge(first[c], last[c], y, z);
+                    first[c] = SIZE_MAX;
+                }
+                touched.clear();
+            }
+        }
 
-    static const int edgeTable[256] = {
-        0x0, 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c,
-        0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
-        0x190, 0x99, 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c,
-        0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
-        0x230, 0x339, 0x33, 0x13a, 0x636, 0x73f, 0x435, 0x53c,
-        0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30,
-        0x3a0, 0x2a9, 0x1a3, 0xaa, 0x7a6, 0x6af, 0x5a5, 0x4ac,
-        0xbac, 0xaa5, 0x9af, 0x8a6, 0xfaa, 0xea3, 0xda9, 0xca0,
-        0x460, 0x569, 0x663, 0x76a, 0x66, 0x16f, 0x265, 0x36c,
-        0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
-        0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0xff, 0x3f5, 0x2fc,
-        0xdfc, 0xcf5, 0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0,
-        0x650, 0x759, 0x453, 0x55a, 0x256, 0x35f, 0x55, 0x15c,
-        0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53, 0x859, 0x950,
-        0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0xcc,
-        0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0,
-        0x8c0, 0x9c9, 0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc,
-        0xcc, 0x1c5, 0x2cf, 0x3c6, 0x4ca, 0x5c3, 0x6c9, 0x7c0,
-        0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f, 0xf55, 0xe5c,
-        0x15c, 0x55, 0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
-        0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc,
-        0x2fc, 0x3f5, 0xff, 0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0,
-        0xb60, 0xa69, 0x963, 0x86a, 0xf66, 0xe6f, 0xd65, 0xc6c,
-        0x36c, 0x265, 0x16f, 0x66, 0x76a, 0x663, 0x569, 0x460,
-        0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac,
-        0x4ac, 0x5a5, 0x6af, 0x7a6, 0xaa, 0x1a3, 0x2a9, 0x3a0,
-        0xd30, 0xc39, 0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c,
-        0x53c, 0x435, 0x73f, 0x636, 0x13a, 0x33, 0x339, 0x230,
-        0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f, 0x895, 0x99c,
-        0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x99, 0x190,
-        0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c,
-        0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0
-    };
+        for (size_t by = 0; by < by_count; ++by) {
+            for (size_t bx = 0; bx < bx_count; ++bx) {
+                const size_t cell = by * bx_count + bx;
+                if (lo[cell] != hi[cell]) {
+                    occ.active[(bz * by_count + by) * bx_count + bx] = 1;
+                    occ.row_active[bz * by_count + by] = 1;
+                    occ.layer_active[bz] = 1;
+                }
+            }
+        }
+    });
 
-    static const int triTable[256][16] = {
-        {-1},
-        {0, 8, 3, -1},
-        {0, 1, 9, -1},
-        {1, 8, 3, 9, 8, 1, -1},
-        {1, 2, 10, -1},
-        {0, 8, 3, 1, 2, 10, -1},
-        {9, 2, 10, 0, 2, 9, -1},
-        {2, 8, 3, 2, 10, 8, 10, 9, 8, -1},
-        {3, 11, 2, -1},
-        {0, 11, 2, 8, 11, 0, -1},
-        {1, 9, 0, 2, 3, 11, -1},
-        {1, 11, 2, 1, 9, 11, 9, 8, 11, -1},
-        {3, 10, 1, 11, 10, 3, -1},
-        {0, 10, 1, 0, 8, 10, 8, 11, 10, -1},
-        {3, 9, 0, 3, 11, 9, 11, 10, 9, -1},
-        {9, 8, 10, 10, 8, 11, -1},
-        {4, 7, 8, -1},
-        {4, 3, 0, 7, 3, 4, -1},
-        {0, 1, 9, 8, 4, 7, -1},
-        {4, 1, 9, 4, 7, 1, 7, 3, 1, -1},
-        {1, 2, 10, 8, 4, 7, -1},
-        {3, 4, 7, 3, 0, 4, 1, 2, 10, -1},
-        {9, 2, 10, 9, 0, 2, 8, 4, 7, -1},
-        {2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1},
-        {8, 4, 7, 3, 11, 2, -1},
-        {11, 4, 7, 11, 2, 4, 2, 0, 4, -1},
-        {9, 0, 1, 8, 4, 7, 2, 3, 11, -1},
-        {4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1},
-        {3, 10, 1, 3, 11, 10, 7, 8, 4, -1},
-        {1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1},
-        {4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1},
-        {4, 7, 11, 4, 11, 9, 9, 11, 10, -1},
-        {9, 5, 4, -1},
-        {9, 5, 4, 0, 8, 3, -1},
-        {0, 5, 4, 1, 5, 0, -1},
-        {8, 5, 4, 8, 3, 5, 3, 1, 5, -1},
-        {1, 2, 10, 9, 5, 4, -1},
-        {3, 0, 8, 1, 2, 10, 4, 9, 5, -1},
-        {5, 2, 10, 5, 4, 2, 4, 0, 2, -1},
-        {2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1},
-        {9, 5, 4, 2, 3, 11, -1},
-        {0, 11, 2, 0, 8, 11, 4, 9, 5, -1},
-        {0, 5, 4, 0, 1, 5, 2, 3, 11, -1},
-        {2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1},
-        {10, 3, 11, 10, 1, 3, 9, 5, 4, -1},
-        {4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1},
-        {5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1},
-        {5, 4, 8, 5, 8, 10, 10, 8, 11, -1},
-        {9, 7, 8, 5, 7, 9, -1},
-        {9, 3, 0, 9, 5, 3, 5, 7, 3, -1},
-        {0, 7, 8, 0, 1, 7, 1, 5, 7, -1},
-        {1, 5, 3, 3, 5, 7, -1},
-        {9, 7, 8, 9, 5, 7, 10, 1, 2, -1},
-        {10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1},
-        {8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1},
-        {2, 10, 5, 2, 5, 3, 3, 5, 7, -1},
-        {7, 9, 5, 7, 8, 9, 3, 11, 2, -1},
-        {9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1},
-        {2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1},
-        {11, 2, 1, 11, 1, 7, 7, 1, 5, -1},
-        {9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1},
-        {5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
-        {11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
-        {11, 10, 5, 7, 11, 5, -1},
-        {10, 6, 5, -1},
-        {0, 8, 3, 5, 10, 6, -1},
-        {9, 0, 1, 5, 10, 6, -1},
-        {1, 8, 3, 1, 9, 8, 5, 10, 6, -1},
-        {1, 6, 5, 2, 6, 1, -1},
-        {1, 6, 5, 1, 2, 6, 3, 0, 8, -1},
-        {9, 6, 5, 9, 0, 6, 0, 2, 6, -1},
-        {5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1},
-        {2, 3, 11, 10, 6, 5, -1},
-        {11, 0, 8, 11, 2, 0, 10, 6, 5, -1},
-        {0, 1, 9, 2, 3, 11, 5, 10, 6, -1},
-        {5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1},
-        {6, 3, 11, 6, 5, 3, 5, 1, 3, -1},
-        {0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1},
-        {3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1},
-        {6, 5, 9, 6, 9, 11, 11, 9, 8, -1},
-        {5, 10, 6, 4, 7, 8, -1},
-        {4, 3, 0, 4, 7, 3, 6, 5, 10, -1},
-        {1, 9, 0, 5, 10, 6, 8, 4, 7, -1},
-        {10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1},
-        {6, 1, 2, 6, 5, 1, 4, 7, 8, -1},
-        {1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1},
-        {8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1},
-        {7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
-        {3, 11, 2, 7, 8, 4, 10, 6, 5, -1},
-        {5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1},
-        {0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1},
-        {9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
-        {8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1},
-        {5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
-        {0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
-        {6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1},
-        {10, 4, 9, 6, 4, 10, -1},
-        {4, 10, 6, 4, 9, 10, 0, 8, 3, -1},
-        {10, 0, 1, 10, 6, 0, 6, 4, 0, -1},
-        {8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1},
-        {1, 4, 9, 1, 2, 4, 2, 6, 4, -1},
-        {3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1},
-        {0, 2, 4, 4, 2, 6, -1},
-        {8, 3, 2, 8, 2, 4, 4, 2, 6, -1},
-        {10, 4, 9, 10, 6, 4, 11, 2, 3, -1},
-        {0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1},
-        {3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1},
-        {6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
-        {9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1},
-        {8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
-        {3, 11, 6, 3, 6, 0, 0, 6, 4, -1},
-        {6, 4, 8, 11, 6, 8, -1},
-        {7, 10, 6, 7, 8, 10, 8, 9, 10, -1},
-        {0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1},
-        {10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1},
-        {10, 6, 7, 10, 7, 1, 1, 7, 3, -1},
-        {1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1},
-        {2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
-        {7, 8, 0, 7, 0, 6, 6, 0, 2, -1},
-        {7, 3, 2, 6, 7, 2, -1},
-        {2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1},
-        {2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
-        {1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
-        {11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1},
-        {8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
-        {0, 9, 1, 11, 6, 7, -1},
-        {7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1},
-        {7, 11, 6, -1},
-        {7, 6, 11, -1},
-        {3, 0, 8, 11, 7, 6, -1},
-        {0, 1, 9, 11, 7, 6, -1},
-        {8, 1, 9, 8, 3, 1, 11, 7, 6, -1},
-        {10, 1, 2, 6, 11, 7, -1},
-        {1, 2, 10, 3, 0, 8, 6, 11, 7, -1},
-        {2, 9, 0, 2, 10, 9, 6, 11, 7, -1},
-        {6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1},
-        {7, 2, 3, 6, 2, 7, -1},
-        {7, 0, 8, 7, 6, 0, 6, 2, 0, -1},
-        {2, 7, 6, 2, 3, 7, 0, 1, 9, -1},
-        {1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1},
-        {10, 7, 6, 10, 1, 7, 1, 3, 7, -1},
-        {10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1},
-        {0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1},
-        {7, 6, 10, 7, 10, 8, 8, 10, 9, -1},
-        {6, 8, 4, 11, 8, 6, -1},
-        {3, 6, 11, 3, 0, 6, 0, 4, 6, -1},
-        {8, 6, 11, 8, 4, 6, 9, 0, 1, -1},
-        {9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1},
-        {6, 8, 4, 6, 11, 8, 2, 10, 1, -1},
-        {1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1},
-        {4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1},
-        {10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
-        {8, 2, 3, 8, 4, 2, 4, 6, 2, -1},
-        {0, 4, 2, 4, 6, 2, -1},
-        {1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1},
-        {1, 9, 4, 1, 4, 2, 2, 4, 6, -1},
-        {8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1},
-        {10, 1, 0, 10, 0, 6, 6, 0, 4, -1},
-        {4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
-        {10, 9, 4, 6, 10, 4, -1},
-        {4, 9, 5, 7, 6, 11, -1},
-        {0, 8, 3, 4, 9, 5, 11, 7, 6, -1},
-        {5, 0, 1, 5, 4, 0, 7, 6, 11, -1},
-        {11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1},
-        {9, 5, 4, 10, 1, 2, 7, 6, 11, -1},
-        {6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1},
-        {7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1},
-        {3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
-        {7, 2, 3, 7, 6, 2, 5, 4, 9, -1},
-        {9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1},
-        {3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1},
-        {6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
-        {9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1},
-        {1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
-        {4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
-        {7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1},
-        {6, 9, 5, 6, 11, 9, 11, 8, 9, -1},
-        {3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1},
-        {0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1},
-        {6, 11, 3, 6, 3, 5, 5, 3, 1, -1},
-        {1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1},
-        {0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
-        {11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
-        {6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1},
-        {5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1},
-        {9, 5, 6, 9, 6, 0, 0, 6, 2, -1},
-        {1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
-        {1, 5, 6, 2, 1, 6, -1},
-        {1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
-        {10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1},
-        {0, 3, 8, 5, 6, 10, -1},
-        {10, 5, 6, -1},
-        {11, 5, 10, 7, 5, 11, -1},
-        {11, 5, 10, 11, 7, 5, 8, 3, 0, -1},
-        {5, 11, 7, 5, 10, 11, 1, 9, 0, -1},
-        {10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1},
-        {11, 1, 2, 11, 7, 1, 7, 5, 1, -1},
-        {0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1},
-        {9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1},
-        {7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
-        {2, 5, 10, 2, 3, 5, 3, 7, 5, -1},
-        {8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1},
-        {9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1},
-        {9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
-        {1, 3, 5, 3, 7, 5, -1},
-        {0, 8, 7, 0, 7, 1, 1, 7, 5, -1},
-        {9, 0, 3, 9, 3, 5, 5, 3, 7, -1},
-        {9, 8, 7, 5, 9, 7, -1},
-        {5, 8, 4, 5, 10, 8, 10, 11, 8, -1},
-        {5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1},
-        {0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1},
-        {10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
-        {2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1},
-        {0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
-        {0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
-        {9, 4, 5, 2, 11, 3, -1},
-        {2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1},
-        {5, 10, 2, 5, 2, 4, 4, 2, 0, -1},
-        {3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
-        {5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1},
-        {8, 4, 5, 8, 5, 3, 3, 5, 1, -1},
-        {0, 4, 5, 1, 0, 5, -1},
-        {8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1},
-        {9, 4, 5, -1},
-        {4, 11, 7, 4, 9, 11, 9, 10, 11, -1},
-        {0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1},
-        {1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1},
-        {3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
-        {4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1},
-        {9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
-        {11, 7, 4, 11, 4, 2, 2, 4, 0, -1},
-        {11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1},
-        {2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1},
-        {9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
-        {3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
-        {1, 10, 2, 8, 7, 4, -1},
-        {4, 9, 1, 4, 1, 7, 7, 1, 3, -1},
-        {4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1},
-        {4, 0, 3, 7, 4, 3, -1},
-        {4, 8, 7, -1},
-        {9, 10, 8, 10, 11, 8, -1},
-        {3, 0, 9, 3, 9, 11, 11, 9, 10, -1},
-        {0, 1, 10, 0, 10, 8, 8, 10, 11, -1},
-        {3, 1, 10, 11, 3, 10, -1},
-        {1, 2, 11, 1, 11, 9, 9, 11, 8, -1},
-        {3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1},
-        {0, 2, 11, 8, 0, 11, -1},
-        {3, 2, 11, -1},
-        {2, 3, 8, 2, 8, 10, 10, 8, 9, -1},
-        {9, 10, 2, 0, 9, 2, -1},
-        {2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1},
-        {1, 10, 2, -1},
-        {1, 3, 8, 9, 1, 8, -1},
-        {0, 9, 1, -1},
-        {0, 3, 8, -1},
-        {-1}
-    };
+    for (size_t i = 0; i < occ.active.size(); ++i) {
+        occ.active_count += occ.active[i];
+    }
+    const uint8_t max_label = *std::max_element(layer_max.begin(), layer_max.end());
+    if (max_label > class_count) {
+        throw std::runtime_error("Label volume has class " + std::to_string(max_label) + " beyond the class table.");
+    }
+    for (const auto &layer : layer_bounds) {
+        for (size_t k = 0; k < class_count; ++k) {
+            class_bounds[k].merge(layer[k]);
+        }
+    }
+    return occ;
+}
+
+// 标签体的带索引 Marching Cubes（立方体层 [z_begin, z_end)）：一次遍历同时提取所有类别，out[k - 1] 为类别 k 的局部网格。
+// 二值场的交点恒在边中点，且一条边只可能被它两个端点各自的类别穿过，因此缓存为每条边保留两个槽位（按端点区分），
+// 每个类别得到的网格与对该类别的 0/1 掩码单独提取完全一致
+static inline void build_label_slab_mesh(const std::vector<uint8_t> &labels,
+                                         size_t z_count,
+                                         size_t height,
+                                         size_t width,
+                                         size_t z_begin,
+                                         size_t z_end,
+                                         const BrickOccupancy &occ,
+                                         std::vector<SlabMesh> &out) {
+    const size_t slice_size = height * width;
 
-    const float iso = 0.5f;
     const float cx = (width - 1) * 0.5f;
     const float cy = (height - 1) * 0.5f;
     const float cz = (z_count - 1) * 0.5f;
+    constexpr uint32_t kNoVertex = UINT32_MAX;
+
+    // 槽位 = 方向(0=x,1=y) * 2 + 端点(0=坐标较小的一端)；bottom 对应 z 层，top 对应 z+1 层，vertical 只按端点区分
+    std::vector<uint32_t> bottom[4];
+    std::vector<uint32_t> top[4];
+    std::vector<uint32_t> vertical[2];
+    for (int a = 0; a < 4; ++a) {
+        bottom[a].assign(slice_size, kNoVertex);
+        top[a].assign(slice_size, kNoVertex);
+    }
+    for (int a = 0; a < 2; ++a) {
+        vertical[a].assign(slice_size, kNoVertex);
+    }
 
-    auto sample = [&](size_t z, size_t y, size_t x) -> float {
-        return vol[z * slice_size + y * width + x];
-    };
-
-    const int edgeToVertex[12][2] = {
-        {0, 1}, {1, 2}, {2, 3}, {3, 0},
-        {4, 5}, {5, 6}, {6, 7}, {7, 4},
-        {0, 4}, {1, 5}, {2, 6}, {3, 7}
-    };
-
-    const int vertexOffset[8][3] = {
-        {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
-        {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}
-    };
-
-    auto add_vertex = [&](float x, float y, float z, float nx, float ny, float nz) {
-        size_t idx = mesh.positions.size() / 3;
+    auto add_vertex = [&](MeshData &mesh, float x, float y, float z) -> uint32_t {
+        const uint32_t idx = static_cast<uint32_t>(mesh.positions.size() / 3);
         mesh.positions.push_back(x);
         mesh.positions.push_back(y);
         mesh.positions.push_back(z);
-        mesh.normals.push_back(nx);
-        mesh.normals.push_back(ny);
-        mesh.normals.push_back(nz);
+        mesh.normals.push_back(0.0f);
+        mesh.normals.push_back(0.0f);
+        mesh.normals.push_back(0.0f);
 
         float u = (width > 1) ? (x + cx) / (width - 1) : 0.0f;
         float v = (height > 1) ? (y + cy) / (height - 1) : 0.0f;
         mesh.uvs.push_back(u);
         mesh.uvs.push_back(1.0f - v);
 
-        bool init = (idx == 0);
-        update_minmax(mesh, x, y, z, init);
-        mesh.indices.push_back(static_cast<uint32_t>(idx));
+        update_minmax(mesh, x, y, z, idx == 0);
+        return idx;
+    };
+
+    // 槽位中的顶点属于对应端点采样的类别；边键 = 槽位 * slice_size + 像素下标，按升序收集
+    auto collect = [&](const std::vector<uint32_t> face[4], size_t z, bool is_top) {
+        const uint8_t *layer = labels.data() + z * slice_size;
+        for (size_t slot = 0; slot < 4; ++slot) {
+            const size_t step = (slot & 1) ? ((slot >> 1) ? width : 1) : 0;
+            for (size_t cell = 0; cell < slice_size; ++cell) {
+                const uint32_t id = face[slot][cell];
+                if (id == kNoVertex) {
+                    continue;
+                }
+                SlabMesh &target = out[layer[cell + step] - 1];
+                (is_top ? target.top : target.bottom).emplace_back(slot * slice_size + cell, id);
+            }
+        }
     };
 
-    for (size_t z = 0; z + 1 < z_count; ++z) {
+    bool bottom_dirty = false;
+    bool top_dirty = false;
+    bool vertical_dirty = false;
+
+    for (size_t z = z_begin; z < z_end; ++z) {
+        if (z > z_begin) {
+            if (z == z_begin + 1 && z_begin > 0) {
+                collect(bottom, z_begin, false);
+            }
+            for (int a = 0; a < 4; ++a) {
+                bottom[a].swap(top[a]);
+            }
+            std::swap(bottom_dirty, top_dirty);
+            if (top_dirty) {
+                for (int a = 0; a < 4; ++a) {
+                    std::fill(top[a].begin(), top[a].end(), kNoVertex);
+                }
+                top_dirty = false;
+            }
+            if (vertical_dirty) {
+                for (int a = 0; a < 2; ++a) {
+                    std::fill(vertical[a].begin(), vertical[a].end(), kNoVertex);
+                }
+                vertical_dirty = false;
+            }
+        }
+        const size_t bz = z / kMeshBrickSize;
+        if (!occ.layer_active[bz]) {
+            continue;
+        }
         for (size_t y = 0; y + 1 < height; ++y) {
+            const size_t by = y / kMeshBrickSize;
+            if (!occ.row_active[bz * occ.bricks[1] + by]) {
+                continue;
+            }
             for (size_t x = 0; x + 1 < width; ++x) {
-                float cube[8];
+                if (x % kMeshBrickSize == 0 && !occ.is_active(bz, by, x / kMeshBrickSize)) {
+                    x += kMeshBrickSize - 1;
+                    continue;
+                }
+                uint8_t cube[8];
+                bool uniform = true;
                 for (int i = 0; i < 8; ++i) {
-                    cube[i] = sample(z + vertexOffset[i][2],
-                                     y + vertexOffset[i][1],
-                                     x + vertexOffset[i][0]);
+                    cube[i] = labels[(z + kMcVertexOffset[i][2]) * slice_size +
+                                     (y + kMcVertexOffset[i][1]) * width +
+                                     x + kMcVertexOffset[i][0]];
+                    uniform = uniform && cube[i] == cube[0];
                 }
-
-                int cubeIndex = 0;
-                if (cube[0] > iso) cubeIndex |= 1;
-                if (cube[1] > iso) cubeIndex |= 2;
-                if (cube[2] > iso) cubeIndex |= 4;
-                if (cube[3] > iso) cubeIndex |= 8;
-                if (cube[4] > iso) cubeIndex |= 16;
-                if (cube[5] > iso) cubeIndex |= 32;
-                if (cube[6] > iso) cubeIndex |= 64;
-                if (cube[7] > iso) cubeIndex |= 128;
-
-                if (edgeTable[cubeIndex] == 0) {
+                if (uniform) {
                     continue;
                 }
 
-                float vertList[12][3];
-                for (int e = 0; e < 12; ++e) {
-                    if (!(edgeTable[cubeIndex] & (1 << e))) {
+                // 立方体中出现的每个非背景类别各做一次 0/1 判定
+                uint8_t done[8];
+                int done_count = 0;
+                for (int c = 0; c < 8; ++c) {
+                    const uint8_t label = cube[c];
+                    if (label == 0 || std::find(done, done + done_count, label) != done + done_count) {
                         continue;
                     }
-                    int v0 = edgeToVertex[e][0];
-                    int v1 = edgeToVertex[e][1];
-                    float val0 = cube[v0];
-                    float val1 = cube[v1];
-                    float t = 0.5f;
-                    if (std::fabs(val1 - val0) > 1e-6f) {
-                        t = (iso - val0) / (val1 - val0);
+                    done[done_count++] = label;
+                    MeshData &mesh = out[label - 1].mesh;
+
+                    int cube_index = 0;
+                    for (int i = 0; i < 8; ++i) {
+                        if (cube[i] == label) {
+                            cube_index |= 1 << i;
+                        }
+                    }
+                    const int edges = kMcEdgeTable[cube_index];
+
+                    uint32_t vert_ids[12];
+                    for (int e = 0; e < 12; ++e) {
+                        if (!(edges & (1 << e))) {
+                            continue;
+                        }
+                        const int v0 = kMcEdgeToVertex[e][0];
+                        const int v1 = kMcEdgeToVertex[e][1];
+                        const int *o0 = kMcVertexOffset[v0];
+                        const int *o1 = kMcVertexOffset[v1];
+                        const size_t lx = x + std::min(o0[0], o1[0]);
+                        const size_t ly = y + std::min(o0[1], o1[1]);
+                        const size_t cell = ly * width + lx;
+                        const int near = (o0[0] + o0[1] + o0[2] < o1[0] + o1[1] + o1[2]) ? v0 : v1;
+                        const int end = cube[near] == label ? 0 : 1;
+                        uint32_t *slot = nullptr;
+                        if (o0[2] != o1[2]) {
+                            slot = &vertical[end][cell];
+                            vertical_dirty = true;
+                        } else {
+                            const int axis = (o0[0] != o1[0]) ? 0 : 1;
+                            slot = o0[2] ? &top[axis * 2 + end][cell] : &bottom[axis * 2 + end][cell];
+                            (o0[2] ? top_dirty : bottom_dirty) = true;
+                        }
+                        if (*slot == kNoVertex) {
+                            const float t = 0.5f;
+                            const float x0 = static_cast<float>(x + o0[0]);
+                            const float y0 = static_cast<float>(y + o0[1]);
+                            const float z0 = static_cast<float>(z + o0[2]);
+                            const float x1 = static_cast<float>(x + o1[0]);
+                            const float y1 = static_cast<float>(y + o1[1]);
+                            const float z1 = static_cast<float>(z + o1[2]);
+                            *slot = add_vertex(mesh,
+                                               x0 + t * (x1 - x0) - cx,
+                                               y0 + t * (y1 - y0) - cy,
+                                               z0 + t * (z1 - z0) - cz);
+                        }
+                        vert_ids[e] = *slot;
                     }
 
-                    float x0 = static_cast<float>(x + vertexOffset[v0][0]);
-                    float y0 = static_cast<float>(y + vertexOffset[v0][1]);
-                    float z0 = static_cast<float>(z + vertexOffset[v0][2]);
-                    float x1 = static_cast<float>(x + vertexOffset[v1][0]);
-                    float y1 = static_cast<float>(y + vertexOffset[v1][1]);
-                    float z1 = static_cast<float>(z + vertexOffset[v1][2]);
+                    const int *tri = kMcTriTable[cube_index];
+                    for (int i = 0; tri[i] != -1; i += 3) {
+                        const uint32_t ia = vert_ids[tri[i]];
+                        const uint32_t ib = vert_ids[tri[i + 1]];
+                        const uint32_t ic = vert_ids[tri[i + 2]];
+                        mesh.indices.push_back(ia);
+                        mesh.indices.push_back(ib);
+                        mesh.indices.push_back(ic);
+                        accumulate_face_normal(mesh, ia, ib, ic);
+                    }
+                }
+            }
+        }
+    }
+
+    if (z_end == z_begin + 1 && z_begin > 0) {
+        collect(bottom, z_begin, false);
+    }
+    if (z_end + 1 < z_count) {
+        collect(top, z_end, true);
+    }
+}
+
+// 片段缓存键的格式版本：slab 提取算法或片段布局变化时递增，使旧片段全部失效
+static constexpr uint64_t kSlabFragmentVersion = 1;
+
+// 64 位 xorshift-multiply 终结函数（MurmurHash3 fmix64），每一位输入都会扩散到全部输出位
+static inline uint64_t mix_hash64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// 逐切片内容哈希：每个 8 字节字并入累加值后整体过一次 mix_hash64，末尾不足 8 字节的部分补零成一个字，
+// 最后并入切片长度。片段缓存的键由 slab 输入切片的哈希组合而成
+static inline std::vector<uint64_t> hash_label_slices(const std::vector<uint8_t> &labels, size_t z_count, size_t slice_size) {
+    std::vector<uint64_t> hashes(z_count);
+    parallel_for_each_index(z_count, [&](size_t z) {
+        const uint8_t *src = labels.data() + z * slice_size;
+        uint64_t h = 0x9E3779B97F4A7C15ULL;
+        size_t i = 0;
+        for (; i + 8 <= slice_size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, src + i, 8);
+            h = mix_hash64(h ^ word);
+        }
+        if (i < slice_size) {
+            uint64_t word = 0;
+            std::memcpy(&word, src + i, slice_size - i);
+            h = mix_hash64(h ^ word);
+        }
+        hashes[z] = mix_hash64(h ^ static_cast<uint64_t>(slice_size));
+    });
+    return hashes;
+}
+
+// slab 片段的键：网格参数与输入切片 [first_slice, last_slice] 的内容哈希。相邻 slab 共享边界切片，
+// 编辑一张切片会同时使包含它的所有 slab 失效
+static inline uint64_t slab_fragment_key(const std::vector<uint64_t> &slice_hashes,
+                                         size_t first_slice,
+                                         size_t last_slice,
+                                         const std::vector<uint64_t> &params) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL;
+    auto mix = [&h](uint64_t v) {
+        h = mix_hash64(h ^ v);
+    };
+    mix(kSlabFragmentVersion);
+    for (uint64_t p : params) {
+        mix(p);
+    }
+    for (size_t z = first_slice; z <= last_slice; ++z) {
+        mix(slice_hashes[z]);
+    }
+    return h;
+}
+
+// 边界顶点表 (边键, 局部顶点 id) 拆成两个数组存放
+static inline void put_boundary(FragmentWriter &out, const std::vector<std::pair<size_t, uint32_t>> &entries) {
+    std::vector<uint64_t> keys(entries.size());
+    std::vector<uint32_t> ids(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        keys[i] = entries[i].first;
+        ids[i] = entries[i].second;
+    }
+    out.put_vector(keys);
+    out.put_vector(ids);
+}
+
+static inline bool get_boundary(FragmentReader &in, std::vector<std::pair<size_t, uint32_t>> &entries) {
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> ids;
+    if (!in.get_vector(keys) || !in.get_vector(ids) || keys.size() != ids.size()) {
+        return false;
+    }
+    entries.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        entries[i] = {static_cast<size_t>(keys[i]), ids[i]};
+    }
+    return true;
+}
+
+static inline void put_slab_mesh(FragmentWriter &out, const SlabMesh &slab) {
+    out.put_vector(slab.mesh.positions);
+    out.put_vector(slab.mesh.normals);
+    out.put_vector(slab.mesh.uvs);
+    out.put_vector(slab.mesh.indices);
+    out.put(slab.mesh.min_pos);
+    out.put(slab.mesh.max_pos);
+    put_boundary(out, slab.bottom);
+    put_boundary(out, slab.top);
+}
+
+static inline bool get_slab_mesh(FragmentReader &in, SlabMesh &slab) {
+    return in.get_vector(slab.mesh.positions) && in.get_vector(slab.mesh.normals) && in.get_vector(slab.mesh.uvs) &&
+           in.get_vector(slab.mesh.indices) && in.get(slab.mesh.min_pos) && in.get(slab.mesh.max_pos) &&
+           get_boundary(in, slab.bottom) && get_boundary(in, slab.top);
+}
 
-                    vertList[e][0] = x0 + t * (x1 - x0) - cx;
-                    vertList[e][1] = y0 + t * (y1 - y0) - cy;
-                    vertList[e][2] = z0 + t * (z1 - z0) - cz;
+// 从缓存读回或重新提取一个 slab 的各类别片段；put / get 为单个类别片段的序列化函数
+template <typename Slab, typename Build, typename Put, typename Get>
+static inline void build_or_load_slab(SlabFragmentCache *cache, uint64_t key, std::vector<Slab> &slab, Build build, Put put, Get get) {
+    if (cache) {
+        std::string payload;
+        if (cache->load(key, payload)) {
+            FragmentReader in{payload};
+            bool ok = true;
+            for (auto &item : slab) {
+                ok = ok && get(in, item);
+            }
+            if (ok && in.pos == payload.size()) {
+                cache->record(true);
+                return;
+            }
+            std::fill(slab.begin(), slab.end(), Slab());
+        }
+    }
+    build();
+    if (cache) {
+        cache->record(false);
+        FragmentWriter out;
+        for (const auto &item : slab) {
+            put(out, item);
+        }
+        cache->store(key, out.bytes);
+    }
+}
+
+// 一次遍历标签体提取所有类别的网格，返回值下标 k - 1 对应类别 k（无体素的类别为空网格）；
+// class_bounds 非空时输出各类别的体素包围盒。按固定层数的 slab 并行提取后经 stitch_slab_meshes 拼接，输出与核数无关
+static inline std::vector<MeshData> build_label_meshes(const std::vector<uint8_t> &labels,
+                                                       size_t z_count,
+                                                       size_t height,
+                                                       size_t width,
+                                                       size_t class_count,
+                                                       std::vector<VoxelBounds> *class_bounds = nullptr,
+                                                       SlabFragmentCache *cache = nullptr) {
+    std::vector<MeshData> meshes(class_count);
+    std::vector<VoxelBounds> bounds;
+    const BrickOccupancy occ = compute_label_occupancy(labels, z_count, height, width, class_count, bounds);
+    if (class_bounds) {
+        *class_bounds = bounds;
+    }
+    if (occ.active_count == 0) {
+        return meshes;
+    }
+    const size_t layers = z_count - 1;
+    const size_t slab_count = (layers + kMeshSlabDepth - 1) / kMeshSlabDepth;
+    std::vector<std::vector<SlabMesh>> slabs(slab_count, std::vector<SlabMesh>(class_count));
+    const std::vector<uint64_t> slice_hashes = cache ? hash_label_slices(labels, z_count, height * width) : std::vector<uint64_t>();
+    parallel_for_each_index(slab_count, [&](size_t s) {
+        const size_t z_begin = s * kMeshSlabDepth;
+        const size_t z_end = std::min(layers, z_begin + kMeshSlabDepth);
+        // slab 的立方体层 [z_begin, z_end) 读取切片 z_begin..z_end；顶点坐标按整个体居中，键中包含 z_count
+        const uint64_t key = cache ? slab_fragment_key(slice_hashes, z_begin, z_end, {0, z_count, height, width, class_count, z_begin}) : 0;
+        build_or_load_slab(cache, key, slabs[s],
+                           [&] { build_label_slab_mesh(labels, z_count, height, width, z_begin, z_end, occ, slabs[s]); },
+                           put_slab_mesh, get_slab_mesh);
+    });
+
+    std::vector<SlabMesh> column(slab_count);
+    for (size_t k = 0; k < class_count; ++k) {
+        for (size_t s = 0; s < slab_count; ++s) {
+            column[s] = std::move(slabs[s][k]);
+        }
+        meshes[k] = stitch_slab_meshes(column);
+    }
+    return meshes;
+}
+
+// Surface Nets 约束松弛的迭代次数：每次把顶点移到相邻顶点的平均位置，但不离开所属立方体，
+// 消除体素台阶的同时不会让细小结构收缩消失
+static constexpr int kSurfaceNetsRelaxIterations = 4;
+
+// 单个 z-slab 中某一类别的 Surface Nets 局部结果。slab 从 z_begin - 1 层开始扫描，开头 ghost 个顶点属于上一 slab 的最后一层立方体，
+// 只用于连接跨层的四边形，拼接时映射到上一 slab 的同一顶点
+struct NetSlab {
+    std::vector<float> positions;   // 体素格点坐标（未居中）
+    std::vector<float> cell_min;    // 顶点所属立方体的最小角
+    std::vector<uint32_t> quads;    // 每 4 个局部顶点 id 为一个四边形，绕序与 Marching Cubes 输出一致
+    size_t ghost = 0;
+    size_t last_layer_start = 0;    // 最后一层立方体的第一个局部顶点 id
+};
+
+static inline void put_net_slab(FragmentWriter &out, const NetSlab &slab) {
+    out.put_vector(slab.positions);
+    out.put_vector(slab.cell_min);
+    out.put_vector(slab.quads);
+    out.put<uint64_t>(slab.ghost);
+    out.put<uint64_t>(slab.last_layer_start);
+}
+
+static inline bool get_net_slab(FragmentReader &in, NetSlab &slab) {
+    uint64_t ghost = 0;
+    uint64_t last_layer_start = 0;
+    if (!(in.get_vector(slab.positions) && in.get_vector(slab.cell_min) && in.get_vector(slab.quads) && in.get(ghost) &&
+          in.get(last_layer_start))) {
+        return false;
+    }
+    slab.ghost = static_cast<size_t>(ghost);
+    slab.last_layer_start = static_cast<size_t>(last_layer_start);
+    return true;
+}
+
+// 标签体的朴素 Surface Nets（立方体层 [z_begin, z_end)）：每个跨越某类别边界的立方体为该类别生成一个顶点，
+// 位于立方体内各跨越边中点的平均位置；每条两端类别不同的体素边，为两端的非背景类别各生成一个连接周围 4 个立方体顶点的四边形。
+// 四边形只由其最小角立方体生成，相邻立方体取自当前层与上一层，逐层滚动
+static inline void build_label_net_slab(const std::vector<uint8_t> &labels,
+                                        size_t height,
+                                        size_t width,
+                                        size_t z_begin,
+                                        size_t z_end,
+                                        const BrickOccupancy &occ,
+                                        std::vector<NetSlab> &out) {
+    const size_t slice_size = height * width;
+    constexpr uint32_t kNone = UINT32_MAX;
+
+    // [0] 为上一层，[1] 为当前层；first[cell] 指向 entries 中该立方体的第一个顶点，同一立方体的顶点连续存放
+    struct CellVertex {
+        size_t cell;
+        uint8_t label;
+        uint32_t id;
+    };
+    std::vector<uint32_t> first[2] = {std::vector<uint32_t>(slice_size, kNone), std::vector<uint32_t>(slice_size, kNone)};
+    std::vector<CellVertex> entries[2];
+
+    auto lookup = [&](int layer, size_t cell, uint8_t label) -> uint32_t {
+        for (size_t j = first[layer][cell]; j < entries[layer].size() && entries[layer][j].cell == cell; ++j) {
+            if (entries[layer][j].label == label) {
+                return entries[layer][j].id;
+            }
+        }
+        return kNone;
+    };
+
+    const size_t z_start = z_begin > 0 ? z_begin - 1 : z_begin;
+    for (size_t z = z_start; z < z_end; ++z) {
+        if (z > z_start) {
+            for (const auto &e : entries[0]) {
+                first[0][e.cell] = kNone;
+            }
+            entries[0].clear();
+            first[0].swap(first[1]);
+            entries[0].swap(entries[1]);
+        }
+        for (auto &net : out) {
+            if (z == z_begin) {
+                net.ghost = net.positions.size() / 3;
+            }
+            if (z + 1 == z_end) {
+                net.last_layer_start = net.positions.size() / 3;
+            }
+        }
+        const bool ghost_layer = z < z_begin;
+        const size_t bz = z / kMeshBrickSize;
+        if (!occ.layer_active[bz]) {
+            continue;
+        }
+        for (size_t y = 0; y + 1 < height; ++y) {
+            const size_t by = y / kMeshBrickSize;
+            if (!occ.row_active[bz * occ.bricks[1] + by]) {
+                continue;
+            }
+            for (size_t x = 0; x + 1 < width; ++x) {
+                if (x % kMeshBrickSize == 0 && !occ.is_active(bz, by, x / kMeshBrickSize)) {
+                    x += kMeshBrickSize - 1;
+                    continue;
+                }
+                uint8_t cube[8];
+                bool uniform = true;
+                for (int i = 0; i < 8; ++i) {
+                    cube[i] = labels[(z + kMcVertexOffset[i][2]) * slice_size +
+                                     (y + kMcVertexOffset[i][1]) * width +
+                                     x + kMcVertexOffset[i][0]];
+                    uniform = uniform && cube[i] == cube[0];
+                }
+                if (uniform) {
+                    continue;
+                }
+
+                const size_t cell = y * width + x;
+                first[1][cell] = static_cast<uint32_t>(entries[1].size());
+                uint8_t done[8];
+                int done_count = 0;
+                for (int c = 0; c < 8; ++c) {
+                    const uint8_t label = cube[c];
+                    if (label == 0 || std::find(done, done + done_count, label) != done + done_count) {
+                        continue;
+                    }
+                    done[done_count++] = label;
+                    float sum[3] = {0.0f, 0.0f, 0.0f};
+                    int crossings = 0;
+                    for (int e = 0; e < 12; ++e) {
+                        const int v0 = kMcEdgeToVertex[e][0];
+                        const int v1 = kMcEdgeToVertex[e][1];
+                        if ((cube[v0] == label) == (cube[v1] == label)) {
+                            continue;
+                        }
+                        for (int k = 0; k < 3; ++k) {
+                            sum[k] += (kMcVertexOffset[v0][k] + kMcVertexOffset[v1][k]) * 0.5f;
+                        }
+                        ++crossings;
+                    }
+                    NetSlab &net = out[label - 1];
+                    const uint32_t id = static_cast<uint32_t>(net.positions.size() / 3);
+                    const float origin[3] = {static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)};
+                    for (int k = 0; k < 3; ++k) {
+                        net.positions.push_back(origin[k] + sum[k] / crossings);
+                        net.cell_min.push_back(origin[k]);
+                    }
+                    entries[1].push_back({cell, label, id});
+                }
+                if (ghost_layer) {
+                    continue;
                 }
 
-                const int *tri = triTable[cubeIndex];
-                for (int i = 0; tri[i] != -1; i += 3) {
-                    float ax = vertList[tri[i]][0];
-                    float ay = vertList[tri[i]][1];
-                    float az = vertList[tri[i]][2];
-                    float bx = vertList[tri[i + 1]][0];
-                    float by = vertList[tri[i + 1]][1];
-                    float bz = vertList[tri[i + 1]][2];
-                    float cxp = vertList[tri[i + 2]][0];
-                    float cyp = vertList[tri[i + 2]][1];
-                    float czp = vertList[tri[i + 2]][2];
-
-                    float ux = bx - ax;
-                    float uy = by - ay;
-                    float uz = bz - az;
-                    float vx = cxp - ax;
-                    float vy = cyp - ay;
-                    float vz = czp - az;
-
-                    float nx = uy * vz - uz * vy;
-                    float ny = uz * vx - ux * vz;
-                    float nz = ux * vy - uy * vx;
-                    normalize_vec3(nx, ny, nz);
-
-                    add_vertex(ax, ay, az, nx, ny, nz);
-                    add_vertex(bx, by, bz, nx, ny, nz);
-                    add_vertex(cxp, cyp, czp, nx, ny, nz);
+                // 最小角出发的 x / y / z 三条边；(u, v) 取另外两轴且 u × v 为边方向，
+                // 周围 4 个立方体按 c, c-u, c-u-v, c-v 排列时四边形法线沿边方向
+                for (int axis = 0; axis < 3; ++axis) {
+                    static const int kCorner[3] = {1, 3, 4};
+                    const uint8_t near_label = cube[0];
+                    const uint8_t far_label = cube[kCorner[axis]];
+                    if (near_label == far_label) {
+                        continue;
+                    }
+                    int layer[4];
+                    size_t cells[4];
+                    if (axis == 0) {
+                        if (y == 0 || z == 0) {
+                            continue;
+                        }
+                        layer[0] = 1; cells[0] = cell;
+                        layer[1] = 1; cells[1] = cell - width;
+                        layer[2] = 0; cells[2] = cell - width;
+                        layer[3] = 0; cells[3] = cell;
+                    } else if (axis == 1) {
+                        if (x == 0 || z == 0) {
+                            continue;
+                        }
+                        layer[0] = 1; cells[0] = cell;
+                        layer[1] = 0; cells[1] = cell;
+                        layer[2] = 0; cells[2] = cell - 1;
+                        layer[3] = 1; cells[3] = cell - 1;
+                    } else {
+                        if (x == 0 || y == 0) {
+                            continue;
+                        }
+                        layer[0] = 1; cells[0] = cell;
+                        layer[1] = 1; cells[1] = cell - 1;
+                        layer[2] = 1; cells[2] = cell - 1 - width;
+                        layer[3] = 1; cells[3] = cell - width;
+                    }
+                    // 与 Marching Cubes 相同的绕序（法线朝向类别内部，材质为双面）：类别在最小角一侧时反向
+                    for (int side = 0; side < 2; ++side) {
+                        const uint8_t label = side == 0 ? near_label : far_label;
+                        if (label == 0) {
+                            continue;
+                        }
+                        uint32_t ids[4];
+                        bool complete = true;
+                        for (int i = 0; i < 4; ++i) {
+                            ids[i] = lookup(layer[i], cells[i], label);
+                            complete = complete && ids[i] != kNone;
+                        }
+                        if (!complete) {
+                            continue;
+                        }
+                        auto &quads = out[label - 1].quads;
+                        if (side == 0) {
+                            quads.insert(quads.end(), {ids[0], ids[3], ids[2], ids[1]});
+                        } else {
+                            quads.insert(quads.end(), {ids[0], ids[1], ids[2], ids[3]});
+                        }
+                    }
                 }
             }
         }
     }
+}
 
+// 拼接各 slab 的 Surface Nets 结果，做约束松弛后把四边形沿较短的对角线切成三角形，生成带法线与纹理坐标的网格
+static inline MeshData stitch_net_slabs(std::vector<NetSlab> &slabs, size_t z_count, size_t height, size_t width) {
+    MeshData mesh;
+    const size_t slab_count = slabs.size();
+    std::vector<size_t> vertex_offset(slab_count + 1, 0);
+    std::vector<size_t> quad_offset(slab_count + 1, 0);
+    for (size_t s = 0; s < slab_count; ++s) {
+        const NetSlab &slab = slabs[s];
+        const size_t count = slab.positions.size() / 3;
+        if (s > 0 && slab.ghost != slabs[s - 1].positions.size() / 3 - slabs[s - 1].last_layer_start) {
+            throw std::runtime_error("Slab boundary mismatch at slab " + std::to_string(s) + ".");
+        }
+        vertex_offset[s + 1] = vertex_offset[s] + count - slab.ghost;
+        quad_offset[s + 1] = quad_offset[s] + slab.quads.size();
+    }
+    const size_t vertex_count = vertex_offset[slab_count];
+    if (vertex_count == 0) {
+        return mesh;
+    }
+    if (vertex_count > UINT32_MAX) {
+        throw std::runtime_error("Mesh has too many vertices for 32-bit indices.");
+    }
+
+    std::vector<float> pos(vertex_count * 3);
+    std::vector<float> cell_min(vertex_count * 3);
+    std::vector<uint32_t> quads(quad_offset[slab_count]);
+    parallel_for_each_index(slab_count, [&](size_t s) {
+        const NetSlab &slab = slabs[s];
+        const size_t owned = slab.positions.size() / 3 - slab.ghost;
+        std::copy_n(slab.positions.begin() + slab.ghost * 3, owned * 3, pos.begin() + vertex_offset[s] * 3);
+        std::copy_n(slab.cell_min.begin() + slab.ghost * 3, owned * 3, cell_min.begin() + vertex_offset[s] * 3);
+        // ghost 顶点 i 即上一 slab 最后一层的第 i 个顶点
+        const size_t ghost_base = s > 0 ? vertex_offset[s - 1] + slabs[s - 1].last_layer_start - slabs[s - 1].ghost : 0;
+        uint32_t *dst = quads.data() + quad_offset[s];
+        for (size_t i = 0; i < slab.quads.size(); ++i) {
+            const size_t local = slab.quads[i];
+            dst[i] = static_cast<uint32_t>(local < slab.ghost ? ghost_base + local : vertex_offset[s] + local - slab.ghost);
+        }
+    });
+
+    // 四边形的边构成顶点邻接（CSR，去重）
+    std::vector<uint32_t> adj_start(vertex_count + 1, 0);
+    for (size_t q = 0; q < quads.size(); q += 4) {
+        for (int i = 0; i < 4; ++i) {
+            ++adj_start[quads[q + i] + 1];
+            ++adj_start[quads[q + (i + 1) % 4] + 1];
+        }
+    }
+    for (size_t v = 0; v < vertex_count; ++v) {
+        adj_start[v + 1] += adj_start[v];
+    }
+    std::vector<uint32_t> adj(adj_start[vertex_count]);
+    {
+        std::vector<uint32_t> fill(adj_start.begin(), adj_start.end() - 1);
+        for (size_t q = 0; q < quads.size(); q += 4) {
+            for (int i = 0; i < 4; ++i) {
+                const uint32_t a = quads[q + i];
+                const uint32_t b = quads[q + (i + 1) % 4];
+                adj[fill[a]++] = b;
+                adj[fill[b]++] = a;
+            }
+        }
+    }
+    std::vector<uint32_t> adj_end(vertex_count);
+    const size_t kChunk = 4096;
+    const size_t chunks = (vertex_count + kChunk - 1) / kChunk;
+    parallel_for_each_index(chunks, [&](size_t c) {
+        for (size_t v = c * kChunk; v < std::min(vertex_count, (c + 1) * kChunk); ++v) {
+            auto begin = adj.begin() + adj_start[v];
+            std::sort(begin, adj.begin() + adj_start[v + 1]);
+            adj_end[v] = static_cast<uint32_t>(std::unique(begin, adj.begin() + adj_start[v + 1]) - adj.begin());
+        }
+    });
+
+    std::vector<float> next(pos.size());
+    for (int it = 0; it < kSurfaceNetsRelaxIterations; ++it) {
+        parallel_for_each_index(chunks, [&](size_t c) {
+            for (size_t v = c * kChunk; v < std::min(vertex_count, (c + 1) * kChunk); ++v) {
+                const size_t degree = adj_end[v] - adj_start[v];
+                for (int k = 0; k < 3; ++k) {
+                    float p = pos[v * 3 + k];
+                    if (degree > 0) {
+                        float sum = 0.0f;
+                        for (size_t j = adj_start[v]; j < adj_end[v]; ++j) {
+                            sum += pos[adj[j] * 3 + k];
+                        }
+                        p = std::min(std::max(sum / degree, cell_min[v * 3 + k]), cell_min[v * 3 + k] + 1.0f);
+                    }
+                    next[v * 3 + k] = p;
+                }
+            }
+        });
+        pos.swap(next);
+    }
+
+    const float cx = (width - 1) * 0.5f;
+    const float cy = (height - 1) * 0.5f;
+    const float cz = (z_count - 1) * 0.5f;
+    mesh.positions.resize(vertex_count * 3);
+    mesh.normals.assign(vertex_count * 3, 0.0f);
+    mesh.uvs.resize(vertex_count * 2);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        const float x = pos[v * 3];
+        const float y = pos[v * 3 + 1];
+        mesh.positions[v * 3] = x - cx;
+        mesh.positions[v * 3 + 1] = y - cy;
+        mesh.positions[v * 3 + 2] = pos[v * 3 + 2] - cz;
+        mesh.uvs[v * 2] = width > 1 ? x / (width - 1) : 0.0f;
+        mesh.uvs[v * 2 + 1] = 1.0f - (height > 1 ? y / (height - 1) : 0.0f);
+        update_minmax(mesh, mesh.positions[v * 3], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2], v == 0);
+    }
+
+    auto dist2 = [&](uint32_t a, uint32_t b) {
+        float d = 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            const float t = pos[a * 3 + k] - pos[b * 3 + k];
+            d += t * t;
+        }
+        return d;
+    };
+    mesh.indices.reserve(quads.size() / 4 * 6);
+    for (size_t q = 0; q < quads.size(); q += 4) {
+        const uint32_t a = quads[q];
+        const uint32_t b = quads[q + 1];
+        const uint32_t c = quads[q + 2];
+        const uint32_t d = quads[q + 3];
+        const uint32_t tris[2][3] = {{a, b, c}, {a, c, d}};
+        const uint32_t flipped[2][3] = {{a, b, d}, {b, c, d}};
+        const auto &pick = dist2(a, c) <= dist2(b, d) ? tris : flipped;
+        for (const auto &t : pick) {
+            mesh.indices.insert(mesh.indices.end(), {t[0], t[1], t[2]});
+            accumulate_face_normal(mesh, t[0], t[1], t[2]);
+        }
+    }
+    finalize_normals(mesh);
     return mesh;
 }
 
-static inline std::vector<float> build_raw_threshold_mask(const std::vector<float> &raw_volume) {
-    std::vector<float> mask(raw_volume.size(), 0.0f);
-    if (raw_volume.empty()) {
-        return mask;
+// build_label_meshes 的 Surface Nets 版本：输出顺序、包围盒与并行方式相同
+static inline std::vector<MeshData> build_label_nets(const std::vector<uint8_t> &labels,
+                                                     size_t z_count,
+                                                     size_t height,
+                                                     size_t width,
+                                                     size_t class_count,
+                                                     std::vector<VoxelBounds> *class_bounds = nullptr,
+                                                     SlabFragmentCache *cache = nullptr) {
+    std::vector<MeshData> meshes(class_count);
+    std::vector<VoxelBounds> bounds;
+    const BrickOccupancy occ = compute_label_occupancy(labels, z_count, height, width, class_count, bounds);
+    if (class_bounds) {
+        *class_bounds = bounds;
     }
-    float vmin = raw_volume[0];
-    float vmax = raw_volume[0];
-    for (float v : raw_volume) {
-        vmin = std::min(vmin, v);
-        vmax = std::max(vmax, v);
+    if (occ.active_count == 0) {
+        return meshes;
+    }
+
+    const size_t layers = z_count - 1;
+    const size_t slab_count = (layers + kMeshSlabDepth - 1) / kMeshSlabDepth;
+    std::vector<std::vector<NetSlab>> slabs(slab_count, std::vector<NetSlab>(class_count));
+    const std::vector<uint64_t> slice_hashes = cache ? hash_label_slices(labels, z_count, height * width) : std::vector<uint64_t>();
+    parallel_for_each_index(slab_count, [&](size_t s) {
+        const size_t z_begin = s * kMeshSlabDepth;
+        const size_t z_end = std::min(layers, z_begin + kMeshSlabDepth);
+        // 片段为松弛前的格点坐标，与 z_count 无关；ghost 层额外读取切片 z_begin - 1
+        const size_t first_slice = z_begin > 0 ? z_begin - 1 : 0;
+        const uint64_t key = cache ? slab_fragment_key(slice_hashes, first_slice, z_end, {1, height, width, class_count, z_begin}) : 0;
+        build_or_load_slab(cache, key, slabs[s],
+                           [&] { build_label_net_slab(labels, height, width, z_begin, z_end, occ, slabs[s]); },
+                           put_net_slab, get_net_slab);
+    });
+
+    std::vector<NetSlab> column(slab_count);
+    for (size_t k = 0; k < class_count; ++k) {
+        for (size_t s = 0; s < slab_count; ++s) {
+            column[s] = std::move(slabs[s][k]);
+        }
+        meshes[k] = stitch_net_slabs(column, z_count, height, width);
     }
-    float thr = (vmin + vmax) * 0.5f;
-    for (size_t i = 0; i < raw_volume.size(); ++i) {
-        mask[i] = raw_volume[i] > thr ? 1.0f : 0.0f;
+    return meshes;
+}
+
+// 按 opts.mesh_mode 选择等值面提取方式
+static inline std::vector<MeshData> extract_label_meshes(const Options &opts,
+                                                         const std::vector<uint8_t> &labels,
+                                                         size_t z_count,
+                                                         size_t height,
+                                                         size_t width,
+                                                         size_t class_count,
+                                                         std::vector<VoxelBounds> *class_bounds = nullptr) {
+    if (opts.mesh_mode == MeshMode::SurfaceNets) {
+        return build_label_nets(labels, z_count, height, width, class_count, class_bounds, opts.fragment_cache);
     }
-    return mask;
+    return build_label_meshes(labels, z_count, height, width, class_count, class_bounds, opts.fragment_cache);
+}
+
+// 无标注时按原图 (最小值 + 最大值) / 2 阈值化为单类别标签体
+static inline std::vector<uint8_t> build_raw_threshold_labels(const RawVolume &raw_volume) {
+    const size_t count = raw_volume.voxel_count();
+    std::vector<uint8_t> labels(count, 0);
+    if (count == 0) {
+        return labels;
+    }
+    visit_npy_data(raw_volume.dtype, raw_volume.buffer.data(), [&](const auto *data) {
+        float vmin = static_cast<float>(data[0]);
+        float vmax = vmin;
+        for (size_t i = 0; i < count; ++i) {
+            vmin = std::min(vmin, static_cast<float>(data[i]));
+            vmax = std::max(vmax, static_cast<float>(data[i]));
+        }
+        const float thr = (vmin + vmax) * 0.5f;
+        for (size_t i = 0; i < count; ++i) {
+            labels[i] = static_cast<float>(data[i]) > thr ? 1 : 0;
+        }
+    });
+    return labels;
 }
 
 static inline size_t append_aligned(std::vector<unsigned char> &buffer,
@@ -893,9 +2000,215 @@ static inline void write_u32(std::ofstream &out, uint32_t v) {
     out.write(reinterpret_cast<const char *>(&v), sizeof(uint32_t));
 }
 
+// GLB 编码方式：quantize 启用 KHR_mesh_quantization（位置 uint16 + 节点变换反量化、法线 int8、UV unorm16），
+// optimize 按顶点缓存重排三角形并按首次使用顺序重排顶点，超过 65535 个顶点的 primitive 拆成多段，索引统一用 uint16
+struct GlbEncoding {
+    bool quantize = false;
+    bool optimize = false;
+};
+
+// Tipsify（Sander 等, 2007）：沿相邻三角形扇形推进，优先选择仍在 FIFO 缓存中且剩余引用少的顶点，
+// 线性时间内把 ACMR 降到接近下限
+static inline void optimize_vertex_cache(MeshData &mesh, int cache_size = 16) {
+    const size_t vertex_count = mesh.positions.size() / 3;
+    const size_t tri_count = mesh.indices.size() / 3;
+    if (tri_count == 0) {
+        return;
+    }
+
+    std::vector<uint32_t> live(vertex_count, 0);
+    for (uint32_t v : mesh.indices) {
+        live[v]++;
+    }
+    std::vector<uint32_t> adj_offset(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        adj_offset[v + 1] = adj_offset[v] + live[v];
+    }
+    std::vector<uint32_t> adj(mesh.indices.size());
+    {
+        std::vector<uint32_t> fill(adj_offset.begin(), adj_offset.end() - 1);
+        for (size_t t = 0; t < tri_count; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                adj[fill[mesh.indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+    }
+
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<uint8_t> emitted(tri_count, 0);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> out;
+    out.reserve(mesh.indices.size());
+    uint32_t timestamp = static_cast<uint32_t>(cache_size) + 1;
+    size_t cursor = 0;
+    int64_t fan = mesh.indices[0];
+
+    while (fan >= 0) {
+        candidates.clear();
+        const uint32_t f = static_cast<uint32_t>(fan);
+        for (uint32_t a = adj_offset[f]; a < adj_offset[f + 1]; ++a) {
+            const uint32_t t = adj[a];
+            if (emitted[t]) {
+                continue;
+            }
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t v = mesh.indices[t * 3 + k];
+                out.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (timestamp - cache_time[v] > static_cast<uint32_t>(cache_size)) {
+                    cache_time[v] = timestamp++;
+                }
+            }
+            emitted[t] = 1;
+        }
+
+        // 候选顶点中选择在下一扇形输出后仍留在缓存中、且最早进入缓存的一个
+        fan = -1;
+        int64_t best_priority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (timestamp - cache_time[v] + 2 * live[v] <= static_cast<uint32_t>(cache_size)) {
+                priority = timestamp - cache_time[v];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                fan = v;
+            }
+        }
+        if (fan >= 0) {
+            continue;
+        }
+        while (!dead_end.empty()) {
+            const uint32_t v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0) {
+                fan = v;
+                break;
+            }
+        }
+        if (fan >= 0) {
+            continue;
+        }
+        while (cursor < vertex_count) {
+            if (live[cursor] > 0) {
+                fan = static_cast<int64_t>(cursor);
+                break;
+            }
+            ++cursor;
+        }
+    }
+    mesh.indices.swap(out);
+}
+
+// 按索引中首次出现的顺序重排顶点，使顶点读取基本顺序进行
+static inline void optimize_vertex_fetch(MeshData &mesh) {
+    const size_t vertex_count = mesh.positions.size() / 3;
+    const bool has_uv = mesh.uvs.size() == vertex_count * 2;
+    std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+    uint32_t next = 0;
+    for (uint32_t &v : mesh.indices) {
+        if (remap[v] == UINT32_MAX) {
+            remap[v] = next++;
+        }
+        v = remap[v];
+    }
+    std::vector<float> positions(static_cast<size_t>(next) * 3);
+    std::vector<float> normals(static_cast<size_t>(next) * 3);
+    std::vector<float> uvs(has_uv ? static_cast<size_t>(next) * 2 : 0);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        const uint32_t dst = remap[v];
+        if (dst == UINT32_MAX) {
+            continue;
+        }
+        std::copy_n(&mesh.positions[v * 3], 3, &positions[dst * 3]);
+        std::copy_n(&mesh.normals[v * 3], 3, &normals[dst * 3]);
+        if (has_uv) {
+            std::copy_n(&mesh.uvs[v * 2], 2, &uvs[dst * 2]);
+        }
+    }
+    mesh.positions.swap(positions);
+    mesh.normals.swap(normals);
+    mesh.uvs.swap(uvs);
+}
+
+// 把顶点数超过 65535 的网格按三角形顺序切成多段，每段局部重新编号以便使用 uint16 索引；
+// 段边界上的顶点在相邻两段中各存一份。应在 optimize_vertex_cache 之后调用以保持局部性。
+// 索引 0xFFFF 是图元重启值，glTF 不允许出现，因此每段最多 65535 个顶点
+static inline std::vector<MeshData> split_mesh_for_u16(const MeshData &mesh) {
+    constexpr size_t kMaxVertices = 65535;
+    const size_t vertex_count = mesh.positions.size() / 3;
+    const bool has_uv = mesh.uvs.size() == vertex_count * 2;
+    std::vector<MeshData> parts;
+    std::vector<uint32_t> local(vertex_count, UINT32_MAX);
+    std::vector<uint32_t> used;
+    size_t t = 0;
+    const size_t tri_count = mesh.indices.size() / 3;
+    while (t < tri_count) {
+        MeshData part;
+        used.clear();
+        for (; t < tri_count; ++t) {
+            size_t fresh = 0;
+            for (int k = 0; k < 3; ++k) {
+                fresh += local[mesh.indices[t * 3 + k]] == UINT32_MAX;
+            }
+            if (used.size() + fresh > kMaxVertices) {
+                break;
+            }
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t v = mesh.indices[t * 3 + k];
+                if (local[v] == UINT32_MAX) {
+                    local[v] = static_cast<uint32_t>(used.size());
+                    used.push_back(v);
+                    const float *pos = &mesh.positions[v * 3];
+                    part.positions.insert(part.positions.end(), pos, pos + 3);
+                    part.normals.insert(part.normals.end(), &mesh.normals[v * 3], &mesh.normals[v * 3] + 3);
+                    if (has_uv) {
+                        part.uvs.insert(part.uvs.end(), &mesh.uvs[v * 2], &mesh.uvs[v * 2] + 2);
+                    }
+                    update_minmax(part, pos[0], pos[1], pos[2], used.size() == 1);
+                }
+                part.indices.push_back(local[v]);
+            }
+        }
+        for (uint32_t v : used) {
+            local[v] = UINT32_MAX;
+        }
+        parts.push_back(std::move(part));
+    }
+    return parts;
+}
+
+// 转义写入 JSON 字符串字面量的文本（类别名称来自命令行，可能含引号、反斜杠或控制字符）
+static inline std::string escape_json_string(const std::string &text) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(text.size() + 2);
+    for (char c : text) {
+        const unsigned char uc = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (uc < 0x20) {
+            out += "\\u00";
+            out.push_back(kHex[uc >> 4]);
+            out.push_back(kHex[uc & 0xF]);
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
 static inline bool write_glb(const fs::path &output_path,
                              const std::vector<PrimitiveData> &primitives,
-                             const std::vector<unsigned char> &png) {
+                             const std::vector<unsigned char> &png,
+                             const GlbEncoding &encoding = GlbEncoding()) {
     if (primitives.empty()) {
         throw std::runtime_error("No mesh generated. Nothing to write.");
     }
@@ -914,10 +2227,12 @@ static inline bool write_glb(const fs::path &output_path,
         size_t offset = 0;
         size_t length = 0;
         int target = 0;
+        size_t stride = 0;
     };
     struct AccessorInfo {
         int buffer_view = -1;
         int component_type = 0;
+        bool normalized = false;
         size_t count = 0;
         std::string type;
         bool has_minmax = false;
@@ -938,82 +2253,155 @@ static inline bool write_glb(const fs::path &output_path,
     std::vector<AccessorInfo> accessors;
     std::vector<PrimitiveInfo> prim_infos;
 
+    // 量化时所有 primitive 共用一个均匀缩放的网格（节点 translation + scale 反量化），均匀缩放保证法线方向不变
+    float quant_origin[3] = {0.0f, 0.0f, 0.0f};
+    float quant_scale = 1.0f;
+    if (encoding.quantize) {
+        float extent = 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            quant_origin[k] = primitives[0].mesh.min_pos[k];
+            for (const auto &prim : primitives) {
+                quant_origin[k] = std::min(quant_origin[k], prim.mesh.min_pos[k]);
+            }
+            for (const auto &prim : primitives) {
+                extent = std::max(extent, prim.mesh.max_pos[k] - quant_origin[k]);
+            }
+        }
+        quant_scale = extent > 0.0f ? extent / 65535.0f : 1.0f;
+    }
+
+    auto add_view = [&](const void *data, size_t bytes, int target, size_t stride) -> int {
+        const size_t offset = append_aligned(bin, data, bytes);
+        buffer_views.push_back({offset, bytes, target, stride});
+        return static_cast<int>(buffer_views.size() - 1);
+    };
+
     for (size_t p = 0; p < primitives.size(); ++p) {
-        const MeshData &mesh = primitives[p].mesh;
-        if (mesh.positions.empty() || mesh.indices.empty()) {
+        MeshData optimized;
+        const MeshData *source = &primitives[p].mesh;
+        if (source->positions.empty() || source->indices.empty()) {
             throw std::runtime_error("Empty mesh at primitive index " + std::to_string(p) + ".");
         }
+        if (encoding.optimize) {
+            optimized = *source;
+            optimize_vertex_cache(optimized);
+            optimize_vertex_fetch(optimized);
+            source = &optimized;
+        }
+        std::vector<MeshData> split;
+        if (encoding.optimize && source->positions.size() / 3 > 65535) {
+            split = split_mesh_for_u16(*source);
+        }
+        const size_t part_count = split.empty() ? 1 : split.size();
+        for (size_t part = 0; part < part_count; ++part) {
+            const MeshData &mesh = split.empty() ? *source : split[part];
+            const size_t vertex_count = mesh.positions.size() / 3;
+
+            AccessorInfo pos_acc;
+            pos_acc.count = vertex_count;
+            pos_acc.type = "VEC3";
+            pos_acc.has_minmax = true;
+            AccessorInfo nrm_acc;
+            nrm_acc.count = vertex_count;
+            nrm_acc.type = "VEC3";
+            if (encoding.quantize) {
+                // VEC3 的 16 位 / 8 位分量需按 4 字节对齐步长存放
+                std::vector<uint16_t> qpos(vertex_count * 4, 0);
+                uint16_t qmin[3] = {UINT16_MAX, UINT16_MAX, UINT16_MAX};
+                uint16_t qmax[3] = {0, 0, 0};
+                for (size_t v = 0; v < vertex_count; ++v) {
+                    for (int k = 0; k < 3; ++k) {
+                        const float q = std::round((mesh.positions[v * 3 + k] - quant_origin[k]) / quant_scale);
+                        const uint16_t value = static_cast<uint16_t>(std::min(65535.0f, std::max(0.0f, q)));
+                        qpos[v * 4 + k] = value;
+                        qmin[k] = std::min(qmin[k], value);
+                        qmax[k] = std::max(qmax[k], value);
+                    }
+                }
+                pos_acc.buffer_view = add_view(qpos.data(), qpos.size() * sizeof(uint16_t), 34962, 8);
+                pos_acc.component_type = 5123;
+                for (int k = 0; k < 3; ++k) {
+                    pos_acc.min[k] = qmin[k];
+                    pos_acc.max[k] = qmax[k];
+                }
 
-        size_t pos_offset = append_aligned(bin, mesh.positions.data(), mesh.positions.size() * sizeof(float));
-        buffer_views.push_back({pos_offset, mesh.positions.size() * sizeof(float), 34962});
-        int pos_view = static_cast<int>(buffer_views.size() - 1);
-        AccessorInfo pos_acc;
-        pos_acc.buffer_view = pos_view;
-        pos_acc.component_type = 5126;
-        pos_acc.count = mesh.positions.size() / 3;
-        pos_acc.type = "VEC3";
-        pos_acc.has_minmax = true;
-        pos_acc.min[0] = mesh.min_pos[0];
-        pos_acc.min[1] = mesh.min_pos[1];
-        pos_acc.min[2] = mesh.min_pos[2];
-        pos_acc.max[0] = mesh.max_pos[0];
-        pos_acc.max[1] = mesh.max_pos[1];
-        pos_acc.max[2] = mesh.max_pos[2];
-        accessors.push_back(pos_acc);
-        int pos_accessor = static_cast<int>(accessors.size() - 1);
-
-        size_t nrm_offset = append_aligned(bin, mesh.normals.data(), mesh.normals.size() * sizeof(float));
-        buffer_views.push_back({nrm_offset, mesh.normals.size() * sizeof(float), 34962});
-        int nrm_view = static_cast<int>(buffer_views.size() - 1);
-        AccessorInfo nrm_acc;
-        nrm_acc.buffer_view = nrm_view;
-        nrm_acc.component_type = 5126;
-        nrm_acc.count = mesh.normals.size() / 3;
-        nrm_acc.type = "VEC3";
-        accessors.push_back(nrm_acc);
-        int nrm_accessor = static_cast<int>(accessors.size() - 1);
+                std::vector<int8_t> qnrm(vertex_count * 4, 0);
+                for (size_t v = 0; v < vertex_count; ++v) {
+                    for (int k = 0; k < 3; ++k) {
+                        const float q = std::round(mesh.normals[v * 3 + k] * 127.0f);
+                        qnrm[v * 4 + k] = static_cast<int8_t>(std::min(127.0f, std::max(-127.0f, q)));
+                    }
+                }
+                nrm_acc.buffer_view = add_view(qnrm.data(), qnrm.size(), 34962, 4);
+                nrm_acc.component_type = 5120;
+                nrm_acc.normalized = true;
+            } else {
+                pos_acc.buffer_view = add_view(mesh.positions.data(), mesh.positions.size() * sizeof(float), 34962, 0);
+                pos_acc.component_type = 5126;
+                for (int k = 0; k < 3; ++k) {
+                    pos_acc.min[k] = mesh.min_pos[k];
+                    pos_acc.max[k] = mesh.max_pos[k];
+                }
+                nrm_acc.buffer_view = add_view(mesh.normals.data(), mesh.normals.size() * sizeof(float), 34962, 0);
+                nrm_acc.component_type = 5126;
+            }
+            accessors.push_back(pos_acc);
+            int pos_accessor = static_cast<int>(accessors.size() - 1);
+            accessors.push_back(nrm_acc);
+            int nrm_accessor = static_cast<int>(accessors.size() - 1);
+
+            int uv_accessor = -1;
+            bool has_uv = false;
+            if (primitives[p].use_texture) {
+                AccessorInfo uv_acc;
+                uv_acc.count = mesh.uvs.size() / 2;
+                uv_acc.type = "VEC2";
+                if (encoding.quantize) {
+                    std::vector<uint16_t> quv(mesh.uvs.size());
+                    for (size_t i = 0; i < mesh.uvs.size(); ++i) {
+                        quv[i] = static_cast<uint16_t>(std::round(std::min(1.0f, std::max(0.0f, mesh.uvs[i])) * 65535.0f));
+                    }
+                    uv_acc.buffer_view = add_view(quv.data(), quv.size() * sizeof(uint16_t), 34962, 0);
+                    uv_acc.component_type = 5123;
+                    uv_acc.normalized = true;
+                } else {
+                    uv_acc.buffer_view = add_view(mesh.uvs.data(), mesh.uvs.size() * sizeof(float), 34962, 0);
+                    uv_acc.component_type = 5126;
+                }
+                accessors.push_back(uv_acc);
+                uv_accessor = static_cast<int>(accessors.size() - 1);
+                has_uv = true;
+            }
 
-        int uv_accessor = -1;
-        bool has_uv = false;
-        if (primitives[p].use_texture) {
-            size_t uv_offset = append_aligned(bin, mesh.uvs.data(), mesh.uvs.size() * sizeof(float));
-            buffer_views.push_back({uv_offset, mesh.uvs.size() * sizeof(float), 34962});
-            int uv_view = static_cast<int>(buffer_views.size() - 1);
-            AccessorInfo uv_acc;
-            uv_acc.buffer_view = uv_view;
-            uv_acc.component_type = 5126;
-            uv_acc.count = mesh.uvs.size() / 2;
-            uv_acc.type = "VEC2";
-            accessors.push_back(uv_acc);
-            uv_accessor = static_cast<int>(accessors.size() - 1);
-            has_uv = true;
-        }
-
-        size_t idx_offset = append_aligned(bin, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
-        buffer_views.push_back({idx_offset, mesh.indices.size() * sizeof(uint32_t), 34963});
-        int idx_view = static_cast<int>(buffer_views.size() - 1);
-        AccessorInfo idx_acc;
-        idx_acc.buffer_view = idx_view;
-        idx_acc.component_type = 5125;
-        idx_acc.count = mesh.indices.size();
-        idx_acc.type = "SCALAR";
-        accessors.push_back(idx_acc);
-        int idx_accessor = static_cast<int>(accessors.size() - 1);
-
-        PrimitiveInfo prim_info;
-        prim_info.pos_accessor = pos_accessor;
-        prim_info.nrm_accessor = nrm_accessor;
-        prim_info.uv_accessor = uv_accessor;
-        prim_info.has_uv = has_uv;
-        prim_info.idx_accessor = idx_accessor;
-        prim_info.material_index = static_cast<int>(p);
-        prim_infos.push_back(prim_info);
+            AccessorInfo idx_acc;
+            idx_acc.count = mesh.indices.size();
+            idx_acc.type = "SCALAR";
+            if (encoding.optimize && vertex_count <= 65535) {
+                std::vector<uint16_t> idx16(mesh.indices.begin(), mesh.indices.end());
+                idx_acc.buffer_view = add_view(idx16.data(), idx16.size() * sizeof(uint16_t), 34963, 0);
+                idx_acc.component_type = 5123;
+            } else {
+                idx_acc.buffer_view = add_view(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), 34963, 0);
+                idx_acc.component_type = 5125;
+            }
+            accessors.push_back(idx_acc);
+            int idx_accessor = static_cast<int>(accessors.size() - 1);
+
+            PrimitiveInfo prim_info;
+            prim_info.pos_accessor = pos_accessor;
+            prim_info.nrm_accessor = nrm_accessor;
+            prim_info.uv_accessor = uv_accessor;
+            prim_info.has_uv = has_uv;
+            prim_info.idx_accessor = idx_accessor;
+            prim_info.material_index = static_cast<int>(p);
+            prim_infos.push_back(prim_info);
+        }
     }
 
     int image_buffer_view = -1;
     if (include_texture) {
         size_t img_offset = append_aligned(bin, png.data(), png.size());
-        buffer_views.push_back({img_offset, png.size(), 0});
+        buffer_views.push_back({img_offset, png.size(), 0, 0});
         image_buffer_view = static_cast<int>(buffer_views.size() - 1);
     }
 
@@ -1023,9 +2411,20 @@ static inline bool write_glb(const fs::path &output_path,
 
     json << "{";
     json << "\"asset\":{\"version\":\"2.0\",\"generator\":\"npz_to_glb\"},";
+    if (encoding.quantize) {
+        json << "\"extensionsUsed\":[\"KHR_mesh_quantization\"],";
+        json << "\"extensionsRequired\":[\"KHR_mesh_quantization\"],";
+    }
     json << "\"scene\":0,";
     json << "\"scenes\":[{\"nodes\":[0]}],";
-    json << "\"nodes\":[{\"mesh\":0}],";
+    if (encoding.quantize) {
+        json.precision(9);
+        json << "\"nodes\":[{\"mesh\":0,\"translation\":[" << quant_origin[0] << "," << quant_origin[1] << "," << quant_origin[2]
+             << "],\"scale\":[" << quant_scale << "," << quant_scale << "," << quant_scale << "]}],";
+        json.precision(6);
+    } else {
+        json << "\"nodes\":[{\"mesh\":0}],";
+    }
     json << "\"meshes\":[{\"primitives\":[";
     for (size_t i = 0; i < prim_infos.size(); ++i) {
         const auto &prim = prim_infos[i];
@@ -1036,7 +2435,17 @@ static inline bool write_glb(const fs::path &output_path,
             json << ",\"TEXCOORD_0\":" << prim.uv_accessor;
         }
         json << "},\"indices\":" << prim.idx_accessor
-             << ",\"material\":" << prim.material_index << "}";
+             << ",\"material\":" << prim.material_index;
+        const PrimitiveData &src = primitives[prim.material_index];
+        if (!src.label.empty() || !src.bounds.empty) {
+            json << ",\"extras\":{\"label\":\"" << escape_json_string(src.label) << "\"";
+            if (!src.bounds.empty) {
+                json << ",\"voxel_min\":[" << src.bounds.min[0] << "," << src.bounds.min[1] << "," << src.bounds.min[2] << "]"
+                     << ",\"voxel_max\":[" << src.bounds.max[0] << "," << src.bounds.max[1] << "," << src.bounds.max[2] << "]";
+            }
+            json << "}";
+        }
+        json << "}";
         if (i + 1 < prim_infos.size()) {
             json << ",";
         }
@@ -1072,6 +2481,9 @@ static inline bool write_glb(const fs::path &output_path,
     for (size_t i = 0; i < buffer_views.size(); ++i) {
         const auto &view = buffer_views[i];
         json << "{\"buffer\":0,\"byteOffset\":" << view.offset << ",\"byteLength\":" << view.length;
+        if (view.stride != 0) {
+            json << ",\"byteStride\":" << view.stride;
+        }
         if (view.target != 0) {
             json << ",\"target\":" << view.target;
         }
@@ -1087,6 +2499,7 @@ static inline bool write_glb(const fs::path &output_path,
         const auto &acc = accessors[i];
         json << "{\"bufferView\":" << acc.buffer_view
              << ",\"componentType\":" << acc.component_type
+             << (acc.normalized ? ",\"normalized\":true" : "")
              << ",\"count\":" << acc.count
              << ",\"type\":\"" << acc.type << "\"";
         if (acc.has_minmax) {
@@ -1130,54 +2543,37 @@ static inline bool write_glb(const fs::path &output_path,
     return true;
 }
 
-static inline void convert_directory_to_glb(const fs::path &input_dir,
-                                            const fs::path &output_path,
-                                            const Options &opts) {
-    std::vector<float> raw_volume;
-    std::vector<float> ann_volume;
+// 读取目录中的切片并提取各 primitive 的网格：有标注时按颜色表每个类别一个 primitive；无标注时按原图阈值提取，png 为对应纹理
+static inline void load_primitives(const fs::path &input_dir,
+                                   const Options &opts,
+                                   std::vector<PrimitiveData> &primitives,
+                                   std::vector<unsigned char> &png) {
+    RawVolume raw_volume;
+    std::vector<uint8_t> label_volume;
     size_t z_count = 0;
     size_t height = 0;
     size_t width = 0;
     bool has_ann = false;
 
-    load_slices(input_dir, opts, raw_volume, ann_volume, z_count, height, width, has_ann);
+    load_slices(input_dir, opts, raw_volume, label_volume, z_count, height, width, has_ann);
 
-    std::vector<PrimitiveData> primitives;
-    std::vector<unsigned char> png;
+    primitives.clear();
+    png.clear();
 
     if (has_ann) {
-        std::vector<float> yellow_mask(ann_volume.size(), 0.0f);
-        std::vector<float> red_mask(ann_volume.size(), 0.0f);
-        for (size_t i = 0; i < ann_volume.size(); ++i) {
-            float v = ann_volume[i];
-            if (v > 1.0f) {
-                yellow_mask[i] = 1.0f;
-            } else if (v > opts.ann_threshold) {
-                red_mask[i] = 1.0f;
+        const auto &classes = opts.label_classes;
+        std::vector<VoxelBounds> bounds;
+        std::vector<MeshData> meshes = extract_label_meshes(opts, label_volume, z_count, height, width, classes.size(), &bounds);
+        for (size_t k = 0; k < classes.size(); ++k) {
+            if (meshes[k].positions.empty()) {
+                continue;
             }
-        }
-
-        MeshData yellow_mesh = build_mesh_from_scalar(yellow_mask, z_count, height, width);
-        if (!yellow_mesh.positions.empty()) {
-            PrimitiveData prim;
-            prim.mesh = std::move(yellow_mesh);
-            prim.use_texture = false;
-            prim.base_color[0] = 1.0f;
-            prim.base_color[1] = 0.831f;
-            prim.base_color[2] = 0.0f;
-            prim.base_color[3] = 1.0f;
-            primitives.push_back(std::move(prim));
-        }
-
-        MeshData red_mesh = build_mesh_from_scalar(red_mask, z_count, height, width);
-        if (!red_mesh.positions.empty()) {
             PrimitiveData prim;
-            prim.mesh = std::move(red_mesh);
+            prim.mesh = std::move(meshes[k]);
+            prim.label = classes[k].name;
+            prim.bounds = bounds[k];
             prim.use_texture = false;
-            prim.base_color[0] = 1.0f;
-            prim.base_color[1] = 0.231f;
-            prim.base_color[2] = 0.231f;
-            prim.base_color[3] = 1.0f;
+            std::copy_n(classes[k].color, 4, prim.base_color);
             primitives.push_back(std::move(prim));
         }
 
@@ -1188,19 +2584,29 @@ static inline void convert_directory_to_glb(const fs::path &input_dir,
         if (!opts.use_raw_threshold) {
             throw std::runtime_error("No annotation found. Enable raw threshold to build mesh.");
         }
-        std::vector<float> raw_mask = build_raw_threshold_mask(raw_volume);
-        MeshData mesh = build_mesh_from_scalar(raw_mask, z_count, height, width);
-        if (mesh.positions.empty()) {
+        label_volume = build_raw_threshold_labels(raw_volume);
+        std::vector<VoxelBounds> bounds;
+        std::vector<MeshData> meshes = extract_label_meshes(opts, label_volume, z_count, height, width, 1, &bounds);
+        if (meshes[0].positions.empty()) {
             throw std::runtime_error("Mesh is empty. Check your annotation or threshold.");
         }
         PrimitiveData prim;
-        prim.mesh = std::move(mesh);
+        prim.mesh = std::move(meshes[0]);
+        prim.label = "raw";
+        prim.bounds = bounds[0];
         prim.use_texture = true;
         primitives.push_back(std::move(prim));
 
-        png = build_texture_from_raw(raw_volume, z_count, height, width);
+        png = build_texture_from_raw(raw_volume);
     }
+}
 
+static inline void convert_directory_to_glb(const fs::path &input_dir,
+                                            const fs::path &output_path,
+                                            const Options &opts) {
+    std::vector<PrimitiveData> primitives;
+    std::vector<unsigned char> png;
+    load_primitives(input_dir, opts, primitives, png);
     write_glb(output_path, primitives, png);
 }
 
@@ -0,0 +1,351 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+#include "npz_enhance_utils.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace npz_to_glb {
+namespace fs = std::filesystem;
+
+// numpy 元素类型：kind 为 dtype 字符（f / i / u / b），word_size 为字节数
+struct NpyDtype {
+    char kind = 0;
+    size_t word_size = 0;
+
+    bool operator==(const NpyDtype &o) const { return kind == o.kind && word_size == o.word_size; }
+    bool operator!=(const NpyDtype &o) const { return !(*this == o); }
+};
+
+struct NpyHeader {
+    NpyDtype dtype;
+    bool fortran_order = false;
+    std::vector<size_t> shape;
+    size_t data_offset = 0;   // 数据区相对 npy 开头的字节偏移
+};
+
+// npz（zip）中的一个 npy 成员
+struct NpzMember {
+    std::string name;              // 去掉 .npy 后缀
+    npzproc::ZipMemberInfo zip;
+};
+
+// 一次读入整个 npz 文件，由 npzproc 解析 zip 本地文件头；成员按需解压，且可以只解压 npy 头或把数据区直接解压到调用方缓冲
+class NpzFile {
+public:
+    explicit NpzFile(const fs::path &path) : path_(path) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            throw std::runtime_error("Failed to open " + path.string());
+        }
+        bytes_.resize(static_cast<size_t>(in.tellg()));
+        in.seekg(0);
+        if (!bytes_.empty() && !in.read(reinterpret_cast<char *>(bytes_.data()), static_cast<std::streamsize>(bytes_.size()))) {
+            throw std::runtime_error("Failed to read " + path.string());
+        }
+        std::vector<npzproc::ZipMemberInfo> zip_members;
+        try {
+            zip_members = npzproc::list_npz_members(bytes_.data(), bytes_.size());
+        } catch (const std::exception &e) {
+            throw std::runtime_error("Invalid npz " + path.string() + ": " + e.what());
+        }
+        for (auto &zip : zip_members) {
+            NpzMember m;
+            m.name = zip.name;
+            if (m.name.size() > 4 && m.name.compare(m.name.size() - 4, 4, ".npy") == 0) {
+                m.name.erase(m.name.size() - 4);
+            }
+            m.zip = std::move(zip);
+            members_.push_back(std::move(m));
+        }
+    }
+
+    const fs::path &path() const { return path_; }
+    const std::vector<NpzMember> &members() const { return members_; }
+
+    const NpzMember *find(const std::string &name) const {
+        for (const auto &m : members_) {
+            if (m.name == name) {
+                return &m;
+            }
+        }
+        return nullptr;
+    }
+
+    NpyHeader read_header(const NpzMember &m) const {
+        npzproc::NpyMeta meta;
+        try {
+            meta = npzproc::read_npz_member_meta(bytes_.data(), m.zip);
+        } catch (const std::exception &e) {
+            throw std::runtime_error("Invalid npy header in member '" + m.name + "' of " + path_.string() + ": " + e.what());
+        }
+        if (meta.descr.size() < 3) {
+            throw std::runtime_error("Malformed npy dtype in member '" + m.name + "' of " + path_.string());
+        }
+        if (meta.descr[0] == '>') {
+            throw std::runtime_error("Big-endian arrays are not supported: member '" + m.name + "' of " + path_.string());
+        }
+        NpyHeader h;
+        h.dtype.kind = meta.descr[1];
+        h.dtype.word_size = static_cast<size_t>(std::atoi(meta.descr.c_str() + 2));
+        h.fortran_order = meta.fortran_order;
+        h.shape = std::move(meta.shape);
+        h.data_offset = meta.data_offset;
+        size_t count = 1;
+        for (size_t dim : h.shape) {
+            count *= dim;
+        }
+        if (h.data_offset + count * h.dtype.word_size > m.zip.uncompressed_size) {
+            throw std::runtime_error("Npy data is shorter than its shape in member '" + m.name + "' of " + path_.string());
+        }
+        return h;
+    }
+
+    // 解压成员数据，跳过前 skip 个字节后写出 bytes 个字节到 dst；写满即停止，不解压其余部分
+    void inflate_member(const NpzMember &m, size_t skip, unsigned char *dst, size_t bytes) const {
+        npzproc::inflate_npz_member(bytes_.data(), m.zip, skip, dst, bytes);
+    }
+
+private:
+    fs::path path_;
+    std::vector<unsigned char> bytes_;
+    std::vector<NpzMember> members_;
+};
+
+// 按 extract_2d 的规则从 npy 形状得到切片尺寸：去掉长度为 1 的维度后为 2D，或为通道数不超过 4 的 3D（取第 0 个通道）
+static inline bool npy_slice_dims(const NpyHeader &h, size_t &height, size_t &width) {
+    std::vector<size_t> shape;
+    for (size_t v : h.shape) {
+        if (v != 1) {
+            shape.push_back(v);
+        }
+    }
+    if (shape.size() == 2) {
+        height = shape[0];
+        width = shape[1];
+        return true;
+    }
+    if (shape.size() == 3 && shape[0] <= 4) {
+        height = shape[1];
+        width = shape[2];
+        return true;
+    }
+    if (shape.size() == 3 && shape[2] <= 4) {
+        height = shape[0];
+        width = shape[1];
+        return true;
+    }
+    return false;
+}
+
+// 把一张切片按原始 dtype 解码到 dst（height * width 个元素）。C 顺序且无通道维的数组直接解压到 dst，
+// 其余布局先解压到临时缓冲再按步长取第 0 个通道
+static inline void decode_npy_slice(const NpzFile &file,
+                                    const NpzMember &m,
+                                    const NpyHeader &h,
+                                    size_t height,
+                                    size_t width,
+                                    unsigned char *dst) {
+    const size_t ws = h.dtype.word_size;
+    std::vector<size_t> shape;
+    for (size_t v : h.shape) {
+        if (v != 1) {
+            shape.push_back(v);
+        }
+    }
+    if (shape.size() == 2 && !h.fortran_order) {
+        file.inflate_member(m, h.data_offset, dst, height * width * ws);
+        return;
+    }
+
+    size_t count = 1;
+    for (size_t v : shape) {
+        count *= v;
+    }
+    std::vector<unsigned char> all(count * ws);
+    file.inflate_member(m, h.data_offset, all.data(), all.size());
+
+    // 各维步长（元素数）；y、x 对应的维度下标
+    std::vector<size_t> stride(shape.size(), 1);
+    if (h.fortran_order) {
+        for (size_t k = 1; k < shape.size(); ++k) {
+            stride[k] = stride[k - 1] * shape[k - 1];
+        }
+    } else {
+        for (size_t k = shape.size() - 1; k-- > 0;) {
+            stride[k] = stride[k + 1] * shape[k + 1];
+        }
+    }
+    const bool channel_first = shape.size() == 3 && shape[0] <= 4;
+    const size_t sy = stride[channel_first ? 1 : 0];
+    const size_t sx = stride[channel_first ? 2 : 1];
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            std::memcpy(dst + (y * width + x) * ws, all.data() + (y * sy + x * sx) * ws, ws);
+        }
+    }
+}
+
+// 按 dtype 以 fn(const T *data) 访问原始字节；不支持的类型抛出异常
+template <typename Fn>
+static inline void visit_npy_data(const NpyDtype &dtype, const unsigned char *data, Fn &&fn) {
+    switch (dtype.kind) {
+        case 'f':
+            if (dtype.word_size == 4) return fn(reinterpret_cast<const float *>(data));
+            if (dtype.word_size == 8) return fn(reinterpret_cast<const double *>(data));
+            break;
+        case 'u':
+        case 'b':
+            if (dtype.word_size == 1) return fn(reinterpret_cast<const uint8_t *>(data));
+            if (dtype.word_size == 2) return fn(reinterpret_cast<const uint16_t *>(data));
+            if (dtype.word_size == 4) return fn(reinterpret_cast<const uint32_t *>(data));
+            if (dtype.word_size == 8) return fn(reinterpret_cast<const uint64_t *>(data));
+            break;
+        case 'i':
+            if (dtype.word_size == 1) return fn(reinterpret_cast<const int8_t *>(data));
+            if (dtype.word_size == 2) return fn(reinterpret_cast<const int16_t *>(data));
+            if (dtype.word_size == 4) return fn(reinterpret_cast<const int32_t *>(data));
+            if (dtype.word_size == 8) return fn(reinterpret_cast<const int64_t *>(data));
+            break;
+        default:
+            break;
+    }
+    throw std::runtime_error(std::string("Unsupported npy dtype: ") + dtype.kind + std::to_string(dtype.word_size));
+}
+
+// 校验 dtype 能否被 visit_npy_data 访问，供读取数据前提前报错
+static inline void require_supported_npy_dtype(const NpyDtype &dtype) {
+    const size_t ws = dtype.word_size;
+    const bool integer = (dtype.kind == 'u' || dtype.kind == 'b' || dtype.kind == 'i') && (ws == 1 || ws == 2 || ws == 4 || ws == 8);
+    const bool floating = dtype.kind == 'f' && (ws == 4 || ws == 8);
+    if (!integer && !floating) {
+        throw std::runtime_error(std::string("Unsupported npy dtype: ") + dtype.kind + std::to_string(dtype.word_size));
+    }
+}
+
+// 整卷数据的连续存储：默认为堆内存；mapped 时改用匿名映射（POSIX 为已删除的临时文件，Windows 为页面文件），
+// 大体数据可由系统按页换出而不常驻进程堆。映射失败时退回堆内存
+class VolumeBuffer {
+public:
+    VolumeBuffer() = default;
+    VolumeBuffer(const VolumeBuffer &) = delete;
+    VolumeBuffer &operator=(const VolumeBuffer &) = delete;
+    VolumeBuffer(VolumeBuffer &&o) noexcept { swap(o); }
+    VolumeBuffer &operator=(VolumeBuffer &&o) noexcept {
+        if (this != &o) {
+            release();
+            swap(o);
+        }
+        return *this;
+    }
+    ~VolumeBuffer() { release(); }
+
+    void allocate(size_t bytes, bool mapped) {
+        release();
+        size_ = bytes;
+        if (mapped && bytes > 0 && map(bytes)) {
+            return;
+        }
+        heap_.assign(bytes, 0);
+        data_ = heap_.data();
+    }
+
+    void release() {
+        if (mapped_) {
+#ifdef _WIN32
+            UnmapViewOfFile(data_);
+#else
+            munmap(data_, size_);
+#endif
+        }
+        std::vector<unsigned char>().swap(heap_);
+        data_ = nullptr;
+        size_ = 0;
+        mapped_ = false;
+    }
+
+    unsigned char *data() { return data_; }
+    const unsigned char *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool mapped() const { return mapped_; }
+
+private:
+    void swap(VolumeBuffer &o) {
+        heap_.swap(o.heap_);
+        std::swap(data_, o.data_);
+        std::swap(size_, o.size_);
+        std::swap(mapped_, o.mapped_);
+    }
+
+    bool map(size_t bytes) {
+#ifdef _WIN32
+        const unsigned long long n = bytes;
+        HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                            static_cast<DWORD>(n >> 32), static_cast<DWORD>(n & 0xFFFFFFFFull), nullptr);
+        if (!mapping) {
+            return false;
+        }
+        void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+        CloseHandle(mapping);  // 视图持有映射对象的引用
+        if (!view) {
+            return false;
+        }
+        data_ = static_cast<unsigned char *>(view);
+#else
+        FILE *tmp = std::tmpfile();
+        if (!tmp) {
+            return false;
+        }
+        const int fd = fileno(tmp);
+        void *view = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+            view = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        std::fclose(tmp);  // 映射建立后文件描述符可以关闭
+        if (view == MAP_FAILED) {
+            return false;
+        }
+        data_ = static_cast<unsigned char *>(view);
+#endif
+        mapped_ = true;
+        return true;
+    }
+
+    std::vector<unsigned char> heap_;
+    unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+};
+
+// 原图体数据：[z][y][x] 连续存放的原始 dtype 元素
+struct RawVolume {
+    NpyDtype dtype;
+    size_t z_count = 0;
+    size_t height = 0;
+    size_t width = 0;
+    VolumeBuffer buffer;
+
+    size_t voxel_count() const { return z_count * height * width; }
+};
+
+} // namespace npz_to_glb
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 并行执行 count 个相互独立的任务，按 CPU 核数开线程、按下标动态领取；
+// 任一任务失败时停止派发并在全部线程结束后抛出第一个异常。count 不超过 1 或单核时直接在当前线程执行
+template <typename Fn>
+inline void parallel_for_each_index(size_t count, Fn &&fn)
+{
+    const size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+    const size_t workers = std::min(hw, count);
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr first_error;
+    std::mutex error_mtx;
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (size_t t = 0; t < workers; ++t) {
+        threads.emplace_back([&] {
+            while (!failed.load()) {
+                const size_t i = next.fetch_add(1);
+                if (i >= count) break;
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lk(error_mtx);
+                    if (!first_error) first_error = std::current_exception();
+                    failed.store(true);
+                }
+            }
+        });
+    }
+    for (auto &th : threads) th.join();
+    if (first_error) std::rethrow_exception(first_error);
+}
@@ -63,6 +63,7 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
             fs::path enh_png_dir = enh_dir / "pngs";
             fs::path enh_marked_dir = enh_dir / "markedpngs";
             std::error_code ec;
+            invalidate_zip_archive_cache(enh_dir);
             fs::remove_all(enh_dir, ec);
             fs::create_directories(enh_npz_dir);
             fs::create_directories(enh_png_dir);
@@ -75,18 +76,23 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
                                 ", gamma=" + std::to_string(args.gamma) +
                                 ", preserve_resolution=" + std::string(args.preserve_resolution ? "true" : "false"));
 
-            size_t processed_count = 0;
+            std::vector<fs::path> npz_inputs;
             for (const auto &src : files) {
-                if (to_lower_copy(src.extension().string()) != ".npz") continue;
+                if (to_lower_copy(src.extension().string()) == ".npz") npz_inputs.push_back(src);
+            }
+            parallel_for_each_index(npz_inputs.size(), [&](size_t i) {
+                const fs::path &src = npz_inputs[i];
                 npzproc::Args file_args = args;
                 file_args.input = src;
                 file_args.output = enh_npz_dir / src.filename();
                 RuntimeLogger::info("[高级增强] 处理文件: " + src.filename().string());
                 npzproc::process_npz_file(file_args);
-                convert_npz_to_pngs(file_args.output, enh_png_dir, enh_marked_dir, true, true, "_marked");
                 RuntimeLogger::info("[高级增强] 输出完成: " + file_args.output.filename().string());
-                ++processed_count;
-            }
+            });
+            std::vector<fs::path> npz_outputs;
+            for (const auto &src : npz_inputs) npz_outputs.push_back(enh_npz_dir / src.filename());
+            prepare_slice_pngs(enh_npz_dir, npz_outputs, enh_png_dir, enh_marked_dir, true, true, "_marked");
+            const size_t processed_count = npz_inputs.size();
 
             if (processed_count == 0) {
                 throw std::runtime_error("npz目录中没有可处理的 npz 文件");
@@ -119,13 +125,13 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/enhdb/png/<string>").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid, const std::string &filename){
+    CROW_ROUTE(app, "/api/project/<string>/enhdb/png/<string>").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid, const std::string &filename){
         try {
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
             if (filename.find("..") != std::string::npos || filename.find('/') != std::string::npos || filename.find('\\') != std::string::npos) {
                 throw std::runtime_error("invalid filename");
             }
-            return make_binary_file_response(store.base_path / uuid / "enhDBprocessed" / "pngs" / filename, "image/png");
+            return make_slice_png_response(req, store.base_path / uuid / "enhDBprocessed" / "pngs", store.base_path / uuid / "enhDBprocessed" / "npzs", filename);
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -146,13 +152,13 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/enhdb/markedpng/<string>").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid, const std::string &filename){
+    CROW_ROUTE(app, "/api/project/<string>/enhdb/markedpng/<string>").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid, const std::string &filename){
         try {
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
             if (filename.find("..") != std::string::npos || filename.find('/') != std::string::npos || filename.find('\\') != std::string::npos) {
                 throw std::runtime_error("invalid filename");
             }
-            return make_binary_file_response(store.base_path / uuid / "enhDBprocessed" / "markedpngs" / filename, "image/png");
+            return make_binary_file_response(req, store.base_path / uuid / "enhDBprocessed" / "markedpngs" / filename, "image/png");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -161,11 +167,11 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/png").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/png").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求高级增强 PNG 压缩包: uuid=" + uuid);
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
-            return make_zip_response(store.base_path / uuid / "enhDBprocessed" / "pngs", uuid + "_enhdb_png.zip", "enhdb_png.zip");
+            return make_zip_response(req, store.base_path / uuid / "enhDBprocessed" / "pngs", uuid + "_enhdb_png.zip", "enhdb_png.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -174,11 +180,11 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/markedpng").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/markedpng").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求高级增强 markedPNG 压缩包: uuid=" + uuid);
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
-            return make_zip_response(store.base_path / uuid / "enhDBprocessed" / "markedpngs", uuid + "_enhdb_markedpng.zip", "enhdb_markedpng.zip");
+            return make_zip_response(req, store.base_path / uuid / "enhDBprocessed" / "markedpngs", uuid + "_enhdb_markedpng.zip", "enhdb_markedpng.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -187,22 +193,16 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/fused/png").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid){
-        fs::path fused_dir;
+    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/fused/png").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求高级增强 PNG 与 markedPNG 融合压缩包: uuid=" + uuid);
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
             fs::path project_dir = store.base_path / uuid;
-            fused_dir = build_fused_png_temp_dir(project_dir / "enhDBprocessed" / "pngs",
-                                                project_dir / "enhDBprocessed" / "markedpngs",
-                                                uuid + "_enhdb_fused_png");
-            auto response = make_zip_response(fused_dir, uuid + "_enhdb_fused_png.zip", "enhdb_png_markedpng_fused.zip");
-            std::error_code ec;
-            fs::remove_all(fused_dir, ec);
-            return response;
+            return make_fused_zip_response(req, project_dir / "enhDBprocessed" / "npzs",
+                                           project_dir / "enhDBprocessed" / "npzs",
+                                           project_dir / "enhDBprocessed" / "fusedpngs",
+                                           "_marked", uuid + "_enhdb_fused_png.zip", "enhdb_png_markedpng_fused.zip");
         } catch (const std::exception &e) {
-            std::error_code ec;
-            if (!fused_dir.empty()) fs::remove_all(fused_dir, ec);
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
             set_json_headers(r);
@@ -210,11 +210,11 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/npz").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/npz").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求高级增强 NPZ 压缩包: uuid=" + uuid);
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
-            return make_zip_response(store.base_path / uuid / "enhDBprocessed" / "npzs", uuid + "_enhdb_npz.zip", "enhdb_npz.zip");
+            return make_zip_response(req, store.base_path / uuid / "enhDBprocessed" / "npzs", uuid + "_enhdb_npz.zip", "enhdb_npz.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -223,17 +223,16 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/dcm").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/dcm").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求高级增强 DCM 压缩包: uuid=" + uuid);
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
             fs::path project_dir = store.base_path / uuid;
             fs::path dir = project_dir / "enhDBprocessed" / "dcm";
-            if (list_files(dir).empty()) {
-                RuntimeLogger::info("[下载触发转换] [npz转dcm] 高级增强目录为空，开始按需转换: uuid=" + uuid);
-                ensure_converted_from_npz_dir(project_dir / "enhDBprocessed" / "npzs", dir, "dcm", "image");
+            if (ensure_converted_from_npz_dir(project_dir / "enhDBprocessed" / "npzs", dir, "dcm", "image")) {
+                RuntimeLogger::info("[下载触发转换] [npz转dcm] 已按需导出(源npz有变化或首次导出): uuid=" + uuid);
             }
-            return make_zip_response(dir, uuid + "_enhdb_dcm.zip", "enhdb_dcm.zip");
+            return make_zip_response(req, dir, uuid + "_enhdb_dcm.zip", "enhdb_dcm.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -242,17 +241,16 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/nii").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/enhdb/nii").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求高级增强 NII 压缩包: uuid=" + uuid);
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
             fs::path project_dir = store.base_path / uuid;
             fs::path dir = project_dir / "enhDBprocessed" / "nii";
-            if (list_files(dir).empty()) {
-                RuntimeLogger::info("[下载触发转换] [npz转nii] 高级增强目录为空，开始按需转换: uuid=" + uuid);
-                ensure_converted_from_npz_dir(project_dir / "enhDBprocessed" / "npzs", dir, "nii", "image");
+            if (ensure_converted_from_npz_dir(project_dir / "enhDBprocessed" / "npzs", dir, "nii", "image")) {
+                RuntimeLogger::info("[下载触发转换] [npz转nii] 已按需导出(源npz有变化或首次导出): uuid=" + uuid);
             }
-            return make_zip_response(dir, uuid + "_enhdb_nii.zip", "enhdb_nii.zip");
+            return make_zip_response(req, dir, uuid + "_enhdb_nii.zip", "enhdb_nii.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -273,10 +271,22 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/3d").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/3d").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
+        try {
+            if (!store.exists(uuid)) throw std::runtime_error("project not found");
+            return make_glb_download_response(req, store.base_path / uuid / "3d" / "model.glb");
+        } catch (const std::exception &e) {
+            crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
+            r.code = 400;
+            set_json_headers(r);
+            return r;
+        }
+    });
+
+    CROW_ROUTE(app, "/api/project/<string>/download/OG3d").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
         try {
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
-            return make_glb_download_response(store.base_path / uuid / "3d" / "model.glb");
+            return make_glb_download_response(req, store.base_path / uuid / "OG3d" / "model.glb");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -285,10 +295,10 @@ inline void register_project_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/OG3d").methods(crow::HTTPMethod::GET)([&store](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/3d_volume").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &uuid){
         try {
             if (!store.exists(uuid)) throw std::runtime_error("project not found");
-            return make_glb_download_response(store.base_path / uuid / "OG3d" / "model.glb");
+            return make_brick_volume_response(req, store.base_path / uuid);
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
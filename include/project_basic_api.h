@@ -202,10 +202,11 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/png/<string>").methods(crow::HTTPMethod::GET)([require_project_dir, ensure_safe_filename](const std::string &uuid, const std::string &filename){
+    CROW_ROUTE(app, "/api/project/<string>/png/<string>").methods(crow::HTTPMethod::GET)([require_project_dir, ensure_safe_filename](const crow::request &req, const std::string &uuid, const std::string &filename){
         try {
             ensure_safe_filename(filename);
-            return make_binary_file_response(require_project_dir(uuid) / "png" / filename, "image/png");
+            const fs::path project_dir = require_project_dir(uuid);
+            return make_slice_png_response(req, project_dir / "png", project_dir / "npz", filename);
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -225,10 +226,10 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/markedpng/<string>").methods(crow::HTTPMethod::GET)([require_project_dir, ensure_safe_filename](const std::string &uuid, const std::string &filename){
+    CROW_ROUTE(app, "/api/project/<string>/markedpng/<string>").methods(crow::HTTPMethod::GET)([require_project_dir, ensure_safe_filename](const crow::request &req, const std::string &uuid, const std::string &filename){
         try {
             ensure_safe_filename(filename);
-            return make_binary_file_response(require_project_dir(uuid) / "markedpng" / filename, "image/png");
+            return make_binary_file_response(req, require_project_dir(uuid) / "markedpng" / filename, "image/png");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -248,10 +249,10 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/processed/png/<string>").methods(crow::HTTPMethod::GET)([require_project_dir, ensure_safe_filename](const std::string &uuid, const std::string &filename){
+    CROW_ROUTE(app, "/api/project/<string>/processed/png/<string>").methods(crow::HTTPMethod::GET)([require_project_dir, ensure_safe_filename](const crow::request &req, const std::string &uuid, const std::string &filename){
         try {
             ensure_safe_filename(filename);
-            return make_binary_file_response(require_project_dir(uuid) / "processed" / "pngs" / filename, "image/png");
+            return make_binary_file_response(req, require_project_dir(uuid) / "processed" / "pngs" / filename, "image/png");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -260,10 +261,43 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/png").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/slices").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
+        try {
+            return make_slice_batch_response(req, require_project_dir(uuid));
+        } catch (const std::exception &e) {
+            crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
+            r.code = 400;
+            set_json_headers(r);
+            return r;
+        }
+    });
+
+    CROW_ROUTE(app, "/api/project/<string>/volume/raw").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
+        try {
+            return make_raw_volume_response(req, require_project_dir(uuid));
+        } catch (const std::exception &e) {
+            crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
+            r.code = 400;
+            set_json_headers(r);
+            return r;
+        }
+    });
+
+    CROW_ROUTE(app, "/api/project/<string>/thumbnails").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
+        try {
+            return make_slice_atlas_response(req, require_project_dir(uuid));
+        } catch (const std::exception &e) {
+            crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
+            r.code = 400;
+            set_json_headers(r);
+            return r;
+        }
+    });
+
+    CROW_ROUTE(app, "/api/project/<string>/download/png").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求PNG压缩包: uuid=" + uuid);
-            return make_zip_response(require_project_dir(uuid) / "png", uuid + "_png.zip", "png.zip");
+            return make_zip_response(req, require_project_dir(uuid) / "png", uuid + "_png.zip", "png.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -272,10 +306,10 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/markedpng").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/markedpng").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求markedPNG压缩包: uuid=" + uuid);
-            return make_zip_response(require_project_dir(uuid) / "markedpng", uuid + "_markedpng.zip", "markedpng.zip");
+            return make_zip_response(req, require_project_dir(uuid) / "markedpng", uuid + "_markedpng.zip", "markedpng.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -284,19 +318,12 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/fused/png").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
-        fs::path fused_dir;
+    CROW_ROUTE(app, "/api/project/<string>/download/fused/png").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求PNG与markedPNG融合压缩包: uuid=" + uuid);
             fs::path project_dir = require_project_dir(uuid);
-            fused_dir = build_fused_png_temp_dir(project_dir / "png", project_dir / "markedpng", uuid + "_fused_png");
-            auto response = make_zip_response(fused_dir, uuid + "_fused_png.zip", "png_markedpng_fused.zip");
-            std::error_code ec;
-            fs::remove_all(fused_dir, ec);
-            return response;
+            return make_fused_zip_response(req, project_dir / "npz", project_dir / "npz", project_dir / "fusedpng", "_marked", uuid + "_fused_png.zip", "png_markedpng_fused.zip");
         } catch (const std::exception &e) {
-            std::error_code ec;
-            if (!fused_dir.empty()) fs::remove_all(fused_dir, ec);
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
             set_json_headers(r);
@@ -304,10 +331,10 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/npz").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/npz").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求NPZ压缩包: uuid=" + uuid);
-            return make_zip_response(require_project_dir(uuid) / "npz", uuid + "_npz.zip", "npz.zip");
+            return make_zip_response(req, require_project_dir(uuid) / "npz", uuid + "_npz.zip", "npz.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -316,17 +343,16 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/dcm").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/dcm").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求DCM压缩包: uuid=" + uuid);
             fs::path project_dir = require_project_dir(uuid);
             fs::path dir = project_dir / "dcm";
-            if (list_files(dir).empty()) {
-                RuntimeLogger::info("[下载触发转换] [npz转dcm] 目录为空，开始按需转换: uuid=" + uuid);
-                ensure_converted_from_npz_dir(project_dir / "npz", dir, "dcm", "image");
+            if (ensure_converted_from_npz_dir(project_dir / "npz", dir, "dcm", "image")) {
+                RuntimeLogger::info("[下载触发转换] [npz转dcm] 已按需导出(源npz有变化或首次导出): uuid=" + uuid);
                 update_project_json_fields(project_dir / "project.json", {{"dcm", "true"}});
             }
-            return make_zip_response(dir, uuid + "_dcm.zip", "dcm.zip");
+            return make_zip_response(req, dir, uuid + "_dcm.zip", "dcm.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -335,17 +361,16 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/nii").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/nii").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
-            RuntimeLogger::info("[下载] 请求NII压缩包: uuid=" + uuid);
+            RuntimeLogger::info("[下载] 请求NII: uuid=" + uuid);
             fs::path project_dir = require_project_dir(uuid);
-            fs::path dir = project_dir / "nii";
-            if (list_files(dir).empty()) {
-                RuntimeLogger::info("[下载触发转换] [npz转nii] 目录为空，开始按需转换: uuid=" + uuid);
-                ensure_converted_from_npz_dir(project_dir / "npz", dir, "nii", "image");
+            bool converted = false;
+            auto r = make_nii_download_response(req, project_dir / "npz", project_dir / "nii", "image", uuid + "_nii.zip", "nii", &converted);
+            if (converted) {
                 update_project_json_fields(project_dir / "project.json", {{"nii", "true"}});
             }
-            return make_zip_response(dir, uuid + "_nii.zip", "nii.zip");
+            return r;
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -354,9 +379,9 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/processed/png").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/processed/png").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
-            return make_zip_response(require_project_dir(uuid) / "processed" / "pngs", uuid + "_processed_png.zip", "processed_png.zip");
+            return make_zip_response(req, require_project_dir(uuid) / "processed" / "pngs", uuid + "_processed_png.zip", "processed_png.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -365,10 +390,10 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/processed/markedpng").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/processed/markedpng").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求processed markedPNG压缩包: uuid=" + uuid);
-            return make_zip_response(require_project_dir(uuid) / "processed" / "pngs", uuid + "_processed_markedpng.zip", "processed_markedpng.zip");
+            return make_zip_response(req, require_project_dir(uuid) / "processed" / "pngs", uuid + "_processed_markedpng.zip", "processed_markedpng.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -377,19 +402,12 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/processed/fused/png").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
-        fs::path fused_dir;
+    CROW_ROUTE(app, "/api/project/<string>/download/processed/fused/png").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求processed PNG与markedPNG融合压缩包: uuid=" + uuid);
             fs::path project_dir = require_project_dir(uuid);
-            fused_dir = build_fused_png_temp_dir(project_dir / "png", project_dir / "processed" / "pngs", uuid + "_processed_fused_png");
-            auto response = make_zip_response(fused_dir, uuid + "_processed_fused_png.zip", "processed_png_markedpng_fused.zip");
-            std::error_code ec;
-            fs::remove_all(fused_dir, ec);
-            return response;
+            return make_fused_zip_response(req, project_dir / "npz", project_dir / "processed" / "npzs", project_dir / "processed" / "fusedpngs", "", uuid + "_processed_fused_png.zip", "processed_png_markedpng_fused.zip");
         } catch (const std::exception &e) {
-            std::error_code ec;
-            if (!fused_dir.empty()) fs::remove_all(fused_dir, ec);
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
             set_json_headers(r);
@@ -397,9 +415,9 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/processed/npz").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/processed/npz").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
-            return make_zip_response(require_project_dir(uuid) / "processed" / "npzs", uuid + "_processed_npz.zip", "processed_npz.zip");
+            return make_zip_response(req, require_project_dir(uuid) / "processed" / "npzs", uuid + "_processed_npz.zip", "processed_npz.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -408,17 +426,16 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/processed/dcm").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/processed/dcm").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
             RuntimeLogger::info("[下载] 请求processed DCM压缩包: uuid=" + uuid);
             fs::path project_dir = require_project_dir(uuid);
             fs::path dir = project_dir / "processed" / "dcm";
-            if (list_files(dir).empty()) {
-                RuntimeLogger::info("[下载触发转换] [npz转dcm] processed目录为空，开始按需转换: uuid=" + uuid);
-                ensure_converted_from_npz_dir(project_dir / "processed" / "npzs", dir, "dcm", "label");
+            if (ensure_converted_from_npz_dir(project_dir / "processed" / "npzs", dir, "dcm", "label")) {
+                RuntimeLogger::info("[下载触发转换] [npz转dcm] 已按需导出(源npz有变化或首次导出): uuid=" + uuid);
                 update_project_json_fields(project_dir / "project.json", {{"PD-dcm", "true"}});
             }
-            return make_zip_response(dir, uuid + "_processed_dcm.zip", "processed_dcm.zip");
+            return make_zip_response(req, dir, uuid + "_processed_dcm.zip", "processed_dcm.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -427,17 +444,17 @@ inline void register_project_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/project/<string>/download/processed/nii").methods(crow::HTTPMethod::GET)([require_project_dir](const std::string &uuid){
+    CROW_ROUTE(app, "/api/project/<string>/download/processed/nii").methods(crow::HTTPMethod::GET)([require_project_dir](const crow::request &req, const std::string &uuid){
         try {
-            RuntimeLogger::info("[下载] 请求processed NII压缩包: uuid=" + uuid);
+            RuntimeLogger::info("[下载] 请求processed NII: uuid=" + uuid);
             fs::path project_dir = require_project_dir(uuid);
-            fs::path dir = project_dir / "processed" / "nii";
-            if (list_files(dir).empty()) {
-                RuntimeLogger::info("[下载触发转换] [npz转nii] processed目录为空，开始按需转换: uuid=" + uuid);
-                ensure_converted_from_npz_dir(project_dir / "processed" / "npzs", dir, "nii", "label");
+            bool converted = false;
+            auto r = make_nii_download_response(req, project_dir / "processed" / "npzs", project_dir / "processed" / "nii", "label",
+                                                uuid + "_processed_nii.zip", "processed_nii", &converted);
+            if (converted) {
                 update_project_json_fields(project_dir / "project.json", {{"PD-nii", "true"}});
             }
-            return make_zip_response(dir, uuid + "_processed_nii.zip", "processed_nii.zip");
+            return r;
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400;
@@ -200,7 +200,7 @@ inline void register_project_llm_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/llm/rag/download/<path>").methods(crow::HTTPMethod::GET)([&store](const std::string &name) {
+    CROW_ROUTE(app, "/api/llm/rag/download/<path>").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &name) {
         try {
             RuntimeLogger::info("[RAG][下载文档] 请求: name=" + name);
             if (name.empty() || name.find("..") != std::string::npos || name.find('/') != std::string::npos || name.find('\\') != std::string::npos) {
@@ -230,12 +230,7 @@ inline void register_project_llm_routes(App &app, InfoStore &store)
 
             RuntimeLogger::info("[RAG][下载文档] 命中: path=" + target_path.string());
 
-            crow::response r{read_text_file(target_path)};
-            r.set_header("Content-Type", "application/octet-stream");
-            r.set_header("Content-Disposition", "attachment; filename=\"" + download_name + "\"");
-            r.set_header("Access-Control-Allow-Origin", "*");
-            r.code = 200;
-            return r;
+            return make_streamed_file_response(req, target_path, "application/octet-stream", download_name);
         } catch (const std::exception &e) {
             RuntimeLogger::error(std::string("[RAG][下载文档] 失败: ") + e.what());
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
@@ -245,17 +240,13 @@ inline void register_project_llm_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/llm/rag/download").methods(crow::HTTPMethod::GET)([&store]() {
+    CROW_ROUTE(app, "/api/llm/rag/download").methods(crow::HTTPMethod::GET)([&store](const crow::request &req) {
         try {
             fs::path dir = rag_db_dir(store);
             RuntimeLogger::info("[RAG][下载全集] 开始打包: dir=" + dir.string());
-            auto zip_path = create_zip_store(dir, "llm_rag_documents.zip");
+            auto zip_path = cached_zip_archive({dir}, "zip|level=5", [&] { return create_zip_store(dir, "llm_rag_documents.zip"); });
             RuntimeLogger::info("[RAG][下载全集] 打包完成: zip=" + zip_path.string());
-            crow::response r{read_text_file(zip_path)};
-            r.set_header("Content-Type", "application/zip");
-            r.set_header("Content-Disposition", "attachment; filename=\"llm_rag_documents.zip\"");
-            r.set_header("Access-Control-Allow-Origin", "*");
-            return r;
+            return make_streamed_file_response(req, zip_path, "application/zip", "llm_rag_documents.zip");
         } catch (const std::exception &e) {
             RuntimeLogger::error(std::string("[RAG][下载全集] 失败: ") + e.what());
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <crow.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "runtime_logger.h"
+
+// 文本响应压缩参数；level 为 0 时关闭压缩
+struct ResponseCompressionOptions {
+    int level = 4;              // zlib 压缩级别 1-9，列表/JSON 在 4 档已接近最佳压缩比
+    size_t min_bytes = 1024;    // 小于该长度的响应压缩收益不抵头部开销，直接原样返回
+};
+
+inline ResponseCompressionOptions &response_compression_options()
+{
+    static ResponseCompressionOptions options;
+    return options;
+}
+
+struct ResponseCompressionMiddleware {
+    enum class Encoding { None, Gzip, Deflate };
+
+    struct context {
+        Encoding encoding = Encoding::None;
+    };
+
+    // 每个工作线程持有一对常驻 z_stream，每次压缩只做 deflateReset，省去 deflateInit2 分配窗口与哈希表的开销
+    struct ThreadStreams {
+        z_stream gzip{};
+        z_stream deflate{};
+        bool gzip_ready = false;
+        bool deflate_ready = false;
+        int level = -1;
+
+        ~ThreadStreams() { release(); }
+
+        void release()
+        {
+            if (gzip_ready) deflateEnd(&gzip);
+            if (deflate_ready) deflateEnd(&deflate);
+            gzip_ready = deflate_ready = false;
+        }
+
+        z_stream *acquire(Encoding encoding, int wanted_level)
+        {
+            if (level != wanted_level) {
+                release();
+                level = wanted_level;
+            }
+            const bool is_gzip = encoding == Encoding::Gzip;
+            z_stream &zs = is_gzip ? gzip : deflate;
+            bool &ready = is_gzip ? gzip_ready : deflate_ready;
+            if (ready) {
+                if (deflateReset(&zs) != Z_OK) return nullptr;
+                return &zs;
+            }
+            zs = z_stream{};
+            // windowBits 15 + 16 输出 gzip 封装；HTTP 的 deflate 指 zlib 封装，使用默认 15
+            if (deflateInit2(&zs, wanted_level, Z_DEFLATED, is_gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return nullptr;
+            }
+            ready = true;
+            return &zs;
+        }
+    };
+
+    static ThreadStreams &thread_streams()
+    {
+        thread_local ThreadStreams streams;
+        return streams;
+    }
+
+    static std::string trim_lower(std::string text)
+    {
+        text.erase(0, text.find_first_not_of(" \t"));
+        text.erase(text.find_last_not_of(" \t") + 1);
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    // 解析 Accept-Encoding：按各编码的 q 值选择，gzip 与 deflate 同分时优先 gzip。
+    // 显式列出的编码（包括 q=0 的明确拒绝）优先于通配符 *，未列出且无通配符的编码视为不可用
+    static Encoding negotiate(const std::string &header)
+    {
+        double gzip_q = -1.0;
+        double deflate_q = -1.0;
+        double wildcard_q = -1.0;
+        std::stringstream ss(header);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            std::stringstream params(item);
+            std::string name;
+            std::getline(params, name, ';');
+            name = trim_lower(name);
+            if (name.empty()) continue;
+            double q = 1.0;
+            std::string param;
+            while (std::getline(params, param, ';')) {
+                const auto eq = param.find('=');
+                if (eq == std::string::npos || trim_lower(param.substr(0, eq)) != "q") continue;
+                const std::string value = trim_lower(param.substr(eq + 1));
+                char *end = nullptr;
+                q = std::strtod(value.c_str(), &end);
+                if (end == value.c_str()) q = 0.0;
+                q = std::clamp(q, 0.0, 1.0);
+            }
+            if (name == "gzip" || name == "x-gzip") gzip_q = std::max(gzip_q, q);
+            else if (name == "deflate") deflate_q = std::max(deflate_q, q);
+            else if (name == "*") wildcard_q = std::max(wildcard_q, q);
+        }
+        const double gzip = gzip_q >= 0.0 ? gzip_q : std::max(wildcard_q, 0.0);
+        const double deflate = deflate_q >= 0.0 ? deflate_q : std::max(wildcard_q, 0.0);
+        if (gzip > 0.0 && gzip >= deflate) return Encoding::Gzip;
+        if (deflate > 0.0) return Encoding::Deflate;
+        return Encoding::None;
+    }
+
+    // 只压缩文本类响应；png / zip / glb / npz 等本身已压缩或为二进制的内容直接跳过
+    static bool is_compressible(const crow::response &res)
+    {
+        std::string content_type = res.get_header_value("Content-Type");
+        std::transform(content_type.begin(), content_type.end(), content_type.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (content_type.empty()) return !RuntimeLogger::is_binary_like(res.body);
+        return content_type.rfind("text/", 0) == 0 ||
+               content_type.find("json") != std::string::npos ||
+               content_type.find("javascript") != std::string::npos ||
+               content_type.find("xml") != std::string::npos;
+    }
+
+    static bool compress(const std::string &input, Encoding encoding, int level, std::string &out)
+    {
+        z_stream *zs = thread_streams().acquire(encoding, level);
+        if (!zs) return false;
+        out.resize(deflateBound(zs, static_cast<uLong>(input.size())));
+        zs->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+        zs->avail_in = static_cast<uInt>(input.size());
+        zs->next_out = reinterpret_cast<Bytef *>(&out[0]);
+        zs->avail_out = static_cast<uInt>(out.size());
+        if (deflate(zs, Z_FINISH) != Z_STREAM_END) return false;
+        out.resize(zs->total_out);
+        return true;
+    }
+
+    void before_handle(crow::request &req, crow::response &, context &ctx)
+    {
+        if (response_compression_options().level <= 0) return;
+        ctx.encoding = negotiate(req.get_header_value("Accept-Encoding"));
+    }
+
+    void after_handle(crow::request &req, crow::response &res, context &ctx)
+    {
+        const auto &options = response_compression_options();
+        if (options.level <= 0 || req.method == crow::HTTPMethod::HEAD) return;
+        if (res.code < 200 || res.code == 204 || res.code == 206 || res.code == 304) return;
+        if (res.body.size() < std::max<size_t>(options.min_bytes, 1)) return;
+        if (res.body.size() > static_cast<size_t>(0x7fffffff)) return;
+        if (!res.get_header_value("Content-Encoding").empty() || !is_compressible(res)) return;
+
+        res.set_header("Vary", "Accept-Encoding");
+        if (ctx.encoding == Encoding::None) return;
+        std::string packed;
+        if (!compress(res.body, ctx.encoding, std::min(options.level, 9), packed) || packed.size() >= res.body.size()) return;
+
+        res.body.swap(packed);
+        res.set_header("Content-Encoding", ctx.encoding == Encoding::Gzip ? "gzip" : "deflate");
+        // 压缩后字节与原表示不同，强 ETag 降为弱 ETag；if_none_match_hit 按弱比较匹配，304 仍然生效
+        const std::string etag = res.get_header_value("ETag");
+        if (!etag.empty() && etag.rfind("W/", 0) != 0) res.set_header("ETag", "W/" + etag);
+    }
+};
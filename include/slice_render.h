@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "npz_enhance_utils.h"
+
+// 切片PNG渲染: 原图按 dtype 直接归一化到 u8，标注经 256 项 RGBA 查找表上色(cv::LUT 内部向量化)
+namespace slice_render {
+
+namespace fs = std::filesystem;
+
+struct PngOptions {
+    int compression = 1;                          // 0-9，1 为最快档，适合浏览器查看
+    int strategy = cv::IMWRITE_PNG_STRATEGY_DEFAULT;
+    bool lazy = false;                            // true 时不预先写 PNG，由读取接口从 npz 按需渲染
+};
+
+// 进程级 PNG 编码参数，由 main 在启动时按命令行设置
+inline PngOptions& png_options() {
+    static PngOptions options;
+    return options;
+}
+
+inline bool parse_png_strategy(const std::string& name, int& out) {
+    if (name == "default") out = cv::IMWRITE_PNG_STRATEGY_DEFAULT;
+    else if (name == "filtered") out = cv::IMWRITE_PNG_STRATEGY_FILTERED;
+    else if (name == "huffman") out = cv::IMWRITE_PNG_STRATEGY_HUFFMAN_ONLY;
+    else if (name == "rle") out = cv::IMWRITE_PNG_STRATEGY_RLE;
+    else if (name == "fixed") out = cv::IMWRITE_PNG_STRATEGY_FIXED;
+    else return false;
+    return true;
+}
+
+inline std::vector<int> png_write_params(const PngOptions& options = png_options()) {
+    // OpenCV 设置压缩级别时会重置策略，因此策略必须放在后面
+    return {cv::IMWRITE_PNG_COMPRESSION, options.compression,
+            cv::IMWRITE_PNG_STRATEGY, options.strategy};
+}
+
+inline void write_png(const fs::path& out_path, const cv::Mat& image) {
+    if (!cv::imwrite(out_path.string(), image, png_write_params())) {
+        throw std::runtime_error("写入PNG失败: " + out_path.string());
+    }
+}
+
+// 标注上色表(BGRA): 0 透明，1 红色，>=2 黄色，与历史 markedpng 配色一致
+inline const cv::Mat& label_overlay_lut() {
+    static const cv::Mat lut = [] {
+        const uchar alpha = 160;
+        cv::Mat table(1, 256, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+        table.at<cv::Vec4b>(0, 1) = cv::Vec4b(59, 59, 255, alpha);
+        for (int v = 2; v < 256; ++v) {
+            table.at<cv::Vec4b>(0, v) = cv::Vec4b(0, 212, 255, alpha);
+        }
+        return table;
+    }();
+    return lut;
+}
+
+inline int npy_cv_depth(const npzproc::DTypeInfo& dtype) {
+    if (dtype.kind == 'b' || (dtype.kind == 'u' && dtype.item_size == 1)) return CV_8U;
+    if (dtype.kind == 'i' && dtype.item_size == 1) return CV_8S;
+    if (dtype.kind == 'u' && dtype.item_size == 2) return CV_16U;
+    if (dtype.kind == 'i' && dtype.item_size == 2) return CV_16S;
+    if (dtype.kind == 'i' && dtype.item_size == 4) return CV_32S;
+    if (dtype.kind == 'f' && dtype.item_size == 4) return CV_32F;
+    if (dtype.kind == 'f' && dtype.item_size == 8) return CV_64F;
+    return -1;
+}
+
+// 将 2D npy 条目按原始 dtype 解码为单通道 Mat；OpenCV 无对应类型时退化为 CV_64F
+inline cv::Mat npy_entry_to_mat(const npzproc::ZipEntry& entry) {
+    const npzproc::NpyMeta meta = npzproc::parse_npy_meta(entry.data);
+    if (meta.shape.size() != 2) {
+        throw std::runtime_error("仅支持2D数组: " + entry.name);
+    }
+    const int h = static_cast<int>(meta.shape[0]);
+    const int w = static_cast<int>(meta.shape[1]);
+    const npzproc::DTypeInfo dtype = npzproc::parse_dtype(meta.descr);
+    const int depth = dtype.little_endian ? npy_cv_depth(dtype) : -1;
+    if (depth < 0) {
+        std::vector<double> values = npzproc::decode_numeric_data(entry.data, meta);
+        return cv::Mat(h, w, CV_64F, values.data()).clone();
+    }
+    if (meta.data_offset + static_cast<size_t>(h) * w * dtype.item_size > entry.data.size()) {
+        throw std::runtime_error("NPY 数据区长度不足: " + entry.name);
+    }
+    void* data = const_cast<uint8_t*>(entry.data.data() + meta.data_offset);
+    if (meta.fortran_order) {
+        cv::Mat out;
+        cv::transpose(cv::Mat(w, h, CV_MAKETYPE(depth, 1), data), out);
+        return out;
+    }
+    return cv::Mat(h, w, CV_MAKETYPE(depth, 1), data).clone();
+}
+
+// 归一化规则与 normalize_to_u8 相同: [0,1] 内按 255 缩放，否则按 min/max 拉伸，常数图直接截断
+inline cv::Mat normalize_mat_to_u8(const cv::Mat& src) {
+    if (src.empty()) throw std::runtime_error("Empty array");
+    double min_v = 0.0;
+    double max_v = 0.0;
+    cv::minMaxLoc(src, &min_v, &max_v);
+    cv::Mat out;
+    if (min_v >= 0.0 && max_v <= 1.0) {
+        src.convertTo(out, CV_8U, 255.0);
+    } else if (max_v > min_v) {
+        const double scale = 255.0 / (max_v - min_v);
+        src.convertTo(out, CV_8U, scale, -min_v * scale);
+    } else {
+        src.convertTo(out, CV_8U);
+    }
+    return out;
+}
+
+// 标注转类别索引: 整数标注饱和截断到 [0,255]，浮点标注按 >0 / >1 分为 1 / 2 类
+inline cv::Mat label_mat_to_classes(const cv::Mat& label) {
+    if (label.depth() == CV_8U) return label;
+    cv::Mat classes;
+    if (label.depth() == CV_32F || label.depth() == CV_64F) {
+        classes = cv::Mat(label.rows, label.cols, CV_8U, cv::Scalar(0));
+        cv::Mat mask;
+        cv::compare(label, cv::Scalar(0.0), mask, cv::CMP_GT);
+        classes.setTo(cv::Scalar(1), mask);
+        cv::compare(label, cv::Scalar(1.0), mask, cv::CMP_GT);
+        classes.setTo(cv::Scalar(2), mask);
+        return classes;
+    }
+    label.convertTo(classes, CV_8U);
+    return classes;
+}
+
+inline cv::Mat render_label_overlay(const cv::Mat& classes) {
+    cv::Mat classes4;
+    cv::merge(std::vector<cv::Mat>{classes, classes, classes, classes}, classes4);
+    cv::Mat rgba;
+    cv::LUT(classes4, label_overlay_lut(), rgba);
+    return rgba;
+}
+
+// 融合色表：按类别(0 / 1 / >=2)与灰度值预先完成整数 alpha 混合，融合时每个像素只需一次查表
+inline const std::array<std::array<cv::Vec3b, 256>, 3>& fused_color_table() {
+    static const auto table = [] {
+        std::array<std::array<cv::Vec3b, 256>, 3> t{};
+        const cv::Mat& lut = label_overlay_lut();
+        for (int cls = 0; cls < 3; ++cls) {
+            const cv::Vec4b over = lut.at<cv::Vec4b>(0, cls);
+            const int alpha = over[3];
+            for (int g = 0; g < 256; ++g) {
+                for (int ch = 0; ch < 3; ++ch) {
+                    t[cls][g][ch] = static_cast<uchar>((g * (255 - alpha) + over[ch] * alpha + 127) / 255);
+                }
+            }
+        }
+        return t;
+    }();
+    return table;
+}
+
+// 灰度原图与类别图融合为 BGR，结果与 markedpng 叠加到 png 上一致
+inline cv::Mat render_fused_slice(const cv::Mat& gray, const cv::Mat& classes) {
+    if (gray.type() != CV_8UC1 || classes.type() != CV_8UC1 || gray.size() != classes.size()) {
+        throw std::runtime_error("融合输入尺寸或类型不一致");
+    }
+    const auto& table = fused_color_table();
+    cv::Mat out(gray.rows, gray.cols, CV_8UC3);
+    for (int r = 0; r < gray.rows; ++r) {
+        const uchar* g = gray.ptr<uchar>(r);
+        const uchar* c = classes.ptr<uchar>(r);
+        cv::Vec3b* o = out.ptr<cv::Vec3b>(r);
+        for (int x = 0; x < gray.cols; ++x) {
+            o[x] = table[c[x] < 2 ? c[x] : 2][g[x]];
+        }
+    }
+    return out;
+}
+
+// 窗宽窗位渲染参数；has_window 为 false 时沿用逐张 min/max 归一化
+struct WindowParams {
+    bool has_window = false;
+    double center = 0.0;
+    double width = 1.0;
+    std::string colormap = "gray";
+    bool invert = false;
+
+    // 按完整精度写出窗位/窗宽，仅在第 7 位之后不同的两组参数不会落到同一缓存键
+    std::string key() const {
+        std::ostringstream oss;
+        oss << std::setprecision(17) << (has_window ? "w" : "auto") << ":" << center << ":" << width << ":" << colormap
+            << ":" << (invert ? 1 : 0);
+        return oss.str();
+    }
+};
+
+// 常用 CT 窗（HU）：要求 npz 中存放的已是 HU 值，DICOM 导入时已按 Rescale Slope/Intercept 换算
+inline bool window_preset(const std::string& name, double& center, double& width) {
+    static const std::map<std::string, std::pair<double, double>> presets = {
+        {"lung", {-600.0, 1500.0}},
+        {"mediastinum", {50.0, 350.0}},
+        {"soft_tissue", {40.0, 400.0}},
+        {"bone", {400.0, 1800.0}},
+        {"brain", {40.0, 80.0}},
+        {"liver", {60.0, 150.0}},
+    };
+    auto it = presets.find(name);
+    if (it == presets.end()) return false;
+    center = it->second.first;
+    width = it->second.second;
+    return true;
+}
+
+inline bool colormap_id(const std::string& name, int& id) {
+    if (name == "gray") id = -1;
+    else if (name == "bone") id = cv::COLORMAP_BONE;
+    else if (name == "jet") id = cv::COLORMAP_JET;
+    else if (name == "hot") id = cv::COLORMAP_HOT;
+    else if (name == "viridis") id = cv::COLORMAP_VIRIDIS;
+    else if (name == "inferno") id = cv::COLORMAP_INFERNO;
+    else return false;
+    return true;
+}
+
+// DICOM 线性窗函数，输出 0-255
+inline uchar apply_window(double x, double center, double width) {
+    const double lo = center - 0.5 - (width - 1.0) / 2.0;
+    const double hi = center - 0.5 + (width - 1.0) / 2.0;
+    if (x <= lo) return 0;
+    if (x > hi) return 255;
+    if (width <= 1.0) return 255;
+    return static_cast<uchar>(std::lround(((x - (center - 0.5)) / (width - 1.0) + 0.5) * 255.0));
+}
+
+// 灰度到输出像素的 256 项后处理表（反相 + 伪彩），灰度输出为 CV_8UC1，伪彩为 CV_8UC3
+inline cv::Mat post_window_lut(const WindowParams& params) {
+    cv::Mat ramp(1, 256, CV_8UC1);
+    for (int v = 0; v < 256; ++v) ramp.at<uchar>(0, v) = static_cast<uchar>(params.invert ? 255 - v : v);
+    int id = -1;
+    if (!colormap_id(params.colormap, id)) throw std::runtime_error("invalid colormap: " + params.colormap);
+    if (id < 0) return ramp;
+    cv::Mat colored;
+    cv::applyColorMap(ramp, colored, id);
+    return colored;
+}
+
+// 16 位查找表：窗函数、反相与伪彩合成为一张 65536 项的表，有符号数据按 +32768 偏移索引
+struct WindowLut16 {
+    int channels = 1;
+    std::vector<uchar> table;  // 65536 * channels
+};
+
+inline std::shared_ptr<const WindowLut16> window_lut16(const WindowParams& params, bool is_signed) {
+    static std::mutex mtx;
+    static std::map<std::string, std::shared_ptr<const WindowLut16>> luts;
+    const std::string key = params.key() + (is_signed ? "|s" : "|u");
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = luts.find(key);
+        if (it != luts.end()) return it->second;
+    }
+    const cv::Mat post = post_window_lut(params);
+    auto lut = std::make_shared<WindowLut16>();
+    lut->channels = post.channels();
+    lut->table.resize(65536 * static_cast<size_t>(lut->channels));
+    const int offset = is_signed ? -32768 : 0;
+    for (int i = 0; i < 65536; ++i) {
+        const uchar g = apply_window(static_cast<double>(i + offset), params.center, params.width);
+        const uchar* px = post.ptr<uchar>(0) + static_cast<size_t>(g) * lut->channels;
+        std::copy(px, px + lut->channels, lut->table.begin() + static_cast<size_t>(i) * lut->channels);
+    }
+    std::lock_guard<std::mutex> lk(mtx);
+    if (luts.size() >= 64) luts.clear();
+    luts[key] = lut;
+    return lut;
+}
+
+template <typename T>
+inline void apply_window_lut16(const cv::Mat& src, const WindowLut16& lut, int offset, cv::Mat& dst) {
+    const int ch = lut.channels;
+    const uchar* table = lut.table.data();
+    for (int r = 0; r < src.rows; ++r) {
+        const T* s = src.ptr<T>(r);
+        uchar* d = dst.ptr<uchar>(r);
+        for (int c = 0; c < src.cols; ++c) {
+            const uchar* px = table + static_cast<size_t>(static_cast<int>(s[c]) + offset) * ch;
+            for (int k = 0; k < ch; ++k) d[c * ch + k] = px[k];
+        }
+    }
+}
+
+// 窗宽窗位渲染：8/16 位整数数据每像素一次查表；其它类型先线性映射到 u8（OpenCV 向量化），再经 256 项表上色
+inline cv::Mat render_windowed(const cv::Mat& src, const WindowParams& params) {
+    const int depth = src.depth();
+    const bool lut16 = params.has_window && (depth == CV_8U || depth == CV_8S || depth == CV_16U || depth == CV_16S);
+    if (lut16) {
+        const bool is_signed = depth == CV_8S || depth == CV_16S;
+        const auto lut = window_lut16(params, is_signed);
+        cv::Mat dst(src.rows, src.cols, CV_MAKETYPE(CV_8U, lut->channels));
+        const int offset = is_signed ? 32768 : 0;
+        if (depth == CV_8U) apply_window_lut16<uint8_t>(src, *lut, offset, dst);
+        else if (depth == CV_8S) apply_window_lut16<int8_t>(src, *lut, offset, dst);
+        else if (depth == CV_16U) apply_window_lut16<uint16_t>(src, *lut, offset, dst);
+        else apply_window_lut16<int16_t>(src, *lut, offset, dst);
+        return dst;
+    }
+
+    cv::Mat gray;
+    if (params.has_window) {
+        const double lo = params.center - 0.5 - (params.width - 1.0) / 2.0;
+        const double scale = 255.0 / std::max(params.width - 1.0, 1.0);
+        src.convertTo(gray, CV_8U, scale, -lo * scale);
+    } else {
+        gray = normalize_mat_to_u8(src);
+    }
+    const cv::Mat post = post_window_lut(params);
+    cv::Mat out;
+    if (post.channels() == 1) {
+        cv::LUT(gray, post, out);
+    } else {
+        cv::Mat gray3;
+        cv::merge(std::vector<cv::Mat>{gray, gray, gray}, gray3);
+        cv::LUT(gray3, post, out);
+    }
+    return out;
+}
+
+}  // namespace slice_render
@@ -243,21 +243,27 @@ inline void register_temp_advanced_routes(App &app, InfoStore &store)
             fs::path enh_png_dir = enh_dir / "pngs";
             fs::path enh_marked_dir = enh_dir / "markedpngs";
             std::error_code ec;
+            invalidate_zip_archive_cache(enh_dir);
             fs::remove_all(enh_dir, ec);
             fs::create_directories(enh_npz_dir);
             fs::create_directories(enh_png_dir);
             fs::create_directories(enh_marked_dir);
 
-            size_t processed_count = 0;
+            std::vector<fs::path> npz_inputs;
             for (const auto &src : files) {
-                if (to_lower_copy(src.extension().string()) != ".npz") continue;
+                if (to_lower_copy(src.extension().string()) == ".npz") npz_inputs.push_back(src);
+            }
+            parallel_for_each_index(npz_inputs.size(), [&](size_t i) {
+                const fs::path &src = npz_inputs[i];
                 npzproc::Args file_args = args;
                 file_args.input = src;
                 file_args.output = enh_npz_dir / src.filename();
                 npzproc::process_npz_file(file_args);
-                convert_npz_to_pngs(file_args.output, enh_png_dir, enh_marked_dir, true, true, "_marked");
-                ++processed_count;
-            }
+            });
+            std::vector<fs::path> npz_outputs;
+            for (const auto &src : npz_inputs) npz_outputs.push_back(enh_npz_dir / src.filename());
+            prepare_slice_pngs(enh_npz_dir, npz_outputs, enh_png_dir, enh_marked_dir, true, true, "_marked");
+            const size_t processed_count = npz_inputs.size();
 
             if (processed_count == 0) {
                 throw std::runtime_error("npz目录中没有可处理的 npz 文件");
@@ -277,27 +283,20 @@ inline void register_temp_advanced_routes(App &app, InfoStore &store)
     CROW_ROUTE(app, "/api/temp/<string>/enhdb/png").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            crow::response r{json_filename_array(list_files(project_dir / "enhDBprocessed" / "pngs"))};
-            r.code = 200; set_json_headers(r); return r;
+            return make_file_list_response(project_dir / "enhDBprocessed" / "pngs");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/enhdb/png/<string>").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid, const std::string &filename){
+    CROW_ROUTE(app, "/api/temp/<string>/enhdb/png/<string>").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid, const std::string &filename){
         try {
             if (filename.find("..") != std::string::npos || filename.find('/') != std::string::npos || filename.find('\\') != std::string::npos) {
                 throw std::runtime_error("invalid filename");
             }
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            fs::path png_path = project_dir / "enhDBprocessed" / "pngs" / filename;
-            if (!fs::exists(png_path)) throw std::runtime_error("enhdb png not found");
-            crow::response r{read_text_file(png_path)};
-            r.set_header("Content-Type", "image/png");
-            r.set_header("Access-Control-Allow-Origin", "*");
-            r.code = 200;
-            return r;
+            return make_slice_png_response(req, project_dir / "enhDBprocessed" / "pngs", project_dir / "enhDBprocessed" / "npzs", filename);
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
@@ -307,127 +306,87 @@ inline void register_temp_advanced_routes(App &app, InfoStore &store)
     CROW_ROUTE(app, "/api/temp/<string>/enhdb/markedpng").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            crow::response r{json_filename_array(list_files(project_dir / "enhDBprocessed" / "markedpngs"))};
-            r.code = 200; set_json_headers(r); return r;
+            return make_file_list_response(project_dir / "enhDBprocessed" / "markedpngs");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/enhdb/markedpng/<string>").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid, const std::string &filename){
+    CROW_ROUTE(app, "/api/temp/<string>/enhdb/markedpng/<string>").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid, const std::string &filename){
         try {
             if (filename.find("..") != std::string::npos || filename.find('/') != std::string::npos || filename.find('\\') != std::string::npos) {
                 throw std::runtime_error("invalid filename");
             }
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            fs::path png_path = project_dir / "enhDBprocessed" / "markedpngs" / filename;
-            if (!fs::exists(png_path)) throw std::runtime_error("enhdb markedpng not found");
-            crow::response r{read_text_file(png_path)};
-            r.set_header("Content-Type", "image/png");
-            r.set_header("Access-Control-Allow-Origin", "*");
-            r.code = 200;
-            return r;
+            return make_binary_file_response(req, project_dir / "enhDBprocessed" / "markedpngs" / filename, "image/png");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/png").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
+    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/png").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            auto zip_path = create_zip_store(project_dir / "enhDBprocessed" / "pngs", temp_uuid + "_temp_enhdb_png.zip");
-            crow::response r{read_text_file(zip_path)};
-            r.set_header("Content-Type", "application/zip");
-            r.set_header("Content-Disposition", "attachment; filename=\"enhdb_png.zip\"");
-            return r;
+            return make_zip_response(req, project_dir / "enhDBprocessed" / "pngs", temp_uuid + "_temp_enhdb_png.zip", "enhdb_png.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/markedpng").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
+    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/markedpng").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            auto zip_path = create_zip_store(project_dir / "enhDBprocessed" / "markedpngs", temp_uuid + "_temp_enhdb_markedpng.zip");
-            crow::response r{read_text_file(zip_path)};
-            r.set_header("Content-Type", "application/zip");
-            r.set_header("Content-Disposition", "attachment; filename=\"enhdb_markedpng.zip\"");
-            return r;
+            return make_zip_response(req, project_dir / "enhDBprocessed" / "markedpngs", temp_uuid + "_temp_enhdb_markedpng.zip", "enhdb_markedpng.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/fused/png").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
-        fs::path fused_dir;
+    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/fused/png").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            fused_dir = build_fused_png_temp_dir(project_dir / "enhDBprocessed" / "pngs",
-                                                project_dir / "enhDBprocessed" / "markedpngs",
-                                                temp_uuid + "_temp_enhdb_fused_png");
-            auto zip_path = create_zip_store(fused_dir, temp_uuid + "_temp_enhdb_fused_png.zip");
-            crow::response r{read_text_file(zip_path)};
-            r.set_header("Content-Type", "application/zip");
-            r.set_header("Content-Disposition", "attachment; filename=\"enhdb_png_markedpng_fused.zip\"");
-            std::error_code ec;
-            fs::remove_all(fused_dir, ec);
-            return r;
+            return make_fused_zip_response(req, project_dir / "enhDBprocessed" / "npzs",
+                                           project_dir / "enhDBprocessed" / "npzs",
+                                           project_dir / "enhDBprocessed" / "fusedpngs",
+                                           "_marked", temp_uuid + "_temp_enhdb_fused_png.zip", "enhdb_png_markedpng_fused.zip");
         } catch (const std::exception &e) {
-            std::error_code ec;
-            if (!fused_dir.empty()) fs::remove_all(fused_dir, ec);
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/npz").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
+    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/npz").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            auto zip_path = create_zip_store(project_dir / "enhDBprocessed" / "npzs", temp_uuid + "_temp_enhdb_npz.zip");
-            crow::response r{read_text_file(zip_path)};
-            r.set_header("Content-Type", "application/zip");
-            r.set_header("Content-Disposition", "attachment; filename=\"enhdb_npz.zip\"");
-            return r;
+            return make_zip_response(req, project_dir / "enhDBprocessed" / "npzs", temp_uuid + "_temp_enhdb_npz.zip", "enhdb_npz.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/dcm").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
+    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/dcm").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
             fs::path dir = project_dir / "enhDBprocessed" / "dcm";
-            if (list_files(dir).empty()) {
-                ensure_converted_from_npz_dir(project_dir / "enhDBprocessed" / "npzs", dir, "dcm", "image");
-            }
-            auto zip_path = create_zip_store(dir, temp_uuid + "_temp_enhdb_dcm.zip");
-            crow::response r{read_text_file(zip_path)};
-            r.set_header("Content-Type", "application/zip");
-            r.set_header("Content-Disposition", "attachment; filename=\"enhdb_dcm.zip\"");
-            return r;
+            ensure_converted_from_npz_dir(project_dir / "enhDBprocessed" / "npzs", dir, "dcm", "image");
+            return make_zip_response(req, dir, temp_uuid + "_temp_enhdb_dcm.zip", "enhdb_dcm.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/nii").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
+    CROW_ROUTE(app, "/api/temp/<string>/download/enhdb/nii").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
             fs::path dir = project_dir / "enhDBprocessed" / "nii";
-            if (list_files(dir).empty()) {
-                ensure_converted_from_npz_dir(project_dir / "enhDBprocessed" / "npzs", dir, "nii", "image");
-            }
-            auto zip_path = create_zip_store(dir, temp_uuid + "_temp_enhdb_nii.zip");
-            crow::response r{read_text_file(zip_path)};
-            r.set_header("Content-Type", "application/zip");
-            r.set_header("Content-Disposition", "attachment; filename=\"enhdb_nii.zip\"");
-            return r;
+            ensure_converted_from_npz_dir(project_dir / "enhDBprocessed" / "npzs", dir, "nii", "image");
+            return make_zip_response(req, dir, temp_uuid + "_temp_enhdb_nii.zip", "enhdb_nii.zip");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
@@ -443,20 +402,29 @@ inline void register_temp_advanced_routes(App &app, InfoStore &store)
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/3d").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
+    CROW_ROUTE(app, "/api/temp/<string>/download/3d").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            return make_glb_download_response(project_dir / "3d" / "model.glb");
+            return make_glb_download_response(req, project_dir / "3d" / "model.glb");
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/OG3d").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid){
+    CROW_ROUTE(app, "/api/temp/<string>/download/OG3d").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
         try {
             fs::path project_dir = require_temp_project_dir(store, temp_uuid);
-            return make_glb_download_response(project_dir / "OG3d" / "model.glb");
+            return make_glb_download_response(req, project_dir / "OG3d" / "model.glb");
+        } catch (const std::exception &e) {
+            crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
+            r.code = 400; set_json_headers(r); return r;
+        }
+    });
+
+    CROW_ROUTE(app, "/api/temp/<string>/download/3d_volume").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid){
+        try {
+            return make_brick_volume_response(req, require_temp_project_dir(store, temp_uuid));
         } catch (const std::exception &e) {
             crow::response r{std::string("{\"error\":\"") + e.what() + "\"}"};
             r.code = 400; set_json_headers(r); return r;
@@ -142,12 +142,13 @@ inline void register_temp_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/png/<string>").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid, const std::string &filename) {
+    CROW_ROUTE(app, "/api/temp/<string>/png/<string>").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid, const std::string &filename) {
         try {
             if (filename.find("..") != std::string::npos || filename.find('/') != std::string::npos || filename.find('\\') != std::string::npos) {
                 throw std::runtime_error("invalid filename");
             }
-            return make_binary_file_response(require_temp_project_dir(store, temp_uuid) / "png" / filename, "image/png");
+            const fs::path project_dir = require_temp_project_dir(store, temp_uuid);
+            return make_slice_png_response(req, project_dir / "png", project_dir / "npz", filename);
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
@@ -161,12 +162,12 @@ inline void register_temp_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/markedpng/<string>").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid, const std::string &filename) {
+    CROW_ROUTE(app, "/api/temp/<string>/markedpng/<string>").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid, const std::string &filename) {
         try {
             if (filename.find("..") != std::string::npos || filename.find('/') != std::string::npos || filename.find('\\') != std::string::npos) {
                 throw std::runtime_error("invalid filename");
             }
-            return make_binary_file_response(require_temp_project_dir(store, temp_uuid) / "markedpng" / filename, "image/png");
+            return make_binary_file_response(req, require_temp_project_dir(store, temp_uuid) / "markedpng" / filename, "image/png");
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
@@ -180,148 +181,157 @@ inline void register_temp_basic_routes(App &app,
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/processed/png/<string>").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid, const std::string &filename) {
+    CROW_ROUTE(app, "/api/temp/<string>/processed/png/<string>").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid, const std::string &filename) {
         try {
             if (filename.find("..") != std::string::npos || filename.find('/') != std::string::npos || filename.find('\\') != std::string::npos) {
                 throw std::runtime_error("invalid filename");
             }
-            return make_binary_file_response(require_temp_project_dir(store, temp_uuid) / "processed" / "pngs" / filename, "image/png");
+            return make_binary_file_response(req, require_temp_project_dir(store, temp_uuid) / "processed" / "pngs" / filename, "image/png");
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/png").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/slices").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
-            return make_zip_response(require_temp_project_dir(store, temp_uuid) / "png", temp_uuid + "_temp_png.zip", "png.zip");
+            return make_slice_batch_response(req, require_temp_project_dir(store, temp_uuid));
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/markedpng").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/volume/raw").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
-            return make_zip_response(require_temp_project_dir(store, temp_uuid) / "markedpng", temp_uuid + "_temp_markedpng.zip", "markedpng.zip");
+            return make_raw_volume_response(req, require_temp_project_dir(store, temp_uuid));
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/fused/png").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
-        fs::path fused_dir;
+    CROW_ROUTE(app, "/api/temp/<string>/thumbnails").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
+        try {
+            return make_slice_atlas_response(req, require_temp_project_dir(store, temp_uuid));
+        } catch (const std::exception &e) {
+            return make_json_error_response(e.what());
+        }
+    });
+
+    CROW_ROUTE(app, "/api/temp/<string>/download/png").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
+        try {
+            return make_zip_response(req, require_temp_project_dir(store, temp_uuid) / "png", temp_uuid + "_temp_png.zip", "png.zip");
+        } catch (const std::exception &e) {
+            return make_json_error_response(e.what());
+        }
+    });
+
+    CROW_ROUTE(app, "/api/temp/<string>/download/markedpng").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
+        try {
+            return make_zip_response(req, require_temp_project_dir(store, temp_uuid) / "markedpng", temp_uuid + "_temp_markedpng.zip", "markedpng.zip");
+        } catch (const std::exception &e) {
+            return make_json_error_response(e.what());
+        }
+    });
+
+    CROW_ROUTE(app, "/api/temp/<string>/download/fused/png").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
             fs::path dir = require_temp_project_dir(store, temp_uuid);
-            fused_dir = build_fused_png_temp_dir(dir / "png", dir / "markedpng", temp_uuid + "_temp_fused_png");
-            auto response = make_zip_response(fused_dir, temp_uuid + "_temp_fused_png.zip", "png_markedpng_fused.zip");
-            std::error_code ec;
-            fs::remove_all(fused_dir, ec);
-            return response;
+            return make_fused_zip_response(req, dir / "npz", dir / "npz", dir / "fusedpng", "_marked", temp_uuid + "_temp_fused_png.zip", "png_markedpng_fused.zip");
         } catch (const std::exception &e) {
-            std::error_code ec;
-            if (!fused_dir.empty()) fs::remove_all(fused_dir, ec);
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/npz").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/download/npz").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
-            return make_zip_response(require_temp_project_dir(store, temp_uuid) / "npz", temp_uuid + "_temp_npz.zip", "npz.zip");
+            return make_zip_response(req, require_temp_project_dir(store, temp_uuid) / "npz", temp_uuid + "_temp_npz.zip", "npz.zip");
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/dcm").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/download/dcm").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
             fs::path dir = require_temp_project_dir(store, temp_uuid);
             fs::path dcm_dir = dir / "dcm";
-            if (list_files(dcm_dir).empty()) {
-                ensure_converted_from_npz_dir(dir / "npz", dcm_dir, "dcm", "image");
+            if (ensure_converted_from_npz_dir(dir / "npz", dcm_dir, "dcm", "image")) {
                 update_project_json_fields(dir / "project.json", {{"dcm", "true"}});
             }
-            return make_zip_response(dcm_dir, temp_uuid + "_temp_dcm.zip", "dcm.zip");
+            return make_zip_response(req, dcm_dir, temp_uuid + "_temp_dcm.zip", "dcm.zip");
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/nii").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/download/nii").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
             fs::path dir = require_temp_project_dir(store, temp_uuid);
-            fs::path nii_dir = dir / "nii";
-            if (list_files(nii_dir).empty()) {
-                ensure_converted_from_npz_dir(dir / "npz", nii_dir, "nii", "image");
+            bool converted = false;
+            auto r = make_nii_download_response(req, dir / "npz", dir / "nii", "image", temp_uuid + "_temp_nii.zip", "nii", &converted);
+            if (converted) {
                 update_project_json_fields(dir / "project.json", {{"nii", "true"}});
             }
-            return make_zip_response(nii_dir, temp_uuid + "_temp_nii.zip", "nii.zip");
+            return r;
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/processed/png").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/download/processed/png").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
-            return make_zip_response(require_temp_project_dir(store, temp_uuid) / "processed" / "pngs", temp_uuid + "_temp_processed_png.zip", "processed_png.zip");
+            return make_zip_response(req, require_temp_project_dir(store, temp_uuid) / "processed" / "pngs", temp_uuid + "_temp_processed_png.zip", "processed_png.zip");
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/processed/markedpng").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/download/processed/markedpng").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
-            return make_zip_response(require_temp_project_dir(store, temp_uuid) / "processed" / "pngs", temp_uuid + "_temp_processed_markedpng.zip", "processed_markedpng.zip");
+            return make_zip_response(req, require_temp_project_dir(store, temp_uuid) / "processed" / "pngs", temp_uuid + "_temp_processed_markedpng.zip", "processed_markedpng.zip");
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/processed/fused/png").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
-        fs::path fused_dir;
+    CROW_ROUTE(app, "/api/temp/<string>/download/processed/fused/png").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
             fs::path dir = require_temp_project_dir(store, temp_uuid);
-            fused_dir = build_fused_png_temp_dir(dir / "png", dir / "processed" / "pngs", temp_uuid + "_temp_processed_fused_png");
-            auto response = make_zip_response(fused_dir, temp_uuid + "_temp_processed_fused_png.zip", "processed_png_markedpng_fused.zip");
-            std::error_code ec;
-            fs::remove_all(fused_dir, ec);
-            return response;
+            return make_fused_zip_response(req, dir / "npz", dir / "processed" / "npzs", dir / "processed" / "fusedpngs", "", temp_uuid + "_temp_processed_fused_png.zip", "processed_png_markedpng_fused.zip");
         } catch (const std::exception &e) {
-            std::error_code ec;
-            if (!fused_dir.empty()) fs::remove_all(fused_dir, ec);
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/processed/npz").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/download/processed/npz").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
-            return make_zip_response(require_temp_project_dir(store, temp_uuid) / "processed" / "npzs", temp_uuid + "_temp_processed_npz.zip", "processed_npz.zip");
+            return make_zip_response(req, require_temp_project_dir(store, temp_uuid) / "processed" / "npzs", temp_uuid + "_temp_processed_npz.zip", "processed_npz.zip");
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/processed/dcm").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/download/processed/dcm").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
             fs::path dir = require_temp_project_dir(store, temp_uuid);
             fs::path dcm_dir = dir / "processed" / "dcm";
-            if (list_files(dcm_dir).empty()) {
-                ensure_converted_from_npz_dir(dir / "processed" / "npzs", dcm_dir, "dcm", "label");
+            if (ensure_converted_from_npz_dir(dir / "processed" / "npzs", dcm_dir, "dcm", "label")) {
                 update_project_json_fields(dir / "project.json", {{"PD-dcm", "true"}});
             }
-            return make_zip_response(dcm_dir, temp_uuid + "_temp_processed_dcm.zip", "processed_dcm.zip");
+            return make_zip_response(req, dcm_dir, temp_uuid + "_temp_processed_dcm.zip", "processed_dcm.zip");
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
     });
 
-    CROW_ROUTE(app, "/api/temp/<string>/download/processed/nii").methods(crow::HTTPMethod::GET)([&store](const std::string &temp_uuid) {
+    CROW_ROUTE(app, "/api/temp/<string>/download/processed/nii").methods(crow::HTTPMethod::GET)([&store](const crow::request &req, const std::string &temp_uuid) {
         try {
             fs::path dir = require_temp_project_dir(store, temp_uuid);
-            fs::path nii_dir = dir / "processed" / "nii";
-            if (list_files(nii_dir).empty()) {
-                ensure_converted_from_npz_dir(dir / "processed" / "npzs", nii_dir, "nii", "label");
+            bool converted = false;
+            auto r = make_nii_download_response(req, dir / "processed" / "npzs", dir / "processed" / "nii", "label",
+                                                temp_uuid + "_temp_processed_nii.zip", "processed_nii", &converted);
+            if (converted) {
                 update_project_json_fields(dir / "project.json", {{"PD-nii", "true"}});
             }
-            return make_zip_response(nii_dir, temp_uuid + "_temp_processed_nii.zip", "processed_nii.zip");
+            return r;
         } catch (const std::exception &e) {
             return make_json_error_response(e.what());
         }
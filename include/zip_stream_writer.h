@@ -0,0 +1,448 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "parallel_utils.h"
+
+// 进程内 ZIP 写出器：条目按顺序从磁盘读取后写入输出流，体积或条目数超出 ZIP32 上限时自动使用 ZIP64。
+// 小文件按批并行读取/压缩后按序写出，大文件逐块流式写出，内存占用与归档总大小无关
+namespace zipstream {
+
+namespace fs = std::filesystem;
+
+inline constexpr uint64_t kZip32Limit = 0xFFFFFFFFull;
+inline constexpr uint64_t kBufferedEntryMaxBytes = 16ull << 20;
+inline constexpr uint64_t kBatchMaxBytes = 64ull << 20;
+inline constexpr size_t kCopyChunkBytes = 1 << 20;
+inline constexpr uint16_t kFlagDataDescriptor = 0x0008;
+inline constexpr uint16_t kFlagUtf8 = 0x0800;
+
+struct SourceEntry {
+    fs::path path;
+    std::string name;  // 归档内路径，使用 '/' 分隔
+    uint64_t size = 0;
+    bool deflate = false;
+    uint16_t dos_time = 0;
+    uint16_t dos_date = 0;
+};
+
+struct CentralRecord {
+    std::string name;
+    uint16_t flags = 0;
+    uint16_t method = 0;
+    uint16_t dos_time = 0;
+    uint16_t dos_date = 0;
+    uint32_t crc = 0;
+    uint64_t compressed = 0;
+    uint64_t uncompressed = 0;
+    uint64_t offset = 0;
+};
+
+inline void put_u16(std::string& out, uint16_t v) {
+    out.push_back(static_cast<char>(v & 0xFF));
+    out.push_back(static_cast<char>((v >> 8) & 0xFF));
+}
+
+inline void put_u32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+inline void put_u64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+inline uint32_t clamp32(uint64_t v) {
+    return v >= kZip32Limit ? 0xFFFFFFFFu : static_cast<uint32_t>(v);
+}
+
+// 已压缩格式直接存储，再 deflate 只会浪费 CPU
+inline bool is_precompressed_name(const std::string& name) {
+    std::string ext = fs::path(name).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext == ".png" || ext == ".npz" || ext == ".gz" || ext == ".zip" || ext == ".jpg" || ext == ".jpeg" ||
+           ext == ".7z";
+}
+
+inline void to_dos_datetime(fs::file_time_type t, uint16_t& dos_time, uint16_t& dos_date) {
+    const auto sys = std::chrono::system_clock::now() +
+                     std::chrono::duration_cast<std::chrono::system_clock::duration>(t - fs::file_time_type::clock::now());
+    const std::time_t tt = std::chrono::system_clock::to_time_t(sys);
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &tt);
+#else
+    localtime_r(&tt, &tm);
+#endif
+    if (tm.tm_year < 80) {
+        dos_time = 0;
+        dos_date = (1 << 5) | 1;
+        return;
+    }
+    dos_time = static_cast<uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+    dos_date = static_cast<uint16_t>(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+inline std::string read_whole_file(const fs::path& path, uint64_t size) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) throw std::runtime_error("无法读取文件: " + path.string());
+    std::string data(static_cast<size_t>(size), '\0');
+    if (size > 0) ifs.read(&data[0], static_cast<std::streamsize>(size));
+    if (static_cast<uint64_t>(ifs.gcount()) != size) throw std::runtime_error("读取文件不完整: " + path.string());
+    return data;
+}
+
+inline std::string deflate_raw(const std::string& input, int level) {
+    z_stream zs{};
+    if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 失败");
+    }
+    std::string out(deflateBound(&zs, static_cast<uLong>(input.size())), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zs.avail_in = static_cast<uInt>(input.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    const int rc = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END) throw std::runtime_error("deflate 失败");
+    out.resize(zs.total_out);
+    return out;
+}
+
+class Writer {
+public:
+    explicit Writer(std::ostream& out, int level = 5) : out_(out), level_(level) {}
+
+    // 连续的小条目组成一批，由多个线程并行读取与压缩，再按原顺序写出；大条目逐块流式写出
+    void add_entries(const std::vector<SourceEntry>& entries) {
+        size_t i = 0;
+        while (i < entries.size()) {
+            if (entries[i].size > kBufferedEntryMaxBytes) {
+                if (entries[i].deflate) {
+                    write_streamed_deflate(entries[i]);
+                } else {
+                    write_streamed_store(entries[i]);
+                }
+                ++i;
+                continue;
+            }
+            size_t end = i;
+            uint64_t batch_bytes = 0;
+            while (end < entries.size() && entries[end].size <= kBufferedEntryMaxBytes &&
+                   (end == i || batch_bytes + entries[end].size <= kBatchMaxBytes)) {
+                batch_bytes += entries[end].size;
+                ++end;
+            }
+            write_buffered_batch(entries, i, end);
+            i = end;
+        }
+    }
+
+    void finish() {
+        const uint64_t cd_offset = offset_;
+        for (const auto& rec : records_) write_central_record(rec);
+        const uint64_t cd_size = offset_ - cd_offset;
+        const uint64_t count = records_.size();
+
+        if (count >= 0xFFFF || cd_offset >= kZip32Limit || cd_size >= kZip32Limit) {
+            const uint64_t zip64_eocd_offset = offset_;
+            std::string rec;
+            put_u32(rec, 0x06064b50);
+            put_u64(rec, 44);
+            put_u16(rec, 45);
+            put_u16(rec, 45);
+            put_u32(rec, 0);
+            put_u32(rec, 0);
+            put_u64(rec, count);
+            put_u64(rec, count);
+            put_u64(rec, cd_size);
+            put_u64(rec, cd_offset);
+            put_u32(rec, 0x07064b50);
+            put_u32(rec, 0);
+            put_u64(rec, zip64_eocd_offset);
+            put_u32(rec, 1);
+            write(rec);
+        }
+
+        std::string eocd;
+        put_u32(eocd, 0x06054b50);
+        put_u16(eocd, 0);
+        put_u16(eocd, 0);
+        put_u16(eocd, static_cast<uint16_t>(std::min<uint64_t>(count, 0xFFFF)));
+        put_u16(eocd, static_cast<uint16_t>(std::min<uint64_t>(count, 0xFFFF)));
+        put_u32(eocd, clamp32(cd_size));
+        put_u32(eocd, clamp32(cd_offset));
+        put_u16(eocd, 0);
+        write(eocd);
+        out_.flush();
+        if (!out_) throw std::runtime_error("写入 zip 失败");
+    }
+
+private:
+    struct Prepared {
+        std::string data;
+        uint32_t crc = 0;
+        uint16_t method = 0;
+    };
+
+    void write(const std::string& bytes) {
+        out_.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!out_) throw std::runtime_error("写入 zip 失败");
+        offset_ += bytes.size();
+    }
+
+    void write(const char* data, size_t size) {
+        out_.write(data, static_cast<std::streamsize>(size));
+        if (!out_) throw std::runtime_error("写入 zip 失败");
+        offset_ += size;
+    }
+
+    void write_local_header(CentralRecord& rec, bool zip64) {
+        rec.offset = offset_;
+        std::string h;
+        put_u32(h, 0x04034b50);
+        put_u16(h, zip64 ? 45 : 20);
+        put_u16(h, rec.flags);
+        put_u16(h, rec.method);
+        put_u16(h, rec.dos_time);
+        put_u16(h, rec.dos_date);
+        const bool descriptor = (rec.flags & kFlagDataDescriptor) != 0;
+        put_u32(h, descriptor ? 0 : rec.crc);
+        put_u32(h, zip64 ? 0xFFFFFFFFu : (descriptor ? 0 : static_cast<uint32_t>(rec.compressed)));
+        put_u32(h, zip64 ? 0xFFFFFFFFu : (descriptor ? 0 : static_cast<uint32_t>(rec.uncompressed)));
+        put_u16(h, static_cast<uint16_t>(rec.name.size()));
+        put_u16(h, zip64 ? 20 : 0);
+        h += rec.name;
+        if (zip64) {
+            put_u16(h, 0x0001);
+            put_u16(h, 16);
+            put_u64(h, descriptor ? 0 : rec.uncompressed);
+            put_u64(h, descriptor ? 0 : rec.compressed);
+        }
+        write(h);
+    }
+
+    void write_central_record(const CentralRecord& rec) {
+        std::string extra;
+        if (rec.uncompressed >= kZip32Limit) put_u64(extra, rec.uncompressed);
+        if (rec.compressed >= kZip32Limit) put_u64(extra, rec.compressed);
+        if (rec.offset >= kZip32Limit) put_u64(extra, rec.offset);
+        std::string zip64_extra;
+        if (!extra.empty()) {
+            put_u16(zip64_extra, 0x0001);
+            put_u16(zip64_extra, static_cast<uint16_t>(extra.size()));
+            zip64_extra += extra;
+        }
+        const uint16_t version = zip64_extra.empty() ? 20 : 45;
+
+        std::string h;
+        put_u32(h, 0x02014b50);
+        put_u16(h, version);
+        put_u16(h, version);
+        put_u16(h, rec.flags);
+        put_u16(h, rec.method);
+        put_u16(h, rec.dos_time);
+        put_u16(h, rec.dos_date);
+        put_u32(h, rec.crc);
+        put_u32(h, clamp32(rec.compressed));
+        put_u32(h, clamp32(rec.uncompressed));
+        put_u16(h, static_cast<uint16_t>(rec.name.size()));
+        put_u16(h, static_cast<uint16_t>(zip64_extra.size()));
+        put_u16(h, 0);
+        put_u16(h, 0);
+        put_u16(h, 0);
+        put_u32(h, 0);
+        put_u32(h, clamp32(rec.offset));
+        h += rec.name;
+        h += zip64_extra;
+        write(h);
+    }
+
+    CentralRecord make_record(const SourceEntry& e, uint16_t method) const {
+        CentralRecord rec;
+        rec.name = e.name;
+        rec.flags = kFlagUtf8;
+        rec.method = method;
+        rec.dos_time = e.dos_time;
+        rec.dos_date = e.dos_date;
+        return rec;
+    }
+
+    void write_buffered_batch(const std::vector<SourceEntry>& entries, size_t begin, size_t end) {
+        const size_t count = end - begin;
+        std::vector<Prepared> prepared(count);
+        auto prepare = [&](size_t k) {
+            const SourceEntry& e = entries[begin + k];
+            Prepared& p = prepared[k];
+            std::string raw = read_whole_file(e.path, e.size);
+            p.crc = static_cast<uint32_t>(crc32(crc32(0L, Z_NULL, 0),
+                                                reinterpret_cast<const Bytef*>(raw.data()),
+                                                static_cast<uInt>(raw.size())));
+            if (e.deflate && !raw.empty()) {
+                std::string packed = deflate_raw(raw, level_);
+                if (packed.size() < raw.size()) {
+                    p.data = std::move(packed);
+                    p.method = 8;
+                    return;
+                }
+            }
+            p.data = std::move(raw);
+            p.method = 0;
+        };
+
+        parallel_for_each_index(count, prepare);
+
+        for (size_t k = 0; k < count; ++k) {
+            const SourceEntry& e = entries[begin + k];
+            Prepared& p = prepared[k];
+            CentralRecord rec = make_record(e, p.method);
+            rec.crc = p.crc;
+            rec.compressed = p.data.size();
+            rec.uncompressed = e.size;
+            write_local_header(rec, false);
+            write(p.data);
+            records_.push_back(std::move(rec));
+            std::string().swap(p.data);
+        }
+    }
+
+    // 大文件存储模式：先算 CRC 再复制，两遍都是顺序读，头部信息完整无需数据描述符
+    void write_streamed_store(const SourceEntry& e) {
+        std::vector<char> buf(kCopyChunkBytes);
+        uLong crc = crc32(0L, Z_NULL, 0);
+        {
+            std::ifstream ifs(e.path, std::ios::binary);
+            if (!ifs) throw std::runtime_error("无法读取文件: " + e.path.string());
+            while (ifs) {
+                ifs.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+                const std::streamsize got = ifs.gcount();
+                if (got <= 0) break;
+                crc = crc32(crc, reinterpret_cast<const Bytef*>(buf.data()), static_cast<uInt>(got));
+            }
+        }
+        CentralRecord rec = make_record(e, 0);
+        rec.crc = static_cast<uint32_t>(crc);
+        rec.compressed = e.size;
+        rec.uncompressed = e.size;
+        write_local_header(rec, e.size >= kZip32Limit);
+
+        std::ifstream ifs(e.path, std::ios::binary);
+        if (!ifs) throw std::runtime_error("无法读取文件: " + e.path.string());
+        uint64_t copied = 0;
+        while (ifs) {
+            ifs.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+            const std::streamsize got = ifs.gcount();
+            if (got <= 0) break;
+            write(buf.data(), static_cast<size_t>(got));
+            copied += static_cast<uint64_t>(got);
+        }
+        if (copied != e.size) throw std::runtime_error("文件在打包过程中被修改: " + e.path.string());
+        records_.push_back(std::move(rec));
+    }
+
+    // 大文件压缩模式：边读边压缩，压缩后大小与 CRC 写在数据描述符中
+    void write_streamed_deflate(const SourceEntry& e) {
+        const bool zip64 = e.size >= 0xF0000000ull;
+        CentralRecord rec = make_record(e, 8);
+        rec.flags |= kFlagDataDescriptor;
+        write_local_header(rec, zip64);
+
+        std::ifstream ifs(e.path, std::ios::binary);
+        if (!ifs) throw std::runtime_error("无法读取文件: " + e.path.string());
+        z_stream zs{};
+        if (deflateInit2(&zs, level_, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("deflateInit2 失败");
+        }
+        std::vector<char> in(kCopyChunkBytes);
+        std::vector<char> out(kCopyChunkBytes);
+        uLong crc = crc32(0L, Z_NULL, 0);
+        uint64_t read_total = 0;
+        uint64_t written = 0;
+        try {
+            int flush = Z_NO_FLUSH;
+            do {
+                ifs.read(in.data(), static_cast<std::streamsize>(in.size()));
+                const std::streamsize got = ifs.gcount();
+                read_total += static_cast<uint64_t>(std::max<std::streamsize>(got, 0));
+                crc = crc32(crc, reinterpret_cast<const Bytef*>(in.data()), static_cast<uInt>(std::max<std::streamsize>(got, 0)));
+                flush = ifs ? Z_NO_FLUSH : Z_FINISH;
+                zs.next_in = reinterpret_cast<Bytef*>(in.data());
+                zs.avail_in = static_cast<uInt>(std::max<std::streamsize>(got, 0));
+                do {
+                    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+                    zs.avail_out = static_cast<uInt>(out.size());
+                    if (deflate(&zs, flush) == Z_STREAM_ERROR) throw std::runtime_error("deflate 失败");
+                    const size_t produced = out.size() - zs.avail_out;
+                    write(out.data(), produced);
+                    written += produced;
+                } while (zs.avail_out == 0);
+            } while (flush != Z_FINISH);
+        } catch (...) {
+            deflateEnd(&zs);
+            throw;
+        }
+        deflateEnd(&zs);
+        if (read_total != e.size) throw std::runtime_error("文件在打包过程中被修改: " + e.path.string());
+
+        rec.crc = static_cast<uint32_t>(crc);
+        rec.compressed = written;
+        rec.uncompressed = read_total;
+        std::string dd;
+        put_u32(dd, 0x08074b50);
+        put_u32(dd, rec.crc);
+        if (zip64) {
+            put_u64(dd, rec.compressed);
+            put_u64(dd, rec.uncompressed);
+        } else {
+            put_u32(dd, static_cast<uint32_t>(rec.compressed));
+            put_u32(dd, static_cast<uint32_t>(rec.uncompressed));
+        }
+        write(dd);
+        records_.push_back(std::move(rec));
+    }
+
+    std::ostream& out_;
+    int level_ = 5;
+    uint64_t offset_ = 0;
+    std::vector<CentralRecord> records_;
+};
+
+// 递归收集目录下的文件，归档内路径相对 dir 并按字典序排列，保证同一目录多次打包的条目顺序一致
+inline std::vector<SourceEntry> collect_dir_entries(const fs::path& dir) {
+    std::vector<SourceEntry> entries;
+    for (const auto& it : fs::recursive_directory_iterator(dir)) {
+        if (!it.is_regular_file()) continue;
+        SourceEntry e;
+        e.path = it.path();
+        e.name = it.path().lexically_relative(dir).generic_u8string();
+        e.size = it.file_size();
+        e.deflate = !is_precompressed_name(e.name);
+        to_dos_datetime(it.last_write_time(), e.dos_time, e.dos_date);
+        entries.push_back(std::move(e));
+    }
+    std::sort(entries.begin(), entries.end(), [](const SourceEntry& a, const SourceEntry& b) { return a.name < b.name; });
+    return entries;
+}
+
+inline void write_dir_zip(const fs::path& dir, std::ostream& out, int level = 5) {
+    Writer writer(out, level);
+    writer.add_entries(collect_dir_entries(dir));
+    writer.finish();
+}
+
+}  // namespace zipstream
@@ -10,6 +10,7 @@
 #include "info_store.h"
 #include "info_api.h"
 #include "request_log_middleware.h"
+#include "response_compression_middleware.h"
 #include "runtime_logger.h"
 
 int main(int argc, char **argv)
@@ -30,6 +31,16 @@ int main(int argc, char **argv)
     bool no_log_file = false;
     bool crow_debug = false;
     int api_port = 18080;
+    int png_level = slice_render::png_options().compression;
+    std::string png_strategy = "default";
+    bool lazy_png = false;
+    int file_cache_mb = static_cast<int>(hot_file_cache_capacity_bytes() >> 20);
+    int zip_cache_mb = static_cast<int>(zip_archive_cache_capacity_bytes() >> 20);
+    int http_compress_level = response_compression_options().level;
+    std::vector<size_t> glb_lod_budgets = glb_lod_triangle_budgets();
+    bool glb_float = false;
+    std::vector<npz_to_glb::LabelClass> glb_labels = glb_label_classes();
+    npz_to_glb::MeshMode glb_mesher = glb_mesh_mode();
     int infer_threads = static_cast<int>(std::thread::hardware_concurrency());
     if (infer_threads <= 0) infer_threads = 1;
 
@@ -89,8 +100,156 @@ int main(int argc, char **argv)
                 std::cerr << "错误: --apiport 必须在 1 到 65535 之间" << std::endl;
                 return 1;
             }
+        } else if (key == "--png-level") {
+            if (i + 1 >= argc) {
+                std::cerr << "错误: --png-level 参数缺少数值" << std::endl;
+                return 1;
+            }
+            try {
+                png_level = std::stoi(argv[++i]);
+            } catch (const std::exception &) {
+                std::cerr << "错误: --png-level 必须是 0 到 9 之间的整数" << std::endl;
+                return 1;
+            }
+            if (png_level < 0 || png_level > 9) {
+                std::cerr << "错误: --png-level 必须是 0 到 9 之间的整数" << std::endl;
+                return 1;
+            }
+        } else if (key == "--png-strategy") {
+            if (i + 1 >= argc) {
+                std::cerr << "错误: --png-strategy 参数缺少策略名" << std::endl;
+                return 1;
+            }
+            png_strategy = argv[++i];
+            int parsed = 0;
+            if (!slice_render::parse_png_strategy(png_strategy, parsed)) {
+                std::cerr << "错误: --png-strategy 仅支持 default、filtered、huffman、rle、fixed" << std::endl;
+                return 1;
+            }
+        } else if (key == "--file-cache-mb") {
+            if (i + 1 >= argc) {
+                std::cerr << "错误: --file-cache-mb 参数缺少数值" << std::endl;
+                return 1;
+            }
+            try {
+                file_cache_mb = std::stoi(argv[++i]);
+            } catch (const std::exception &) {
+                std::cerr << "错误: --file-cache-mb 必须是非负整数" << std::endl;
+                return 1;
+            }
+            if (file_cache_mb < 0) {
+                std::cerr << "错误: --file-cache-mb 必须是非负整数" << std::endl;
+                return 1;
+            }
+        } else if (key == "--zip-cache-mb") {
+            if (i + 1 >= argc) {
+                std::cerr << "错误: --zip-cache-mb 参数缺少数值" << std::endl;
+                return 1;
+            }
+            try {
+                zip_cache_mb = std::stoi(argv[++i]);
+            } catch (const std::exception &) {
+                std::cerr << "错误: --zip-cache-mb 必须是非负整数" << std::endl;
+                return 1;
+            }
+            if (zip_cache_mb < 0) {
+                std::cerr << "错误: --zip-cache-mb 必须是非负整数" << std::endl;
+                return 1;
+            }
+        } else if (key == "--http-compress-level") {
+            if (i + 1 >= argc) {
+                std::cerr << "错误: --http-compress-level 参数缺少数值" << std::endl;
+                return 1;
+            }
+            try {
+                http_compress_level = std::stoi(argv[++i]);
+            } catch (const std::exception &) {
+                std::cerr << "错误: --http-compress-level 必须是 0-9 的整数" << std::endl;
+                return 1;
+            }
+            if (http_compress_level < 0 || http_compress_level > 9) {
+                std::cerr << "错误: --http-compress-level 必须是 0-9 的整数" << std::endl;
+                return 1;
+            }
+        } else if (key == "--glb-lod") {
+            if (i + 1 >= argc) {
+                std::cerr << "错误: --glb-lod 参数缺少数值" << std::endl;
+                return 1;
+            }
+            glb_lod_budgets.clear();
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                long long budget = -1;
+                try {
+                    budget = std::stoll(item);
+                } catch (const std::exception &) {
+                }
+                if (budget < 0) {
+                    std::cerr << "错误: --glb-lod 必须是逗号分隔的非负整数" << std::endl;
+                    return 1;
+                }
+                if (budget > 0) glb_lod_budgets.push_back(static_cast<size_t>(budget));
+            }
+            std::sort(glb_lod_budgets.rbegin(), glb_lod_budgets.rend());
+        } else if (key == "--glb-float") {
+            glb_float = true;
+        } else if (key == "--glb-labels") {
+            if (i + 1 >= argc) {
+                std::cerr << "错误: --glb-labels 参数缺少颜色表" << std::endl;
+                return 1;
+            }
+            glb_labels.clear();
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                // 值:名称:RRGGBB[AA]
+                const size_t p1 = item.find(':');
+                const size_t p2 = p1 == std::string::npos ? std::string::npos : item.find(':', p1 + 1);
+                npz_to_glb::LabelClass cls;
+                bool ok = p2 != std::string::npos && p2 > p1 + 1;
+                if (ok) {
+                    try {
+                        cls.value = std::stoi(item.substr(0, p1));
+                    } catch (const std::exception &) {
+                        ok = false;
+                    }
+                    cls.name = item.substr(p1 + 1, p2 - p1 - 1);
+                    const std::string hex = item.substr(p2 + 1);
+                    ok = ok && cls.value >= 1 && cls.value <= 255 && (hex.size() == 6 || hex.size() == 8) &&
+                         hex.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos;
+                    for (size_t c = 0; ok && c * 2 < hex.size(); ++c) {
+                        cls.color[c] = static_cast<float>(std::stoi(hex.substr(c * 2, 2), nullptr, 16)) / 255.0f;
+                    }
+                }
+                if (!ok) {
+                    std::cerr << "错误: --glb-labels 格式为 值:名称:RRGGBB[AA]，多个类别以逗号分隔，值为 1-255" << std::endl;
+                    return 1;
+                }
+                glb_labels.push_back(cls);
+            }
+            if (glb_labels.empty() || glb_labels.size() > 255) {
+                std::cerr << "错误: --glb-labels 需要 1-255 个类别" << std::endl;
+                return 1;
+            }
+        } else if (key == "--glb-mesher") {
+            if (i + 1 >= argc) {
+                std::cerr << "错误: --glb-mesher 参数缺少取值" << std::endl;
+                return 1;
+            }
+            const std::string mesher = argv[++i];
+            if (mesher == "mc") {
+                glb_mesher = npz_to_glb::MeshMode::MarchingCubes;
+            } else if (mesher == "surface-nets") {
+                glb_mesher = npz_to_glb::MeshMode::SurfaceNets;
+            } else {
+                std::cerr << "错误: --glb-mesher 仅支持 mc 或 surface-nets" << std::endl;
+                return 1;
+            }
+        } else if (key == "--lazy-png") {
+            lazy_png = true;
         } else if (key == "--help" || key == "-h") {
-            std::cout << "用法: ./main [--onnx <model.onnx>] [--model_type <no_prompt|pts|box|box+pts|sota>] [--infer-threads <N>] [--apiport <1-65535>] [--nolog] [--crowdebug]" << std::endl;
+            std::cout << "用法: ./main [--onnx <model.onnx>] [--model_type <no_prompt|pts|box|box+pts|sota>] [--infer-threads <N>] [--apiport <1-65535>] [--png-level <0-9>] [--png-strategy <default|filtered|huffman|rle|fixed>] [--lazy-png] [--file-cache-mb <N>] [--zip-cache-mb <N>] [--http-compress-level <0-9>] [--glb-lod <N[,N...]>] [--glb-float] [--glb-labels <值:名称:RRGGBB[,...]>] [--glb-mesher <mc|surface-nets>] [--nolog] [--crowdebug]" << std::endl;
             return 0;
         }
     }
@@ -108,6 +267,33 @@ int main(int argc, char **argv)
     RuntimeLogger::info(std::string("推理线程数: ") + std::to_string(infer_threads));
     RuntimeLogger::info("推理模型类型: " + model_type);
     RuntimeLogger::info(std::string("API监听端口: ") + std::to_string(api_port));
+    slice_render::png_options().compression = png_level;
+    slice_render::parse_png_strategy(png_strategy, slice_render::png_options().strategy);
+    slice_render::png_options().lazy = lazy_png;
+    RuntimeLogger::info("PNG压缩参数: level=" + std::to_string(png_level) + ", strategy=" + png_strategy);
+    RuntimeLogger::info(std::string("PNG按需渲染: ") + (lazy_png ? "开启" : "关闭"));
+    hot_file_cache_capacity_bytes() = static_cast<size_t>(file_cache_mb) << 20;
+    RuntimeLogger::info("热点文件缓存容量: " + std::to_string(file_cache_mb) + "MB");
+    zip_archive_cache_capacity_bytes() = static_cast<size_t>(zip_cache_mb) << 20;
+    RuntimeLogger::info("打包缓存容量: " + std::to_string(zip_cache_mb) + "MB");
+    response_compression_options().level = http_compress_level;
+    RuntimeLogger::info("文本响应压缩级别: " + std::to_string(http_compress_level) + (http_compress_level ? "" : "（已关闭）"));
+    glb_lod_triangle_budgets() = glb_lod_budgets;
+    glb_encoding().quantize = !glb_float;
+    RuntimeLogger::info(std::string("3D 模型顶点编码: ") + (glb_float ? "float32" : "KHR_mesh_quantization"));
+    glb_label_classes() = glb_labels;
+    glb_mesh_mode() = glb_mesher;
+    RuntimeLogger::info(std::string("3D 模型等值面提取: ") + (glb_mesher == npz_to_glb::MeshMode::SurfaceNets ? "Surface Nets" : "Marching Cubes"));
+    {
+        std::string text;
+        for (const auto &cls : glb_labels) text += (text.empty() ? "" : ",") + std::to_string(cls.value) + ":" + cls.name;
+        RuntimeLogger::info("3D 模型标注颜色表: " + text);
+    }
+    {
+        std::string text;
+        for (size_t budget : glb_lod_budgets) text += (text.empty() ? "" : ",") + std::to_string(budget);
+        RuntimeLogger::info("3D 模型 LOD 三角形预算: " + (text.empty() ? std::string("（已关闭）") : text));
+    }
     RuntimeLogger::info(std::string("日志文件保存: ") + (no_log_file ? "关闭" : "开启"));
     RuntimeLogger::info(std::string("Crow日志级别: ") + (crow_debug ? "DEBUG(全量)" : "WARNING及以上"));
     {
@@ -134,7 +320,7 @@ int main(int argc, char **argv)
         RuntimeLogger::warn("未指定 ONNX 文件，推理接口将不可用");
     }
     crow::logger::setLogLevel(crow_debug ? crow::LogLevel::Debug : crow::LogLevel::Warning);
-    crow::App<RequestLogMiddleware> app;
+    crow::App<RequestLogMiddleware, ResponseCompressionMiddleware> app;
     app.loglevel(crow_debug ? crow::LogLevel::Debug : crow::LogLevel::Warning);
 
     // 初始化数据库（若缺失则创建 db/info.json）
@@ -160,6 +346,33 @@ int main(int argc, char **argv)
         return crow::response{res};
     });
 
+    CROW_ROUTE(app, "/api/cache/stats")([](){
+        auto &files = hot_file_cache();
+        auto &renders = lazy_png_memory_cache();
+        crow::json::wvalue res;
+        res["file"]["hits"] = files.hits();
+        res["file"]["misses"] = files.misses();
+        res["file"]["evicted_bytes"] = files.evicted_bytes();
+        res["file"]["used_bytes"] = static_cast<uint64_t>(files.used_bytes());
+        res["file"]["capacity_bytes"] = static_cast<uint64_t>(files.capacity_bytes());
+        res["render"]["hits"] = renders.hits();
+        res["render"]["misses"] = renders.misses();
+        res["render"]["evicted_bytes"] = renders.evicted_bytes();
+        res["render"]["used_bytes"] = static_cast<uint64_t>(renders.used_bytes());
+        res["render"]["capacity_bytes"] = static_cast<uint64_t>(renders.capacity_bytes());
+        if (zip_archive_cache_capacity_bytes() > 0) {
+            auto &archives = zip_archive_cache();
+            res["archive"]["hits"] = archives.hits();
+            res["archive"]["misses"] = archives.misses();
+            res["archive"]["evicted_bytes"] = archives.evicted_bytes();
+            res["archive"]["used_bytes"] = archives.used_bytes();
+            res["archive"]["capacity_bytes"] = archives.capacity_bytes();
+        }
+        crow::response r{res};
+        r.set_header("Access-Control-Allow-Origin", "*");
+        return r;
+    });
+
     RuntimeLogger::info(std::string("服务启动监听端口: ") + std::to_string(api_port));
     app.port(static_cast<uint16_t>(api_port)).multithreaded().run();
     return 0;